@@ -0,0 +1,378 @@
+/**
+* ItemColorBatch.cpp
+*
+* Block classification with SSE2 and AVX2, and the plain loop they fall back to.
+*
+*/
+
+#include "ItemColorBatch.h"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ITEMCOLOR_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define ITEMCOLOR_X86 0
+#endif
+
+// GCC and Clang only allow intrinsics in functions built for the instruction set, MSVC allows them anywhere
+#if ITEMCOLOR_X86 && (defined(__GNUC__) || defined(__clang__))
+#define ITEMCOLOR_TARGET(isa) __attribute__((target(isa)))
+#else
+#define ITEMCOLOR_TARGET(isa)
+#endif
+
+namespace
+{
+    constexpr size_t PlaneCount = static_cast<size_t>(ItemColorFlagPlane::Count);
+    constexpr size_t DefinitionPlanes = static_cast<size_t>(ItemColorFlagPlane::NoDropFlag);
+    constexpr size_t RankCount = std::size(ItemColorPriority);
+
+    // Attribute bit each plane adds to a slot's mask when set, 0 if the settings ignore the flag
+    using PlaneBits = std::array<uint16_t, PlaneCount>;
+
+    PlaneBits GetPlaneBits(const ItemColorClassifierSettings& settings)
+    {
+        auto bit = [](ItemColorAttribute itemAttribute) { return static_cast<uint16_t>(GetItemColorAttributeBit(itemAttribute)); };
+
+        // On FV server, color Normal No Trade only if FVNormalNoTrade setting is enabled
+        // On FV server, color those that are FV No Trade using Normal No Trade settings
+        bool normalNoTrade = !settings.FVServer || settings.FVNormalNoTrade;
+
+        PlaneBits bits{};
+        bits[static_cast<size_t>(ItemColorFlagPlane::AugSlot8)] = bit(ItemColorAttribute::HasAugSlot8_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::PowerSource)] = bit(ItemColorAttribute::PowerSource_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::Quest)] = bit(ItemColorAttribute::Quest_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::TradeSkills)] = bit(ItemColorAttribute::TradeSkills_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::Collectible)] = bit(ItemColorAttribute::Collectible_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::Heirloom)] = bit(ItemColorAttribute::Heirloom_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::NoTrade)] = normalNoTrade ? bit(ItemColorAttribute::NoTrade_Item) : 0;
+        bits[static_cast<size_t>(ItemColorFlagPlane::FVNoTrade)] = settings.FVServer ? bit(ItemColorAttribute::NoTrade_Item) : 0;
+        bits[static_cast<size_t>(ItemColorFlagPlane::Attuneable)] = bit(ItemColorAttribute::Attuneable_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::Placeable)] = bit(ItemColorAttribute::Placeable_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::Ornamentation)] = bit(ItemColorAttribute::Ornamentation_Item);
+        bits[static_cast<size_t>(ItemColorFlagPlane::NoDropFlag)] = normalNoTrade ? bit(ItemColorAttribute::NoTrade_Item) : 0;
+        return bits;
+    }
+
+    void ClassifyBlockScalar(const ItemColorFlagBlock& block, const PlaneBits& bits, uint32_t enabledMask, ItemColorBlockResult& result)
+    {
+        for (size_t slot = 0; slot < ItemColorFlagBlock::Size; ++slot)
+        {
+            // A set flag (1) becomes all ones, so no branch per flag
+            uint16_t definitionMask = 0;
+            for (size_t plane = 0; plane < DefinitionPlanes; ++plane)
+            {
+                definitionMask |= bits[plane] & static_cast<uint16_t>(-block.Planes[plane][slot]);
+            }
+
+            uint16_t attributeMask = definitionMask | (bits[DefinitionPlanes] & static_cast<uint16_t>(-block.Planes[DefinitionPlanes][slot]));
+
+            result.DefinitionMask[slot] = definitionMask;
+            result.AttributeMask[slot] = attributeMask;
+            result.DefinitionAttribute[slot] = static_cast<int16_t>(ResolveItemColorAttribute(definitionMask, enabledMask));
+            result.Attribute[slot] = static_cast<int16_t>(ResolveItemColorAttribute(attributeMask, enabledMask));
+        }
+    }
+
+#if ITEMCOLOR_X86
+    // Highest priority attribute turned on in each 16 bit lane, -1 (Default) if none
+    // Walks the ranks from lowest priority up so the last one set wins
+    ITEMCOLOR_TARGET("sse2") __m128i ResolveSSE2(__m128i attributeMask, __m128i enabledMask)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i active = _mm_and_si128(attributeMask, enabledMask);
+        __m128i winner = _mm_set1_epi16(static_cast<int16_t>(ItemColorAttribute::Default));
+
+        for (size_t rank = RankCount; rank-- > 0;)
+        {
+            __m128i missing = _mm_cmpeq_epi16(_mm_and_si128(active, _mm_set1_epi16(static_cast<int16_t>(1U << rank))), zero);
+            __m128i attribute = _mm_set1_epi16(static_cast<int16_t>(ItemColorPriority[rank]));
+            winner = _mm_or_si128(_mm_and_si128(missing, winner), _mm_andnot_si128(missing, attribute));
+        }
+
+        return winner;
+    }
+
+    // 16 slots per step, their flag bytes are widened to 16 bit lanes 8 at a time
+    ITEMCOLOR_TARGET("sse2") void ClassifyBlockSSE2(const ItemColorFlagBlock& block, const PlaneBits& bits, uint32_t enabledMask, ItemColorBlockResult& result)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i enabled = _mm_set1_epi16(static_cast<int16_t>(enabledMask));
+
+        for (size_t base = 0; base < ItemColorFlagBlock::Size; base += 16)
+        {
+            __m128i masks[2][2] = { { zero, zero }, { zero, zero } };
+
+            for (size_t plane = 0; plane < PlaneCount; ++plane)
+            {
+                __m128i clear = _mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(&block.Planes[plane][base])), zero);
+                __m128i bit = _mm_set1_epi16(static_cast<int16_t>(bits[plane]));
+                size_t target = (plane < DefinitionPlanes) ? 0 : 1;
+
+                masks[target][0] = _mm_or_si128(masks[target][0], _mm_andnot_si128(_mm_unpacklo_epi8(clear, clear), bit));
+                masks[target][1] = _mm_or_si128(masks[target][1], _mm_andnot_si128(_mm_unpackhi_epi8(clear, clear), bit));
+            }
+
+            for (size_t half = 0; half < 2; ++half)
+            {
+                size_t slot = base + half * 8;
+                __m128i definitionMask = masks[0][half];
+                __m128i attributeMask = _mm_or_si128(definitionMask, masks[1][half]);
+
+                _mm_store_si128(reinterpret_cast<__m128i*>(&result.DefinitionMask[slot]), definitionMask);
+                _mm_store_si128(reinterpret_cast<__m128i*>(&result.AttributeMask[slot]), attributeMask);
+                _mm_store_si128(reinterpret_cast<__m128i*>(&result.DefinitionAttribute[slot]), ResolveSSE2(definitionMask, enabled));
+                _mm_store_si128(reinterpret_cast<__m128i*>(&result.Attribute[slot]), ResolveSSE2(attributeMask, enabled));
+            }
+        }
+    }
+
+    ITEMCOLOR_TARGET("avx2") __m256i ResolveAVX2(__m256i attributeMask, __m256i enabledMask)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i active = _mm256_and_si256(attributeMask, enabledMask);
+        __m256i winner = _mm256_set1_epi16(static_cast<int16_t>(ItemColorAttribute::Default));
+
+        for (size_t rank = RankCount; rank-- > 0;)
+        {
+            __m256i hit = _mm256_cmpgt_epi16(_mm256_and_si256(active, _mm256_set1_epi16(static_cast<int16_t>(1U << rank))), zero);
+            winner = _mm256_blendv_epi8(winner, _mm256_set1_epi16(static_cast<int16_t>(ItemColorPriority[rank])), hit);
+        }
+
+        return winner;
+    }
+
+    // 16 slots per step, their flag bytes are widened to 16 bit lanes in one go
+    ITEMCOLOR_TARGET("avx2") void ClassifyBlockAVX2(const ItemColorFlagBlock& block, const PlaneBits& bits, uint32_t enabledMask, ItemColorBlockResult& result)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i enabled = _mm256_set1_epi16(static_cast<int16_t>(enabledMask));
+
+        for (size_t slot = 0; slot < ItemColorFlagBlock::Size; slot += 16)
+        {
+            __m256i masks[2] = { zero, zero };
+
+            for (size_t plane = 0; plane < PlaneCount; ++plane)
+            {
+                __m256i flags = _mm256_cvtepu8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(&block.Planes[plane][slot])));
+                __m256i clear = _mm256_cmpeq_epi16(flags, zero);
+                size_t target = (plane < DefinitionPlanes) ? 0 : 1;
+
+                masks[target] = _mm256_or_si256(masks[target], _mm256_andnot_si256(clear, _mm256_set1_epi16(static_cast<int16_t>(bits[plane]))));
+            }
+
+            __m256i definitionMask = masks[0];
+            __m256i attributeMask = _mm256_or_si256(definitionMask, masks[1]);
+
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&result.DefinitionMask[slot]), definitionMask);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&result.AttributeMask[slot]), attributeMask);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&result.DefinitionAttribute[slot]), ResolveAVX2(definitionMask, enabled));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&result.Attribute[slot]), ResolveAVX2(attributeMask, enabled));
+        }
+    }
+#endif
+
+    ItemColorSimdLevel DetectSimdLevel()
+    {
+#if ITEMCOLOR_X86
+        bool sse2 = false;
+        bool avx2 = false;
+#if defined(_MSC_VER)
+        int registers[4] = {};
+        __cpuid(registers, 0);
+        int maxLeaf = registers[0];
+
+        __cpuid(registers, 1);
+        sse2 = (registers[3] & (1 << 26)) != 0;
+        bool osSavesAVX = (registers[2] & (1 << 27)) != 0 && (registers[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+
+        if (maxLeaf >= 7 && osSavesAVX)
+        {
+            __cpuidex(registers, 7, 0);
+            avx2 = (registers[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        sse2 = __builtin_cpu_supports("sse2");
+        avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if (avx2)
+        {
+            return ItemColorSimdLevel::AVX2;
+        }
+
+        if (sse2)
+        {
+            return ItemColorSimdLevel::SSE2;
+        }
+#endif
+        return ItemColorSimdLevel::Scalar;
+    }
+}
+
+
+ItemColorSimdLevel GetItemColorSimdLevel()
+{
+    static const ItemColorSimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+
+std::string_view GetItemColorSimdLevelName(ItemColorSimdLevel level)
+{
+    switch (level)
+    {
+    case ItemColorSimdLevel::SSE2:
+        return "SSE2";
+
+    case ItemColorSimdLevel::AVX2:
+        return "AVX2";
+
+    default:
+        return "Scalar";
+    }
+}
+
+
+bool ItemColorFlagBlock::Add(const ItemColorDefinitionInfo& itemInfo, bool noDropFlag)
+{
+    if (Count >= Size)
+    {
+        return false;
+    }
+
+    auto set = [this](ItemColorFlagPlane plane, bool value) { Planes[static_cast<size_t>(plane)][Count] = value ? 1 : 0; };
+
+    set(ItemColorFlagPlane::AugSlot8, HasType8AugSlot(itemInfo));
+    set(ItemColorFlagPlane::PowerSource, itemInfo.PowerSource);
+    set(ItemColorFlagPlane::Quest, itemInfo.QuestItem);
+    set(ItemColorFlagPlane::TradeSkills, itemInfo.TradeSkills);
+    set(ItemColorFlagPlane::Collectible, itemInfo.Collectible);
+    set(ItemColorFlagPlane::Heirloom, itemInfo.Heirloom);
+    set(ItemColorFlagPlane::NoTrade, !itemInfo.IsDroppable);
+    set(ItemColorFlagPlane::FVNoTrade, itemInfo.FVNoDrop);
+    set(ItemColorFlagPlane::Attuneable, itemInfo.Attuneable);
+    set(ItemColorFlagPlane::Placeable, itemInfo.Placeable);
+    set(ItemColorFlagPlane::Ornamentation, IsOrnamentation(itemInfo));
+    set(ItemColorFlagPlane::NoDropFlag, noDropFlag);
+
+    ++Count;
+    return true;
+}
+
+
+void ItemColorFlagBlock::Clear()
+{
+    for (auto& plane : Planes)
+    {
+        std::fill(std::begin(plane), std::end(plane), uint8_t(0));
+    }
+    Count = 0;
+}
+
+
+/**
+* @fn ClassifyItemColorBlock
+*
+* @param block const ItemColorFlagBlock& - Flags of the slots to classify
+* @param settings const ItemColorClassifierSettings& - Server flags and attributes turned on
+* @param result ItemColorBlockResult& - Receives the masks and attributes of every slot in the block
+* @param level ItemColorSimdLevel - Instruction set to use, lowered to what the CPU supports
+*/
+void ClassifyItemColorBlock(const ItemColorFlagBlock& block, const ItemColorClassifierSettings& settings,
+    ItemColorBlockResult& result, ItemColorSimdLevel level)
+{
+    PlaneBits bits = GetPlaneBits(settings);
+    level = std::min(level, GetItemColorSimdLevel());
+
+    switch (level)
+    {
+#if ITEMCOLOR_X86
+    case ItemColorSimdLevel::AVX2:
+        ClassifyBlockAVX2(block, bits, settings.EnabledAttributeMask, result);
+        break;
+
+    case ItemColorSimdLevel::SSE2:
+        ClassifyBlockSSE2(block, bits, settings.EnabledAttributeMask, result);
+        break;
+#endif
+
+    default:
+        ClassifyBlockScalar(block, bits, settings.EnabledAttributeMask, result);
+        break;
+    }
+}
+
+
+/**
+* @fn BenchmarkItemColorBlocks
+*
+* @param items const std::vector<ItemColorDefinitionInfo>& - Definitions to classify
+* @param noDropFlags const std::vector<bool>& - NoDropFlag of each item, missing ones are false
+* @param settings const ItemColorClassifierSettings& - Settings to classify with
+* @param passes int - Runs per level, the fastest is kept
+* @return std::vector<ItemColorBlockBenchmarkResult> - Scalar first, then each level the CPU supports
+*/
+std::vector<ItemColorBlockBenchmarkResult> BenchmarkItemColorBlocks(const std::vector<ItemColorDefinitionInfo>& items,
+    const std::vector<bool>& noDropFlags, const ItemColorClassifierSettings& settings, int passes)
+{
+    std::vector<ItemColorBlockBenchmarkResult> results;
+    if (items.empty())
+    {
+        return results;
+    }
+    passes = std::max(passes, 1);
+
+    std::vector<ItemColorFlagBlock> blocks((items.size() + ItemColorFlagBlock::Size - 1) / ItemColorFlagBlock::Size);
+    for (size_t item = 0; item < items.size(); ++item)
+    {
+        blocks[item / ItemColorFlagBlock::Size].Add(items[item], item < noDropFlags.size() && noDropFlags[item]);
+    }
+
+    std::vector<ItemColorBlockResult> blockResults(blocks.size());
+    for (int level = 0; level <= static_cast<int>(GetItemColorSimdLevel()); ++level)
+    {
+        ItemColorBlockBenchmarkResult result;
+        result.Level = static_cast<ItemColorSimdLevel>(level);
+
+        double best = 0;
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (size_t block = 0; block < blocks.size(); ++block)
+            {
+                ClassifyItemColorBlock(blocks[block], settings, blockResults[block], result.Level);
+            }
+            double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            best = (pass == 0) ? elapsed : std::min(best, elapsed);
+        }
+        result.Nanoseconds = best / static_cast<double>(items.size());
+
+        // Every level is checked against the one item at a time chain the rest of the plugin uses
+        for (size_t item = 0; item < items.size(); ++item)
+        {
+            const ItemColorBlockResult& blockResult = blockResults[item / ItemColorFlagBlock::Size];
+            size_t slot = item % ItemColorFlagBlock::Size;
+
+            uint32_t definitionMask = GetItemDefinitionMask(items[item], settings);
+            uint32_t attributeMask = definitionMask | GetItemInstanceMask(item < noDropFlags.size() && noDropFlags[item], settings);
+
+            if (blockResult.DefinitionMask[slot] != definitionMask || blockResult.AttributeMask[slot] != attributeMask ||
+                blockResult.DefinitionAttribute[slot] != static_cast<int16_t>(ResolveItemColorAttribute(definitionMask, settings.EnabledAttributeMask)) ||
+                blockResult.Attribute[slot] != static_cast<int16_t>(ResolveItemColorAttribute(attributeMask, settings.EnabledAttributeMask)))
+            {
+                ++result.Mismatches;
+            }
+        }
+
+        results.push_back(result);
+    }
+
+    return results;
+}
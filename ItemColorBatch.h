@@ -0,0 +1,95 @@
+/**
+* ItemColorBatch.h
+*
+* Classifies a block of slots at once. The flags the attribute chain reads are stored as
+* structure of arrays, one byte per slot per flag, so the attribute masks and winning attributes
+* of a whole block come out of a handful of SSE2 or AVX2 instructions.
+* The instruction set is picked at runtime, with a plain loop for CPUs (or builds) without either.
+*
+*/
+
+#pragma once
+
+#include "ItemColorCore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Instruction sets ClassifyItemColorBlock can use, in order of preference
+enum class ItemColorSimdLevel
+{
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// Best level this CPU and OS support, detected on first use
+ItemColorSimdLevel GetItemColorSimdLevel();
+
+std::string_view GetItemColorSimdLevelName(ItemColorSimdLevel level);
+
+// Flags of an item definition and item the attribute chain reads, one plane per flag
+// Every plane but NoDropFlag comes from the definition, see GetItemDefinitionMask
+enum class ItemColorFlagPlane : uint8_t
+{
+    AugSlot8,
+    PowerSource,
+    Quest,
+    TradeSkills,
+    Collectible,
+    Heirloom,
+    // Not droppable, and FV No Trade on the FV server
+    NoTrade,
+    FVNoTrade,
+    Attuneable,
+    Placeable,
+    Ornamentation,
+    // The item's own NoDropFlag, see GetItemInstanceMask
+    NoDropFlag,
+    Count
+};
+
+// A block of slots as structure of arrays, each plane holds 0 or 1 per slot
+struct ItemColorFlagBlock
+{
+    static constexpr size_t Size = 32;
+
+    alignas(32) uint8_t Planes[static_cast<size_t>(ItemColorFlagPlane::Count)][Size] = {};
+    // Slots filled, the rest of the block is zero and classifies as Default
+    size_t Count = 0;
+
+    // Fills the next slot, returns false if the block is full
+    bool Add(const ItemColorDefinitionInfo& itemInfo, bool noDropFlag);
+
+    void Clear();
+};
+
+// Classification of every slot in a block, the same as GetItemDefinitionMask, GetItemInstanceMask
+// and ResolveItemColorAttribute give for each slot on its own
+struct ItemColorBlockResult
+{
+    alignas(32) uint16_t DefinitionMask[ItemColorFlagBlock::Size] = {};
+    alignas(32) uint16_t AttributeMask[ItemColorFlagBlock::Size] = {};
+    // ItemColorAttribute values
+    alignas(32) int16_t DefinitionAttribute[ItemColorFlagBlock::Size] = {};
+    alignas(32) int16_t Attribute[ItemColorFlagBlock::Size] = {};
+};
+
+// Classifies every slot of a block, a level the CPU does not support falls back to the best one it does
+void ClassifyItemColorBlock(const ItemColorFlagBlock& block, const ItemColorClassifierSettings& settings,
+    ItemColorBlockResult& result, ItemColorSimdLevel level = GetItemColorSimdLevel());
+
+// Cost per slot of each level this CPU supports, blocks are filled before timing starts
+struct ItemColorBlockBenchmarkResult
+{
+    ItemColorSimdLevel Level = ItemColorSimdLevel::Scalar;
+    double Nanoseconds = 0;
+    // Slots classified differently from GetItemDefinitionMask and friends one slot at a time, should be 0
+    int Mismatches = 0;
+};
+
+// Classifies items passes times at each level, the fastest pass is kept
+std::vector<ItemColorBlockBenchmarkResult> BenchmarkItemColorBlocks(const std::vector<ItemColorDefinitionInfo>& items,
+    const std::vector<bool>& noDropFlags, const ItemColorClassifierSettings& settings, int passes);
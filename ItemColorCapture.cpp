@@ -0,0 +1,539 @@
+/**
+* ItemColorCapture.cpp
+*
+* Writing, mapping and replaying inventory captures.
+*
+*/
+
+#include "ItemColorCapture.h"
+#include "ItemColorScanner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Sets flag in flags if value is true
+    constexpr uint32_t FlagIf(bool value, uint32_t flag)
+    {
+        return value ? flag : 0;
+    }
+
+    template <typename T>
+    void AppendBytes(std::vector<uint8_t>& data, const T& value)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+    // Two textures a replayed window can show, only their addresses matter
+    const char DefaultTexture = 0;
+    const char GlowTexture = 0;
+
+    // Stands in for a slot window while replaying, holds what the scanner writes
+    struct ReplayWindow
+    {
+        uint32_t BGTintNormal = 0;
+        uint32_t BGTintRollover = 0;
+        const void* pBackground = &DefaultTexture;
+    };
+
+    // Item in a captured slot
+    struct ReplayItem
+    {
+        const ItemColorCaptureSlot* pSlot = nullptr;
+
+        int GetDefinitionID() const { return pSlot->GetDefinitionID(); }
+        bool GetNoDropFlag() const { return pSlot->GetNoDropFlag(); }
+        ItemColorDefinitionInfo GetDefinitionInfo() const { return pSlot->GetDefinitionInfo(); }
+    };
+
+    // One frame of a capture as ItemColorScanner reads it, a window per slot index kept across frames
+    class ReplaySlotSource : public ItemColorSlotSource
+    {
+    public:
+        using Window = ReplayWindow;
+        using Item = ReplayItem;
+
+        // Fresh windows for slotIndexes slots, as a new session would find them
+        void Reset(size_t slotIndexes)
+        {
+            Windows.assign(slotIndexes, ReplayWindow());
+            FrameSlots.assign(slotIndexes, nullptr);
+        }
+
+        // Slots of the next frame, looked up by slot index
+        void SetFrame(const ItemColorCaptureSlot* pSlots, uint32_t slotCount)
+        {
+            std::fill(FrameSlots.begin(), FrameSlots.end(), nullptr);
+            for (uint32_t slot = 0; slot < slotCount; ++slot)
+            {
+                if (pSlots[slot].SlotIndex < FrameSlots.size())
+                {
+                    FrameSlots[pSlots[slot].SlotIndex] = &pSlots[slot];
+                }
+            }
+        }
+
+        // Slots whose colors changed, what the plugin would repaint
+        uint64_t GetRepainted() const { return Repainted; }
+
+        Window* GetColorableWindow(int index)
+        {
+            const ItemColorCaptureSlot* pSlot = FrameSlots[index];
+            return (pSlot && IsColorableSlot(pSlot->GetSlotInfo())) ? &Windows[index] : nullptr;
+        }
+
+        Item GetItem(int index, Window* /*pWindow*/)
+        {
+            return { FrameSlots[index] };
+        }
+
+        ItemColorSlotIdentity GetIdentity(int /*index*/, Window* pWindow, const Item& item)
+        {
+            ItemColorSlotIdentity identity;
+            identity.LocationKey = item.pSlot->LocationKey;
+            identity.pWindow = pWindow;
+            identity.pItem = reinterpret_cast<const void*>(static_cast<uintptr_t>(item.pSlot->ItemToken));
+            identity.ItemID = item.pSlot->GetDefinitionID();
+            identity.NoDropFlag = item.pSlot->GetNoDropFlag();
+            return identity;
+        }
+
+        void ReadWindow(const Window* pWindow, ItemColorSlotWndShadow& shadow)
+        {
+            shadow.BGTintNormal = pWindow->BGTintNormal;
+            shadow.BGTintRollover = pWindow->BGTintRollover;
+            shadow.pBackground = pWindow->pBackground;
+        }
+
+        void WriteTint(Window* pWindow, uint32_t normalARGB, uint32_t rolloverARGB)
+        {
+            pWindow->BGTintNormal = normalARGB;
+            pWindow->BGTintRollover = rolloverARGB;
+            ++Repainted;
+        }
+
+        const void* GetBackground(const Window* /*pWindow*/, bool glow)
+        {
+            return glow ? &GlowTexture : &DefaultTexture;
+        }
+
+        void WriteBackground(Window* pWindow, const void* pTexture)
+        {
+            pWindow->pBackground = pTexture;
+        }
+
+    private:
+        std::vector<ReplayWindow> Windows;
+        std::vector<const ItemColorCaptureSlot*> FrameSlots;
+        uint64_t Repainted = 0;
+    };
+}
+
+
+/**
+* @fn ItemColorCaptureHeader::GetClassifierSettings
+*
+* @return ItemColorClassifierSettings - Classifier settings the capture was taken with
+*/
+ItemColorClassifierSettings ItemColorCaptureHeader::GetClassifierSettings() const
+{
+    ItemColorClassifierSettings settings;
+    settings.FVServer = (ClassifierFlags & FVServerFlag) != 0;
+    settings.FVNormalNoTrade = (ClassifierFlags & FVNormalNoTradeFlag) != 0;
+    settings.EnabledAttributeMask = EnabledAttributeMask;
+    return settings;
+}
+
+
+/**
+* @fn ItemColorCaptureHeader::SetClassifierSettings
+*
+* @param settings const ItemColorClassifierSettings& - Classifier settings to keep in the capture
+*/
+void ItemColorCaptureHeader::SetClassifierSettings(const ItemColorClassifierSettings& settings)
+{
+    ClassifierFlags = FlagIf(settings.FVServer, FVServerFlag) | FlagIf(settings.FVNormalNoTrade, FVNormalNoTradeFlag);
+    EnabledAttributeMask = settings.EnabledAttributeMask;
+}
+
+
+/**
+* @fn ItemColorCaptureSlot::Make
+*
+* @param slotIndex int - Index of the slot in the slot array
+* @param slotInfo const ItemColorSlotInfo& - Slot fields IsColorableSlot reads
+* @param locationKey uint64_t - Location of the slot, see ItemColorSlotIdentity::LocationKey
+* @param pItem const void* - Item in the slot, only its address is kept, null for an empty slot
+* @param noDropFlag bool - NoDropFlag of the item
+* @param itemInfo const ItemColorDefinitionInfo* - Definition of the item, null for an empty slot
+* @return ItemColorCaptureSlot - The slot as written to a capture
+*/
+ItemColorCaptureSlot ItemColorCaptureSlot::Make(int slotIndex, const ItemColorSlotInfo& slotInfo, uint64_t locationKey,
+    const void* pItem, bool noDropFlag, const ItemColorDefinitionInfo* itemInfo)
+{
+    ItemColorCaptureSlot slot;
+    slot.LocationKey = locationKey;
+    slot.SlotIndex = static_cast<uint32_t>(slotIndex);
+    slot.SlotFlags = FlagIf(slotInfo.Enabled, EnabledFlag) |
+        FlagIf(slotInfo.HasWindow, HasWindowFlag) |
+        FlagIf(slotInfo.HotButton, HotButtonFlag) |
+        FlagIf(slotInfo.ValidLocation, ValidLocationFlag) |
+        FlagIf(slotInfo.Equipped, EquippedFlag) |
+        (static_cast<uint32_t>(slotInfo.Container) << ContainerShift);
+
+    if (!pItem || !itemInfo)
+    {
+        return slot;
+    }
+
+    slot.ItemToken = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pItem));
+    slot.SlotFlags |= FlagIf(noDropFlag, NoDropFlag);
+    slot.ItemID = itemInfo->ItemID;
+    slot.DefinitionFlags = FlagIf(itemInfo->QuestItem, QuestFlag) |
+        FlagIf(itemInfo->TradeSkills, TradeSkillsFlag) |
+        FlagIf(itemInfo->Collectible, CollectibleFlag) |
+        FlagIf(itemInfo->Heirloom, HeirloomFlag) |
+        FlagIf(itemInfo->IsDroppable, DroppableFlag) |
+        FlagIf(itemInfo->FVNoDrop, FVNoDropFlag) |
+        FlagIf(itemInfo->Attuneable, AttuneableFlag) |
+        FlagIf(itemInfo->Placeable, PlaceableFlag) |
+        FlagIf(itemInfo->PowerSource, PowerSourceFlag) |
+        FlagIf(itemInfo->Lore, LoreFlag) |
+        FlagIf(itemInfo->Magic, MagicFlag);
+    slot.AugType = itemInfo->AugType;
+    slot.SocketTypes = itemInfo->SocketTypes;
+    slot.RequiredLevel = itemInfo->RequiredLevel;
+    slot.RecommendedLevel = itemInfo->RecommendedLevel;
+    slot.ItemType = itemInfo->ItemType;
+    slot.ItemClass = itemInfo->ItemClass;
+    slot.Size = itemInfo->Size;
+    slot.Weight = itemInfo->Weight;
+    slot.Cost = itemInfo->Cost;
+    slot.StackSize = itemInfo->StackSize;
+    return slot;
+}
+
+
+/**
+* @fn ItemColorCaptureSlot::GetSlotInfo
+*
+* @return ItemColorSlotInfo - Slot fields for IsColorableSlot
+*/
+ItemColorSlotInfo ItemColorCaptureSlot::GetSlotInfo() const
+{
+    ItemColorSlotInfo slotInfo;
+    slotInfo.Enabled = (SlotFlags & EnabledFlag) != 0;
+    slotInfo.HasWindow = (SlotFlags & HasWindowFlag) != 0;
+    slotInfo.HotButton = (SlotFlags & HotButtonFlag) != 0;
+    slotInfo.ValidLocation = (SlotFlags & ValidLocationFlag) != 0;
+    slotInfo.Equipped = (SlotFlags & EquippedFlag) != 0;
+    slotInfo.Container = static_cast<ItemColorContainer>((SlotFlags >> ContainerShift) & 0x3);
+    return slotInfo;
+}
+
+
+/**
+* @fn ItemColorCaptureSlot::GetDefinitionInfo
+*
+* @return ItemColorDefinitionInfo - Definition of the item in the slot
+*/
+ItemColorDefinitionInfo ItemColorCaptureSlot::GetDefinitionInfo() const
+{
+    ItemColorDefinitionInfo itemInfo;
+    itemInfo.ItemID = ItemID;
+    itemInfo.QuestItem = (DefinitionFlags & QuestFlag) != 0;
+    itemInfo.TradeSkills = (DefinitionFlags & TradeSkillsFlag) != 0;
+    itemInfo.Collectible = (DefinitionFlags & CollectibleFlag) != 0;
+    itemInfo.Heirloom = (DefinitionFlags & HeirloomFlag) != 0;
+    itemInfo.IsDroppable = (DefinitionFlags & DroppableFlag) != 0;
+    itemInfo.FVNoDrop = (DefinitionFlags & FVNoDropFlag) != 0;
+    itemInfo.Attuneable = (DefinitionFlags & AttuneableFlag) != 0;
+    itemInfo.Placeable = (DefinitionFlags & PlaceableFlag) != 0;
+    itemInfo.PowerSource = (DefinitionFlags & PowerSourceFlag) != 0;
+    itemInfo.Lore = (DefinitionFlags & LoreFlag) != 0;
+    itemInfo.Magic = (DefinitionFlags & MagicFlag) != 0;
+    itemInfo.AugType = AugType;
+    itemInfo.SocketTypes = SocketTypes;
+    itemInfo.RequiredLevel = RequiredLevel;
+    itemInfo.RecommendedLevel = RecommendedLevel;
+    itemInfo.ItemType = ItemType;
+    itemInfo.ItemClass = ItemClass;
+    itemInfo.Size = Size;
+    itemInfo.Weight = Weight;
+    itemInfo.Cost = Cost;
+    itemInfo.StackSize = StackSize;
+    return itemInfo;
+}
+
+
+/**
+* @fn ItemColorCaptureWriter::Start
+*
+* Drops any frames taken so far and starts the capture clock
+*
+* @param settings const ItemColorClassifierSettings& - Classifier settings to keep in the capture
+*/
+void ItemColorCaptureWriter::Start(const ItemColorClassifierSettings& settings)
+{
+    Header = ItemColorCaptureHeader();
+    Header.SetClassifierSettings(settings);
+    Data.clear();
+    FrameStart = 0;
+    StartTime = std::chrono::steady_clock::now();
+}
+
+
+void ItemColorCaptureWriter::BeginFrame()
+{
+    ItemColorCaptureFrame frame;
+    frame.Microseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - StartTime).count());
+
+    FrameStart = Data.size();
+    AppendBytes(Data, frame);
+}
+
+
+void ItemColorCaptureWriter::AddSlot(const ItemColorCaptureSlot& slot)
+{
+    AppendBytes(Data, slot);
+}
+
+
+void ItemColorCaptureWriter::EndFrame()
+{
+    ItemColorCaptureFrame frame;
+    memcpy(&frame, Data.data() + FrameStart, sizeof(frame));
+    frame.SlotCount = static_cast<uint32_t>((Data.size() - FrameStart - sizeof(frame)) / sizeof(ItemColorCaptureSlot));
+    memcpy(Data.data() + FrameStart, &frame, sizeof(frame));
+
+    ++Header.FrameCount;
+}
+
+
+/**
+* @fn ItemColorCaptureWriter::Save
+*
+* @param path const std::string& - File to write, replaced if it exists
+* @param error std::string& - Receives the reason if the file could not be written
+* @return bool - True if the capture was written
+*/
+bool ItemColorCaptureWriter::Save(const std::string& path, std::string& error) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        error = "Could not create " + path;
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&Header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(Data.data()), static_cast<std::streamsize>(Data.size()));
+    if (!file)
+    {
+        error = "Could not write " + path;
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+* @fn ItemColorCaptureFile::Open
+*
+* @param path const std::string& - Capture to map
+* @param error std::string& - Receives the reason if the file is not a valid capture
+* @return bool - True if every frame of the capture can be read
+*/
+bool ItemColorCaptureFile::Open(const std::string& path, std::string& error)
+{
+    Close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        error = "Could not open " + path;
+        return false;
+    }
+
+    // The view keeps the mapping and the file open, both handles can go once it is mapped
+    LARGE_INTEGER fileSize = {};
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+            void* pMapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (pMapped)
+            {
+                Bytes = static_cast<const uint8_t*>(pMapped);
+                Length = static_cast<size_t>(fileSize.QuadPart);
+            }
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "Could not open " + path;
+        return false;
+    }
+
+    struct stat fileStat = {};
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        void* pMapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pMapped != MAP_FAILED)
+        {
+            Bytes = static_cast<const uint8_t*>(pMapped);
+            Length = static_cast<size_t>(fileStat.st_size);
+        }
+    }
+    close(fd);
+#endif
+
+    if (!Bytes || Length < sizeof(ItemColorCaptureHeader))
+    {
+        error = path + " is not a capture";
+        Close();
+        return false;
+    }
+
+    const ItemColorCaptureHeader& header = GetHeader();
+    if (memcmp(header.Magic, ItemColorCaptureHeader().Magic, sizeof(header.Magic)) != 0 ||
+        header.Version != ItemColorCaptureHeader::CurrentVersion)
+    {
+        error = path + " is not a capture, or from another version";
+        Close();
+        return false;
+    }
+
+    size_t offset = sizeof(ItemColorCaptureHeader);
+    for (uint32_t frame = 0; frame < header.FrameCount; ++frame)
+    {
+        if (Length - offset < sizeof(ItemColorCaptureFrame))
+        {
+            error = path + " ends in frame " + std::to_string(frame);
+            Close();
+            return false;
+        }
+
+        const ItemColorCaptureFrame* pFrame = reinterpret_cast<const ItemColorCaptureFrame*>(Bytes + offset);
+        offset += sizeof(ItemColorCaptureFrame);
+
+        if ((Length - offset) / sizeof(ItemColorCaptureSlot) < pFrame->SlotCount)
+        {
+            error = path + " ends in frame " + std::to_string(frame);
+            Close();
+            return false;
+        }
+
+        offset += pFrame->SlotCount * sizeof(ItemColorCaptureSlot);
+        Frames.push_back(pFrame);
+    }
+
+    return true;
+}
+
+
+void ItemColorCaptureFile::Close()
+{
+    if (Bytes)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(Bytes);
+#else
+        munmap(const_cast<uint8_t*>(Bytes), Length);
+#endif
+    }
+
+    Bytes = nullptr;
+    Length = 0;
+    Frames.clear();
+}
+
+
+/**
+* @fn ReplayItemColorCapture
+*
+* @param capture const ItemColorCaptureFile& - Capture to replay
+* @param settings const ItemColorSettingsSnapshot& - Settings to classify and pick colors with
+* @param cacheSize size_t - Capacity of the classification cache, 0 to classify every changed slot from scratch
+* @param passes int - Times to replay the whole capture
+* @return ItemColorReplayResult - Time of each pulse and the slot counters
+*/
+ItemColorReplayResult ReplayItemColorCapture(const ItemColorCaptureFile& capture, const ItemColorSettingsSnapshot& settings,
+    size_t cacheSize, int passes)
+{
+    ItemColorReplayResult result;
+    ReplaySlotSource slots;
+    ItemColorStats stats;
+
+    // Slot indexes are the same in every frame, memos and windows cover the largest
+    size_t slotIndexes = 0;
+    for (size_t frame = 0; frame < capture.GetFrameCount(); ++frame)
+    {
+        const ItemColorCaptureSlot* pSlots = capture.GetSlots(frame);
+        for (uint32_t slot = 0; slot < capture.GetFrame(frame).SlotCount; ++slot)
+        {
+            slotIndexes = std::max<size_t>(slotIndexes, static_cast<size_t>(pSlots[slot].SlotIndex) + 1);
+        }
+    }
+
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        ItemColorScanner scanner;
+        scanner.GetCache().SetCapacity(cacheSize);
+        scanner.GetMemos().assign(slotIndexes, ItemColorSlotMemo());
+        slots.Reset(slotIndexes);
+
+        for (size_t frame = 0; frame < capture.GetFrameCount(); ++frame)
+        {
+            const ItemColorCaptureSlot* pSlots = capture.GetSlots(frame);
+            uint32_t slotCount = capture.GetFrame(frame).SlotCount;
+            slots.SetFrame(pSlots, slotCount);
+
+            auto start = std::chrono::steady_clock::now();
+
+            for (uint32_t slot = 0; slot < slotCount; ++slot)
+            {
+                scanner.ColorSlot(slots, static_cast<int>(pSlots[slot].SlotIndex), settings, 1, stats);
+            }
+
+            result.PulseTime.Record(std::chrono::steady_clock::now() - start);
+        }
+
+        result.CacheHits += scanner.GetCache().Hits;
+        result.CacheMisses += scanner.GetCache().Misses;
+    }
+
+    result.SlotsVisited = stats.Current.SlotsVisited;
+    result.SlotsNotColorable = stats.Current.SlotsNotColorable;
+    result.SlotsUnchanged = stats.Current.SlotsUnchanged;
+    result.SlotsReclassified = stats.Current.SlotsReclassified;
+    result.SlotsRepainted = slots.GetRepainted();
+    return result;
+}
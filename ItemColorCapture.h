@@ -0,0 +1,176 @@
+/**
+* ItemColorCapture.h
+*
+* Captures of what a scan reads from the game (slot flags, locations, item definitions and NoDropFlag),
+* one frame per snapshot of the slot array, written to a compact binary file.
+* The replay side maps a capture back in and runs it through the classification and scan logic
+* away from the game, so spikes seen on a real inventory can be timed and compared offline.
+*
+*/
+
+#pragma once
+
+#include "ItemColorCore.h"
+#include "ItemColorSettings.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Start of a capture file, every value is little endian
+struct ItemColorCaptureHeader
+{
+    static constexpr uint32_t CurrentVersion = 1;
+
+    char Magic[8] = { 'I', 'C', 'C', 'A', 'P', 'T', 'R', '\0' };
+    uint32_t Version = CurrentVersion;
+    uint32_t FrameCount = 0;
+    // Classifier settings when the capture was taken, FVServerFlag and FVNormalNoTradeFlag
+    uint32_t ClassifierFlags = 0;
+    uint32_t EnabledAttributeMask = 0;
+    uint64_t Reserved = 0;
+
+    static constexpr uint32_t FVServerFlag = 1U << 0;
+    static constexpr uint32_t FVNormalNoTradeFlag = 1U << 1;
+
+    ItemColorClassifierSettings GetClassifierSettings() const;
+    void SetClassifierSettings(const ItemColorClassifierSettings& settings);
+};
+static_assert(sizeof(ItemColorCaptureHeader) == 32, "Capture header layout is part of the file format");
+
+// Start of each frame, followed by SlotCount ItemColorCaptureSlot
+struct ItemColorCaptureFrame
+{
+    // Time since the capture started
+    uint64_t Microseconds = 0;
+    uint32_t SlotCount = 0;
+    uint32_t Reserved = 0;
+};
+static_assert(sizeof(ItemColorCaptureFrame) == 16, "Capture frame layout is part of the file format");
+
+// One slot of the slot array as a scan sees it
+struct ItemColorCaptureSlot
+{
+    uint64_t LocationKey = 0;
+    // Stands in for the item's address, changes whenever the item in the slot is replaced, 0 for an empty slot
+    uint64_t ItemToken = 0;
+    // Index in the slot array, also stands in for the slot window
+    uint32_t SlotIndex = 0;
+    // EnabledFlag and the other slot flags below, the ItemColorContainer is kept from ContainerShift up
+    uint32_t SlotFlags = 0;
+    // Item definition, only meaningful when ItemToken is not 0
+    int32_t ItemID = 0;
+    // QuestFlag and the other definition flags below
+    uint32_t DefinitionFlags = 0;
+    uint32_t AugType = 0;
+    uint32_t SocketTypes = 0;
+    int32_t RequiredLevel = 0;
+    int32_t RecommendedLevel = 0;
+    int32_t ItemType = 0;
+    int32_t ItemClass = 0;
+    int32_t Size = 0;
+    int32_t Weight = 0;
+    int32_t Cost = 0;
+    int32_t StackSize = 0;
+
+    static constexpr uint32_t EnabledFlag = 1U << 0;
+    static constexpr uint32_t HasWindowFlag = 1U << 1;
+    static constexpr uint32_t HotButtonFlag = 1U << 2;
+    static constexpr uint32_t ValidLocationFlag = 1U << 3;
+    static constexpr uint32_t EquippedFlag = 1U << 4;
+    static constexpr uint32_t NoDropFlag = 1U << 5;
+    static constexpr uint32_t ContainerShift = 8;
+
+    static constexpr uint32_t QuestFlag = 1U << 0;
+    static constexpr uint32_t TradeSkillsFlag = 1U << 1;
+    static constexpr uint32_t CollectibleFlag = 1U << 2;
+    static constexpr uint32_t HeirloomFlag = 1U << 3;
+    static constexpr uint32_t DroppableFlag = 1U << 4;
+    static constexpr uint32_t FVNoDropFlag = 1U << 5;
+    static constexpr uint32_t AttuneableFlag = 1U << 6;
+    static constexpr uint32_t PlaceableFlag = 1U << 7;
+    static constexpr uint32_t PowerSourceFlag = 1U << 8;
+    static constexpr uint32_t LoreFlag = 1U << 9;
+    static constexpr uint32_t MagicFlag = 1U << 10;
+
+    // Fills every field from what the plugin read, itemInfo may be null for an empty slot
+    static ItemColorCaptureSlot Make(int slotIndex, const ItemColorSlotInfo& slotInfo, uint64_t locationKey,
+        const void* pItem, bool noDropFlag, const ItemColorDefinitionInfo* itemInfo);
+
+    ItemColorSlotInfo GetSlotInfo() const;
+    ItemColorDefinitionInfo GetDefinitionInfo() const;
+    bool GetNoDropFlag() const { return (SlotFlags & NoDropFlag) != 0; }
+    // Item definition in the slot, 0 for an empty slot
+    int GetDefinitionID() const { return ItemToken ? ItemID : 0; }
+};
+static_assert(sizeof(ItemColorCaptureSlot) == 72, "Capture slot layout is part of the file format");
+
+// Builds a capture in memory, frames are taken on the game thread and the whole file is written once at the end
+class ItemColorCaptureWriter
+{
+public:
+    void Start(const ItemColorClassifierSettings& settings);
+
+    // Starts a frame, slots added until EndFrame belong to it
+    void BeginFrame();
+    void AddSlot(const ItemColorCaptureSlot& slot);
+    void EndFrame();
+
+    uint32_t GetFrameCount() const { return Header.FrameCount; }
+    size_t GetSize() const { return Data.size(); }
+
+    // Writes the capture, returns false and sets error if the file could not be written
+    bool Save(const std::string& path, std::string& error) const;
+
+private:
+    ItemColorCaptureHeader Header;
+    std::vector<uint8_t> Data;
+    size_t FrameStart = 0;
+    std::chrono::steady_clock::time_point StartTime;
+};
+
+// A capture file mapped into memory, frames are read in place
+class ItemColorCaptureFile
+{
+public:
+    ItemColorCaptureFile() = default;
+    ~ItemColorCaptureFile() { Close(); }
+    ItemColorCaptureFile(const ItemColorCaptureFile&) = delete;
+    ItemColorCaptureFile& operator=(const ItemColorCaptureFile&) = delete;
+
+    // Maps a capture and checks every frame fits, returns false and sets error if it is not a valid capture
+    bool Open(const std::string& path, std::string& error);
+    void Close();
+
+    const ItemColorCaptureHeader& GetHeader() const { return *reinterpret_cast<const ItemColorCaptureHeader*>(Bytes); }
+    size_t GetFrameCount() const { return Frames.size(); }
+    const ItemColorCaptureFrame& GetFrame(size_t frame) const { return *Frames[frame]; }
+    const ItemColorCaptureSlot* GetSlots(size_t frame) const { return reinterpret_cast<const ItemColorCaptureSlot*>(Frames[frame] + 1); }
+
+private:
+    const uint8_t* Bytes = nullptr;
+    size_t Length = 0;
+    std::vector<const ItemColorCaptureFrame*> Frames;
+};
+
+// Timing of a replay, every frame of every pass is one pulse
+struct ItemColorReplayResult
+{
+    ItemColorLatencyHistogram PulseTime;
+    // Slot counters of every pulse added up
+    uint64_t SlotsVisited = 0;
+    uint64_t SlotsNotColorable = 0;
+    uint64_t SlotsUnchanged = 0;
+    uint64_t SlotsReclassified = 0;
+    uint64_t CacheHits = 0;
+    uint64_t CacheMisses = 0;
+    // Slots whose colors changed, what the plugin would repaint
+    uint64_t SlotsRepainted = 0;
+};
+
+// Replays every frame of a capture passes times, each pass starts with an empty classification cache and no slot memos
+// Each frame is colored with ItemColorScanner the way a full sweep colors the slot array, the windows are stand ins
+ItemColorReplayResult ReplayItemColorCapture(const ItemColorCaptureFile& capture, const ItemColorSettingsSnapshot& settings,
+    size_t cacheSize, int passes);
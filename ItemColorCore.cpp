@@ -0,0 +1,606 @@
+/**
+* ItemColorCore.cpp
+*
+* Classification and scan logic for MQItemColor that does not depend on MacroQuest or the game.
+*
+*/
+
+#include "ItemColorCore.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdio>
+
+/**
+* @fn HasType8AugSlot
+*
+* @param itemInfo const ItemColorDefinitionInfo& - Definition of the item to check
+* @return bool - True if the item has a type 8 aug slot (raid item)
+*/
+bool HasType8AugSlot(const ItemColorDefinitionInfo& itemInfo)
+{
+    return (itemInfo.SocketTypes & GetItemColorSocketBit(8)) != 0;
+}
+
+
+/**
+* @fn IsNoTrade
+*
+* On FV server, Normal No Trade only counts if the FVNormalNoTrade setting is enabled,
+* and FV No Trade counts as Normal No Trade
+*
+* @param itemInfo const ItemColorDefinitionInfo& - Definition of the item to check
+* @param settings const ItemColorClassifierSettings& - Server flags the No Trade rules depend on
+* @return bool - True if the item definition is No Trade
+*/
+bool IsNoTrade(const ItemColorDefinitionInfo& itemInfo, const ItemColorClassifierSettings& settings)
+{
+    return (!itemInfo.IsDroppable && (!settings.FVServer || settings.FVNormalNoTrade)) ||
+        (settings.FVServer && itemInfo.FVNoDrop);
+}
+
+
+/**
+* @fn IsOrnamentation
+*
+* @param itemInfo const ItemColorDefinitionInfo& - Definition of the item to check
+* @return bool - True if the item fits a type 20 or 21 aug slot (Ornamentations)
+*/
+bool IsOrnamentation(const ItemColorDefinitionInfo& itemInfo)
+{
+    return (itemInfo.AugType & ItemColorOrnamentationAugTypes) != 0;
+}
+
+
+/**
+* @fn GetItemDefinitionMask
+*
+* Classifies an item definition into a mask of every attribute it has, see GetItemColorAttributeBit.
+* Does not look at which attributes are turned on, or per item state, see GetItemInstanceMask.
+*
+* @param itemInfo const ItemColorDefinitionInfo& - Definition of the item
+* @param settings const ItemColorClassifierSettings& - Server flags the No Trade rules depend on
+* @return uint32_t - Mask of attribute bits
+*/
+uint32_t GetItemDefinitionMask(const ItemColorDefinitionInfo& itemInfo, const ItemColorClassifierSettings& settings)
+{
+    uint32_t attributeMask = 0;
+
+    // One test per line of ITEMCOLOR_ATTRIBUTES
+#define ITEMCOLOR_ATTRIBUTE_PREDICATE(Enum, Name, Priority, DefaultOn, DefaultNormal, DefaultRollover, Predicate) \
+    if (Predicate) \
+    { \
+        attributeMask |= GetItemColorAttributeBit(ItemColorAttribute::Enum); \
+    }
+    ITEMCOLOR_ATTRIBUTES(ITEMCOLOR_ATTRIBUTE_PREDICATE)
+#undef ITEMCOLOR_ATTRIBUTE_PREDICATE
+
+    return attributeMask;
+}
+
+
+/**
+* @fn GetItemInstanceMask
+*
+* Attribute bits that come from the item itself rather than its definition (No Trade from NoDropFlag)
+*
+* @param noDropFlag bool - NoDropFlag of the item
+* @param settings const ItemColorClassifierSettings& - Server flags the No Trade rules depend on
+* @return uint32_t - Mask of attribute bits
+*/
+uint32_t GetItemInstanceMask(bool noDropFlag, const ItemColorClassifierSettings& settings)
+{
+    // On FV server, color Normal No Trade only if FVNormalNoTrade setting is enabled
+    if (noDropFlag && (!settings.FVServer || settings.FVNormalNoTrade))
+    {
+        return GetItemColorAttributeBit(ItemColorAttribute::NoTrade_Item);
+    }
+
+    return 0;
+}
+
+
+/**
+* @fn ResolveItemColorAttribute
+*
+* Picks the highest priority attribute from a mask that is turned on
+*
+* @param attributeMask uint32_t - Mask from GetItemDefinitionMask and GetItemInstanceMask
+* @param enabledAttributeMask uint32_t - Mask of attributes that are turned on
+* @return ItemColorAttribute - Attribute to color with, Default if none are turned on
+*/
+ItemColorAttribute ResolveItemColorAttribute(uint32_t attributeMask, uint32_t enabledAttributeMask)
+{
+    uint32_t activeMask = attributeMask & enabledAttributeMask;
+    if (activeMask == 0)
+    {
+        return ItemColorAttribute::Default;
+    }
+
+    return ItemColorPriority[std::countr_zero(activeMask)];
+}
+
+
+/**
+* @fn GetItemColorEnabledMask
+*
+* Power sources have never had their On flag checked, so they are always enabled
+*
+* @param onMask uint32_t - Bits of the attributes whose On flag is set
+* @return uint32_t - Enabled mask for ItemColorClassifierSettings
+*/
+uint32_t GetItemColorEnabledMask(uint32_t onMask)
+{
+    return onMask | GetItemColorAttributeBit(ItemColorAttribute::PowerSource_Item);
+}
+
+
+void ItemClassificationCache::SetCapacity(size_t capacity)
+{
+    Capacity = capacity;
+    Clear();
+    Entries.reserve(Capacity);
+    Lookup.reserve(Capacity);
+}
+
+
+void ItemClassificationCache::Clear()
+{
+    Entries.clear();
+    Lookup.clear();
+    Hand = 0;
+}
+
+
+void ItemClassificationCache::ResetCounters()
+{
+    Hits = 0;
+    Misses = 0;
+    Evictions = 0;
+}
+
+
+const ItemClassificationCache::Entry* ItemClassificationCache::Find(int itemID)
+{
+    auto it = Lookup.find(itemID);
+    if (it == Lookup.end())
+    {
+        ++Misses;
+        return nullptr;
+    }
+
+    ++Hits;
+    Entry& entry = Entries[it->second];
+    entry.Referenced = true;
+    return &entry;
+}
+
+
+const ItemClassificationCache::Entry* ItemClassificationCache::Insert(int itemID, uint32_t attributeMask, ItemColorAttribute attribute, int rule)
+{
+    if (Capacity == 0)
+    {
+        return nullptr;
+    }
+
+    size_t index = Entries.size();
+    if (index < Capacity)
+    {
+        Entries.emplace_back();
+    }
+    else
+    {
+        while (Entries[Hand].Referenced)
+        {
+            Entries[Hand].Referenced = false;
+            Hand = (Hand + 1) % Capacity;
+        }
+
+        index = Hand;
+        Hand = (Hand + 1) % Capacity;
+        Lookup.erase(Entries[index].ItemID);
+        ++Evictions;
+    }
+
+    Entry& entry = Entries[index];
+    entry.ItemID = itemID;
+    entry.AttributeMask = attributeMask;
+    entry.Attribute = attribute;
+    entry.Rule = rule;
+    entry.Referenced = false;
+    Lookup[itemID] = index;
+    return &entry;
+}
+
+
+/**
+* @fn IsColorableSlot
+*
+* @param slotInfo const ItemColorSlotInfo& - Slot to check
+* @return bool - True if the slot should be colored
+*/
+bool IsColorableSlot(const ItemColorSlotInfo& slotInfo)
+{
+    // Skip if no valid CInvSlotWnd or Hot Button
+    if (!slotInfo.Enabled || !slotInfo.HasWindow || slotInfo.HotButton)
+    {
+        return false;
+    }
+
+    // Check if Index is Valid and the locations we want (Inventory, Bank, or Shared Bank)
+    if (!slotInfo.ValidLocation || (slotInfo.Container == ItemColorContainer::Other))
+    {
+        return false;
+    }
+
+    // Skip if Index is an Equipped Location
+    return !slotInfo.Equipped;
+}
+
+
+/**
+* @fn ItemColorQuery::Pack
+*
+* @return uint64_t - Item ID in the low 32 bits, then 16 bits of attribute mask, 4 of attribute and 12 of rule
+*/
+uint64_t ItemColorQuery::Pack() const
+{
+    static_assert(std::size(ItemColorPriority) <= 16, "Attribute masks must fit in 16 bits");
+    static_assert(static_cast<int>(ItemColorAttribute::Last) < 15, "Attributes must fit in 4 bits");
+
+    // Default and no rule are -1, stored as 0
+    uint64_t attribute = static_cast<uint64_t>(static_cast<int>(Attribute) + 1);
+    uint64_t rule = (Rule >= 0 && Rule <= MaxRule) ? static_cast<uint64_t>(Rule + 1) : 0;
+
+    return static_cast<uint64_t>(static_cast<uint32_t>(ItemID)) |
+        (static_cast<uint64_t>(AttributeMask & 0xFFFF) << 32) |
+        (attribute << 48) |
+        (rule << 52);
+}
+
+
+/**
+* @fn ItemColorQuery::Unpack
+*
+* @param packed uint64_t - Value from Pack
+* @return ItemColorQuery - The query that was packed
+*/
+ItemColorQuery ItemColorQuery::Unpack(uint64_t packed)
+{
+    ItemColorQuery query;
+    query.ItemID = static_cast<int>(static_cast<uint32_t>(packed));
+    query.AttributeMask = static_cast<uint32_t>((packed >> 32) & 0xFFFF);
+    query.Attribute = static_cast<ItemColorAttribute>(static_cast<int>((packed >> 48) & 0xF) - 1);
+    query.Rule = static_cast<int>(packed >> 52) - 1;
+    return query;
+}
+
+
+/**
+* @fn ItemColorQuery::ToMemo
+*
+* @return ItemColorSlotMemo - Memo with the attribute mask, attribute and rule of the query
+*/
+ItemColorSlotMemo ItemColorQuery::ToMemo() const
+{
+    ItemColorSlotMemo memo;
+    memo.AttributeMask = AttributeMask;
+    memo.Attribute = Attribute;
+    memo.Rule = Rule;
+    return memo;
+}
+
+
+/**
+* @fn AppendItemColorAttributeNames
+*
+* @param attributeMask uint32_t - Attribute bits to name, see GetItemColorAttributeBit
+* @param separator char - Put between names
+* @param out std::string& - Receives the names
+*/
+void AppendItemColorAttributeNames(uint32_t attributeMask, char separator, std::string& out)
+{
+    bool first = true;
+    for (ItemColorAttribute itemAttribute : ItemColorPriority)
+    {
+        if (attributeMask & GetItemColorAttributeBit(itemAttribute))
+        {
+            if (!first)
+            {
+                out += separator;
+            }
+
+            out += GetItemColorAttributeName(itemAttribute);
+            first = false;
+        }
+    }
+}
+
+
+/**
+* @fn ItemColorPulseScheduler::SetIntervals
+*
+* @param minInterval std::chrono::milliseconds - Interval right after a change
+* @param maxInterval std::chrono::milliseconds - Longest the interval backs off to, raised to minInterval if below it
+*/
+void ItemColorPulseScheduler::SetIntervals(std::chrono::milliseconds minInterval, std::chrono::milliseconds maxInterval)
+{
+    MinInterval = std::max(minInterval, std::chrono::milliseconds(1));
+    MaxInterval = std::max(maxInterval, MinInterval);
+    Interval = std::clamp(Interval, MinInterval, MaxInterval);
+}
+
+
+/**
+* @fn ItemColorPulseScheduler::SweepStarted
+*
+* @param now Clock::time_point - Time the sweep started
+*/
+void ItemColorPulseScheduler::SweepStarted(Clock::time_point now)
+{
+    if (HaveLastSweepStart)
+    {
+        double gap = std::chrono::duration<double>(now - LastSweepStart).count();
+        AverageGap = (AverageGap > 0) ? (AverageGap * 0.75 + gap * 0.25) : gap;
+    }
+
+    LastSweepStart = now;
+    HaveLastSweepStart = true;
+}
+
+
+/**
+* @fn ItemColorPulseScheduler::SweepDone
+*
+* @param changed bool - True if the sweep found any slot that had to be classified again
+* @param now Clock::time_point - Time the sweep finished
+*/
+void ItemColorPulseScheduler::SweepDone(bool changed, Clock::time_point now)
+{
+    Interval = changed ? MinInterval : std::min(Interval * 2, MaxInterval);
+    NextSweep = now + Interval;
+}
+
+
+/**
+* @fn ItemColorPulseScheduler::Wake
+*
+* @param now Clock::time_point - Time the change was seen
+*/
+void ItemColorPulseScheduler::Wake(Clock::time_point now)
+{
+    Interval = MinInterval;
+    NextSweep = std::min(NextSweep, now + MinInterval);
+}
+
+
+/**
+* @fn ItemColorPulseScheduler::Resume
+*
+* Sweeps again from the min interval, the first one starts right away
+*
+* @param now Clock::time_point - Time the game was entered again
+*/
+void ItemColorPulseScheduler::Resume(Clock::time_point now)
+{
+    Paused = false;
+    Interval = MinInterval;
+    NextSweep = now;
+    HaveLastSweepStart = false;
+    AverageGap = 0;
+}
+
+
+double ItemColorPulseScheduler::GetSweepsPerSecond() const
+{
+    return (AverageGap > 0) ? 1.0 / AverageGap : 0.0;
+}
+
+
+/**
+* @fn GetItemColorPhaseName
+*
+* @param phase ItemColorPhase - Phase to name
+* @return std::string_view - Name used in stats output
+*/
+std::string_view GetItemColorPhaseName(ItemColorPhase phase)
+{
+    switch (phase)
+    {
+    case ItemColorPhase::Pulse:
+        return "Pulse";
+
+    case ItemColorPhase::Signals:
+        return "Signals";
+
+    case ItemColorPhase::Sweep:
+        return "Sweep";
+
+    case ItemColorPhase::Filter:
+        return "Filter";
+
+    case ItemColorPhase::Lookup:
+        return "Lookup";
+
+    case ItemColorPhase::Classify:
+        return "Classify";
+
+    case ItemColorPhase::Write:
+        return "Write";
+
+    default:
+        return "Unnamed";
+    }
+}
+
+
+int ItemColorLatencyHistogram::GetBucket(uint64_t value)
+{
+    if (value < LinearBuckets)
+    {
+        return static_cast<int>(value);
+    }
+
+    int exponent = std::bit_width(value) - 1;
+    if (exponent >= MaxExponent)
+    {
+        return BucketCount - 1;
+    }
+
+    int subBucket = static_cast<int>((value >> (exponent - 3)) & (SubBuckets - 1));
+    return LinearBuckets + (exponent - 4) * SubBuckets + subBucket;
+}
+
+
+uint64_t ItemColorLatencyHistogram::GetBucketUpperBound(int bucket)
+{
+    if (bucket < LinearBuckets)
+    {
+        return static_cast<uint64_t>(bucket);
+    }
+
+    int exponent = (bucket - LinearBuckets) / SubBuckets + 4;
+    uint64_t subBucket = static_cast<uint64_t>((bucket - LinearBuckets) % SubBuckets);
+    uint64_t width = uint64_t(1) << (exponent - 3);
+    return (uint64_t(1) << exponent) + (subBucket + 1) * width - 1;
+}
+
+
+void ItemColorLatencyHistogram::Record(std::chrono::nanoseconds duration)
+{
+    uint64_t value = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+
+    ++Buckets[GetBucket(value)];
+    ++Count;
+    Total += value;
+    if (value > Max)
+    {
+        Max = value;
+    }
+}
+
+
+void ItemColorLatencyHistogram::Reset()
+{
+    Buckets.fill(0);
+    Count = 0;
+    Max = 0;
+    Total = 0;
+}
+
+
+std::chrono::nanoseconds ItemColorLatencyHistogram::GetPercentile(double percentile) const
+{
+    if (Count == 0)
+    {
+        return std::chrono::nanoseconds(0);
+    }
+
+    // Rank of the sample we want, 1 based
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(Count) + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, Count);
+
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        seen += Buckets[bucket];
+        if (seen >= rank)
+        {
+            return std::chrono::nanoseconds(std::min(GetBucketUpperBound(bucket), Max));
+        }
+    }
+
+    return std::chrono::nanoseconds(Max);
+}
+
+
+ItemColorPulseCounters& ItemColorPulseCounters::operator+=(const ItemColorPulseCounters& other)
+{
+    SlotsVisited += other.SlotsVisited;
+    SlotsNotColorable += other.SlotsNotColorable;
+    SlotsUnchanged += other.SlotsUnchanged;
+    SlotsReclassified += other.SlotsReclassified;
+    SlotsHidden += other.SlotsHidden;
+    SlotsDeferred += other.SlotsDeferred;
+    WritesApplied += other.WritesApplied;
+    WritesSkipped += other.WritesSkipped;
+    return *this;
+}
+
+
+void ItemColorStats::EndPulse()
+{
+    Last = Current;
+    Total += Current;
+    Current = ItemColorPulseCounters();
+    ++Pulses;
+}
+
+
+void ItemColorStats::Reset()
+{
+    Current = ItemColorPulseCounters();
+    Last = ItemColorPulseCounters();
+    Total = ItemColorPulseCounters();
+    Pulses = 0;
+
+    for (ItemColorLatencyHistogram& histogram : Histograms)
+    {
+        histogram.Reset();
+    }
+}
+
+
+/**
+* @fn ParseItemColorValue
+*
+* Parses an ARGB hex color from an ini value, with or without a 0x prefix
+*
+* @param iniValue std::string_view - Value read from the ini, empty if it was not there
+* @param defaultARGB uint32_t - Color to use when missing or invalid
+* @param argb uint32_t& - Set to the parsed color, or the default
+* @return ItemColorValueResult - Missing if empty, Invalid if it could not be parsed
+*/
+ItemColorValueResult ParseItemColorValue(std::string_view iniValue, uint32_t defaultARGB, uint32_t& argb)
+{
+    argb = defaultARGB;
+
+    while (!iniValue.empty() && ((iniValue.front() == ' ') || (iniValue.front() == '\t')))
+    {
+        iniValue.remove_prefix(1);
+    }
+
+    if (iniValue.empty())
+    {
+        return ItemColorValueResult::Missing;
+    }
+
+    if ((iniValue.size() > 2) && (iniValue[0] == '0') && ((iniValue[1] == 'x') || (iniValue[1] == 'X')))
+    {
+        iniValue.remove_prefix(2);
+    }
+
+    uint32_t value = 0;
+    auto [ptr, ec] = std::from_chars(iniValue.data(), iniValue.data() + iniValue.size(), value, 16);
+    if (ec != std::errc())
+    {
+        return ItemColorValueResult::Invalid;
+    }
+
+    argb = value;
+    return ItemColorValueResult::Loaded;
+}
+
+
+/**
+* @fn FormatItemColorValue
+*
+* @param argb uint32_t - Color to format
+* @param buffer char* - Receives the color as 0xAARRGGBB
+* @param bufferSize size_t - Size of buffer, 11 is enough
+*/
+void FormatItemColorValue(uint32_t argb, char* buffer, size_t bufferSize)
+{
+    snprintf(buffer, bufferSize, "0x%X", argb);
+}
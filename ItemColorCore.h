@@ -0,0 +1,751 @@
+/**
+* ItemColorCore.h
+*
+* Classification and scan logic for MQItemColor that does not depend on MacroQuest or the game.
+* The plugin fills the small info structs below from the game and hands them to this code,
+* so everything here builds with any C++20 compiler.
+*
+*/
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Every attribute an item can be colored by, in the order of the ini and the settings panel. Everything else
+// about attributes (ItemColorAttribute, ItemColorAttributes, ItemColorPriority, GetItemDefinitionMask) is generated from it.
+// X(Enum, Name, Priority, DefaultOn, DefaultNormal, DefaultRollover, Predicate)
+//   Name      - Ini section and settings panel label, the ini keys are the name followed by On, Normal and Rollover
+//   Priority  - Rank in coloring order, an item is colored by the lowest ranked attribute it has that is turned on
+//   Predicate - True if an item definition has the attribute, reads itemInfo and settings, see GetItemDefinitionMask
+// A new attribute also needs its flag in ItemColorFlagPlane and ClassifyItemColorBlock to be classified in blocks
+#define ITEMCOLOR_ATTRIBUTES(X) \
+    X(Quest_Item,         "Quest",         2, true,  0xFFF01DFF, 0xFFF9AFFF, itemInfo.QuestItem) \
+    X(TradeSkills_Item,   "TradeSkills",   3, true,  0xFFF0F000, 0xFFF09253, itemInfo.TradeSkills) \
+    X(Collectible_Item,   "Collectible",   4, true,  0xFFFF8C20, 0xFFFFCA4D, itemInfo.Collectible) \
+    X(Heirloom_Item,      "Heirloom",      5, false, 0xFFC0C0C0, 0xFFFFFFFF, itemInfo.Heirloom) \
+    X(NoTrade_Item,       "NoTrade",       6, true,  0xFFFF2020, 0xFFFF8080, IsNoTrade(itemInfo, settings)) \
+    X(Attuneable_Item,    "Attuneable",    7, true,  0xFF6BBAFF, 0xFFFFADF4, itemInfo.Attuneable) \
+    X(HasAugSlot8_Item,   "HasAugSlot8",   0, true,  0xFF00FF00, 0xFFFFADF4, HasType8AugSlot(itemInfo)) \
+    X(PowerSource_Item,   "PowerSource",   1, true,  0xFF0F13DA, 0xFFFFADF4, itemInfo.PowerSource) \
+    X(Placeable_Item,     "Placeable",     8, true,  0xFFC0C0C0, 0xFFFFFFFF, itemInfo.Placeable) \
+    X(Ornamentation_Item, "Ornamentation", 9, true,  0xFFC0C0C0, 0xFFFFFFFF, IsOrnamentation(itemInfo))
+
+// Enumerations of item attributes for each ItemColor, indexes ItemColorAttributes except Default which is standalone
+enum class ItemColorAttribute
+{
+    Default = -1,
+#define ITEMCOLOR_ATTRIBUTE_ENUM(Enum, ...) Enum,
+    ITEMCOLOR_ATTRIBUTES(ITEMCOLOR_ATTRIBUTE_ENUM)
+#undef ITEMCOLOR_ATTRIBUTE_ENUM
+    Last
+};
+
+// Name, ini keys and defaults of an attribute, the strings are literals so data() is null terminated
+struct ItemColorAttributeInfo
+{
+    ItemColorAttribute Attribute = ItemColorAttribute::Default;
+    std::string_view Name;
+    std::string_view OnKey;
+    std::string_view NormalKey;
+    std::string_view RolloverKey;
+    int Priority = -1;
+    bool DefaultOn = false;
+    uint32_t DefaultNormalARGB = 0;
+    uint32_t DefaultRolloverARGB = 0;
+};
+
+// One entry per attribute, in ItemColorAttribute order
+constexpr ItemColorAttributeInfo ItemColorAttributes[] =
+{
+#define ITEMCOLOR_ATTRIBUTE_INFO(Enum, Name, Priority, DefaultOn, DefaultNormal, DefaultRollover, Predicate) \
+    { ItemColorAttribute::Enum, Name, Name "On", Name "Normal", Name "Rollover", Priority, DefaultOn, DefaultNormal, DefaultRollover },
+    ITEMCOLOR_ATTRIBUTES(ITEMCOLOR_ATTRIBUTE_INFO)
+#undef ITEMCOLOR_ATTRIBUTE_INFO
+};
+
+// Default colors, for slots without an attribute that is turned on
+constexpr ItemColorAttributeInfo ItemColorDefaultAttribute =
+    { ItemColorAttribute::Default, "Default", "DefaultOn", "DefaultNormal", "DefaultRollover", -1, true, 0xFFC0C0C0, 0xFFFFFFFF };
+
+constexpr bool IsItemColorAttributeTableInOrder()
+{
+    for (size_t index = 0; index < std::size(ItemColorAttributes); ++index)
+    {
+        if (ItemColorAttributes[index].Attribute != static_cast<ItemColorAttribute>(index))
+        {
+            return false;
+        }
+    }
+
+    return std::size(ItemColorAttributes) == static_cast<size_t>(ItemColorAttribute::Last);
+}
+static_assert(IsItemColorAttributeTableInOrder(), "ItemColorAttributes must be in the same order as ItemColorAttribute");
+
+// Returns the table entry of an attribute, ItemColorDefaultAttribute for Default or anything out of range
+constexpr const ItemColorAttributeInfo& GetItemColorAttributeInfo(ItemColorAttribute itemAttribute)
+{
+    if (itemAttribute < ItemColorAttribute::Quest_Item || itemAttribute >= ItemColorAttribute::Last)
+    {
+        return ItemColorDefaultAttribute;
+    }
+
+    return ItemColorAttributes[static_cast<size_t>(itemAttribute)];
+}
+
+// Returns the name of an attribute, used for ini sections and the settings panel
+constexpr std::string_view GetItemColorAttributeName(ItemColorAttribute itemAttribute)
+{
+    return GetItemColorAttributeInfo(itemAttribute).Name;
+}
+
+// Attributes in coloring priority order, built from the Priority column of ITEMCOLOR_ATTRIBUTES
+constexpr std::array<ItemColorAttribute, std::size(ItemColorAttributes)> MakeItemColorPriority()
+{
+    std::array<ItemColorAttribute, std::size(ItemColorAttributes)> priority{};
+    priority.fill(ItemColorAttribute::Default);
+
+    for (const ItemColorAttributeInfo& info : ItemColorAttributes)
+    {
+        if (info.Priority >= 0 && static_cast<size_t>(info.Priority) < priority.size())
+        {
+            priority[info.Priority] = info.Attribute;
+        }
+    }
+
+    return priority;
+}
+
+// Coloring priority order, an item is colored by the first attribute in this list that it has and is turned on
+constexpr std::array<ItemColorAttribute, std::size(ItemColorAttributes)> ItemColorPriority = MakeItemColorPriority();
+
+constexpr bool IsItemColorPriorityComplete()
+{
+    for (ItemColorAttribute itemAttribute : ItemColorPriority)
+    {
+        if (itemAttribute == ItemColorAttribute::Default)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+static_assert(IsItemColorPriorityComplete(), "Every ItemColorAttribute needs its own priority from 0 up");
+
+// Returns the bit for an attribute in an attribute mask
+// Bits are laid out in priority order so the lowest set bit of a mask is the attribute that wins
+constexpr uint32_t GetItemColorAttributeBit(ItemColorAttribute itemAttribute)
+{
+    int priority = GetItemColorAttributeInfo(itemAttribute).Priority;
+    return (priority >= 0) ? (1U << priority) : 0;
+}
+
+// Highest aug socket type the socket bitset of an item can hold
+constexpr int ItemColorMaxSocketType = 31;
+
+// Returns the bit for an aug socket type in a socket bitset, 0 for types outside 1 to ItemColorMaxSocketType
+constexpr uint32_t GetItemColorSocketBit(int socketType)
+{
+    return (socketType > 0 && socketType <= ItemColorMaxSocketType) ? (1U << socketType) : 0;
+}
+
+// Returns the bit for an aug type in ItemDefinition::AugType, which has type n in bit n - 1
+constexpr uint32_t GetItemColorAugTypeBit(int augType)
+{
+    return (augType > 0 && augType <= 32) ? (1U << (augType - 1)) : 0;
+}
+
+// Aug types of Ornamentations
+constexpr uint32_t ItemColorOrnamentationAugTypes = GetItemColorAugTypeBit(20) | GetItemColorAugTypeBit(21);
+
+// Item definition fields the classifier reads, filled from an ItemDefinition by the plugin
+struct ItemColorDefinitionInfo
+{
+    int ItemID = 0;
+    bool QuestItem = false;
+    bool TradeSkills = false;
+    bool Collectible = false;
+    bool Heirloom = false;
+    bool IsDroppable = true;
+    bool FVNoDrop = false;
+    bool Attuneable = false;
+    bool Placeable = false;
+    bool PowerSource = false;
+    uint32_t AugType = 0;
+    // Bit set for the type of each aug socket the item has, see GetItemColorSocketBit
+    uint32_t SocketTypes = 0;
+
+    // Only read by coloring rules
+    int RequiredLevel = 0;
+    int RecommendedLevel = 0;
+    int ItemType = 0;
+    int ItemClass = 0;
+    int Size = 0;
+    int Weight = 0;
+    int Cost = 0;
+    int StackSize = 0;
+    bool Lore = false;
+    bool Magic = false;
+};
+
+// Settings the classification depends on
+struct ItemColorClassifierSettings
+{
+    bool FVServer = false;
+    bool FVNormalNoTrade = false;
+    uint32_t EnabledAttributeMask = 0;
+};
+
+// True if the item has a type 8 aug slot (raid item)
+bool HasType8AugSlot(const ItemColorDefinitionInfo& itemInfo);
+
+// True if the item definition is No Trade, which depends on the FV flags
+bool IsNoTrade(const ItemColorDefinitionInfo& itemInfo, const ItemColorClassifierSettings& settings);
+
+// True if the item fits a type 20 or 21 aug slot (Ornamentations)
+bool IsOrnamentation(const ItemColorDefinitionInfo& itemInfo);
+
+// Mask of every attribute an item definition has, does not look at which attributes are turned on
+uint32_t GetItemDefinitionMask(const ItemColorDefinitionInfo& itemInfo, const ItemColorClassifierSettings& settings);
+
+// Attribute bits that come from the item itself rather than its definition (No Trade from NoDropFlag)
+uint32_t GetItemInstanceMask(bool noDropFlag, const ItemColorClassifierSettings& settings);
+
+// Picks the highest priority attribute from a mask that is turned on, Default if none
+ItemColorAttribute ResolveItemColorAttribute(uint32_t attributeMask, uint32_t enabledAttributeMask);
+
+// Mask of the attributes that color items, from the bits of the attributes whose On flag is set
+uint32_t GetItemColorEnabledMask(uint32_t onMask);
+
+// Per attribute data needed while coloring slots, plain data so lookups never copy strings
+// The names and ini profile strings stay in ItemColor
+struct ItemColorPaletteEntry
+{
+    uint32_t NormalARGB = 0;
+    uint32_t RolloverARGB = 0;
+    bool On = false;
+
+    bool operator==(const ItemColorPaletteEntry&) const = default;
+};
+
+// Palette layout, index 0 is Default, then each ItemColorAttribute, then each coloring rule
+constexpr uint32_t ItemColorRulePaletteBase = static_cast<uint32_t>(ItemColorAttribute::Last) + 1;
+
+// Returns the palette index of an attribute, 0 (Default) for Default or anything out of range
+constexpr uint32_t GetItemColorPaletteIndex(ItemColorAttribute itemAttribute)
+{
+    if (itemAttribute < ItemColorAttribute::Quest_Item || itemAttribute >= ItemColorAttribute::Last)
+    {
+        return 0;
+    }
+
+    return static_cast<uint32_t>(itemAttribute) + 1;
+}
+
+// Bounded cache of item definition ID to its classification, uses CLOCK eviction
+// Only holds what can be derived from the item definition and current settings, per item state is applied by the caller
+class ItemClassificationCache
+{
+public:
+    struct Entry
+    {
+        int ItemID = 0;
+        uint32_t AttributeMask = 0;
+        ItemColorAttribute Attribute = ItemColorAttribute::Default;
+        // Coloring rule that matched, -1 if none
+        int Rule = -1;
+        bool Referenced = false;
+    };
+
+    // Counters
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Evictions = 0;
+
+    // Sets the max number of definitions held, clears the cache
+    void SetCapacity(size_t capacity);
+
+    size_t GetCapacity() const { return Capacity; }
+    size_t GetSize() const { return Entries.size(); }
+
+    // Drops every entry, used when any setting the classification depends on changes
+    void Clear();
+
+    void ResetCounters();
+
+    // Returns the entry for an item definition ID or nullptr if not cached
+    const Entry* Find(int itemID);
+
+    // True if the definition is cached, without counting a hit or miss or marking the entry referenced
+    bool Contains(int itemID) const { return Lookup.find(itemID) != Lookup.end(); }
+
+    // Adds an entry, evicting the first unreferenced entry past the clock hand when full
+    // Returns nullptr if the cache has no capacity
+    const Entry* Insert(int itemID, uint32_t attributeMask, ItemColorAttribute attribute, int rule);
+
+private:
+    size_t Capacity = 0;
+    size_t Hand = 0;
+    std::vector<Entry> Entries;
+    std::unordered_map<int, size_t> Lookup;
+};
+
+// Container a slot belongs to, only Possessions, Bank and SharedBank are colored
+enum class ItemColorContainer
+{
+    Other,
+    Possessions,
+    Bank,
+    SharedBank,
+};
+
+// Slot fields used to decide if a slot is colored, filled from a CInvSlot by the plugin
+struct ItemColorSlotInfo
+{
+    bool Enabled = false;
+    bool HasWindow = false;
+    bool HotButton = false;
+    bool ValidLocation = false;
+    bool Equipped = false;
+    ItemColorContainer Container = ItemColorContainer::Other;
+};
+
+// True for slots that are part of the player main inventory or bags, bank or shared bank,
+// avoids coloring worn items or any item buttons that may be created.
+bool IsColorableSlot(const ItemColorSlotInfo& slotInfo);
+
+// What is in a slot, compared between pulses to tell if the slot needs to be classified again
+struct ItemColorSlotIdentity
+{
+    uint64_t LocationKey = 0;
+    const void* pWindow = nullptr;
+    const void* pItem = nullptr;
+    int ItemID = 0;
+    bool NoDropFlag = false;
+
+    bool operator==(const ItemColorSlotIdentity& other) const = default;
+};
+
+// Memo of what a slot was last classified as
+struct ItemColorSlotMemo
+{
+    ItemColorSlotIdentity Identity;
+    uint32_t SettingsVersion = 0;
+    uint32_t AttributeMask = 0;
+    ItemColorAttribute Attribute = ItemColorAttribute::Default;
+    // Coloring rule that matched, -1 if none, a matching rule wins over Attribute
+    int Rule = -1;
+    // Skipped by a sweep while the window owning the slot was closed, colored when it opens
+    bool Pending = false;
+    // Queued for the classify workers, not queued again until its result is applied or dropped
+    bool Queued = false;
+
+    // True if the memo holds a slot we colored
+    bool IsSet() const { return Identity.pWindow != nullptr; }
+
+    // Palette index the slot is colored with
+    uint32_t GetPaletteIndex() const
+    {
+        return (Rule >= 0) ? ItemColorRulePaletteBase + static_cast<uint32_t>(Rule) : GetItemColorPaletteIndex(Attribute);
+    }
+
+    // True if the memo already matches, without taking the identity
+    bool IsCurrent(const ItemColorSlotIdentity& identity, uint32_t settingsVersion) const
+    {
+        return (SettingsVersion == settingsVersion) && (Identity == identity);
+    }
+
+    // Returns true if the memo already matches, otherwise takes the new identity and returns false
+    bool CheckCurrent(const ItemColorSlotIdentity& identity, uint32_t settingsVersion)
+    {
+        if ((SettingsVersion == settingsVersion) && (Identity == identity))
+        {
+            return true;
+        }
+
+        Identity = identity;
+        SettingsVersion = settingsVersion;
+        return false;
+    }
+};
+
+// How one item or slot is classified, what the ${ItemColor} TLO answers scripts with
+// Packs into one 64 bit value so a TLO member can hand it on to the next member without allocating
+struct ItemColorQuery
+{
+    int ItemID = 0;
+    uint32_t AttributeMask = 0;
+    ItemColorAttribute Attribute = ItemColorAttribute::Default;
+    // Coloring rule that matched, -1 if none
+    int Rule = -1;
+
+    // Rules past this are answered as no rule matching
+    static constexpr int MaxRule = 0xFFE;
+
+    uint64_t Pack() const;
+    static ItemColorQuery Unpack(uint64_t packed);
+
+    // Memo holding the classification, for ItemColorSettingsSnapshot::GetSlotPaletteIndex
+    ItemColorSlotMemo ToMemo() const;
+};
+
+// Appends the name of every attribute in attributeMask in priority order, separated by separator
+void AppendItemColorAttributeNames(uint32_t attributeMask, char separator, std::string& out);
+
+// What the plugin last applied to a slot window, writes are skipped when nothing would change
+struct ItemColorSlotWndShadow
+{
+    uint32_t BGTintNormal = 0;
+    uint32_t BGTintRollover = 0;
+    const void* pBackground = nullptr;
+    // Palette index last applied, 0 is Default
+    uint32_t PaletteIndex = 0;
+};
+
+// Folds a value into a fingerprint of the slot array, see ItemColorSlotIndex
+constexpr uint64_t MixItemColorFingerprint(uint64_t fingerprint, uint64_t value)
+{
+    return (fingerprint ^ value) * 0x100000001B3ull + 0x9E3779B97F4A7C15ull;
+}
+
+// Dense list of the slots worth coloring, so sweeps visit those instead of every slot in the slot array
+// Rebuilt only when the fingerprint of the slot array (slot count, slot and window pointers) changes or after Invalidate
+class ItemColorSlotIndex
+{
+public:
+    // Rebuilds the index by calling isColorable(index) for every slot if the fingerprint changed since the last
+    // rebuild or the index was invalidated. Returns true if it was rebuilt.
+    template <typename ColorableFn>
+    bool Update(int totalSlots, uint64_t fingerprint, ColorableFn&& isColorable)
+    {
+        if (!Stale && (fingerprint == Fingerprint) && (totalSlots == TotalSlots))
+        {
+            return false;
+        }
+
+        Slots.clear();
+        for (int index = 0; index < totalSlots; ++index)
+        {
+            if (isColorable(index))
+            {
+                Slots.push_back(index);
+            }
+        }
+
+        Stale = false;
+        Fingerprint = fingerprint;
+        TotalSlots = totalSlots;
+        ++Rebuilds;
+        return true;
+    }
+
+    // Rebuild on the next Update even if the slot array looks the same, a slot may have been enabled or moved
+    void Invalidate() { Stale = true; }
+
+    // Forgets every slot, for when the slot windows are destroyed
+    void Clear()
+    {
+        Slots.clear();
+        TotalSlots = 0;
+        Stale = true;
+    }
+
+    void ResetCounters() { Rebuilds = 0; }
+
+    // Indexes in the slot array of the slots that passed the filter at the last rebuild
+    const std::vector<int>& GetSlots() const { return Slots; }
+    int GetSize() const { return static_cast<int>(Slots.size()); }
+
+    // Slots in the slot array left out at the last rebuild
+    int GetFilteredSlots() const { return TotalSlots - GetSize(); }
+    uint64_t GetRebuilds() const { return Rebuilds; }
+
+private:
+    std::vector<int> Slots;
+    uint64_t Fingerprint = 0;
+    int TotalSlots = 0;
+    bool Stale = true;
+    uint64_t Rebuilds = 0;
+};
+
+// Resumable full sweep over a number of slots, continued each pulse within a slot and time budget
+class ItemColorSweep
+{
+public:
+    bool IsInProgress() const { return InProgress; }
+
+    // Starts a sweep, if one is already running it carries on from its cursor and covers every slot again
+    void Begin(int totalSlots)
+    {
+        if (!InProgress)
+        {
+            InProgress = true;
+            Pulses = 0;
+            StartTime = std::chrono::steady_clock::now();
+        }
+
+        Remaining = totalSlots;
+    }
+
+    // Calls colorSlot(index) until the sweep is done, slotBudget slots were handled, or timeBudget
+    // has passed (zero for no limit). The clock is only checked every few slots.
+    // Returns true if the sweep finished during this call.
+    template <typename ColorSlotFn>
+    bool Continue(int totalSlots, int slotBudget, std::chrono::microseconds timeBudget, ColorSlotFn&& colorSlot)
+    {
+        if (!InProgress)
+        {
+            return false;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ++Pulses;
+
+        // Nothing left to sweep
+        if (totalSlots <= 0)
+        {
+            Remaining = 0;
+        }
+
+        int processed = 0;
+        while ((Remaining > 0) && (slotBudget > 0))
+        {
+            if (Cursor >= totalSlots)
+            {
+                Cursor = 0;
+            }
+
+            colorSlot(Cursor);
+            ++Cursor;
+            --Remaining;
+            --slotBudget;
+
+            if ((timeBudget.count() > 0) && ((++processed & 7) == 0) &&
+                (std::chrono::steady_clock::now() - start >= timeBudget))
+            {
+                break;
+            }
+        }
+
+        if (Remaining > 0)
+        {
+            return false;
+        }
+
+        InProgress = false;
+        LastDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - StartTime);
+        LastPulses = Pulses;
+        return true;
+    }
+
+    // How long the last full sweep took from start to finish, and over how many pulses
+    std::chrono::microseconds GetLastDuration() const { return LastDuration; }
+    int GetLastPulses() const { return LastPulses; }
+
+private:
+    bool InProgress = false;
+    int Cursor = 0;
+    int Remaining = 0;
+    int Pulses = 0;
+    std::chrono::steady_clock::time_point StartTime;
+    std::chrono::microseconds LastDuration{ 0 };
+    int LastPulses = 0;
+};
+
+// Decides when the next full sweep starts. The interval doubles after each sweep that changed nothing,
+// up to the max, and drops back to the min as soon as a change is seen. Paused outside the game.
+class ItemColorPulseScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Keeps the current interval inside the new range
+    void SetIntervals(std::chrono::milliseconds minInterval, std::chrono::milliseconds maxInterval);
+
+    // True if a sweep should start now
+    bool IsSweepDue(Clock::time_point now) const { return !Paused && (now >= NextSweep); }
+
+    void SweepStarted(Clock::time_point now);
+
+    // A sweep finished, changed is true if it found any slot that had to be classified again
+    void SweepDone(bool changed, Clock::time_point now);
+
+    // Something happened (an item moved, a window opened), the next sweep is at most the min interval away
+    void Wake(Clock::time_point now);
+
+    // Stops sweeps until Resume, the rate starts over after a pause
+    void Pause() { Paused = true; }
+    void Resume(Clock::time_point now);
+    bool IsPaused() const { return Paused; }
+
+    std::chrono::milliseconds GetInterval() const { return Interval; }
+    std::chrono::milliseconds GetMinInterval() const { return MinInterval; }
+    std::chrono::milliseconds GetMaxInterval() const { return MaxInterval; }
+
+    // Sweeps started per second, averaged over the last few sweeps, 0 until two have started
+    double GetSweepsPerSecond() const;
+
+private:
+    std::chrono::milliseconds MinInterval{ 100 };
+    std::chrono::milliseconds MaxInterval{ 10000 };
+    std::chrono::milliseconds Interval{ 100 };
+    Clock::time_point NextSweep;
+    Clock::time_point LastSweepStart;
+    bool HaveLastSweepStart = false;
+    // Moving average of the time between sweep starts in seconds
+    double AverageGap = 0;
+    bool Paused = false;
+};
+
+// Phases of a pulse that are timed, slot phases are nested inside Sweep
+enum class ItemColorPhase
+{
+    Pulse,
+    Signals,
+    Sweep,
+    Filter,
+    Lookup,
+    Classify,
+    Write,
+    Count
+};
+
+// Returns the name of a phase for stats output
+std::string_view GetItemColorPhaseName(ItemColorPhase phase);
+
+// Latency histogram with buckets that are about 12% wide, good enough for p50/p99 without keeping samples
+// Values below 16ns get their own bucket, above that each power of two is split into 8 buckets
+class ItemColorLatencyHistogram
+{
+public:
+    void Record(std::chrono::nanoseconds duration);
+    void Reset();
+
+    uint64_t GetCount() const { return Count; }
+    std::chrono::nanoseconds GetMax() const { return std::chrono::nanoseconds(Max); }
+    std::chrono::nanoseconds GetTotal() const { return std::chrono::nanoseconds(Total); }
+
+    // Upper bound of the bucket holding the given percentile (0-100), never above the max seen
+    std::chrono::nanoseconds GetPercentile(double percentile) const;
+
+private:
+    static constexpr int LinearBuckets = 16;
+    static constexpr int SubBuckets = 8;
+    // Covers up to 2^36ns (about 68 seconds), anything longer lands in the last bucket
+    static constexpr int MaxExponent = 36;
+    static constexpr int BucketCount = LinearBuckets + (MaxExponent - 4) * SubBuckets;
+
+    static int GetBucket(uint64_t value);
+    static uint64_t GetBucketUpperBound(int bucket);
+
+    std::array<uint64_t, BucketCount> Buckets{};
+    uint64_t Count = 0;
+    uint64_t Max = 0;
+    uint64_t Total = 0;
+};
+
+// Records the time from construction to destruction into a histogram, does nothing if given nullptr
+class ItemColorTimingScope
+{
+public:
+    explicit ItemColorTimingScope(ItemColorLatencyHistogram* pHistogram) :
+        pHistogram(pHistogram)
+    {
+        if (pHistogram)
+        {
+            Start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ItemColorTimingScope()
+    {
+        if (pHistogram)
+        {
+            pHistogram->Record(std::chrono::steady_clock::now() - Start);
+        }
+    }
+
+    ItemColorTimingScope(const ItemColorTimingScope&) = delete;
+    ItemColorTimingScope& operator=(const ItemColorTimingScope&) = delete;
+
+private:
+    ItemColorLatencyHistogram* pHistogram;
+    std::chrono::steady_clock::time_point Start;
+};
+
+// Work done on slots, counted per pulse
+struct ItemColorPulseCounters
+{
+    uint64_t SlotsVisited = 0;
+    // Skipped because the slot is not one we color (worn, hot button, disabled, other containers)
+    uint64_t SlotsNotColorable = 0;
+    // Skipped because the slot memo matched
+    uint64_t SlotsUnchanged = 0;
+    uint64_t SlotsReclassified = 0;
+    // Skipped because the window owning the slot is closed, see ItemColorSlotMemo::Pending
+    uint64_t SlotsHidden = 0;
+    // Handed to the classify workers instead of being classified on the game thread
+    uint64_t SlotsDeferred = 0;
+    uint64_t WritesApplied = 0;
+    // Skipped because the window already showed the color or texture
+    uint64_t WritesSkipped = 0;
+
+    ItemColorPulseCounters& operator+=(const ItemColorPulseCounters& other);
+};
+
+// Timing histograms per phase and slot counters for the current pulse, the last pulse and since the last reset
+class ItemColorStats
+{
+public:
+    ItemColorPulseCounters Current;
+    ItemColorPulseCounters Last;
+    ItemColorPulseCounters Total;
+    uint64_t Pulses = 0;
+
+    // When false the per slot phases (Filter, Lookup, Classify, Write) are not timed, they cost two clock reads per slot
+    bool DetailedTiming = false;
+
+    // Histogram for a phase, nullptr for slot phases while DetailedTiming is off so the scope does nothing
+    ItemColorLatencyHistogram* Time(ItemColorPhase phase)
+    {
+        if (!DetailedTiming && (phase >= ItemColorPhase::Filter))
+        {
+            return nullptr;
+        }
+
+        return &Histograms[static_cast<size_t>(phase)];
+    }
+
+    const ItemColorLatencyHistogram& GetHistogram(ItemColorPhase phase) const { return Histograms[static_cast<size_t>(phase)]; }
+
+    // Moves the current pulse counters into Last and Total
+    void EndPulse();
+
+    void Reset();
+
+private:
+    std::array<ItemColorLatencyHistogram, static_cast<size_t>(ItemColorPhase::Count)> Histograms;
+};
+
+// Result of reading a color from the ini
+enum class ItemColorValueResult
+{
+    Missing,
+    Loaded,
+    Invalid,
+};
+
+// Parses an ARGB hex color from an ini value such as 0xFFC0C0C0
+// Missing and Invalid leave argb set to defaultARGB
+ItemColorValueResult ParseItemColorValue(std::string_view iniValue, uint32_t defaultARGB, uint32_t& argb);
+
+// Formats an ARGB color the way it is written to the ini, 0xFFC0C0C0
+void FormatItemColorValue(uint32_t argb, char* buffer, size_t bufferSize);
@@ -0,0 +1,500 @@
+/**
+* ItemColorIni.cpp
+*
+* In memory copy of an ini file, read and written in one pass.
+*
+*/
+
+#include "ItemColorIni.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    bool EqualsNoCase(std::string_view a, std::string_view b)
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+            [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+    }
+
+    std::string_view Trim(std::string_view text)
+    {
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front())))
+        {
+            text.remove_prefix(1);
+        }
+
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back())))
+        {
+            text.remove_suffix(1);
+        }
+
+        return text;
+    }
+
+    // Reads a whole number the way GetPrivateProfileInt does, leading digits only
+    bool ParseInt(std::string_view text, int& value)
+    {
+        text = Trim(text);
+        if (!text.empty() && text.front() == '+')
+        {
+            text.remove_prefix(1);
+        }
+
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc();
+    }
+
+    // Reads a bool the way GetPrivateProfileBool does, true/on/yes or a non zero number
+    bool ParseBool(std::string_view text, bool& value)
+    {
+        text = Trim(text);
+        if (EqualsNoCase(text, "true") || EqualsNoCase(text, "on") || EqualsNoCase(text, "yes"))
+        {
+            value = true;
+            return true;
+        }
+
+        if (EqualsNoCase(text, "false") || EqualsNoCase(text, "off") || EqualsNoCase(text, "no"))
+        {
+            value = false;
+            return true;
+        }
+
+        int number = 0;
+        if (ParseInt(text, number))
+        {
+            value = number != 0;
+            return true;
+        }
+
+        return false;
+    }
+
+    // Writes value the way text, a bool that read back as the opposite, was written: true/false, on/off and yes/no
+    // keep their words and capitals, anything else is written as 1 or 0
+    std::string FormatBoolLike(std::string_view text, bool value)
+    {
+        static constexpr std::string_view Words[][2] = { { "false", "true" }, { "off", "on" }, { "no", "yes" } };
+
+        text = Trim(text);
+        for (const auto& pair : Words)
+        {
+            if (!EqualsNoCase(text, pair[0]) && !EqualsNoCase(text, pair[1]))
+            {
+                continue;
+            }
+
+            std::string word(pair[value ? 1 : 0]);
+            bool allUpper = std::all_of(text.begin(), text.end(), [](char c) { return std::isupper(static_cast<unsigned char>(c)) != 0; });
+            if (allUpper)
+            {
+                std::transform(word.begin(), word.end(), word.begin(), [](char c) { return static_cast<char>(std::toupper(static_cast<unsigned char>(c))); });
+            }
+            else if (std::isupper(static_cast<unsigned char>(text.front())))
+            {
+                word.front() = static_cast<char>(std::toupper(static_cast<unsigned char>(word.front())));
+            }
+            return word;
+        }
+
+        return value ? "1" : "0";
+    }
+
+    bool IsBlank(std::string_view text)
+    {
+        return Trim(text).empty();
+    }
+}
+
+
+bool ItemColorIniFile::Load(const std::string& path)
+{
+    Sections.clear();
+    Sections.push_back({});
+    Dirty = false;
+
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec))
+    {
+        return true;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    std::string rawLine;
+    while (std::getline(file, rawLine))
+    {
+        if (!rawLine.empty() && rawLine.back() == '\r')
+        {
+            rawLine.pop_back();
+        }
+
+        std::string_view trimmed = Trim(rawLine);
+
+        if (trimmed.size() >= 2 && trimmed.front() == '[' && trimmed.back() == ']')
+        {
+            Sections.push_back({ std::string(Trim(trimmed.substr(1, trimmed.size() - 2))), {} });
+            continue;
+        }
+
+        Line line;
+        size_t equals = trimmed.find('=');
+        if (!trimmed.empty() && trimmed.front() != ';' && trimmed.front() != '#' && equals != std::string_view::npos)
+        {
+            line.IsEntry = true;
+            line.Key = Trim(trimmed.substr(0, equals));
+            line.Value = Trim(trimmed.substr(equals + 1));
+        }
+        else
+        {
+            line.Raw = rawLine;
+        }
+
+        Sections.back().Lines.push_back(std::move(line));
+    }
+
+    return !file.bad();
+}
+
+
+bool ItemColorIniFile::Save(const std::string& path)
+{
+    if (!Dirty)
+    {
+        return true;
+    }
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        // Comments and blank lines are written back where they were, sections added since Load bring their own blank line
+        for (const Section& section : Sections)
+        {
+            if (!section.Name.empty())
+            {
+                file << '[' << section.Name << "]\r\n";
+            }
+
+            for (const Line& line : section.Lines)
+            {
+                if (line.IsEntry)
+                {
+                    file << line.Key << '=' << line.Value << "\r\n";
+                }
+                else
+                {
+                    file << line.Raw << "\r\n";
+                }
+            }
+        }
+
+        file.flush();
+        if (!file)
+        {
+            file.close();
+            std::error_code ec;
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    Dirty = false;
+    return true;
+}
+
+
+ItemColorIniFile::Line* ItemColorIniFile::FindLine(std::string_view section, std::string_view key)
+{
+    return const_cast<Line*>(static_cast<const ItemColorIniFile*>(this)->FindLine(section, key));
+}
+
+
+const ItemColorIniFile::Line* ItemColorIniFile::FindLine(std::string_view section, std::string_view key) const
+{
+    for (const Section& iniSection : Sections)
+    {
+        if (!EqualsNoCase(iniSection.Name, section))
+        {
+            continue;
+        }
+
+        for (const Line& line : iniSection.Lines)
+        {
+            if (line.IsEntry && EqualsNoCase(line.Key, key))
+            {
+                return &line;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+
+const std::string* ItemColorIniFile::Find(std::string_view section, std::string_view key) const
+{
+    const Line* pLine = FindLine(section, key);
+    return pLine ? &pLine->Value : nullptr;
+}
+
+
+std::string ItemColorIniFile::GetString(std::string_view section, std::string_view key, std::string_view defaultValue) const
+{
+    const std::string* pValue = Find(section, key);
+    return pValue ? *pValue : std::string(defaultValue);
+}
+
+
+int ItemColorIniFile::GetInt(std::string_view section, std::string_view key, int defaultValue) const
+{
+    int value = defaultValue;
+    const std::string* pValue = Find(section, key);
+    if (!pValue || !ParseInt(*pValue, value))
+    {
+        return defaultValue;
+    }
+
+    return value;
+}
+
+
+bool ItemColorIniFile::GetBool(std::string_view section, std::string_view key, bool defaultValue) const
+{
+    bool value = defaultValue;
+    const std::string* pValue = Find(section, key);
+    if (!pValue || !ParseBool(*pValue, value))
+    {
+        return defaultValue;
+    }
+
+    return value;
+}
+
+
+void ItemColorIniFile::SetString(std::string_view section, std::string_view key, std::string_view value)
+{
+    if (Line* pLine = FindLine(section, key))
+    {
+        if (pLine->Value != value)
+        {
+            pLine->Value = value;
+            Dirty = true;
+        }
+        return;
+    }
+
+    auto it = std::find_if(Sections.begin(), Sections.end(),
+        [section](const Section& iniSection) { return !section.empty() && EqualsNoCase(iniSection.Name, section); });
+    if (it == Sections.end())
+    {
+        // A blank line ahead of the new section, unless the file is empty or already ends with one
+        bool empty = Sections.empty() || (Sections.size() == 1 && Sections[0].Name.empty() && Sections[0].Lines.empty());
+        if (!empty)
+        {
+            std::vector<Line>& lastLines = Sections.back().Lines;
+            if (lastLines.empty() || lastLines.back().IsEntry || !IsBlank(lastLines.back().Raw))
+            {
+                lastLines.push_back(Line());
+            }
+        }
+
+        Sections.push_back({ std::string(section), {} });
+        it = Sections.end() - 1;
+    }
+
+    // Add after the last key of the section so trailing comments stay where they were
+    auto position = it->Lines.end();
+    while (position != it->Lines.begin() && !(position - 1)->IsEntry)
+    {
+        --position;
+    }
+
+    Line line;
+    line.IsEntry = true;
+    line.Key = key;
+    line.Value = value;
+    it->Lines.insert(position, std::move(line));
+    Dirty = true;
+}
+
+
+void ItemColorIniFile::SetInt(std::string_view section, std::string_view key, int value)
+{
+    int current = 0;
+    Line* pLine = FindLine(section, key);
+    if (!pLine || !ParseInt(pLine->Value, current) || current != value)
+    {
+        SetString(section, key, std::to_string(value));
+        pLine = FindLine(section, key);
+    }
+
+    pLine->Kind = ValueKind::Int;
+}
+
+
+void ItemColorIniFile::SetBool(std::string_view section, std::string_view key, bool value)
+{
+    bool current = false;
+    Line* pLine = FindLine(section, key);
+    if (!pLine || !ParseBool(pLine->Value, current) || current != value)
+    {
+        SetString(section, key, pLine ? FormatBoolLike(pLine->Value, value) : std::string(value ? "1" : "0"));
+        pLine = FindLine(section, key);
+    }
+
+    pLine->Kind = ValueKind::Bool;
+}
+
+
+void ItemColorIniFile::Merge(const ItemColorIniFile& other)
+{
+    for (const Section& section : other.Sections)
+    {
+        for (const Line& line : section.Lines)
+        {
+            if (!line.IsEntry)
+            {
+                continue;
+            }
+
+            // A snapshot's "1" for a bool reads the same as the file's "true", which is left as it is
+            int intValue = 0;
+            bool boolValue = false;
+            if (line.Kind == ValueKind::Int && ParseInt(line.Value, intValue))
+            {
+                SetInt(section.Name, line.Key, intValue);
+            }
+            else if (line.Kind == ValueKind::Bool && ParseBool(line.Value, boolValue))
+            {
+                SetBool(section.Name, line.Key, boolValue);
+            }
+            else
+            {
+                SetString(section.Name, line.Key, line.Value);
+            }
+        }
+    }
+}
+
+
+void ItemColorIniWriter::Submit(const std::string& path, ItemColorIniFile snapshot)
+{
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        PendingPath = path;
+        PendingSnapshot = std::move(snapshot);
+        Pending = true;
+        ++Submitted;
+
+        if (!Thread.joinable())
+        {
+            Thread = std::thread(&ItemColorIniWriter::Run, this);
+        }
+    }
+
+    Wake.notify_one();
+}
+
+
+void ItemColorIniWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (Thread.joinable())
+    {
+        Done.wait(lock, [this] { return !Pending && !Writing; });
+    }
+}
+
+
+void ItemColorIniWriter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        Stopping = true;
+    }
+    Wake.notify_one();
+
+    // Run only stops once nothing is pending
+    if (Thread.joinable())
+    {
+        Thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    Stopping = false;
+}
+
+
+ItemColorIniWriter::Status ItemColorIniWriter::GetStatus() const
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    if (Pending || Writing)
+    {
+        return Status::Saving;
+    }
+
+    if (Submitted == 0)
+    {
+        return Status::Idle;
+    }
+
+    return LastFailed ? Status::Failed : Status::Saved;
+}
+
+
+void ItemColorIniWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    while (true)
+    {
+        Wake.wait(lock, [this] { return Pending || Stopping; });
+        if (!Pending)
+        {
+            break;
+        }
+
+        std::string path = std::move(PendingPath);
+        ItemColorIniFile snapshot = std::move(PendingSnapshot);
+        Pending = false;
+        Writing = true;
+
+        // The file is only touched without the lock, Submit never waits on the disk
+        lock.unlock();
+        ItemColorIniFile ini;
+        bool written = ini.Load(path);
+        if (written)
+        {
+            ini.Merge(snapshot);
+            written = ini.Save(path);
+        }
+        lock.lock();
+
+        Writing = false;
+        LastFailed = !written;
+        Done.notify_all();
+    }
+
+    Done.notify_all();
+}
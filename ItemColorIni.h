@@ -0,0 +1,144 @@
+/**
+* ItemColorIni.h
+*
+* In memory copy of an ini file. The plugin reads the file once, gets and sets every key
+* in memory, then writes it back once, only if something changed.
+* Section and key names are not case sensitive, comments and unknown keys are kept as they are.
+* ItemColorIniWriter does the same merge and write on its own thread for edits made while playing.
+*
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class ItemColorIniFile
+{
+public:
+    // Reads the whole file, a file that does not exist loads as empty
+    // Returns false if the file exists but could not be read
+    bool Load(const std::string& path);
+
+    // If anything changed since Load, writes every line to a temporary file next to path and renames it over path
+    // so a crash or another client never sees a half written file. Returns false if the write failed.
+    bool Save(const std::string& path);
+
+    // True if a Set changed or added a value since Load
+    bool IsDirty() const { return Dirty; }
+
+    // Returns the value of a key, or nullptr if the key is not there
+    const std::string* Find(std::string_view section, std::string_view key) const;
+
+    std::string GetString(std::string_view section, std::string_view key, std::string_view defaultValue) const;
+    int GetInt(std::string_view section, std::string_view key, int defaultValue) const;
+    bool GetBool(std::string_view section, std::string_view key, bool defaultValue) const;
+
+    // Set only marks the file dirty when the value is missing or different
+    // SetInt and SetBool leave a value alone if it already reads back the same, so "true" is not rewritten as "1"
+    // SetBool writes a changed value in the style already there, "true" becomes "false" and "1" becomes "0"
+    void SetString(std::string_view section, std::string_view key, std::string_view value);
+    void SetInt(std::string_view section, std::string_view key, int value);
+    void SetBool(std::string_view section, std::string_view key, bool value);
+
+    // Sets every key of another ini in this one, keys the other set with SetInt or SetBool are merged with them
+    void Merge(const ItemColorIniFile& other);
+
+    // Calls fn(section, key, value) for every key in file order
+    template <typename EntryFn>
+    void ForEachEntry(EntryFn&& fn) const
+    {
+        for (const Section& section : Sections)
+        {
+            for (const Line& line : section.Lines)
+            {
+                if (line.IsEntry)
+                {
+                    fn(section.Name, line.Key, line.Value);
+                }
+            }
+        }
+    }
+
+private:
+    // How a key was last set, so Merge can set it the same way
+    enum class ValueKind : uint8_t
+    {
+        String,
+        Int,
+        Bool,
+    };
+
+    struct Line
+    {
+        bool IsEntry = false;
+        ValueKind Kind = ValueKind::String;
+        std::string Key;
+        std::string Value;
+        // Comments and blank lines are written back as they were read
+        std::string Raw;
+    };
+
+    struct Section
+    {
+        // Empty for lines before the first section
+        std::string Name;
+        std::vector<Line> Lines;
+    };
+
+    Line* FindLine(std::string_view section, std::string_view key);
+    const Line* FindLine(std::string_view section, std::string_view key) const;
+
+    std::vector<Section> Sections;
+    bool Dirty = false;
+};
+
+// Writes settings on a background thread so the game thread never waits on the disk
+// Each write loads the file, merges the submitted keys in and saves it, see ItemColorIniFile::Save
+// A snapshot submitted while another is still waiting replaces it, so a burst of edits becomes one write
+class ItemColorIniWriter
+{
+public:
+    enum class Status
+    {
+        // Nothing submitted yet
+        Idle,
+        Saving,
+        Saved,
+        Failed,
+    };
+
+    ~ItemColorIniWriter() { Stop(); }
+
+    // Queues the keys in snapshot to be written to path, starts the thread the first time
+    void Submit(const std::string& path, ItemColorIniFile snapshot);
+
+    // Waits until everything submitted has been written
+    void Flush();
+
+    // Flushes, then stops the thread
+    void Stop();
+
+    Status GetStatus() const;
+
+private:
+    void Run();
+
+    mutable std::mutex Mutex;
+    std::condition_variable Wake;
+    std::condition_variable Done;
+    std::thread Thread;
+
+    bool Pending = false;
+    bool Writing = false;
+    bool Stopping = false;
+    bool LastFailed = false;
+    uint64_t Submitted = 0;
+    std::string PendingPath;
+    ItemColorIniFile PendingSnapshot;
+};
@@ -0,0 +1,496 @@
+/**
+* ItemColorPersistentCache.cpp
+*
+* Mapping, probing and benchmarking the per server classification file.
+*
+*/
+
+#include "ItemColorPersistentCache.h"
+#include "ItemColorScanner.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Smallest and largest tables a file holds
+    constexpr size_t MinCapacity = 64;
+    constexpr size_t MaxCapacity = size_t(1) << 24;
+
+    // 64 bit FNV-1a
+    constexpr uint64_t HashSeed = 14695981039346656037ULL;
+
+    void HashBytes(uint64_t& hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t n = 0; n < size; ++n)
+        {
+            hash = (hash ^ bytes[n]) * 1099511628211ULL;
+        }
+    }
+
+    template <typename T>
+    void HashValue(uint64_t& hash, const T& value)
+    {
+        HashBytes(hash, &value, sizeof(T));
+    }
+
+    // Length first so "ab" "c" and "a" "bc" hash differently
+    void HashString(uint64_t& hash, std::string_view text)
+    {
+        HashValue(hash, static_cast<uint64_t>(text.size()));
+        HashBytes(hash, text.data(), text.size());
+    }
+}
+
+
+/**
+* @fn GetItemColorClassificationHash
+*
+* @param settings const ItemColorSettingsSnapshot& - Settings definitions are classified with
+* @return uint64_t - Hash a persistent cache file is checked against, the same settings always give the same hash
+*/
+uint64_t GetItemColorClassificationHash(const ItemColorSettingsSnapshot& settings)
+{
+    uint64_t hash = HashSeed;
+    HashValue(hash, ItemColorPersistentCacheHeader::CurrentVersion);
+    HashValue(hash, static_cast<uint8_t>(settings.Classifier.FVServer));
+    HashValue(hash, static_cast<uint8_t>(settings.Classifier.FVNormalNoTrade));
+
+    // Attribute bits come from the priorities, a reordered table means every stored mask is wrong
+    for (const ItemColorAttributeInfo& info : ItemColorAttributes)
+    {
+        HashString(hash, info.Name);
+        HashValue(hash, info.Priority);
+    }
+
+    // Stored rules are indexes into the rule set, any change to it can move them
+    size_t ruleCount = settings.Rules ? settings.Rules->Rules.size() : 0;
+    HashValue(hash, static_cast<uint64_t>(ruleCount));
+    for (size_t rule = 0; rule < ruleCount; ++rule)
+    {
+        HashString(hash, settings.Rules->Rules[rule].Expression);
+        HashValue(hash, settings.Rules->Rules[rule].Priority);
+    }
+
+    return hash;
+}
+
+
+/**
+* @fn ItemColorPersistentCache::Open
+*
+* @param path const std::string& - File to map, created if it does not exist
+* @param capacity size_t - Entries to make room for, rounded up to a power of two
+* @param settingsHash uint64_t - From GetItemColorClassificationHash, a file with another hash is emptied
+* @param error std::string& - Receives the reason if the file could not be used
+* @return bool - True if the file is mapped
+*/
+bool ItemColorPersistentCache::Open(const std::string& path, size_t capacity, uint64_t settingsHash, std::string& error)
+{
+    Close();
+
+    capacity = std::bit_ceil(std::clamp(capacity, MinCapacity, MaxCapacity));
+    size_t length = sizeof(ItemColorPersistentCacheHeader) + capacity * sizeof(ItemColorPersistentCacheEntry);
+    bool sizeChanged = false;
+    void* pMapped = nullptr;
+
+#if defined(_WIN32)
+    // No sharing, a second client on the same server runs without the file rather than writing over this one
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        error = (GetLastError() == ERROR_SHARING_VIOLATION) ? path + " is in use by another client" : "Could not open " + path;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize = {};
+    GetFileSizeEx(file, &fileSize);
+    if (static_cast<uint64_t>(fileSize.QuadPart) != length)
+    {
+        LARGE_INTEGER newSize = {};
+        newSize.QuadPart = static_cast<LONGLONG>(length);
+        sizeChanged = true;
+        if (!SetFilePointerEx(file, newSize, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+        {
+            CloseHandle(file);
+            error = "Could not resize " + path;
+            return false;
+        }
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(static_cast<uint64_t>(length) >> 32), static_cast<DWORD>(length), nullptr);
+    if (mapping)
+    {
+        pMapped = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, length);
+    }
+
+    if (!pMapped)
+    {
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        error = "Could not map " + path;
+        return false;
+    }
+
+    FileHandle = file;
+    MappingHandle = mapping;
+#else
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        error = "Could not open " + path;
+        return false;
+    }
+
+    // Held until Close, a second client on the same server runs without the file rather than writing over this one
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(fd);
+        error = path + " is in use by another client";
+        return false;
+    }
+
+    struct stat fileStat = {};
+    if (fstat(fd, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) != length)
+    {
+        sizeChanged = true;
+        if (ftruncate(fd, static_cast<off_t>(length)) != 0)
+        {
+            close(fd);
+            error = "Could not resize " + path;
+            return false;
+        }
+    }
+
+    pMapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pMapped == MAP_FAILED)
+    {
+        close(fd);
+        error = "Could not map " + path;
+        return false;
+    }
+
+    FileDescriptor = fd;
+#endif
+
+    Header = static_cast<ItemColorPersistentCacheHeader*>(pMapped);
+    Entries = reinterpret_cast<ItemColorPersistentCacheEntry*>(Header + 1);
+    Length = length;
+    Path = path;
+
+    // Anything that does not match exactly is thrown away, it is only a cache
+    OpenedEmpty = sizeChanged ||
+        memcmp(Header->Magic, ItemColorPersistentCacheHeader().Magic, sizeof(Header->Magic)) != 0 ||
+        Header->Version != ItemColorPersistentCacheHeader::CurrentVersion ||
+        Header->Capacity != capacity ||
+        Header->SettingsHash != settingsHash ||
+        Header->Count > capacity * MaxLoadPercent / 100;
+
+    if (OpenedEmpty)
+    {
+        Reset(settingsHash);
+    }
+
+    return true;
+}
+
+
+void ItemColorPersistentCache::Close()
+{
+    if (!Header)
+    {
+        return;
+    }
+
+    Flush();
+
+#if defined(_WIN32)
+    UnmapViewOfFile(Header);
+    CloseHandle(static_cast<HANDLE>(MappingHandle));
+    CloseHandle(static_cast<HANDLE>(FileHandle));
+    MappingHandle = nullptr;
+    FileHandle = nullptr;
+#else
+    munmap(Header, Length);
+    close(FileDescriptor);
+    FileDescriptor = -1;
+#endif
+
+    Header = nullptr;
+    Entries = nullptr;
+    Length = 0;
+    Path.clear();
+}
+
+
+void ItemColorPersistentCache::Flush()
+{
+    if (!Header)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    FlushViewOfFile(Header, Length);
+#else
+    msync(Header, Length, MS_ASYNC);
+#endif
+}
+
+
+/**
+* @fn ItemColorPersistentCache::Reset
+*
+* @param settingsHash uint64_t - Settings the entries added from now on are classified with
+*/
+void ItemColorPersistentCache::Reset(uint64_t settingsHash)
+{
+    if (!Header)
+    {
+        return;
+    }
+
+    size_t capacity = (Length - sizeof(ItemColorPersistentCacheHeader)) / sizeof(ItemColorPersistentCacheEntry);
+    std::fill_n(Entries, capacity, ItemColorPersistentCacheEntry());
+
+    ItemColorPersistentCacheHeader header;
+    header.Capacity = static_cast<uint32_t>(capacity);
+    header.SettingsHash = settingsHash;
+    memcpy(Header, &header, sizeof(header));
+}
+
+
+void ItemColorPersistentCache::ResetCounters()
+{
+    Hits = 0;
+    Misses = 0;
+    Rejected = 0;
+}
+
+
+/**
+* @fn ItemColorPersistentCache::GetSlot
+*
+* @param itemID int - Item definition ID
+* @return size_t - Entry probing for itemID starts at, from the top bits of a multiplicative hash
+*/
+size_t ItemColorPersistentCache::GetSlot(int itemID) const
+{
+    uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(itemID)) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(hash >> (64 - std::countr_zero(Header->Capacity)));
+}
+
+
+const ItemColorPersistentCacheEntry* ItemColorPersistentCache::Lookup(int itemID) const
+{
+    if (!Header || itemID == 0)
+    {
+        return nullptr;
+    }
+
+    size_t mask = Header->Capacity - 1;
+    size_t slot = GetSlot(itemID);
+    for (size_t probe = 0; probe < Header->Capacity; ++probe, slot = (slot + 1) & mask)
+    {
+        const ItemColorPersistentCacheEntry& entry = Entries[slot];
+        if (entry.ItemID == itemID)
+        {
+            return &entry;
+        }
+
+        if (entry.ItemID == 0)
+        {
+            break;
+        }
+    }
+
+    return nullptr;
+}
+
+
+const ItemColorPersistentCacheEntry* ItemColorPersistentCache::Find(int itemID)
+{
+    if (!Header)
+    {
+        return nullptr;
+    }
+
+    const ItemColorPersistentCacheEntry* pEntry = Lookup(itemID);
+    if (pEntry)
+    {
+        ++Hits;
+    }
+    else
+    {
+        ++Misses;
+    }
+
+    return pEntry;
+}
+
+
+/**
+* @fn ItemColorPersistentCache::Insert
+*
+* @param itemID int - Item definition ID, 0 is never stored
+* @param definitionMask uint32_t - Mask from GetItemDefinitionMask
+* @param socketTypes uint32_t - Aug socket types of the definition
+* @param rule int - Coloring rule the definition matched, -1 if none
+* @return bool - True if the definition is in the file
+*/
+bool ItemColorPersistentCache::Insert(int itemID, uint32_t definitionMask, uint32_t socketTypes, int rule)
+{
+    if (!Header || itemID == 0)
+    {
+        return false;
+    }
+
+    size_t mask = Header->Capacity - 1;
+    size_t slot = GetSlot(itemID);
+    while (Entries[slot].ItemID != 0)
+    {
+        if (Entries[slot].ItemID == itemID)
+        {
+            return true;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    if (static_cast<size_t>(Header->Count) * 100 >= static_cast<size_t>(Header->Capacity) * MaxLoadPercent)
+    {
+        ++Rejected;
+        return false;
+    }
+
+    ItemColorPersistentCacheEntry& entry = Entries[slot];
+    entry.DefinitionMask = definitionMask;
+    entry.SocketTypes = socketTypes;
+    entry.Rule = rule;
+    entry.ItemID = itemID;
+    ++Header->Count;
+    return true;
+}
+
+
+/**
+* @fn BenchmarkItemColorColdStart
+*
+* @param records const std::vector<ItemColorClassifyRecord>& - Slots seen on the first sweep of a session
+* @param settings const ItemColorSettingsSnapshot& - Settings to classify with
+* @param path const std::string& - Scratch file for the persistent cache, removed afterwards
+* @param passes int - Times to run each cold start, the best is kept
+* @param result ItemColorColdStartBenchmarkResult& - Receives the timings
+* @param error std::string& - Receives the reason if the file could not be used
+* @return bool - True if both cold starts were timed
+*/
+bool BenchmarkItemColorColdStart(const std::vector<ItemColorClassifyRecord>& records, const ItemColorSettingsSnapshot& settings,
+    const std::string& path, int passes, ItemColorColdStartBenchmarkResult& result, std::string& error)
+{
+    using Clock = std::chrono::steady_clock;
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
+    result = ItemColorColdStartBenchmarkResult();
+    uint64_t settingsHash = GetItemColorClassificationHash(settings);
+    size_t capacity = std::max<size_t>(records.size() * 2, 1);
+
+    // The session before, which classified every record and wrote it to the file
+    {
+        ItemColorPersistentCache persistentCache;
+        if (!persistentCache.Open(path, capacity, settingsHash, error))
+        {
+            return false;
+        }
+
+        persistentCache.Reset(settingsHash);
+        for (const ItemColorClassifyRecord& record : records)
+        {
+            ItemColorClassifyResult classified = ClassifyItemColorRecord(record, settings);
+            persistentCache.Insert(record.Info.ItemID, classified.DefinitionMask, record.Info.SocketTypes, classified.DefinitionRule);
+        }
+    }
+
+    // Classifies every record the way the first sweep of a session does, through an empty classification cache
+    // that falls back to the persistent cache, if there is one, before classifying the definition
+    int sink = 0;
+    auto classifyAll = [&records, &settings, &sink](ItemColorPersistentCache* pPersistentCache)
+    {
+        ItemColorScanner scanner;
+        scanner.GetCache().SetCapacity(records.size());
+        scanner.SetPersistentCache(pPersistentCache);
+
+        ItemColorSlotMemo memo;
+        for (const ItemColorClassifyRecord& record : records)
+        {
+            scanner.ClassifyItem(ItemColorDefinitionItem{ &record.Info, record.NoDropFlag }, settings, memo);
+            sink += static_cast<int>(memo.Attribute) + memo.Rule;
+        }
+    };
+
+    for (int pass = 0; pass < std::max(passes, 1); ++pass)
+    {
+        Clock::time_point start = Clock::now();
+        classifyAll(nullptr);
+        double cold = Milliseconds(Clock::now() - start).count();
+
+        ItemColorPersistentCache persistentCache;
+
+        start = Clock::now();
+        if (!persistentCache.Open(path, capacity, settingsHash, error))
+        {
+            return false;
+        }
+        Clock::time_point opened = Clock::now();
+
+        classifyAll(&persistentCache);
+        double warm = Milliseconds(Clock::now() - opened).count();
+        double open = Milliseconds(opened - start).count();
+
+        if (pass == 0 || cold < result.ColdMilliseconds)
+        {
+            result.ColdMilliseconds = cold;
+        }
+        if (pass == 0 || open + warm < result.OpenMilliseconds + result.WarmMilliseconds)
+        {
+            result.OpenMilliseconds = open;
+            result.WarmMilliseconds = warm;
+        }
+        result.Hits = persistentCache.Hits;
+        result.Misses = persistentCache.Misses;
+    }
+
+    // Keeps the classification from being optimized away
+    if (sink == 0x12345678)
+    {
+        ++result.Misses;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return true;
+}
@@ -0,0 +1,143 @@
+/**
+* ItemColorPersistentCache.h
+*
+* Classification of item definitions kept on disk between sessions, one file per server.
+* The file is a fixed layout hash table mapped straight into memory, so opening it reads nothing
+* and the first sweep after a login or zone finds most definitions already classified.
+* Entries are written in place as new definitions are classified.
+*
+*/
+
+#pragma once
+
+#include "ItemColorCore.h"
+#include "ItemColorPipeline.h"
+#include "ItemColorSettings.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Start of a persistent cache file, followed by Capacity entries, every value is little endian
+struct ItemColorPersistentCacheHeader
+{
+    static constexpr uint32_t CurrentVersion = 1;
+
+    char Magic[8] = { 'I', 'C', 'C', 'A', 'C', 'H', 'E', '\0' };
+    uint32_t Version = CurrentVersion;
+    // Entries in the table, a power of two
+    uint32_t Capacity = 0;
+    // What the entries were classified with, see GetItemColorClassificationHash
+    uint64_t SettingsHash = 0;
+    uint32_t Count = 0;
+    uint32_t Reserved = 0;
+};
+static_assert(sizeof(ItemColorPersistentCacheHeader) == 32, "Persistent cache header layout is part of the file format");
+
+// Classification of one item definition, what ItemClassificationCache holds less the attribute,
+// which is resolved again from DefinitionMask so turning attributes on or off keeps the file
+struct ItemColorPersistentCacheEntry
+{
+    // 0 for an unused entry, written last so a half written entry is never found
+    int32_t ItemID = 0;
+    uint32_t DefinitionMask = 0;
+    // Aug socket types of the definition, see GetItemColorSocketBit
+    uint32_t SocketTypes = 0;
+    // Coloring rule that matched, -1 if none
+    int32_t Rule = -1;
+};
+static_assert(sizeof(ItemColorPersistentCacheEntry) == 16, "Persistent cache entry layout is part of the file format");
+
+// Hash of everything a definition's mask and rule depend on: the FV flags, the attribute table and every rule in order
+// Does not include the enabled attributes or colors, changing those keeps the file
+uint64_t GetItemColorClassificationHash(const ItemColorSettingsSnapshot& settings);
+
+// A persistent cache file mapped into memory and locked so only one client writes it
+// Find and Insert do nothing while no file is open
+class ItemColorPersistentCache
+{
+public:
+    // Counters
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    // Definitions not written because the table was full
+    uint64_t Rejected = 0;
+
+    ItemColorPersistentCache() = default;
+    ~ItemColorPersistentCache() { Close(); }
+    ItemColorPersistentCache(const ItemColorPersistentCache&) = delete;
+    ItemColorPersistentCache& operator=(const ItemColorPersistentCache&) = delete;
+
+    // Maps path, creating it if needed, with room for capacity entries rounded up to a power of two
+    // A file from another version, of another size or classified with other settings is emptied
+    // Returns false and sets error if the file could not be created, mapped or is in use by another client
+    bool Open(const std::string& path, size_t capacity, uint64_t settingsHash, std::string& error);
+
+    // Writes what changed back to disk and unmaps the file
+    void Close();
+
+    // Asks the system to write changed entries back to disk now rather than whenever it likes
+    void Flush();
+
+    // Empties the table in place for entries classified with settingsHash
+    void Reset(uint64_t settingsHash);
+
+    void ResetCounters();
+
+    bool IsOpen() const { return Header != nullptr; }
+    const std::string& GetPath() const { return Path; }
+    size_t GetCapacity() const { return Header ? Header->Capacity : 0; }
+    size_t GetSize() const { return Header ? Header->Count : 0; }
+    uint64_t GetSettingsHash() const { return Header ? Header->SettingsHash : 0; }
+
+    // True if Open found the file missing or stale and started it empty
+    bool WasReset() const { return OpenedEmpty; }
+
+    // Returns the entry for an item definition ID or nullptr if not in the file
+    const ItemColorPersistentCacheEntry* Find(int itemID);
+
+    // True if the definition is in the file, without counting a hit or miss
+    bool Contains(int itemID) const { return Lookup(itemID) != nullptr; }
+
+    // Adds an entry unless the definition is already there, returns false if no file is open or the table is full
+    bool Insert(int itemID, uint32_t definitionMask, uint32_t socketTypes, int rule);
+
+    // Most of the table that is filled before new definitions are turned away, keeps probes short
+    static constexpr size_t MaxLoadPercent = 75;
+
+private:
+    const ItemColorPersistentCacheEntry* Lookup(int itemID) const;
+    size_t GetSlot(int itemID) const;
+
+    ItemColorPersistentCacheHeader* Header = nullptr;
+    ItemColorPersistentCacheEntry* Entries = nullptr;
+    size_t Length = 0;
+    std::string Path;
+    bool OpenedEmpty = false;
+#if defined(_WIN32)
+    void* FileHandle = nullptr;
+    void* MappingHandle = nullptr;
+#else
+    int FileDescriptor = -1;
+#endif
+};
+
+// Time to classify the same slots right after a login with and without the persistent cache
+struct ItemColorColdStartBenchmarkResult
+{
+    // Every record through an empty classification cache, what the first sweep of a session does without the file
+    double ColdMilliseconds = 0;
+    // Mapping the file an earlier session wrote
+    double OpenMilliseconds = 0;
+    // Every record through an empty classification cache that falls back to the file before classifying
+    double WarmMilliseconds = 0;
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+};
+
+// Writes the classification of every record to a persistent cache at path, as a session would, then times a cold start
+// without the file and a cold start with it, the best of passes runs each. The file is removed afterwards
+// Returns false and sets error if the file could not be used
+bool BenchmarkItemColorColdStart(const std::vector<ItemColorClassifyRecord>& records, const ItemColorSettingsSnapshot& settings,
+    const std::string& path, int passes, ItemColorColdStartBenchmarkResult& result, std::string& error);
@@ -0,0 +1,331 @@
+/**
+* ItemColorPipeline.cpp
+*
+* Worker threads classifying slot records for full sweeps.
+*
+*/
+
+#include "ItemColorPipeline.h"
+
+#include <algorithm>
+
+
+/**
+* @fn ClassifyItemColorRecord
+*
+* @param record const ItemColorClassifyRecord& - Slot to classify
+* @param settings const ItemColorSettingsSnapshot& - Settings to classify with
+* @return ItemColorClassifyResult - Classification of the definition and of the item
+*/
+ItemColorClassifyResult ClassifyItemColorRecord(const ItemColorClassifyRecord& record, const ItemColorSettingsSnapshot& settings)
+{
+    const ItemColorClassifierSettings& classifier = settings.Classifier;
+    const ItemColorRuleProgram* pProgram = settings.Rules ? &settings.Rules->Program : nullptr;
+
+    ItemColorClassifyResult result;
+    result.DefinitionMask = GetItemDefinitionMask(record.Info, classifier);
+    result.DefinitionAttribute = ResolveItemColorAttribute(result.DefinitionMask, classifier.EnabledAttributeMask);
+    result.DefinitionRule = EvaluateItemColorRules(pProgram, record.Info, result.DefinitionMask);
+
+    result.AttributeMask = result.DefinitionMask;
+    result.Attribute = result.DefinitionAttribute;
+    result.Rule = result.DefinitionRule;
+
+    // Per item state can only add bits, only resolve again if it does
+    if (uint32_t instanceMask = GetItemInstanceMask(record.NoDropFlag, classifier))
+    {
+        result.AttributeMask |= instanceMask;
+        result.Attribute = ResolveItemColorAttribute(result.AttributeMask, classifier.EnabledAttributeMask);
+
+        if (pProgram && pProgram->UsesInstanceFields())
+        {
+            result.Rule = EvaluateItemColorRules(pProgram, record.Info, result.AttributeMask);
+        }
+    }
+
+    return result;
+}
+
+
+/**
+* @fn ClassifyItemColorRecords
+*
+* @param records const ItemColorClassifyRecord* - Slots to classify
+* @param count size_t - Number of records
+* @param settings const ItemColorSettingsSnapshot& - Settings to classify with
+* @param results ItemColorClassifyResult* - Receives count results in the same order
+*/
+void ClassifyItemColorRecords(const ItemColorClassifyRecord* records, size_t count, const ItemColorSettingsSnapshot& settings,
+    ItemColorClassifyResult* results)
+{
+    const ItemColorRuleProgram* pProgram = settings.Rules ? &settings.Rules->Program : nullptr;
+
+    ItemColorFlagBlock block;
+    ItemColorBlockResult blockResult;
+    for (size_t begin = 0; begin < count; begin += ItemColorFlagBlock::Size)
+    {
+        size_t end = std::min(begin + ItemColorFlagBlock::Size, count);
+
+        block.Clear();
+        for (size_t record = begin; record < end; ++record)
+        {
+            block.Add(records[record].Info, records[record].NoDropFlag);
+        }
+        ClassifyItemColorBlock(block, settings.Classifier, blockResult);
+
+        for (size_t record = begin; record < end; ++record)
+        {
+            size_t slot = record - begin;
+            ItemColorClassifyResult& result = results[record];
+
+            result.DefinitionMask = blockResult.DefinitionMask[slot];
+            result.DefinitionAttribute = static_cast<ItemColorAttribute>(blockResult.DefinitionAttribute[slot]);
+            result.DefinitionRule = EvaluateItemColorRules(pProgram, records[record].Info, result.DefinitionMask);
+
+            result.AttributeMask = blockResult.AttributeMask[slot];
+            result.Attribute = static_cast<ItemColorAttribute>(blockResult.Attribute[slot]);
+            result.Rule = result.DefinitionRule;
+
+            // Only the item's own NoDrop can change a rule's answer
+            if (result.AttributeMask != result.DefinitionMask && pProgram && pProgram->UsesInstanceFields())
+            {
+                result.Rule = EvaluateItemColorRules(pProgram, records[record].Info, result.AttributeMask);
+            }
+        }
+    }
+}
+
+
+void ItemColorClassifyPool::SetThreadCount(int threads)
+{
+    threads = std::max(threads, 0);
+    Wait();
+
+    if (threads == GetThreadCount())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        Stopping = true;
+    }
+    Wake.notify_all();
+
+    for (std::thread& thread : Threads)
+    {
+        thread.join();
+    }
+    Threads.clear();
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    Stopping = false;
+    for (int thread = 0; thread < threads; ++thread)
+    {
+        // A new thread only takes batches submitted after this point, even if it starts running later
+        Threads.emplace_back(&ItemColorClassifyPool::Run, this, Generation);
+    }
+}
+
+
+bool ItemColorClassifyPool::Submit(ItemColorClassifyBatch&& batch)
+{
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        if (Threads.empty() || Running || !batch.Settings)
+        {
+            return false;
+        }
+
+        Batch = std::move(batch);
+        Batch.Results.assign(Batch.Records.size(), ItemColorClassifyResult());
+        NextRecord = 0;
+        WorkersLeft = static_cast<int>(Threads.size());
+        Running = true;
+        Finished = false;
+        BatchStart = std::chrono::steady_clock::now();
+        ++Generation;
+    }
+
+    Wake.notify_all();
+    return true;
+}
+
+
+bool ItemColorClassifyPool::IsBusy() const
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    return Running;
+}
+
+
+bool ItemColorClassifyPool::TakeResults(ItemColorClassifyBatch& batch)
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    if (Running || !Finished)
+    {
+        return false;
+    }
+
+    batch = std::move(Batch);
+    Batch = ItemColorClassifyBatch();
+    Finished = false;
+    return true;
+}
+
+
+void ItemColorClassifyPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    Done.wait(lock, [this] { return !Running; });
+}
+
+
+void ItemColorClassifyPool::Run(uint64_t seenGeneration)
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    while (true)
+    {
+        Wake.wait(lock, [this, seenGeneration] { return Stopping || (Generation != seenGeneration); });
+        if (Stopping)
+        {
+            return;
+        }
+        seenGeneration = Generation;
+
+        // The batch is not touched by the game thread while Running, so no lock is held while classifying
+        lock.unlock();
+        ClassifyChunks();
+        lock.lock();
+
+        if (--WorkersLeft == 0)
+        {
+            Batch.Duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - BatchStart);
+            Running = false;
+            Finished = true;
+            Done.notify_all();
+        }
+    }
+}
+
+
+void ItemColorClassifyPool::ClassifyChunks()
+{
+    const size_t count = Batch.Records.size();
+    const ItemColorSettingsSnapshot& settings = *Batch.Settings;
+
+    while (true)
+    {
+        size_t begin = NextRecord.fetch_add(ChunkSize, std::memory_order_relaxed);
+        if (begin >= count)
+        {
+            break;
+        }
+
+        size_t end = std::min(begin + ChunkSize, count);
+        ClassifyItemColorRecords(&Batch.Records[begin], end - begin, settings, &Batch.Results[begin]);
+    }
+}
+
+
+/**
+* @fn MakeItemColorBenchmarkRecords
+*
+* @param count int - Number of records
+* @return std::vector<ItemColorClassifyRecord> - The same records every call, about a fifth of them share a definition
+*/
+std::vector<ItemColorClassifyRecord> MakeItemColorBenchmarkRecords(int count)
+{
+    std::vector<ItemColorClassifyRecord> records(std::max(count, 0));
+    uint32_t seed = 12345;
+    auto next = [&seed](uint32_t range)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<int>((seed >> 8) % range);
+        };
+
+    for (size_t index = 0; index < records.size(); ++index)
+    {
+        ItemColorClassifyRecord& record = records[index];
+        ItemColorDefinitionInfo& info = record.Info;
+
+        record.SlotIndex = static_cast<int>(index);
+        record.NoDropFlag = next(20) == 0;
+
+        info.ItemID = 1000 + next(static_cast<uint32_t>(std::max<size_t>(records.size() * 4 / 5, 1)));
+        info.QuestItem = next(12) == 0;
+        info.TradeSkills = next(5) == 0;
+        info.Collectible = next(30) == 0;
+        info.Heirloom = next(40) == 0;
+        info.IsDroppable = next(4) != 0;
+        info.Attuneable = next(15) == 0;
+        info.Placeable = next(25) == 0;
+        info.PowerSource = next(60) == 0;
+        info.AugType = (next(10) == 0) ? (1u << next(21)) : 0;
+        info.SocketTypes = GetItemColorSocketBit(next(8) == 0 ? 8 : next(20));
+        info.RequiredLevel = next(126);
+        info.RecommendedLevel = info.RequiredLevel;
+        info.ItemType = next(60);
+        info.ItemClass = next(3);
+        info.Size = next(5);
+        info.Weight = next(200);
+        info.Cost = next(100000);
+        info.StackSize = next(3) == 0 ? 1000 : 1;
+        info.Lore = next(3) == 0;
+        info.Magic = next(2) == 0;
+    }
+
+    return records;
+}
+
+
+/**
+* @fn BenchmarkItemColorClassifyPool
+*
+* @param records const std::vector<ItemColorClassifyRecord>& - Records to classify
+* @param settings const std::shared_ptr<const ItemColorSettingsSnapshot>& - Settings to classify with
+* @param maxThreads int - Most workers to time
+* @param passes int - Runs per thread count, the fastest is kept
+* @return std::vector<ItemColorThreadBenchmarkResult> - Calling thread first, then 1 to maxThreads workers
+*/
+std::vector<ItemColorThreadBenchmarkResult> BenchmarkItemColorClassifyPool(const std::vector<ItemColorClassifyRecord>& records,
+    const std::shared_ptr<const ItemColorSettingsSnapshot>& settings, int maxThreads, int passes)
+{
+    std::vector<ItemColorThreadBenchmarkResult> results;
+    passes = std::max(passes, 1);
+
+    // Calling thread
+    std::vector<ItemColorClassifyResult> serialResults(records.size());
+    double best = 0;
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ClassifyItemColorRecords(records.data(), records.size(), *settings, serialResults.data());
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = (pass == 0) ? elapsed : std::min(best, elapsed);
+    }
+    results.push_back({ 0, best });
+
+    // Workers, the records are copied into each batch before it is timed
+    ItemColorClassifyPool pool;
+    for (int threads = 1; threads <= maxThreads; ++threads)
+    {
+        pool.SetThreadCount(threads);
+
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            ItemColorClassifyBatch batch;
+            batch.Records = records;
+            batch.Settings = settings;
+            pool.Submit(std::move(batch));
+            pool.Wait();
+            pool.TakeResults(batch);
+
+            double elapsed = batch.Duration.count() / 1000.0;
+            best = (pass == 0) ? elapsed : std::min(best, elapsed);
+        }
+        results.push_back({ threads, best });
+    }
+
+    return results;
+}
@@ -0,0 +1,125 @@
+/**
+* ItemColorPipeline.h
+*
+* Classifies slots for full sweeps on worker threads.
+* The game thread copies what each slot needs into plain records, the workers classify them
+* against a settings snapshot, and the game thread applies the results on a later pulse.
+*
+*/
+
+#pragma once
+
+#include "ItemColorBatch.h"
+#include "ItemColorCore.h"
+#include "ItemColorSettings.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Copy of what classifying a slot needs, taken on the game thread so workers never read game memory
+struct ItemColorClassifyRecord
+{
+    // Index of the slot in the slot array
+    int SlotIndex = 0;
+    // What was in the slot when the record was taken, a result is only applied if it still matches
+    ItemColorSlotIdentity Identity;
+    bool NoDropFlag = false;
+    ItemColorDefinitionInfo Info;
+};
+
+struct ItemColorClassifyResult
+{
+    // Classification of the definition alone, what ItemClassificationCache holds
+    uint32_t DefinitionMask = 0;
+    ItemColorAttribute DefinitionAttribute = ItemColorAttribute::Default;
+    int DefinitionRule = -1;
+
+    // With the item's own state added, what the slot is colored with
+    uint32_t AttributeMask = 0;
+    ItemColorAttribute Attribute = ItemColorAttribute::Default;
+    int Rule = -1;
+};
+
+// Classifies a record the same way the plugin does on the game thread, without the classification cache
+ItemColorClassifyResult ClassifyItemColorRecord(const ItemColorClassifyRecord& record, const ItemColorSettingsSnapshot& settings);
+
+// Same as ClassifyItemColorRecord for count records, the attributes are worked out a block at a time
+// with ClassifyItemColorBlock and only the rules are evaluated one record at a time
+void ClassifyItemColorRecords(const ItemColorClassifyRecord* records, size_t count, const ItemColorSettingsSnapshot& settings,
+    ItemColorClassifyResult* results);
+
+// Records handed to the workers and, once they are done, their results in the same order
+struct ItemColorClassifyBatch
+{
+    std::vector<ItemColorClassifyRecord> Records;
+    std::vector<ItemColorClassifyResult> Results;
+    std::shared_ptr<const ItemColorSettingsSnapshot> Settings;
+    // The plugin's settings version when the batch was taken, results are dropped if it changed
+    uint32_t SettingsVersion = 0;
+    // Time from Submit until the last record was classified
+    std::chrono::microseconds Duration{ 0 };
+};
+
+// Fixed set of worker threads classifying one batch at a time, records are split into chunks the workers take in turn
+class ItemColorClassifyPool
+{
+public:
+    ~ItemColorClassifyPool() { SetThreadCount(0); }
+
+    // Waits for a running batch, then starts or stops workers, 0 stops them all
+    void SetThreadCount(int threads);
+    int GetThreadCount() const { return static_cast<int>(Threads.size()); }
+
+    // Starts classifying a batch, returns false without taking it if there are no workers or one is running
+    bool Submit(ItemColorClassifyBatch&& batch);
+
+    // True while a submitted batch is being classified
+    bool IsBusy() const;
+
+    // Moves out a batch the workers finished, returns false while one is running or if none was submitted
+    bool TakeResults(ItemColorClassifyBatch& batch);
+
+    // Blocks until the running batch is finished
+    void Wait();
+
+    // Records a worker takes at a time
+    static constexpr size_t ChunkSize = 256;
+
+private:
+    // seenGeneration is the last batch the thread should not take
+    void Run(uint64_t seenGeneration);
+    void ClassifyChunks();
+
+    mutable std::mutex Mutex;
+    std::condition_variable Wake;
+    std::condition_variable Done;
+    std::vector<std::thread> Threads;
+
+    ItemColorClassifyBatch Batch;
+    std::chrono::steady_clock::time_point BatchStart;
+    std::atomic<size_t> NextRecord{ 0 };
+    uint64_t Generation = 0;
+    int WorkersLeft = 0;
+    bool Running = false;
+    bool Finished = false;
+    bool Stopping = false;
+};
+
+// Records shaped like a real inventory (mix of levels, types and flags), count of them, used to time the workers
+std::vector<ItemColorClassifyRecord> MakeItemColorBenchmarkRecords(int count);
+
+struct ItemColorThreadBenchmarkResult
+{
+    // 0 for classifying on the calling thread
+    int Threads = 0;
+    double Milliseconds = 0;
+};
+
+// Times classifying records on the calling thread and then with 1 to maxThreads workers, the best of passes runs each
+std::vector<ItemColorThreadBenchmarkResult> BenchmarkItemColorClassifyPool(const std::vector<ItemColorClassifyRecord>& records,
+    const std::shared_ptr<const ItemColorSettingsSnapshot>& settings, int maxThreads, int passes);
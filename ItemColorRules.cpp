@@ -0,0 +1,922 @@
+/**
+* ItemColorRules.cpp
+*
+* Parser and compiler for user defined coloring rules.
+*
+* Grammar, keywords and field names are not case sensitive:
+*   expression := and ( ("or" | "||") and )*
+*   and        := not ( ("and" | "&&") not )*
+*   not        := ("not" | "!") not | primary
+*   primary    := "(" expression ")" | "Socket" "(" number ( "," number )* ")" | field [ op number ]
+*   op         := "<" | "<=" | ">" | ">=" | "=" | "==" | "!="
+* A field on its own is true when it is not 0.
+* Socket(8, 20) is true when the item has an aug socket of any of the listed types.
+*
+*/
+
+#include "ItemColorRules.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <limits>
+
+namespace
+{
+    struct RuleFieldName
+    {
+        std::string_view Name;
+        ItemColorRuleField Field;
+    };
+
+    constexpr RuleFieldName RuleFieldNames[] =
+    {
+        { "ID", ItemColorRuleField::ID },
+        { "ReqLevel", ItemColorRuleField::ReqLevel },
+        { "RecLevel", ItemColorRuleField::RecLevel },
+        { "ItemType", ItemColorRuleField::ItemType },
+        { "ItemClass", ItemColorRuleField::ItemClass },
+        { "Size", ItemColorRuleField::Size },
+        { "Weight", ItemColorRuleField::Weight },
+        { "Cost", ItemColorRuleField::Cost },
+        { "StackSize", ItemColorRuleField::StackSize },
+        { "Lore", ItemColorRuleField::Lore },
+        { "Magic", ItemColorRuleField::Magic },
+        { "Quest", ItemColorRuleField::Quest },
+        { "TradeSkills", ItemColorRuleField::TradeSkills },
+        { "Collectible", ItemColorRuleField::Collectible },
+        { "Heirloom", ItemColorRuleField::Heirloom },
+        { "NoDrop", ItemColorRuleField::NoDrop },
+        { "NoTrade", ItemColorRuleField::NoDrop },
+        { "Attuneable", ItemColorRuleField::Attuneable },
+        { "AugSlot8", ItemColorRuleField::AugSlot8 },
+        { "PowerSource", ItemColorRuleField::PowerSource },
+        { "Placeable", ItemColorRuleField::Placeable },
+        { "Ornamentation", ItemColorRuleField::Ornamentation },
+    };
+
+    // Attribute bit behind a flag field, 0 for fields read from the definition
+    constexpr uint32_t GetRuleFieldBit(ItemColorRuleField field)
+    {
+        switch (field)
+        {
+        case ItemColorRuleField::Quest: return GetItemColorAttributeBit(ItemColorAttribute::Quest_Item);
+        case ItemColorRuleField::TradeSkills: return GetItemColorAttributeBit(ItemColorAttribute::TradeSkills_Item);
+        case ItemColorRuleField::Collectible: return GetItemColorAttributeBit(ItemColorAttribute::Collectible_Item);
+        case ItemColorRuleField::Heirloom: return GetItemColorAttributeBit(ItemColorAttribute::Heirloom_Item);
+        case ItemColorRuleField::NoDrop: return GetItemColorAttributeBit(ItemColorAttribute::NoTrade_Item);
+        case ItemColorRuleField::Attuneable: return GetItemColorAttributeBit(ItemColorAttribute::Attuneable_Item);
+        case ItemColorRuleField::AugSlot8: return GetItemColorAttributeBit(ItemColorAttribute::HasAugSlot8_Item);
+        case ItemColorRuleField::PowerSource: return GetItemColorAttributeBit(ItemColorAttribute::PowerSource_Item);
+        case ItemColorRuleField::Placeable: return GetItemColorAttributeBit(ItemColorAttribute::Placeable_Item);
+        case ItemColorRuleField::Ornamentation: return GetItemColorAttributeBit(ItemColorAttribute::Ornamentation_Item);
+        default: return 0;
+        }
+    }
+
+    constexpr bool IsFlagField(ItemColorRuleField field)
+    {
+        return GetRuleFieldBit(field) != 0 || field == ItemColorRuleField::Lore || field == ItemColorRuleField::Magic;
+    }
+
+    // Test that passes exactly when the given one fails
+    constexpr ItemColorRuleOp NegateRuleOp(ItemColorRuleOp op)
+    {
+        switch (op)
+        {
+        case ItemColorRuleOp::Equal: return ItemColorRuleOp::NotEqual;
+        case ItemColorRuleOp::NotEqual: return ItemColorRuleOp::Equal;
+        case ItemColorRuleOp::Less: return ItemColorRuleOp::GreaterEqual;
+        case ItemColorRuleOp::LessEqual: return ItemColorRuleOp::Greater;
+        case ItemColorRuleOp::Greater: return ItemColorRuleOp::LessEqual;
+        case ItemColorRuleOp::AnyOf: return ItemColorRuleOp::NoneOf;
+        case ItemColorRuleOp::NoneOf: return ItemColorRuleOp::AnyOf;
+        default: return ItemColorRuleOp::Less;
+        }
+    }
+
+    bool EqualsNoCase(std::string_view a, std::string_view b)
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+            [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+    }
+
+    // Parsed expression, only lives while a rule is compiled
+    struct RuleNode
+    {
+        enum class Kind { Test, And, Or, Not };
+
+        Kind NodeKind = Kind::Test;
+        ItemColorRuleField Field = ItemColorRuleField::ID;
+        ItemColorRuleOp Op = ItemColorRuleOp::NotEqual;
+        int32_t Value = 0;
+        int Left = -1;
+        int Right = -1;
+    };
+
+    class RuleParser
+    {
+    public:
+        explicit RuleParser(std::string_view text) : Text(text) {}
+
+        std::vector<RuleNode> Nodes;
+        std::string Error;
+
+        // Returns the root node, or -1 with Error set
+        int Parse()
+        {
+            int root = ParseOr();
+            if (root >= 0)
+            {
+                SkipSpace();
+                if (Pos < Text.size())
+                {
+                    return Fail("unexpected text");
+                }
+            }
+
+            return root;
+        }
+
+    private:
+        std::string_view Text;
+        size_t Pos = 0;
+
+        int Fail(const char* message)
+        {
+            if (Error.empty())
+            {
+                Error = std::string(message) + " at column " + std::to_string(Pos + 1);
+            }
+
+            return -1;
+        }
+
+        int AddNode(const RuleNode& node)
+        {
+            Nodes.push_back(node);
+            return static_cast<int>(Nodes.size()) - 1;
+        }
+
+        void SkipSpace()
+        {
+            while (Pos < Text.size() && std::isspace(static_cast<unsigned char>(Text[Pos])))
+            {
+                ++Pos;
+            }
+        }
+
+        // Consumes a symbol such as "&&" or "<="
+        bool AcceptSymbol(std::string_view symbol)
+        {
+            SkipSpace();
+            if (Text.substr(Pos, symbol.size()) == symbol)
+            {
+                Pos += symbol.size();
+                return true;
+            }
+
+            return false;
+        }
+
+        std::string_view PeekWord()
+        {
+            SkipSpace();
+            size_t end = Pos;
+            while (end < Text.size() && (std::isalnum(static_cast<unsigned char>(Text[end])) || Text[end] == '_'))
+            {
+                ++end;
+            }
+
+            return Text.substr(Pos, end - Pos);
+        }
+
+        // Consumes a keyword such as "and", only if it is the whole word
+        bool AcceptKeyword(std::string_view keyword)
+        {
+            std::string_view word = PeekWord();
+            if (EqualsNoCase(word, keyword))
+            {
+                Pos += word.size();
+                return true;
+            }
+
+            return false;
+        }
+
+        int ParseOr()
+        {
+            int left = ParseAnd();
+            while (left >= 0 && (AcceptKeyword("or") || AcceptSymbol("||")))
+            {
+                int right = ParseAnd();
+                if (right < 0)
+                {
+                    return -1;
+                }
+
+                RuleNode node;
+                node.NodeKind = RuleNode::Kind::Or;
+                node.Left = left;
+                node.Right = right;
+                left = AddNode(node);
+            }
+
+            return left;
+        }
+
+        int ParseAnd()
+        {
+            int left = ParseNot();
+            while (left >= 0 && (AcceptKeyword("and") || AcceptSymbol("&&")))
+            {
+                int right = ParseNot();
+                if (right < 0)
+                {
+                    return -1;
+                }
+
+                RuleNode node;
+                node.NodeKind = RuleNode::Kind::And;
+                node.Left = left;
+                node.Right = right;
+                left = AddNode(node);
+            }
+
+            return left;
+        }
+
+        int ParseNot()
+        {
+            SkipSpace();
+            // "!" but not "!="
+            bool bang = (Text.substr(Pos, 1) == "!") && (Text.substr(Pos, 2) != "!=");
+            if (bang || AcceptKeyword("not"))
+            {
+                if (bang)
+                {
+                    ++Pos;
+                }
+
+                int child = ParseNot();
+                if (child < 0)
+                {
+                    return -1;
+                }
+
+                RuleNode node;
+                node.NodeKind = RuleNode::Kind::Not;
+                node.Left = child;
+                return AddNode(node);
+            }
+
+            return ParsePrimary();
+        }
+
+        int ParsePrimary()
+        {
+            if (AcceptSymbol("("))
+            {
+                int inner = ParseOr();
+                if (inner < 0)
+                {
+                    return -1;
+                }
+
+                if (!AcceptSymbol(")"))
+                {
+                    return Fail("expected )");
+                }
+
+                return inner;
+            }
+
+            if (AcceptKeyword("Socket"))
+            {
+                return ParseSocketTypes();
+            }
+
+            std::string_view word = PeekWord();
+            if (word.empty())
+            {
+                return Fail("expected a field name");
+            }
+
+            auto it = std::find_if(std::begin(RuleFieldNames), std::end(RuleFieldNames),
+                [word](const RuleFieldName& fieldName) { return EqualsNoCase(fieldName.Name, word); });
+            if (it == std::end(RuleFieldNames))
+            {
+                return Fail("unknown field");
+            }
+            Pos += word.size();
+
+            RuleNode node;
+            node.Field = it->Field;
+
+            // Longer symbols first so "<=" is not read as "<"
+            if (AcceptSymbol("<=")) node.Op = ItemColorRuleOp::LessEqual;
+            else if (AcceptSymbol(">=")) node.Op = ItemColorRuleOp::GreaterEqual;
+            else if (AcceptSymbol("==")) node.Op = ItemColorRuleOp::Equal;
+            else if (AcceptSymbol("!=")) node.Op = ItemColorRuleOp::NotEqual;
+            else if (AcceptSymbol("<")) node.Op = ItemColorRuleOp::Less;
+            else if (AcceptSymbol(">")) node.Op = ItemColorRuleOp::Greater;
+            else if (AcceptSymbol("=")) node.Op = ItemColorRuleOp::Equal;
+            else
+            {
+                // Field on its own, true when not 0
+                return AddNode(node);
+            }
+
+            SkipSpace();
+            const char* first = Text.data() + Pos;
+            const char* last = Text.data() + Text.size();
+            auto [ptr, ec] = std::from_chars(first, last, node.Value);
+            if (ec != std::errc())
+            {
+                return Fail("expected a number");
+            }
+            Pos += ptr - first;
+
+            return AddNode(node);
+        }
+
+        // List of socket types after "Socket", becomes one test of the socket bitset
+        int ParseSocketTypes()
+        {
+            if (!AcceptSymbol("("))
+            {
+                return Fail("expected (");
+            }
+
+            RuleNode node;
+            node.Field = ItemColorRuleField::Sockets;
+            node.Op = ItemColorRuleOp::AnyOf;
+
+            uint32_t socketMask = 0;
+            do
+            {
+                SkipSpace();
+                int socketType = 0;
+                const char* first = Text.data() + Pos;
+                auto [ptr, ec] = std::from_chars(first, Text.data() + Text.size(), socketType);
+                if (ec != std::errc())
+                {
+                    return Fail("expected a socket type");
+                }
+
+                if (GetItemColorSocketBit(socketType) == 0)
+                {
+                    return Fail("socket type must be 1 to 31");
+                }
+                Pos += ptr - first;
+                socketMask |= GetItemColorSocketBit(socketType);
+            } while (AcceptSymbol(","));
+
+            if (!AcceptSymbol(")"))
+            {
+                return Fail("expected )");
+            }
+
+            node.Value = static_cast<int32_t>(socketMask);
+            return AddNode(node);
+        }
+    };
+}
+
+
+/**
+* @fn GetItemColorRuleFields
+*
+* @param itemInfo const ItemColorDefinitionInfo& - Definition of the item
+* @param attributeMask uint32_t - Attribute bits of the item, including per item bits
+* @param fields ItemColorRuleFields& - Receives the value of every field
+*/
+void GetItemColorRuleFields(const ItemColorDefinitionInfo& itemInfo, uint32_t attributeMask, ItemColorRuleFields& fields)
+{
+    fields[static_cast<size_t>(ItemColorRuleField::ID)] = itemInfo.ItemID;
+    fields[static_cast<size_t>(ItemColorRuleField::ReqLevel)] = itemInfo.RequiredLevel;
+    fields[static_cast<size_t>(ItemColorRuleField::RecLevel)] = itemInfo.RecommendedLevel;
+    fields[static_cast<size_t>(ItemColorRuleField::ItemType)] = itemInfo.ItemType;
+    fields[static_cast<size_t>(ItemColorRuleField::ItemClass)] = itemInfo.ItemClass;
+    fields[static_cast<size_t>(ItemColorRuleField::Size)] = itemInfo.Size;
+    fields[static_cast<size_t>(ItemColorRuleField::Weight)] = itemInfo.Weight;
+    fields[static_cast<size_t>(ItemColorRuleField::Cost)] = itemInfo.Cost;
+    fields[static_cast<size_t>(ItemColorRuleField::StackSize)] = itemInfo.StackSize;
+    fields[static_cast<size_t>(ItemColorRuleField::Lore)] = itemInfo.Lore ? 1 : 0;
+    fields[static_cast<size_t>(ItemColorRuleField::Magic)] = itemInfo.Magic ? 1 : 0;
+    fields[static_cast<size_t>(ItemColorRuleField::Sockets)] = static_cast<int32_t>(itemInfo.SocketTypes);
+
+    for (size_t field = static_cast<size_t>(ItemColorRuleField::Quest); field < fields.size(); ++field)
+    {
+        fields[field] = (attributeMask & GetRuleFieldBit(static_cast<ItemColorRuleField>(field))) ? 1 : 0;
+    }
+}
+
+
+/**
+* @fn AddRule
+*
+* Parses a rule and compiles it onto the end of the program.
+* And, or and not become jumps between tests, so nothing is left to interpret when a slot is colored.
+*
+* @param ruleID int - Returned by Evaluate when this rule matches
+* @param expression std::string_view - Rule text such as "ReqLevel > 100 and NoDrop"
+* @param priority int - Lower values are tried first
+* @param error std::string& - Set to why the rule could not be parsed
+* @return bool - True if the rule was added
+*/
+bool ItemColorRuleProgram::AddRule(int ruleID, std::string_view expression, int priority, std::string& error)
+{
+    RuleParser parser(expression);
+    int root = parser.Parse();
+    if (root < 0)
+    {
+        error = parser.Error;
+        return false;
+    }
+
+    const std::vector<RuleNode>& nodes = parser.Nodes;
+
+    // Emits the tests for a node that continue at onTrue or onFalse, returns where the node starts
+    // The right side of and/or is emitted first so the left side knows where to jump
+    auto compile = [&](auto& self, int nodeIndex, int32_t onTrue, int32_t onFalse) -> int32_t
+    {
+        const RuleNode& node = nodes[nodeIndex];
+        switch (node.NodeKind)
+        {
+        case RuleNode::Kind::Not:
+            return self(self, node.Left, onFalse, onTrue);
+
+        case RuleNode::Kind::And:
+            return self(self, node.Left, self(self, node.Right, onTrue, onFalse), onFalse);
+
+        case RuleNode::Kind::Or:
+            return self(self, node.Left, onTrue, self(self, node.Right, onTrue, onFalse));
+
+        default:
+            break;
+        }
+
+        if (node.Field == ItemColorRuleField::NoDrop)
+        {
+            InstanceFields = true;
+        }
+
+        Tests.push_back({ node.Field, node.Op, node.Value, onTrue, onFalse });
+        return static_cast<int32_t>(Tests.size()) - 1;
+    };
+
+    // Tests plainly and-ed at the top of the rule become ranges the index can check without walking the rule
+    // Not equal only becomes a range for 0 or 1 fields, anything under an or is left to the tests
+    std::vector<RuleConstraint> constraints;
+    auto addConstraints = [&](auto& self, int nodeIndex, bool negate) -> void
+    {
+        const RuleNode& node = nodes[nodeIndex];
+        if (node.NodeKind == RuleNode::Kind::Not)
+        {
+            self(self, node.Left, !negate);
+            return;
+        }
+
+        if ((node.NodeKind == RuleNode::Kind::And) && !negate)
+        {
+            self(self, node.Left, false);
+            self(self, node.Right, false);
+            return;
+        }
+
+        if (node.NodeKind != RuleNode::Kind::Test)
+        {
+            return;
+        }
+
+        ItemColorRuleOp op = negate ? NegateRuleOp(node.Op) : node.Op;
+        int64_t value = node.Value;
+        int64_t low = INT32_MIN;
+        int64_t high = INT32_MAX;
+
+        switch (op)
+        {
+        case ItemColorRuleOp::Equal: low = value; high = value; break;
+        case ItemColorRuleOp::Less: high = value - 1; break;
+        case ItemColorRuleOp::LessEqual: high = value; break;
+        case ItemColorRuleOp::Greater: low = value + 1; break;
+        case ItemColorRuleOp::GreaterEqual: low = value; break;
+        case ItemColorRuleOp::NotEqual:
+            if (!IsFlagField(node.Field) || (value != 0 && value != 1))
+            {
+                return;
+            }
+            low = 1 - value;
+            high = 1 - value;
+            break;
+
+        // Bits are not a range, left to the tests
+        case ItemColorRuleOp::AnyOf:
+        case ItemColorRuleOp::NoneOf:
+            return;
+        }
+
+        auto it = std::find_if(constraints.begin(), constraints.end(),
+            [&node](const RuleConstraint& constraint) { return constraint.Field == node.Field; });
+        if (it == constraints.end())
+        {
+            constraints.push_back({ node.Field, low, high });
+        }
+        else
+        {
+            it->Low = std::max(it->Low, low);
+            it->High = std::min(it->High, high);
+        }
+    };
+
+    Rule rule;
+    rule.ID = ruleID;
+    rule.Priority = priority;
+    rule.Entry = compile(compile, root, Match, NoMatch);
+    addConstraints(addConstraints, root, false);
+    rule.Constraints = std::move(constraints);
+
+    // Keep rules in priority order, after any rule with the same priority
+    auto position = std::upper_bound(Rules.begin(), Rules.end(), priority,
+        [](int value, const Rule& other) { return value < other.Priority; });
+    Rules.insert(position, std::move(rule));
+    Indexed = false;
+    return true;
+}
+
+
+/**
+* @fn BuildIndex
+*
+* For every field some rule constrains, splits its values into ranges at each constraint edge
+* and records which rules each range leaves possible. Evaluate then looks up the range of
+* every indexed field, ands their bitsets and only walks the rules left, in priority order.
+*/
+void ItemColorRuleProgram::BuildIndex()
+{
+    FieldIndexes.clear();
+    IndexWords = (Rules.size() + 63) / 64;
+    Indexed = false;
+
+    if (Rules.empty() || Rules.size() > MaxIndexedRules)
+    {
+        return;
+    }
+
+    for (size_t field = 0; field < static_cast<size_t>(ItemColorRuleField::Count); ++field)
+    {
+        FieldIndex index;
+        index.Field = static_cast<ItemColorRuleField>(field);
+
+        for (const Rule& rule : Rules)
+        {
+            for (const RuleConstraint& constraint : rule.Constraints)
+            {
+                if (constraint.Field == index.Field)
+                {
+                    index.Bounds.push_back(constraint.Low);
+                    index.Bounds.push_back(constraint.High + 1);
+                }
+            }
+        }
+
+        if (index.Bounds.empty())
+        {
+            continue;
+        }
+
+        std::sort(index.Bounds.begin(), index.Bounds.end());
+        index.Bounds.erase(std::unique(index.Bounds.begin(), index.Bounds.end()), index.Bounds.end());
+        index.Candidates.assign((index.Bounds.size() + 1) * IndexWords, 0);
+
+        for (size_t range = 0; range <= index.Bounds.size(); ++range)
+        {
+            // Every value in a range passes or fails a constraint the same way, so one value stands for it
+            int64_t value = (range == 0) ? index.Bounds[0] - 1 : index.Bounds[range - 1];
+            uint64_t* pCandidates = &index.Candidates[range * IndexWords];
+
+            for (size_t ruleIndex = 0; ruleIndex < Rules.size(); ++ruleIndex)
+            {
+                bool possible = true;
+                for (const RuleConstraint& constraint : Rules[ruleIndex].Constraints)
+                {
+                    if ((constraint.Field == index.Field) && ((value < constraint.Low) || (value > constraint.High)))
+                    {
+                        possible = false;
+                    }
+                }
+
+                if (possible)
+                {
+                    pCandidates[ruleIndex / 64] |= uint64_t(1) << (ruleIndex % 64);
+                }
+            }
+        }
+
+        FieldIndexes.push_back(std::move(index));
+    }
+
+    // No rule has a range to narrow by, every rule is tried
+    // Evaluate would otherwise start from every bit of the last word set, past the last rule
+    Indexed = !FieldIndexes.empty();
+}
+
+
+void ItemColorRuleProgram::Clear()
+{
+    Tests.clear();
+    Rules.clear();
+    FieldIndexes.clear();
+    IndexWords = 0;
+    Indexed = false;
+    InstanceFields = false;
+}
+
+
+/**
+* @fn RuleMatches
+*
+* Walks the tests of one rule
+*
+* @param rule const Rule& - Rule to check
+* @param fields const ItemColorRuleFields& - Values of the item being colored
+* @return bool - True if the rule matches
+*/
+bool ItemColorRuleProgram::RuleMatches(const Rule& rule, const ItemColorRuleFields& fields) const
+{
+    int32_t next = rule.Entry;
+    while (next >= 0)
+    {
+        const ItemColorRuleTest& test = Tests[next];
+        int32_t value = fields[static_cast<size_t>(test.Field)];
+
+        bool result = false;
+        switch (test.Op)
+        {
+        case ItemColorRuleOp::Equal: result = value == test.Value; break;
+        case ItemColorRuleOp::NotEqual: result = value != test.Value; break;
+        case ItemColorRuleOp::Less: result = value < test.Value; break;
+        case ItemColorRuleOp::LessEqual: result = value <= test.Value; break;
+        case ItemColorRuleOp::Greater: result = value > test.Value; break;
+        case ItemColorRuleOp::GreaterEqual: result = value >= test.Value; break;
+        case ItemColorRuleOp::AnyOf: result = (value & test.Value) != 0; break;
+        case ItemColorRuleOp::NoneOf: result = (value & test.Value) == 0; break;
+        }
+
+        next = result ? test.OnTrue : test.OnFalse;
+    }
+
+    return next == Match;
+}
+
+
+/**
+* @fn Evaluate
+*
+* @param fields const ItemColorRuleFields& - Values of the item being colored
+* @return int - ID of the first rule in priority order that matches, -1 if none
+*/
+int ItemColorRuleProgram::Evaluate(const ItemColorRuleFields& fields) const
+{
+    if (!Indexed)
+    {
+        for (const Rule& rule : Rules)
+        {
+            if (RuleMatches(rule, fields))
+            {
+                return rule.ID;
+            }
+        }
+
+        return -1;
+    }
+
+    // Bitset row of each indexed field for this item's value
+    const uint64_t* rows[static_cast<size_t>(ItemColorRuleField::Count)];
+    size_t rowCount = 0;
+    for (const FieldIndex& index : FieldIndexes)
+    {
+        int64_t value = fields[static_cast<size_t>(index.Field)];
+        size_t range = std::upper_bound(index.Bounds.begin(), index.Bounds.end(), value) - index.Bounds.begin();
+        rows[rowCount++] = &index.Candidates[range * IndexWords];
+    }
+
+    for (size_t word = 0; word < IndexWords; ++word)
+    {
+        uint64_t candidates = ~uint64_t(0);
+        for (size_t row = 0; row < rowCount; ++row)
+        {
+            candidates &= rows[row][word];
+        }
+
+        while (candidates)
+        {
+            size_t ruleIndex = word * 64 + std::countr_zero(candidates);
+            candidates &= candidates - 1;
+
+            if (RuleMatches(Rules[ruleIndex], fields))
+            {
+                return Rules[ruleIndex].ID;
+            }
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+* @fn EvaluateItemColorRules
+*
+* @param pProgram const ItemColorRuleProgram* - Compiled rules, may be null
+* @param itemInfo const ItemColorDefinitionInfo& - Definition of the item
+* @param attributeMask uint32_t - Attribute bits of the item
+* @return int - ID of the first rule that matches, -1 if none
+*/
+int EvaluateItemColorRules(const ItemColorRuleProgram* pProgram, const ItemColorDefinitionInfo& itemInfo, uint32_t attributeMask)
+{
+    if (!pProgram || (pProgram->GetRuleCount() == 0))
+    {
+        return -1;
+    }
+
+    ItemColorRuleFields fields;
+    GetItemColorRuleFields(itemInfo, attributeMask, fields);
+    return pProgram->Evaluate(fields);
+}
+
+
+/**
+* @fn BenchmarkItemColorRules
+*
+* @param items const std::vector<ItemColorDefinitionInfo>& - Items to classify
+* @param program const ItemColorRuleProgram& - Rules to time
+* @param settings const ItemColorClassifierSettings& - Settings for the built in chain
+* @param passes int - Times to go over every item
+* @return ItemColorRuleBenchmarkResult - Nanoseconds per item for each, and how many items a rule matched in one pass
+*/
+ItemColorRuleBenchmarkResult BenchmarkItemColorRules(const std::vector<ItemColorDefinitionInfo>& items,
+    const ItemColorRuleProgram& program, const ItemColorClassifierSettings& settings, int passes)
+{
+    ItemColorRuleBenchmarkResult result;
+    if (items.empty() || passes <= 0)
+    {
+        return result;
+    }
+
+    // Keeps the compiler from dropping the work
+    volatile uint32_t sink = 0;
+    double classified = static_cast<double>(items.size()) * passes;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (const ItemColorDefinitionInfo& itemInfo : items)
+        {
+            uint32_t attributeMask = GetItemDefinitionMask(itemInfo, settings);
+            sink = sink + static_cast<uint32_t>(ResolveItemColorAttribute(attributeMask, settings.EnabledAttributeMask));
+        }
+    }
+    result.ChainNanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / classified;
+
+    ItemColorRuleFields fields;
+    start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        int matches = 0;
+        for (const ItemColorDefinitionInfo& itemInfo : items)
+        {
+            uint32_t attributeMask = GetItemDefinitionMask(itemInfo, settings);
+            GetItemColorRuleFields(itemInfo, attributeMask, fields);
+            int rule = program.Evaluate(fields);
+            sink = sink + static_cast<uint32_t>(ResolveItemColorAttribute(attributeMask, settings.EnabledAttributeMask));
+            matches += (rule >= 0) ? 1 : 0;
+        }
+        result.Matches = matches;
+    }
+    result.RulesNanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / classified;
+
+    return result;
+}
+
+
+/**
+* @fn MakeItemColorBenchmarkRule
+*
+* @param n int - Number of the rule
+* @return std::string - Rule shaped like a real one, a level and type range the index can use and an or it can not, that no item matches
+*/
+std::string MakeItemColorBenchmarkRule(int n)
+{
+    return "ReqLevel >= " + std::to_string(n % 130) + " and ItemType = " + std::to_string(n % 60) +
+        " and (Cost = " + std::to_string(-1 - n) + " or Weight < 0)";
+}
+
+
+/**
+* @fn LoadItemColorRules
+*
+* @param ini const ItemColorIniFile& - Settings read from the ini
+* @param section std::string_view - Section holding the rules
+* @param maxRules int - Most rules read
+* @param defaultNormalARGB uint32_t - Normal color of a rule without a valid RuleNNormal
+* @param defaultRolloverARGB uint32_t - Rollover color of a rule without a valid RuleNRollover
+* @param ruleSet ItemColorRuleSet& - Receives the rules that compiled and their program
+* @param errors std::vector<std::string>& - Receives a message for each invalid rule or color
+*/
+void LoadItemColorRules(const ItemColorIniFile& ini, std::string_view section, int maxRules,
+    uint32_t defaultNormalARGB, uint32_t defaultRolloverARGB, ItemColorRuleSet& ruleSet, std::vector<std::string>& errors)
+{
+    ruleSet.Rules.clear();
+    ruleSet.Program.Clear();
+
+    for (int ruleNumber = 1; ruleNumber <= maxRules; ++ruleNumber)
+    {
+        std::string ruleKey = "Rule" + std::to_string(ruleNumber);
+        std::string expression = ini.GetString(section, ruleKey, "");
+        if (expression.empty())
+        {
+            break;
+        }
+
+        ItemColorRule rule;
+        rule.Expression = expression;
+        rule.Priority = ini.GetInt(section, ruleKey + "Priority", ruleNumber);
+
+        if (ParseItemColorValue(ini.GetString(section, ruleKey + "Normal", ""), defaultNormalARGB, rule.NormalARGB) == ItemColorValueResult::Invalid)
+        {
+            errors.push_back("Invalid Normal Color in INI for " + ruleKey);
+        }
+
+        if (ParseItemColorValue(ini.GetString(section, ruleKey + "Rollover", ""), defaultRolloverARGB, rule.RolloverARGB) == ItemColorValueResult::Invalid)
+        {
+            errors.push_back("Invalid Rollover Color in INI for " + ruleKey);
+        }
+
+        std::string error;
+        if (!ruleSet.Program.AddRule(static_cast<int>(ruleSet.Rules.size()), expression, rule.Priority, error))
+        {
+            errors.push_back("Invalid " + ruleKey + " in INI: " + expression + " (" + error + ")");
+            continue;
+        }
+
+        ruleSet.Rules.push_back(std::move(rule));
+    }
+
+    ruleSet.Program.BuildIndex();
+}
+
+
+/**
+* @fn LoadItemColorSocketColors
+*
+* @param ini const ItemColorIniFile& - Settings read from the ini
+* @param section std::string_view - Section holding the socket colors
+* @param maxColors int - Most socket colors read
+* @param defaultNormalARGB uint32_t - Normal color of a socket color without a valid SocketNNormal
+* @param defaultRolloverARGB uint32_t - Rollover color of a socket color without a valid SocketNRollover
+* @param ruleSet ItemColorRuleSet& - Rules loaded so far, receives a rule for each socket color
+* @param errors std::vector<std::string>& - Receives a message for each invalid socket list or color
+*/
+void LoadItemColorSocketColors(const ItemColorIniFile& ini, std::string_view section, int maxColors,
+    uint32_t defaultNormalARGB, uint32_t defaultRolloverARGB, ItemColorRuleSet& ruleSet, std::vector<std::string>& errors)
+{
+    for (int socketNumber = 1; socketNumber <= maxColors; ++socketNumber)
+    {
+        std::string socketKey = "Socket" + std::to_string(socketNumber);
+        std::string socketTypes = ini.GetString(section, socketKey, "");
+        if (socketTypes.empty())
+        {
+            break;
+        }
+
+        // Same priority for all, so they keep their order and come after every rule
+        ItemColorRule rule;
+        rule.Expression = "Socket(" + socketTypes + ")";
+        rule.Priority = std::numeric_limits<int>::max();
+
+        if (ParseItemColorValue(ini.GetString(section, socketKey + "Normal", ""), defaultNormalARGB, rule.NormalARGB) == ItemColorValueResult::Invalid)
+        {
+            errors.push_back("Invalid Normal Color in INI for " + socketKey);
+        }
+
+        if (ParseItemColorValue(ini.GetString(section, socketKey + "Rollover", ""), defaultRolloverARGB, rule.RolloverARGB) == ItemColorValueResult::Invalid)
+        {
+            errors.push_back("Invalid Rollover Color in INI for " + socketKey);
+        }
+
+        std::string error;
+        if (!ruleSet.Program.AddRule(static_cast<int>(ruleSet.Rules.size()), rule.Expression, rule.Priority, error))
+        {
+            errors.push_back("Invalid " + socketKey + " in INI: " + rule.Expression + " (" + error + ")");
+            continue;
+        }
+
+        ruleSet.Rules.push_back(std::move(rule));
+    }
+
+    ruleSet.Program.BuildIndex();
+}
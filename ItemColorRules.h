@@ -0,0 +1,196 @@
+/**
+* ItemColorRules.h
+*
+* User defined coloring rules such as "ReqLevel > 100 and NoDrop".
+* Each rule is parsed once and compiled into a flat list of tests joined by jumps,
+* so coloring a slot only walks the tests and never looks at the rule text again.
+*
+*/
+
+#pragma once
+
+#include "ItemColorCore.h"
+#include "ItemColorIni.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Item values a rule can test
+// Flag fields are 0 or 1 and come from the attribute mask, the rest come from the item definition
+// Sockets is the item's socket bitset and is only tested by Socket(...), see GetItemColorSocketBit
+enum class ItemColorRuleField : uint8_t
+{
+    ID,
+    ReqLevel,
+    RecLevel,
+    ItemType,
+    ItemClass,
+    Size,
+    Weight,
+    Cost,
+    StackSize,
+    Lore,
+    Magic,
+    Sockets,
+    Quest,
+    TradeSkills,
+    Collectible,
+    Heirloom,
+    NoDrop,
+    Attuneable,
+    AugSlot8,
+    PowerSource,
+    Placeable,
+    Ornamentation,
+    Count
+};
+
+// Values of every ItemColorRuleField for one item, indexed by the field
+using ItemColorRuleFields = std::array<int32_t, static_cast<size_t>(ItemColorRuleField::Count)>;
+
+// Fills the rule fields for an item from its definition and its attribute mask (definition and instance bits)
+void GetItemColorRuleFields(const ItemColorDefinitionInfo& itemInfo, uint32_t attributeMask, ItemColorRuleFields& fields);
+
+// Comparison done by a test
+enum class ItemColorRuleOp : uint8_t
+{
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    // Any or none of the bits in Value are set
+    AnyOf,
+    NoneOf,
+};
+
+// One compiled test, jumps to OnTrue or OnFalse next
+// A negative jump ends the rule, see ItemColorRuleProgram::Match and NoMatch
+struct ItemColorRuleTest
+{
+    ItemColorRuleField Field = ItemColorRuleField::ID;
+    ItemColorRuleOp Op = ItemColorRuleOp::NotEqual;
+    int32_t Value = 0;
+    int32_t OnTrue = 0;
+    int32_t OnFalse = 0;
+};
+
+// Every rule compiled into one flat program, rules are tried in priority order and the first match wins
+// After the last AddRule, BuildIndex narrows each item down to the rules that can match before any are walked
+class ItemColorRuleProgram
+{
+public:
+    static constexpr int32_t Match = -1;
+    static constexpr int32_t NoMatch = -2;
+
+    // Parses and compiles a rule, ruleID is what Evaluate returns when it matches
+    // Lower priority values are tried first, ties go to the rule added first
+    // Returns false and sets error if the expression could not be parsed
+    bool AddRule(int ruleID, std::string_view expression, int priority, std::string& error);
+
+    // Builds the per field index of candidate rules, until then Evaluate tries every rule
+    void BuildIndex();
+
+    void Clear();
+
+    size_t GetRuleCount() const { return Rules.size(); }
+    size_t GetTestCount() const { return Tests.size(); }
+
+    // True if any rule tests NoDrop, which can change with the item's NoDropFlag and not only its definition
+    bool UsesInstanceFields() const { return InstanceFields; }
+
+    // Returns the ID of the first rule that matches, or -1 if none do
+    int Evaluate(const ItemColorRuleFields& fields) const;
+
+    // Most rules the index covers, more than this and every rule is tried
+    static constexpr size_t MaxIndexedRules = 4096;
+
+private:
+    // Range a field must be in for a rule to match, from the tests and-ed at the top of the rule
+    struct RuleConstraint
+    {
+        ItemColorRuleField Field = ItemColorRuleField::ID;
+        int64_t Low = 0;
+        int64_t High = 0;
+    };
+
+    struct Rule
+    {
+        int ID = 0;
+        int Priority = 0;
+        int32_t Entry = 0;
+        std::vector<RuleConstraint> Constraints;
+    };
+
+    // Splits the values of a field at every constraint edge, each range has a bitset of rules it does not rule out
+    struct FieldIndex
+    {
+        ItemColorRuleField Field = ItemColorRuleField::ID;
+        // Range k holds values from Bounds[k - 1] up to but not including Bounds[k]
+        std::vector<int64_t> Bounds;
+        // (Bounds.size() + 1) bitsets of IndexWords words, bit n is Rules[n]
+        std::vector<uint64_t> Candidates;
+    };
+
+    bool RuleMatches(const Rule& rule, const ItemColorRuleFields& fields) const;
+
+    std::vector<ItemColorRuleTest> Tests;
+    std::vector<Rule> Rules;
+    std::vector<FieldIndex> FieldIndexes;
+    size_t IndexWords = 0;
+    bool Indexed = false;
+    bool InstanceFields = false;
+};
+
+// ID of the first rule in pProgram an item matches, -1 if none or pProgram is null
+// The rule fields are only filled when there is a rule to test them
+int EvaluateItemColorRules(const ItemColorRuleProgram* pProgram, const ItemColorDefinitionInfo& itemInfo, uint32_t attributeMask);
+
+// A rule from the [Rules] section of the ini and its colors
+struct ItemColorRule
+{
+    std::string Expression;
+    int Priority = 0;
+    uint32_t NormalARGB = 0;
+    uint32_t RolloverARGB = 0;
+
+    bool operator==(const ItemColorRule&) const = default;
+};
+
+// Every rule and socket color loaded from the ini and the program they compile to, a rule's ID in Program is its index in Rules
+struct ItemColorRuleSet
+{
+    std::vector<ItemColorRule> Rules;
+    ItemColorRuleProgram Program;
+};
+
+// Loads Rule1, Rule2, ... from section until one is missing or maxRules, compiles them and builds the index
+// Each rule can have RuleNNormal and RuleNRollover colors and a RuleNPriority (lower is checked first, defaults to N)
+// Does not report anything itself so it can run off the game thread, problems are added to errors
+void LoadItemColorRules(const ItemColorIniFile& ini, std::string_view section, int maxRules,
+    uint32_t defaultNormalARGB, uint32_t defaultRolloverARGB, ItemColorRuleSet& ruleSet, std::vector<std::string>& errors);
+
+// Loads Socket1, Socket2, ... from section until one is missing or maxColors, each a list of aug socket types such as "8" or "20, 21"
+// and SocketNNormal and SocketNRollover colors. Each is added to ruleSet as a Socket(...) rule checked after every rule already there,
+// in the order they are listed, then the index is built again. Problems are added to errors.
+void LoadItemColorSocketColors(const ItemColorIniFile& ini, std::string_view section, int maxColors,
+    uint32_t defaultNormalARGB, uint32_t defaultRolloverARGB, ItemColorRuleSet& ruleSet, std::vector<std::string>& errors);
+
+// Average cost per item of the built in attribute chain and of the chain plus a rule program
+struct ItemColorRuleBenchmarkResult
+{
+    double ChainNanoseconds = 0;
+    double RulesNanoseconds = 0;
+    int Matches = 0;
+};
+
+// Classifies every item passes times with and without the rule program, used by /itemcolor bench
+ItemColorRuleBenchmarkResult BenchmarkItemColorRules(const std::vector<ItemColorDefinitionInfo>& items,
+    const ItemColorRuleProgram& program, const ItemColorClassifierSettings& settings, int passes);
+
+// Rule that never matches but is shaped like a real one, n makes each one different, used to time many rules
+std::string MakeItemColorBenchmarkRule(int n);
@@ -0,0 +1,84 @@
+/**
+* ItemColorScanner.cpp
+*
+* The parts of coloring a slot that do not depend on the slot adapter: looking definitions up in the caches
+* and classifying the ones they miss.
+*
+*/
+
+#include "ItemColorScanner.h"
+
+
+const ItemColorSlotWndShadow* ItemColorScanner::FindShadow(const void* pWindow) const
+{
+    auto it = Shadows.find(pWindow);
+    return (it != Shadows.end()) ? &it->second : nullptr;
+}
+
+
+/**
+* @fn ItemColorScanner::FindDefinition
+*
+* @param itemID int - Item definition ID
+* @param settings const ItemColorSettingsSnapshot& - Settings to resolve the attribute of a stored definition with
+* @param uncached ItemClassificationCache::Entry& - Holds the entry when the classification cache is turned off
+* @return const ItemClassificationCache::Entry* - Classification of the definition, nullptr if neither cache has it
+*/
+const ItemClassificationCache::Entry* ItemColorScanner::FindDefinition(int itemID, const ItemColorSettingsSnapshot& settings,
+    ItemClassificationCache::Entry& uncached)
+{
+    if (const ItemClassificationCache::Entry* pEntry = Cache.Find(itemID))
+    {
+        return pEntry;
+    }
+
+    const ItemColorPersistentCacheEntry* pStored = pPersistentCache ? pPersistentCache->Find(itemID) : nullptr;
+    if (pStored == nullptr)
+    {
+        return nullptr;
+    }
+
+    return CacheDefinition(itemID, pStored->DefinitionMask, pStored->Rule, settings, uncached);
+}
+
+
+/**
+* @fn ItemColorScanner::AddDefinition
+*
+* @param itemInfo const ItemColorDefinitionInfo& - Definition neither cache has
+* @param settings const ItemColorSettingsSnapshot& - Settings to classify with
+* @param uncached ItemClassificationCache::Entry& - Holds the entry when the classification cache is turned off
+* @return const ItemClassificationCache::Entry* - Classification of the definition
+*/
+const ItemClassificationCache::Entry* ItemColorScanner::AddDefinition(const ItemColorDefinitionInfo& itemInfo,
+    const ItemColorSettingsSnapshot& settings, ItemClassificationCache::Entry& uncached)
+{
+    const ItemColorRuleProgram* pProgram = settings.Rules ? &settings.Rules->Program : nullptr;
+    uint32_t definitionMask = GetItemDefinitionMask(itemInfo, settings.Classifier);
+    int definitionRule = EvaluateItemColorRules(pProgram, itemInfo, definitionMask);
+
+    if (pPersistentCache)
+    {
+        pPersistentCache->Insert(itemInfo.ItemID, definitionMask, itemInfo.SocketTypes, definitionRule);
+    }
+
+    return CacheDefinition(itemInfo.ItemID, definitionMask, definitionRule, settings, uncached);
+}
+
+
+const ItemClassificationCache::Entry* ItemColorScanner::CacheDefinition(int itemID, uint32_t definitionMask, int definitionRule,
+    const ItemColorSettingsSnapshot& settings, ItemClassificationCache::Entry& uncached)
+{
+    ItemColorAttribute definitionAttr = ResolveItemColorAttribute(definitionMask, settings.Classifier.EnabledAttributeMask);
+    if (const ItemClassificationCache::Entry* pEntry = Cache.Insert(itemID, definitionMask, definitionAttr, definitionRule))
+    {
+        return pEntry;
+    }
+
+    // Cache is turned off
+    uncached.ItemID = itemID;
+    uncached.AttributeMask = definitionMask;
+    uncached.Attribute = definitionAttr;
+    uncached.Rule = definitionRule;
+    return &uncached;
+}
@@ -0,0 +1,288 @@
+/**
+* ItemColorScanner.h
+*
+* Coloring one slot, the same steps for the plugin, the replay tool and the unit tests: filter, slot memo,
+* classification through the classification cache and the persistent cache, palette index, and window writes
+* skipped when the window already shows them.
+* Slots, items and windows are reached through an adapter, so the same code colors the game's slot array,
+* the slots of a capture or a mock inventory.
+*
+*/
+
+#pragma once
+
+#include "ItemColorCore.h"
+#include "ItemColorPersistentCache.h"
+#include "ItemColorRules.h"
+#include "ItemColorSettings.h"
+
+#include <unordered_map>
+#include <vector>
+
+// Hooks of a slot adapter that most adapters leave alone, an adapter derives from this and hides the ones it needs
+//
+// Every adapter also has:
+//   using Window = ...;   Slot window, the scanner only keeps its address
+//   using Item = ...;     What GetItem returns, see below
+//   Window* GetColorableWindow(int index);   Window of the slot, nullptr if IsColorableSlot says it is not colored
+//   Item GetItem(int index, Window* pWindow);
+//   ItemColorSlotIdentity GetIdentity(int index, Window* pWindow, const Item& item);
+//   void ReadWindow(const Window* pWindow, ItemColorSlotWndShadow& shadow);   What the window shows before the first write
+//   void WriteTint(Window* pWindow, uint32_t normalARGB, uint32_t rolloverARGB);
+//   const void* GetBackground(const Window* pWindow, bool glow);   Texture the window should show, nullptr to leave it
+//   void WriteBackground(Window* pWindow, const void* pTexture);
+//
+// And an Item has:
+//   int GetDefinitionID() const;   0 for an empty slot or an item without a definition
+//   bool GetNoDropFlag() const;
+//   GetDefinitionInfo() const;     ItemColorDefinitionInfo, only read when the caches miss or rules test NoDrop
+class ItemColorSlotSource
+{
+public:
+    // True to leave the slot to the classify workers, its memo is left alone so it is still seen as changed
+    template <typename Item>
+    bool DeferClassify(int /*index*/, const ItemColorSlotIdentity& /*identity*/, const Item& /*item*/) { return false; }
+
+    // The slot was just classified into memo
+    template <typename Item>
+    void SlotClassified(int /*index*/, const Item& /*item*/, const ItemColorSlotMemo& /*memo*/) {}
+
+    // The slot is no longer colored, its memo was cleared
+    void SlotForgotten(int /*index*/) {}
+
+    // Palette index to color a slot with, given the one its classification picks
+    uint32_t GetPaletteIndex(int /*index*/, uint32_t paletteIndex) { return paletteIndex; }
+};
+
+// Item read from a copy of its definition, for records and tests
+struct ItemColorDefinitionItem
+{
+    // Null for an empty slot
+    const ItemColorDefinitionInfo* pInfo = nullptr;
+    bool NoDropFlag = false;
+
+    int GetDefinitionID() const { return pInfo ? pInfo->ItemID : 0; }
+    bool GetNoDropFlag() const { return NoDropFlag; }
+    const ItemColorDefinitionInfo& GetDefinitionInfo() const { return *pInfo; }
+};
+
+// Slot memos, window shadows and the classification cache of one slot array, and the steps that color its slots
+class ItemColorScanner
+{
+public:
+    // Classification of item definitions, shared by every slot
+    ItemClassificationCache& GetCache() { return Cache; }
+    const ItemClassificationCache& GetCache() const { return Cache; }
+
+    // Checked when the classification cache misses and given every definition classified, nullptr for none
+    void SetPersistentCache(ItemColorPersistentCache* pCache) { pPersistentCache = pCache; }
+
+    // Memo of each slot, indexed the same as the slot array and sized by the caller
+    std::vector<ItemColorSlotMemo>& GetMemos() { return Memos; }
+    const std::vector<ItemColorSlotMemo>& GetMemos() const { return Memos; }
+
+    // What was last written to a window, nullptr if it never was
+    const ItemColorSlotWndShadow* FindShadow(const void* pWindow) const;
+
+    // Forgets what was written to every window, for when they are put back or destroyed
+    void ForgetWindows() { Shadows.clear(); }
+
+    // Colors the slot at index unless it holds what its memo says, setDefault puts back the original colors instead
+    template <typename SlotSource>
+    void ColorSlot(SlotSource& slots, int index, const ItemColorSettingsSnapshot& settings, uint32_t settingsVersion,
+        ItemColorStats& stats, bool setDefault = false);
+
+    // Classifies an item into a memo through the caches, the item must have a definition
+    template <typename Item>
+    void ClassifyItem(const Item& item, const ItemColorSettingsSnapshot& settings, ItemColorSlotMemo& memo);
+
+    // Writes the colors and texture of a palette index to a window, nothing is written that the window already shows
+    template <typename SlotSource>
+    void SetItemBG(SlotSource& slots, typename SlotSource::Window* pWindow, const ItemColorSettingsSnapshot& settings,
+        uint32_t paletteIndex, ItemColorStats& stats);
+
+private:
+    // Classification of a definition from the classification cache, or the persistent cache if it has it
+    // Returns nullptr if neither does, uncached holds the entry if the classification cache is turned off
+    const ItemClassificationCache::Entry* FindDefinition(int itemID, const ItemColorSettingsSnapshot& settings,
+        ItemClassificationCache::Entry& uncached);
+
+    // Classifies a definition neither cache has and adds it to both
+    const ItemClassificationCache::Entry* AddDefinition(const ItemColorDefinitionInfo& itemInfo, const ItemColorSettingsSnapshot& settings,
+        ItemClassificationCache::Entry& uncached);
+
+    const ItemClassificationCache::Entry* CacheDefinition(int itemID, uint32_t definitionMask, int definitionRule,
+        const ItemColorSettingsSnapshot& settings, ItemClassificationCache::Entry& uncached);
+
+    // Adds the item's own state to a memo holding the classification of its definition
+    template <typename Item>
+    void AddInstanceState(const Item& item, const ItemColorSettingsSnapshot& settings, ItemColorSlotMemo& memo);
+
+    ItemClassificationCache Cache;
+    ItemColorPersistentCache* pPersistentCache = nullptr;
+    std::vector<ItemColorSlotMemo> Memos;
+    std::unordered_map<const void*, ItemColorSlotWndShadow> Shadows;
+};
+
+
+template <typename SlotSource>
+void ItemColorScanner::ColorSlot(SlotSource& slots, int index, const ItemColorSettingsSnapshot& settings, uint32_t settingsVersion,
+    ItemColorStats& stats, bool setDefault)
+{
+    if (index < 0 || index >= static_cast<int>(Memos.size()))
+    {
+        return;
+    }
+
+    ItemColorSlotMemo& memo = Memos[index];
+    memo.Pending = false;
+    ++stats.Current.SlotsVisited;
+
+    typename SlotSource::Window* pWindow = nullptr;
+    {
+        ItemColorTimingScope timeFilter(stats.Time(ItemColorPhase::Filter));
+        pWindow = slots.GetColorableWindow(index);
+    }
+
+    if (!pWindow)
+    {
+        ++stats.Current.SlotsNotColorable;
+
+        // Forget slots that are no longer ours so they are not repainted from a stale memo
+        if (memo.IsSet())
+        {
+            memo = ItemColorSlotMemo();
+            slots.SlotForgotten(index);
+        }
+        return;
+    }
+
+    if (setDefault)
+    {
+        SetItemBG(slots, pWindow, settings, 0, stats);
+        return;
+    }
+
+    typename SlotSource::Item item;
+    {
+        ItemColorTimingScope timeLookup(stats.Time(ItemColorPhase::Lookup));
+        item = slots.GetItem(index, pWindow);
+    }
+
+    ItemColorSlotIdentity identity = slots.GetIdentity(index, pWindow, item);
+    if (slots.DeferClassify(index, identity, item))
+    {
+        return;
+    }
+
+    // Skip if this slot was already colored for the same item
+    if (memo.CheckCurrent(identity, settingsVersion))
+    {
+        ++stats.Current.SlotsUnchanged;
+        return;
+    }
+    ++stats.Current.SlotsReclassified;
+
+    // An empty slot, or an item without a definition, is colored Default
+    {
+        ItemColorTimingScope timeClassify(stats.Time(ItemColorPhase::Classify));
+        memo.AttributeMask = 0;
+        memo.Attribute = ItemColorAttribute::Default;
+        memo.Rule = -1;
+
+        if (item.GetDefinitionID() != 0)
+        {
+            ClassifyItem(item, settings, memo);
+        }
+    }
+
+    slots.SlotClassified(index, item, memo);
+    SetItemBG(slots, pWindow, settings, slots.GetPaletteIndex(index, settings.GetSlotPaletteIndex(memo)), stats);
+}
+
+
+template <typename Item>
+void ItemColorScanner::ClassifyItem(const Item& item, const ItemColorSettingsSnapshot& settings, ItemColorSlotMemo& memo)
+{
+    ItemClassificationCache::Entry uncached;
+    const ItemClassificationCache::Entry* pEntry = FindDefinition(item.GetDefinitionID(), settings, uncached);
+    if (!pEntry)
+    {
+        pEntry = AddDefinition(item.GetDefinitionInfo(), settings, uncached);
+    }
+
+    memo.AttributeMask = pEntry->AttributeMask;
+    memo.Attribute = pEntry->Attribute;
+    memo.Rule = pEntry->Rule;
+    AddInstanceState(item, settings, memo);
+}
+
+
+template <typename Item>
+void ItemColorScanner::AddInstanceState(const Item& item, const ItemColorSettingsSnapshot& settings, ItemColorSlotMemo& memo)
+{
+    // Per item state can only add bits, only resolve again if it does
+    uint32_t instanceMask = GetItemInstanceMask(item.GetNoDropFlag(), settings.Classifier);
+    if (instanceMask == 0)
+    {
+        return;
+    }
+
+    memo.AttributeMask |= instanceMask;
+    memo.Attribute = ResolveItemColorAttribute(memo.AttributeMask, settings.Classifier.EnabledAttributeMask);
+
+    const ItemColorRuleProgram* pProgram = settings.Rules ? &settings.Rules->Program : nullptr;
+    if (pProgram && pProgram->UsesInstanceFields())
+    {
+        memo.Rule = EvaluateItemColorRules(pProgram, item.GetDefinitionInfo(), memo.AttributeMask);
+    }
+}
+
+
+template <typename SlotSource>
+void ItemColorScanner::SetItemBG(SlotSource& slots, typename SlotSource::Window* pWindow, const ItemColorSettingsSnapshot& settings,
+    uint32_t paletteIndex, ItemColorStats& stats)
+{
+    if (pWindow == nullptr)
+    {
+        return;
+    }
+
+    ItemColorTimingScope timeWrite(stats.Time(ItemColorPhase::Write));
+
+    // First time we touch a window, start the shadow from what it shows now
+    auto [it, inserted] = Shadows.try_emplace(pWindow);
+    ItemColorSlotWndShadow& shadow = it->second;
+    if (inserted)
+    {
+        slots.ReadWindow(pWindow, shadow);
+    }
+
+    const ItemColorPaletteEntry& paletteEntry = settings.GetPaletteEntry(paletteIndex);
+    if ((paletteEntry.NormalARGB != shadow.BGTintNormal) || (paletteEntry.RolloverARGB != shadow.BGTintRollover))
+    {
+        slots.WriteTint(pWindow, paletteEntry.NormalARGB, paletteEntry.RolloverARGB);
+        shadow.BGTintNormal = paletteEntry.NormalARGB;
+        shadow.BGTintRollover = paletteEntry.RolloverARGB;
+        ++stats.Current.WritesApplied;
+    }
+    else
+    {
+        ++stats.Current.WritesSkipped;
+    }
+
+    // Default slots always show the default texture, the rest the glow texture unless UseGlowTexture is off
+    const void* pTexture = slots.GetBackground(pWindow, (paletteIndex != 0) && settings.UseGlowTexture);
+    if ((pTexture != nullptr) && (pTexture != shadow.pBackground))
+    {
+        slots.WriteBackground(pWindow, pTexture);
+        shadow.pBackground = pTexture;
+        ++stats.Current.WritesApplied;
+    }
+    else
+    {
+        ++stats.Current.WritesSkipped;
+    }
+
+    shadow.PaletteIndex = paletteIndex;
+}
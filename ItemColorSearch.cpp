@@ -0,0 +1,405 @@
+/**
+* ItemColorSearch.cpp
+*
+* Parsing searches and keeping the slot index.
+*
+*/
+
+#include "ItemColorSearch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+
+namespace
+{
+    char ToLower(char c)
+    {
+        return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+
+    bool IsWordChar(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) != 0;
+    }
+
+    std::string ToLowerString(std::string_view text)
+    {
+        std::string lower(text);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ToLower);
+        return lower;
+    }
+
+    // Calls add for each run of letters and digits in text, lower case
+    template <typename AddFn>
+    void ForEachWord(std::string_view text, AddFn&& add)
+    {
+        size_t start = 0;
+        while (start < text.size())
+        {
+            while (start < text.size() && !IsWordChar(text[start]))
+            {
+                ++start;
+            }
+
+            size_t end = start;
+            while (end < text.size() && IsWordChar(text[end]))
+            {
+                ++end;
+            }
+
+            if (end > start)
+            {
+                add(ToLowerString(text.substr(start, end - start)));
+            }
+            start = end;
+        }
+    }
+
+    void InsertSlot(std::vector<int>& slots, int slot)
+    {
+        auto it = std::lower_bound(slots.begin(), slots.end(), slot);
+        if (it == slots.end() || *it != slot)
+        {
+            slots.insert(it, slot);
+        }
+    }
+
+    void EraseSlot(std::vector<int>& slots, int slot)
+    {
+        auto it = std::lower_bound(slots.begin(), slots.end(), slot);
+        if (it != slots.end() && *it == slot)
+        {
+            slots.erase(it);
+        }
+    }
+
+    // One bit per slot, candidates are narrowed down by and-ing these together
+    using SlotBits = std::vector<uint64_t>;
+
+    void SetBits(SlotBits& bits, const std::vector<int>& slots)
+    {
+        for (int slot : slots)
+        {
+            bits[slot / 64] |= uint64_t(1) << (slot % 64);
+        }
+    }
+
+    // Keeps only the candidates also in bits, the first list and-ed in becomes the candidates
+    void Intersect(SlotBits& candidates, bool& narrowed, const SlotBits& bits)
+    {
+        if (!narrowed)
+        {
+            candidates = bits;
+            narrowed = true;
+            return;
+        }
+
+        for (size_t word = 0; word < candidates.size(); ++word)
+        {
+            candidates[word] &= bits[word];
+        }
+    }
+}
+
+
+/**
+* @fn MatchesItemColorPattern
+*
+* @param pattern std::string_view - Pattern, * stands for any text
+* @param text std::string_view - Text to match, compared exactly so both are lower case for a search
+* @return bool - True if the whole of text matches pattern
+*/
+bool MatchesItemColorPattern(std::string_view pattern, std::string_view text)
+{
+    // Most searches are text anywhere in the name, a plain find is much quicker than matching stars
+    if (pattern.size() >= 2 && pattern.front() == '*' && pattern.back() == '*' &&
+        pattern.find('*', 1) == pattern.size() - 1)
+    {
+        return text.find(pattern.substr(1, pattern.size() - 2)) != std::string_view::npos;
+    }
+
+    size_t p = 0;
+    size_t t = 0;
+    size_t star = std::string_view::npos;
+    size_t starText = 0;
+
+    while (t < text.size())
+    {
+        if (p < pattern.size() && pattern[p] == '*')
+        {
+            star = p++;
+            starText = t;
+        }
+        else if (p < pattern.size() && pattern[p] == text[t])
+        {
+            ++p;
+            ++t;
+        }
+        else if (star != std::string_view::npos)
+        {
+            p = star + 1;
+            t = ++starText;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (p < pattern.size() && pattern[p] == '*')
+    {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+
+/**
+* @fn ParseItemColorSearch
+*
+* @param text std::string_view - Search as typed, see ItemColorSearchQuery
+* @return ItemColorSearchQuery - Terms of the search, empty if text has none
+*/
+ItemColorSearchQuery ParseItemColorSearch(std::string_view text)
+{
+    ItemColorSearchQuery query;
+
+    size_t position = 0;
+    while (position < text.size())
+    {
+        if (std::isspace(static_cast<unsigned char>(text[position])))
+        {
+            ++position;
+            continue;
+        }
+
+        // Quoted text is found anywhere in the name, spaces and all
+        if (text[position] == '"')
+        {
+            size_t close = text.find('"', position + 1);
+            std::string_view quoted = text.substr(position + 1, (close == std::string_view::npos) ? std::string_view::npos : close - position - 1);
+            position = (close == std::string_view::npos) ? text.size() : close + 1;
+
+            if (!quoted.empty())
+            {
+                std::string& pattern = query.Patterns.emplace_back(1, '*');
+                pattern += ToLowerString(quoted);
+                pattern += '*';
+            }
+            continue;
+        }
+
+        size_t end = position;
+        while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end])) && text[end] != '"')
+        {
+            ++end;
+        }
+        std::string_view term = text.substr(position, end - position);
+        position = end;
+
+        auto attribute = std::find_if(std::begin(ItemColorAttributes), std::end(ItemColorAttributes),
+            [term](const ItemColorAttributeInfo& info)
+            {
+                return std::equal(term.begin(), term.end(), info.Name.begin(), info.Name.end(),
+                    [](char x, char y) { return ToLower(x) == ToLower(y); });
+            });
+
+        if (attribute != std::end(ItemColorAttributes))
+        {
+            query.AttributeMask |= GetItemColorAttributeBit(attribute->Attribute);
+        }
+        else if (term.find('*') != std::string_view::npos)
+        {
+            query.Patterns.push_back(ToLowerString(term));
+        }
+        else
+        {
+            ForEachWord(term, [&query](std::string word) { query.Words.push_back(std::move(word)); });
+        }
+    }
+
+    return query;
+}
+
+
+/**
+* @fn ItemColorSearchIndex::SetSlot
+*
+* @param slot int - Index of the slot in the slot array
+* @param itemID int - Item definition ID, 0 for an empty slot
+* @param attributeMask uint32_t - Every attribute of the item, turned on or not
+* @param name std::string_view - Name of the item
+*/
+void ItemColorSearchIndex::SetSlot(int slot, int itemID, uint32_t attributeMask, std::string_view name)
+{
+    if (slot < 0)
+    {
+        return;
+    }
+
+    if (itemID == 0)
+    {
+        ClearSlot(slot);
+        return;
+    }
+
+    if (static_cast<size_t>(slot) < Slots.size() && Slots[slot].ItemID == itemID && Slots[slot].AttributeMask == attributeMask)
+    {
+        return;
+    }
+
+    ClearSlot(slot);
+    if (static_cast<size_t>(slot) >= Slots.size())
+    {
+        Slots.resize(slot + 1);
+    }
+
+    SlotEntry& entry = Slots[slot];
+    entry.ItemID = itemID;
+    entry.AttributeMask = attributeMask;
+    entry.Name = ToLowerString(name);
+    ++SlotCount;
+
+    for (size_t bit = 0; bit < AttributeSlots.size(); ++bit)
+    {
+        if (attributeMask & (1U << bit))
+        {
+            InsertSlot(AttributeSlots[bit], slot);
+        }
+    }
+
+    ForEachWord(entry.Name, [this, slot](std::string word) { InsertSlot(Words[std::move(word)], slot); });
+
+    ++Generation;
+}
+
+
+void ItemColorSearchIndex::ClearSlot(int slot)
+{
+    if (slot < 0 || static_cast<size_t>(slot) >= Slots.size() || Slots[slot].ItemID == 0)
+    {
+        return;
+    }
+
+    SlotEntry& entry = Slots[slot];
+    for (size_t bit = 0; bit < AttributeSlots.size(); ++bit)
+    {
+        if (entry.AttributeMask & (1U << bit))
+        {
+            EraseSlot(AttributeSlots[bit], slot);
+        }
+    }
+
+    ForEachWord(entry.Name, [this, slot](const std::string& word)
+        {
+            auto it = Words.find(word);
+            if (it != Words.end())
+            {
+                EraseSlot(it->second, slot);
+                if (it->second.empty())
+                {
+                    Words.erase(it);
+                }
+            }
+        });
+
+    entry = SlotEntry();
+    --SlotCount;
+    ++Generation;
+}
+
+
+void ItemColorSearchIndex::Clear()
+{
+    Slots.clear();
+    SlotCount = 0;
+    for (std::vector<int>& slots : AttributeSlots)
+    {
+        slots.clear();
+    }
+    Words.clear();
+    ++Generation;
+}
+
+
+/**
+* @fn ItemColorSearchIndex::Search
+*
+* Narrows down the slots with the attribute and word lists first, patterns are only checked
+* against the names of the slots left, found through the words that contain each piece of the pattern.
+*
+* @param query const ItemColorSearchQuery& - Terms to match, see ParseItemColorSearch
+* @param slots std::vector<int>& - Receives the matching slots
+*/
+void ItemColorSearchIndex::Search(const ItemColorSearchQuery& query, std::vector<int>& slots) const
+{
+    slots.clear();
+    if (query.IsEmpty())
+    {
+        return;
+    }
+
+    size_t bitWords = (Slots.size() + 63) / 64;
+    SlotBits candidates(bitWords, 0);
+    SlotBits bits(bitWords, 0);
+    bool narrowed = false;
+
+    for (size_t bit = 0; bit < AttributeSlots.size(); ++bit)
+    {
+        if (query.AttributeMask & (1U << bit))
+        {
+            std::fill(bits.begin(), bits.end(), 0);
+            SetBits(bits, AttributeSlots[bit]);
+            Intersect(candidates, narrowed, bits);
+        }
+    }
+
+    // Every word in the name starting with the search word
+    for (const std::string& word : query.Words)
+    {
+        std::fill(bits.begin(), bits.end(), 0);
+        for (auto it = Words.lower_bound(word); it != Words.end() && it->first.compare(0, word.size(), word) == 0; ++it)
+        {
+            SetBits(bits, it->second);
+        }
+        Intersect(candidates, narrowed, bits);
+    }
+
+    // Each run of letters and digits in a pattern is inside a word of every name that matches it
+    for (const std::string& pattern : query.Patterns)
+    {
+        ForEachWord(pattern, [&](const std::string& part)
+            {
+                std::fill(bits.begin(), bits.end(), 0);
+                for (const auto& [word, wordSlots] : Words)
+                {
+                    if (word.find(part) != std::string::npos)
+                    {
+                        SetBits(bits, wordSlots);
+                    }
+                }
+                Intersect(candidates, narrowed, bits);
+            });
+    }
+
+    for (size_t word = 0; word < bitWords; ++word)
+    {
+        for (uint64_t wordBits = narrowed ? candidates[word] : ~uint64_t(0); wordBits != 0; wordBits &= wordBits - 1)
+        {
+            size_t slot = word * 64 + std::countr_zero(wordBits);
+            if (slot >= Slots.size() || Slots[slot].ItemID == 0)
+            {
+                continue;
+            }
+
+            // Patterns are only checked against the slots the index left
+            const std::string& name = Slots[slot].Name;
+            if (std::all_of(query.Patterns.begin(), query.Patterns.end(),
+                [&name](const std::string& pattern) { return MatchesItemColorPattern(pattern, name); }))
+            {
+                slots.push_back(static_cast<int>(slot));
+            }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+/**
+* ItemColorSearch.h
+*
+* Finding colored slots by attribute and item name, for highlighting what matches.
+* The index follows each slot as it is classified, so a search only reads the index
+* and never walks the slot array.
+*
+*/
+
+#pragma once
+
+#include "ItemColorCore.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Colors of slots matching a search, [Search] in the ini, SearchOn turns the highlight on
+constexpr ItemColorAttributeInfo ItemColorSearchAttribute =
+    { ItemColorAttribute::Default, "Search", "SearchOn", "SearchNormal", "SearchRollover", -1, true, 0xFFFFFF00, 0xFFFFFFA0 };
+
+// A parsed search, a slot has to match every term. Not case sensitive
+//   Quest, TradeSkills, ...  - An attribute name, slots whose item has the attribute whether or not it is turned on
+//   word                     - Items with a word in their name starting with it
+//   *Spell:*                 - Items whose whole name matches, * stands for any text
+//   "black sapphire"         - Items with the quoted text anywhere in their name, also for names that look like an attribute
+struct ItemColorSearchQuery
+{
+    uint32_t AttributeMask = 0;
+    // Lower case, letters and digits only
+    std::vector<std::string> Words;
+    // Lower case, matched against the whole lower case name
+    std::vector<std::string> Patterns;
+
+    bool IsEmpty() const { return (AttributeMask == 0) && Words.empty() && Patterns.empty(); }
+};
+
+ItemColorSearchQuery ParseItemColorSearch(std::string_view text);
+
+// True if the whole of text matches pattern, * in pattern stands for any text
+bool MatchesItemColorPattern(std::string_view pattern, std::string_view text);
+
+// Attribute bits and name words of every slot holding an item, each mapped to the slots that have them
+class ItemColorSearchIndex
+{
+public:
+    // Indexes what a slot holds now, nothing changes if it is the same item with the same attributes
+    void SetSlot(int slot, int itemID, uint32_t attributeMask, std::string_view name);
+
+    // Forgets a slot that is empty or no longer colored
+    void ClearSlot(int slot);
+
+    void Clear();
+
+    // Bumped by every change, a search only has to run again when it moved
+    uint64_t GetGeneration() const { return Generation; }
+
+    size_t GetSlotCount() const { return SlotCount; }
+    size_t GetWordCount() const { return Words.size(); }
+
+    // Fills slots with every indexed slot matching the query, in slot order, nothing for an empty query
+    void Search(const ItemColorSearchQuery& query, std::vector<int>& slots) const;
+
+private:
+    struct SlotEntry
+    {
+        int ItemID = 0;
+        uint32_t AttributeMask = 0;
+        // Lower case
+        std::string Name;
+    };
+
+    std::vector<SlotEntry> Slots;
+    size_t SlotCount = 0;
+    // Slots with each attribute bit, by bit
+    std::array<std::vector<int>, std::size(ItemColorPriority)> AttributeSlots;
+    // Every word of every indexed name, lower case, to the slots whose name has it, sorted
+    std::map<std::string, std::vector<int>, std::less<>> Words;
+    uint64_t Generation = 0;
+};
@@ -0,0 +1,302 @@
+/**
+* ItemColorSettings.cpp
+*
+* Settings snapshots and the ini watcher.
+*
+*/
+
+#include "ItemColorSettings.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+
+namespace
+{
+    constexpr std::string_view BlendModeNames[] = { "Priority", "Mix", "Dual" };
+
+    // Average of each channel of the ARGB colors, rounded
+    uint32_t AverageARGB(const uint32_t* colors, size_t count)
+    {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            uint32_t sum = 0;
+            for (size_t color = 0; color < count; ++color)
+            {
+                sum += (colors[color] >> shift) & 0xFF;
+            }
+            result |= ((sum + static_cast<uint32_t>(count / 2)) / static_cast<uint32_t>(count)) << shift;
+        }
+
+        return result;
+    }
+
+    // True if both rule sets would classify every item the same, colors are left to the palette
+    bool HasSameRuleLogic(const ItemColorRuleSet* before, const ItemColorRuleSet* after)
+    {
+        if (before == after)
+        {
+            return true;
+        }
+
+        if (!before || !after || (before->Rules.size() != after->Rules.size()))
+        {
+            return false;
+        }
+
+        for (size_t rule = 0; rule < before->Rules.size(); ++rule)
+        {
+            if ((before->Rules[rule].Expression != after->Rules[rule].Expression) || (before->Rules[rule].Priority != after->Rules[rule].Priority))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+
+/**
+* @fn CompareItemColorSettings
+*
+* @param before const ItemColorSettingsSnapshot& - Snapshot the slots were colored with
+* @param after const ItemColorSettingsSnapshot& - Snapshot replacing it
+* @return ItemColorSettingsChange - What has to be done to the colored slots
+*/
+ItemColorSettingsChange CompareItemColorSettings(const ItemColorSettingsSnapshot& before, const ItemColorSettingsSnapshot& after)
+{
+    ItemColorSettingsChange change;
+
+    change.Reclassify = (before.Classifier.FVServer != after.Classifier.FVServer) ||
+        (before.Classifier.FVNormalNoTrade != after.Classifier.FVNormalNoTrade) ||
+        !HasSameRuleLogic(before.Rules.get(), after.Rules.get());
+    change.EnabledAttributes = before.Classifier.EnabledAttributeMask ^ after.Classifier.EnabledAttributeMask;
+    change.Repaint = (before.Palette != after.Palette) || (before.UseGlowTexture != after.UseGlowTexture) ||
+        (before.BlendTable != after.BlendTable) || (before.SearchHighlight != after.SearchHighlight);
+
+    return change;
+}
+
+
+std::string_view GetItemColorBlendModeName(ItemColorBlendMode mode)
+{
+    size_t index = static_cast<size_t>(mode);
+    return (index < std::size(BlendModeNames)) ? BlendModeNames[index] : BlendModeNames[0];
+}
+
+
+bool ParseItemColorBlendMode(std::string_view name, ItemColorBlendMode& mode)
+{
+    for (size_t index = 0; index < std::size(BlendModeNames); ++index)
+    {
+        if (std::equal(name.begin(), name.end(), BlendModeNames[index].begin(), BlendModeNames[index].end(),
+            [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); }))
+        {
+            mode = static_cast<ItemColorBlendMode>(index);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void ItemColorBlendTable::Build(const std::vector<ItemColorPaletteEntry>& palette, ItemColorBlendMode mode)
+{
+    Mode = mode;
+    for (uint32_t attributeMask = 0; attributeMask < Size; ++attributeMask)
+    {
+        BuildEntry(palette, attributeMask);
+    }
+}
+
+
+size_t ItemColorBlendTable::Update(const std::vector<ItemColorPaletteEntry>& palette, uint32_t changedMask)
+{
+    size_t built = 0;
+    for (uint32_t attributeMask = 0; attributeMask < Size; ++attributeMask)
+    {
+        if (attributeMask & changedMask)
+        {
+            BuildEntry(palette, attributeMask);
+            ++built;
+        }
+    }
+
+    return built;
+}
+
+
+void ItemColorBlendTable::BuildEntry(const std::vector<ItemColorPaletteEntry>& palette, uint32_t attributeMask)
+{
+    // Colors of the attributes in the mask, highest priority first
+    uint32_t normal[std::size(ItemColorPriority)];
+    uint32_t rollover[std::size(ItemColorPriority)];
+    size_t count = 0;
+    for (uint32_t bits = attributeMask; bits != 0; bits &= bits - 1)
+    {
+        uint32_t paletteIndex = GetItemColorPaletteIndex(ItemColorPriority[std::countr_zero(bits)]);
+        const ItemColorPaletteEntry& color = (paletteIndex < palette.size()) ? palette[paletteIndex] : palette[0];
+        normal[count] = color.NormalARGB;
+        rollover[count] = color.RolloverARGB;
+        ++count;
+    }
+
+    ItemColorPaletteEntry& entry = Entries[attributeMask];
+    entry.On = true;
+    if (count == 0)
+    {
+        entry = palette[0];
+        return;
+    }
+
+    switch (Mode)
+    {
+    case ItemColorBlendMode::Mix:
+        entry.NormalARGB = AverageARGB(normal, count);
+        entry.RolloverARGB = AverageARGB(rollover, count);
+        break;
+
+    case ItemColorBlendMode::Dual:
+        entry.NormalARGB = normal[0];
+        entry.RolloverARGB = (count > 1) ? normal[1] : rollover[0];
+        break;
+
+    default:
+        entry.NormalARGB = normal[0];
+        entry.RolloverARGB = rollover[0];
+        break;
+    }
+}
+
+
+/**
+* @fn UpdateItemColorBlendTable
+*
+* @param previous const std::shared_ptr<const ItemColorBlendTable>& - Table of the snapshot being replaced, may be null
+* @param previousPalette const std::vector<ItemColorPaletteEntry>& - Palette previous was built from
+* @param palette const std::vector<ItemColorPaletteEntry>& - Palette of the new snapshot
+* @param mode ItemColorBlendMode - Blend mode of the new snapshot
+* @param entriesBuilt size_t& - Set to the number of entries built
+* @return std::shared_ptr<const ItemColorBlendTable> - Table for the new snapshot, nullptr for Priority
+*/
+std::shared_ptr<const ItemColorBlendTable> UpdateItemColorBlendTable(const std::shared_ptr<const ItemColorBlendTable>& previous,
+    const std::vector<ItemColorPaletteEntry>& previousPalette, const std::vector<ItemColorPaletteEntry>& palette,
+    ItemColorBlendMode mode, size_t& entriesBuilt)
+{
+    entriesBuilt = 0;
+    if (mode == ItemColorBlendMode::Priority || palette.empty())
+    {
+        return nullptr;
+    }
+
+    // The Default color fills the empty mask, every other entry only depends on its own attributes
+    bool canUpdate = previous && (previous->GetMode() == mode) && (previousPalette.size() >= ItemColorRulePaletteBase) &&
+        (palette.size() >= ItemColorRulePaletteBase) && (previousPalette[0] == palette[0]);
+
+    if (!canUpdate)
+    {
+        auto table = std::make_shared<ItemColorBlendTable>();
+        table->Build(palette, mode);
+        entriesBuilt = ItemColorBlendTable::Size;
+        return table;
+    }
+
+    uint32_t changedMask = 0;
+    for (ItemColorAttribute itemAttribute : ItemColorPriority)
+    {
+        uint32_t paletteIndex = GetItemColorPaletteIndex(itemAttribute);
+        if (previousPalette[paletteIndex] != palette[paletteIndex])
+        {
+            changedMask |= GetItemColorAttributeBit(itemAttribute);
+        }
+    }
+
+    if (changedMask == 0)
+    {
+        return previous;
+    }
+
+    auto table = std::make_shared<ItemColorBlendTable>(*previous);
+    entriesBuilt = table->Update(palette, changedMask);
+    return table;
+}
+
+
+void ItemColorIniWatcher::MarkSeen(const std::string& path)
+{
+    std::error_code ec;
+    std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, ec);
+    if (!ec)
+    {
+        LastWriteTime = writeTime;
+    }
+}
+
+
+void ItemColorIniWatcher::Poll(const std::string& path, CompileFn compile)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (Loading.valid() || (now < NextCheck))
+    {
+        return;
+    }
+    NextCheck = now + CheckInterval;
+
+    // One stat, the file is only read when it changed
+    std::error_code ec;
+    std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, ec);
+    if (ec || (writeTime == LastWriteTime))
+    {
+        return;
+    }
+
+    // Taken before reading, a write while reading is seen by the next Poll
+    LastWriteTime = writeTime;
+    Ignored = false;
+    Loading = std::async(std::launch::async, [path, compile = std::move(compile)]()
+        {
+            std::unique_ptr<ItemColorLoadedIni> loaded = std::make_unique<ItemColorLoadedIni>();
+            if (!loaded->Ini.Load(path))
+            {
+                return std::unique_ptr<ItemColorLoadedIni>();
+            }
+
+            if (compile)
+            {
+                compile(*loaded);
+            }
+            return loaded;
+        });
+}
+
+
+std::unique_ptr<ItemColorLoadedIni> ItemColorIniWatcher::TakeLoaded()
+{
+    if (!Loading.valid() || (Loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready))
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<ItemColorLoadedIni> loaded = Loading.get();
+    if (Ignored)
+    {
+        Ignored = false;
+        return nullptr;
+    }
+
+    return loaded;
+}
+
+
+void ItemColorIniWatcher::Ignore()
+{
+    if (Loading.valid())
+    {
+        Ignored = true;
+        // Read it again after the edit is written
+        LastWriteTime = {};
+    }
+}
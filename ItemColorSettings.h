@@ -0,0 +1,178 @@
+/**
+* ItemColorSettings.h
+*
+* The settings a pulse colors slots with, published as one immutable snapshot,
+* and the watcher that reloads the ini in the background when it changes on disk.
+*
+*/
+
+#pragma once
+
+#include "ItemColorCore.h"
+#include "ItemColorIni.h"
+#include "ItemColorRules.h"
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// How an item with more than one attribute turned on is colored, rules always color with their own colors
+enum class ItemColorBlendMode : uint8_t
+{
+    // Only the highest priority attribute, see ItemColorPriority
+    Priority,
+    // Every attribute's colors averaged
+    Mix,
+    // Normal color of the highest priority attribute, and the normal color of the next one on mouseover
+    Dual,
+};
+
+std::string_view GetItemColorBlendModeName(ItemColorBlendMode mode);
+
+// Reads a mode by name, not case sensitive, returns false and leaves mode alone if the name is unknown
+bool ParseItemColorBlendMode(std::string_view name, ItemColorBlendMode& mode);
+
+// Palette indexes with this bit set are a blended color, the rest of the index is the attribute mask, see ItemColorBlendTable
+constexpr uint32_t ItemColorBlendPaletteFlag = 0x80000000;
+
+// Palette index of slots matching a search, see ItemColorSettingsSnapshot::SearchHighlight
+constexpr uint32_t ItemColorSearchPaletteIndex = 0x40000000;
+
+// Colors for every combination of attributes, indexed by a mask of attributes turned on
+// Built once when settings change so coloring a slot is one lookup with no color math
+class ItemColorBlendTable
+{
+public:
+    static constexpr size_t Size = size_t(1) << std::size(ItemColorPriority);
+
+    // Builds every entry from the attribute colors in a palette laid out as ItemColorSettingsSnapshot::Palette
+    void Build(const std::vector<ItemColorPaletteEntry>& palette, ItemColorBlendMode mode);
+
+    // Builds again only the entries with an attribute in changedMask, returns how many that was
+    size_t Update(const std::vector<ItemColorPaletteEntry>& palette, uint32_t changedMask);
+
+    ItemColorBlendMode GetMode() const { return Mode; }
+
+    const ItemColorPaletteEntry& Get(uint32_t attributeMask) const { return Entries[attributeMask & (Size - 1)]; }
+
+private:
+    void BuildEntry(const std::vector<ItemColorPaletteEntry>& palette, uint32_t attributeMask);
+
+    std::array<ItemColorPaletteEntry, Size> Entries{};
+    ItemColorBlendMode Mode = ItemColorBlendMode::Priority;
+};
+
+// Everything the scan reads to color a slot. Built whole and never changed once published,
+// a new snapshot replaces the old one between pulses so a pulse never sees half of a change
+struct ItemColorSettingsSnapshot
+{
+    // Index 0 is Default followed by each ItemColorAttribute then each rule, see GetItemColorPaletteIndex
+    std::vector<ItemColorPaletteEntry> Palette;
+    ItemColorClassifierSettings Classifier;
+    bool UseGlowTexture = false;
+    // Shared with the snapshot this one replaced unless the rules changed
+    std::shared_ptr<const ItemColorRuleSet> Rules;
+    ItemColorBlendMode BlendMode = ItemColorBlendMode::Priority;
+    // Only built when BlendMode is not Priority, shared with the snapshot this one replaced unless a color changed
+    std::shared_ptr<const ItemColorBlendTable> BlendTable;
+    // Colors of slots matching a search, On is false when matches are only counted
+    ItemColorPaletteEntry SearchHighlight;
+
+    // Returns the palette entry at paletteIndex, or the Default entry if it is out of range
+    const ItemColorPaletteEntry& GetPaletteEntry(uint32_t paletteIndex) const
+    {
+        if ((paletteIndex & ItemColorBlendPaletteFlag) && BlendTable)
+        {
+            return BlendTable->Get(paletteIndex & ~ItemColorBlendPaletteFlag);
+        }
+
+        if (paletteIndex == ItemColorSearchPaletteIndex)
+        {
+            return SearchHighlight;
+        }
+
+        return (paletteIndex < Palette.size()) ? Palette[paletteIndex] : Palette[0];
+    }
+
+    // Palette index a slot is colored with, a blended color when more than one of its attributes is turned on
+    uint32_t GetSlotPaletteIndex(const ItemColorSlotMemo& memo) const
+    {
+        if ((memo.Rule < 0) && BlendTable)
+        {
+            uint32_t activeMask = memo.AttributeMask & Classifier.EnabledAttributeMask;
+            if (activeMask & (activeMask - 1))
+            {
+                return ItemColorBlendPaletteFlag | activeMask;
+            }
+        }
+
+        return memo.GetPaletteIndex();
+    }
+};
+
+// Blend table for a new snapshot. Reuses previous when the mode and attribute colors are the same,
+// otherwise copies it and builds again only the entries whose colors changed, or builds it whole if the mode changed
+// entriesBuilt is set to the number of entries built, nullptr is returned for Priority
+std::shared_ptr<const ItemColorBlendTable> UpdateItemColorBlendTable(const std::shared_ptr<const ItemColorBlendTable>& previous,
+    const std::vector<ItemColorPaletteEntry>& previousPalette, const std::vector<ItemColorPaletteEntry>& palette,
+    ItemColorBlendMode mode, size_t& entriesBuilt);
+
+// How two snapshots differ, decides how much of the inventory has to be looked at again
+struct ItemColorSettingsChange
+{
+    // Items may classify differently (FV flags, rule expressions or priorities changed), every slot is classified again
+    bool Reclassify = false;
+    // Attribute bits turned on or off, slots with them resolve their attribute again from their memo
+    uint32_t EnabledAttributes = 0;
+    // Colors or the texture changed, classified slots may only need repainting
+    bool Repaint = false;
+
+    bool Any() const { return Reclassify || (EnabledAttributes != 0) || Repaint; }
+};
+
+ItemColorSettingsChange CompareItemColorSettings(const ItemColorSettingsSnapshot& before, const ItemColorSettingsSnapshot& after);
+
+// An ini read by ItemColorIniWatcher along with the rules compiled from it
+struct ItemColorLoadedIni
+{
+    ItemColorIniFile Ini;
+    std::shared_ptr<ItemColorRuleSet> Rules = std::make_shared<ItemColorRuleSet>();
+    // Problems found while compiling, reported on the game thread
+    std::vector<std::string> Errors;
+};
+
+// Checks the modification time of the ini now and then, and reads it again on a background thread when it changed
+class ItemColorIniWatcher
+{
+public:
+    // Run on the background thread after the file is read, compiles whatever the plugin needs from it
+    using CompileFn = std::function<void(ItemColorLoadedIni&)>;
+
+    // Time between modification time checks
+    static constexpr std::chrono::milliseconds CheckInterval{ 1000 };
+
+    // Remembers the current modification time of path, call after reading or writing it on the game thread
+    void MarkSeen(const std::string& path);
+
+    // At most once per CheckInterval, starts reading path in the background if its modification time changed
+    void Poll(const std::string& path, CompileFn compile);
+
+    // Returns the file read in the background once it is ready, nullptr while reading or if nothing changed
+    std::unique_ptr<ItemColorLoadedIni> TakeLoaded();
+
+    // Drops a read that is still running, used when settings were edited and it would undo the edit
+    // The next Poll reads the file again if it changed
+    void Ignore();
+
+private:
+    std::filesystem::file_time_type LastWriteTime{};
+    std::chrono::steady_clock::time_point NextCheck{};
+    std::future<std::unique_ptr<ItemColorLoadedIni>> Loading;
+    bool Ignored = false;
+};
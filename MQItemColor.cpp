@@ -4,24 +4,39 @@
 * This plugin will set the background color of items according to various item attributes.
 * Colors are done in priority order, for example a no trade tradeskill item gets colored in tradeskill colors.
 *
-* Colors for specific attributes can be set in the ini. A reload is required to take effect.
+* Colors for specific attributes can be set in the ini. Changes to the ini are picked up within a second or so,
+* only slots whose color changed are repainted. Set HotReload=0 in the ini to only read it when the plugin loads.
 * Colors are based on ARGB hex format. Hex "0x" Alpha "00-FF" Red "00-FF" Green "00-FF" Blue "00-FF"
 * Example: 0xFFC0C0C0
 *
+* Slots are recolored when inventory signals are seen (cursor item changes, bag or bank windows opening)
+* with a slower full scan as a safety net. Set EventDriven=0 in the ini to scan every ScanIntervalMin ms instead.
+* Full scans that find nothing changed back off up to ScanIntervalMax ms, any change brings them back to the fastest.
+*
 * The plugin will try to load an UI XML for a item background texture to give them more visibility.
 * A /reload or /loadskin default may be required for the texture background change to show.
 *
 * To Add a New Color
-* Define a new ItemColorAttribute enumeration in MQItemColor.h (in desired priority order, keep this order in the below steps)
-* Add Name definition to switch in ItemColor constructor in MQItemColor.h
-* Define a new ItemColor in the AvailableItemColors array
-* Add new If statement for when your new ItemColor should be used to SetItemBG(), keeping in mind the priority order of the enums
+* Add a line to ITEMCOLOR_ATTRIBUTES in ItemColorCore.h with its name, priority, default colors and the test for items
+* that have it. The enumeration, ini keys, AvailableItemColors, ItemColorPriority and GetItemDefinitionMask follow from it.
+*
+* Colors can also be added without code as rules in the [Rules] section of the ini, see README.md.
+* Rules are checked before the attributes above, in their own priority order.
 *
 */
 
 #include <mq/Plugin.h>
 
 #include <MQItemColor/MQItemColor.h>
+#include "ItemColorCapture.h"
+#include "ItemColorPersistentCache.h"
+#include "ItemColorPipeline.h"
+#include "ItemColorScanner.h"
+#include "ItemColorSearch.h"
+#include "ItemColorSettings.h"
+
+#include <bit>
+#include <filesystem>
 #include "imgui/ImGuiUtils.h"
 #include "imgui/ImGuiTextEditor.h"
 
@@ -42,38 +57,215 @@ bool FVNormalNoTrade = false;
 // Flag for using custom "glow" texture
 bool UseGlowTexture = true;
 
+// How items with more than one attribute turned on are colored, and how many blend table entries the last settings change built
+ItemColorBlendMode BlendMode = ItemColorBlendMode::Priority;
+size_t BlendEntriesBuilt = 0;
+
 // Default Item Color, used for coloring items back to a default color and default background texture
-ItemColor ItemColorDefault(ItemColorAttribute::Default, true, 0xFFC0C0C0, 0xFFFFFFFF);
+ItemColor ItemColorDefault(ItemColorDefaultAttribute);
+
+// Colors of slots matching /itemcolor find or the search box in the settings panel
+ItemColor ItemColorSearch(ItemColorSearchAttribute);
 
-// ItemColor definitions, stores info for each item attribute we care to color
+// ItemColor definitions, stores info for each item attribute we care to color, one per line of ITEMCOLOR_ATTRIBUTES
 ItemColor AvailableItemColors[] =
 {
-    { ItemColor(ItemColorAttribute::Quest_Item, true,  0xFFF01DFF, 0xFFF9AFFF) },
-    { ItemColor(ItemColorAttribute::TradeSkills_Item, true, 0xFFF0F000, 0xFFF09253) },
-    { ItemColor(ItemColorAttribute::Collectible_Item, true, 0xFFFF8C20, 0xFFFFCA4D) },
-    { ItemColor(ItemColorAttribute::Heirloom_Item, false, 0xFFC0C0C0, 0xFFFFFFFF) },
-    { ItemColor(ItemColorAttribute::NoTrade_Item, true, 0xFFFF2020, 0xFFFF8080) },
-    { ItemColor(ItemColorAttribute::Attuneable_Item, true, 0xFF6BBAFF, 0xFFFFADF4) },
-    { ItemColor(ItemColorAttribute::HasAugSlot8_Item, true, 0xFF00FF00, 0xFFFFADF4) },
-    { ItemColor(ItemColorAttribute::PowerSource_Item, true, 0xFF0F13DA, 0xFFFFADF4) },
-    { ItemColor(ItemColorAttribute::Placeable_Item, true, 0xFFC0C0C0, 0xFFFFFFFF) },
-    { ItemColor(ItemColorAttribute::Ornamentation_Item, true, 0xFFC0C0C0, 0xFFFFFFFF) },
+#define ITEMCOLOR_AVAILABLE(Enum, ...) ItemColor(ItemColorAttributes[static_cast<size_t>(ItemColorAttribute::Enum)]),
+    ITEMCOLOR_ATTRIBUTES(ITEMCOLOR_AVAILABLE)
+#undef ITEMCOLOR_AVAILABLE
 };
 
+// Coloring rules from the [Rules] section of the ini and their compiled program, checked before the ItemColor attributes
+// Replaced whole when the rules are loaded, never changed in place
+std::string RulesSection = "Rules";
+std::shared_ptr<const ItemColorRuleSet> ColorRules = std::make_shared<ItemColorRuleSet>();
+// Most rules read from the ini
+constexpr int MaxColorRules = 1024;
+
+// Colors for items with aug sockets of chosen types, from the [SocketColors] section of the ini
+// Loaded into ColorRules as Socket(...) rules checked after the rules from the [Rules] section
+std::string SocketColorsSection = "SocketColors";
+constexpr int MaxSocketColors = 64;
+static_assert(MaxColorRules + MaxSocketColors <= ItemColorQuery::MaxRule + 1, "${ItemColor} answers must be able to name every rule");
+
+// Palette, classifier settings and rules the scan colors slots with, the hot path never touches ItemColor
+// Settings changes build PendingSettings from AvailableItemColors and ColorRules, and OnPulse swaps it in
+// before looking at any slot, so a pulse never mixes old and new settings
+std::shared_ptr<const ItemColorSettingsSnapshot> ActiveSettings;
+std::shared_ptr<const ItemColorSettingsSnapshot> PendingSettings;
+
+// Reload the ini when it changes on disk
+bool HotReload = true;
+ItemColorIniWatcher IniWatcher;
+
+// Slot memos, window shadows and classification cache of pInvSlotMgr->SlotArray, and the steps that color a slot
+ItemColorScanner Scanner;
+
+// Classification of item definitions, capacity is set from the ini
+ItemClassificationCache& ClassificationCache = Scanner.GetCache();
+int ClassificationCacheSize = 1024;
+
+// Classification of item definitions kept on disk between sessions, one file per server next to the ini
+// Checked when ClassificationCache misses, so the first sweep after a login or zone classifies little from scratch
+bool UsePersistentCache = false;
+int PersistentCacheSize = 32768;
+ItemColorPersistentCache PersistentCache;
+// Set when the file to use or the settings it was classified with may have changed, see SyncPersistentCache
+bool PersistentCacheSyncNeeded = true;
+// SettingsVersion the open file was last checked against, and why the last open failed
+uint32_t PersistentCacheVersion = 0;
+std::string PersistentCacheError;
+
+// Per-slot memo of what was last classified, indexed the same as pInvSlotMgr->SlotArray
+// A slot is only reclassified when its location, window, item or the settings have changed since the last pulse
+std::vector<ItemColorSlotMemo>& SlotMemos = Scanner.GetMemos();
+
+// Bumped whenever a setting changes that can alter the classification of a slot
+// Starts at 1 so a default constructed ItemColorSlotMemo never matches
+uint32_t SettingsVersion = 1;
+
+// Per phase timing and per pulse slot counters, shown by /itemcolor stats and the settings panel
+ItemColorStats Stats;
+
+// Settings edited in the panel are written by SettingsWriter off the game thread,
+// once there have been no edits for SettingsQuietPeriod
+ItemColorIniWriter SettingsWriter;
+bool SettingsDirty = false;
+std::chrono::steady_clock::time_point LastSettingsEdit;
+constexpr std::chrono::milliseconds SettingsQuietPeriod{ 1000 };
+
+// How long LoadSettingsFromINI took, and if it had to write the ini
+std::chrono::microseconds SettingsLoadTime{ 0 };
+bool SettingsLoadWroteINI = false;
+
+// Event driven recoloring, when off the whole inventory is scanned every ScanIntervalMin ms or slower when idle
+bool EventDriven = true;
+// Interval in ms of the safety net full scan while event driven, used in place of ScanIntervalMin and ScanIntervalMax
+// It does not back off, changes are found by PollInventorySignals and the safety net only has to bound how late one can be
+int FullScanInterval = 1000;
+
+// Full sweeps start ScanIntervalMin ms apart and back off up to ScanIntervalMax ms while they find nothing changed
+int ScanIntervalMin = 100;
+int ScanIntervalMax = 10000;
+ItemColorPulseScheduler Scheduler;
+// Slots reclassified when the running sweep began, a sweep that ends with more found a change
+uint64_t SweepStartReclassified = 0;
+// Merchant window was open last pulse, opening it brings the next sweep forward
+bool MerchantWasOpen = false;
+
+// Top level windows (inventory, bags, bank) owning inventory slots, watched for being opened
+struct WatchedWindow
+{
+    CXWnd* pWnd = nullptr;
+    bool WasVisible = false;
+    std::vector<int> SlotIndexes;
+};
+std::vector<WatchedWindow> WatchedWindows;
+bool WatchedWindowsStale = true;
+// Index in WatchedWindows of the window owning each slot, -1 if none, sweeps skip slots of closed windows
+std::vector<int> SlotOwners;
+
+// Queue of slots to recolor on the next pulse, and a flag to recheck every slot
+std::vector<int> DirtySlots;
+bool FullScanRequested = true;
+
+// Per pulse budget for full sweeps, 0 means no limit
+// Slot budget is a number of slots, time budget is in microseconds
+int ScanSlotBudget = 200;
+int ScanTimeBudget = 500;
+
+// Slots in pInvSlotMgr->SlotArray that pass GetColorableSlotWnd, rebuilt when the slot array changes
+// Full sweeps only visit these instead of filtering every slot
+ItemColorSlotIndex ColorableSlots;
+
+// Resumable full sweep over ColorableSlots, continued each pulse within the budgets
+ItemColorSweep Sweep;
+
+// Worker threads classifying the items a full sweep finds missing from the classification cache
+// 0 classifies everything on the game thread, results are applied on a later pulse
+int ClassifyThreads = 0;
+constexpr int MaxClassifyThreads = 16;
+ItemColorClassifyPool ClassifyPool;
+// Records taken by the sweep and not yet handed to ClassifyPool
+std::vector<ItemColorClassifyRecord> PendingRecords;
+
+// Capture of the slot array for replaying offline, see /itemcolor capture
+// A frame is taken every CaptureInterval ms until CaptureFramesLeft runs out, then the file is written
+ItemColorCaptureWriter Capture;
+bool Capturing = false;
+int CaptureFramesLeft = 0;
+std::chrono::milliseconds CaptureInterval{ 1000 };
+std::chrono::steady_clock::time_point NextCaptureFrame;
+constexpr int MaxCaptureFrames = 10000;
+
+// Slots matching the search are colored with ItemColorSearch until the search is cleared
+// SearchIndex follows every slot as it is classified, so a search never walks the slot array
+ItemColorSearchIndex SearchIndex;
+std::string SearchText;
+ItemColorSearchQuery SearchQuery;
+// Slots matching now in slot order, and a flag per slot indexed the same as SlotMemos
+std::vector<int> SearchSlots;
+std::vector<bool> SearchSlotFlags;
+// SearchIndex generation SearchSlots were found at, and how long finding them took
+uint64_t SearchGeneration = 0;
+std::chrono::nanoseconds SearchTime{ 0 };
+// Text of the search box in the settings panel, SearchBoxChanged asks the next pulse to search for it
+char SearchBuffer[256] = { 0 };
+bool SearchBoxChanged = false;
+
+// Last item seen on the cursor, any change means an item was picked up or put down
+const ItemClient* LastCursorItem = nullptr;
+
+// Background animations, resolved once and again after the UI is reloaded
+CTextureAnimation* pDefaultBGTexture = nullptr;
+CTextureAnimation* pGlowBGTexture = nullptr;
+bool BGTexturesResolved = false;
+
 
 /**
-* @fn GetItemColor
+* @fn RebuildSettings
 *
-* Returns the ItemColor for the specified ItemColorAttribute, or Default ItemColor if invalid attribute given
+* Builds PendingSettings from the Default ItemColor, each ItemColor, each rule, the FV flags and the texture flag.
+* It is swapped in by ApplyPendingSettings at the start of the next pulse.
 */
-static ItemColor& GetItemColor(ItemColorAttribute itemColorAttr)
+static void RebuildSettings()
 {
-    if (itemColorAttr < ItemColorAttribute::Quest_Item || itemColorAttr >= ItemColorAttribute::Last)
+    std::shared_ptr<ItemColorSettingsSnapshot> settings = std::make_shared<ItemColorSettingsSnapshot>();
+
+    settings->Palette.resize(ItemColorRulePaletteBase + ColorRules->Rules.size());
+    settings->Palette[0] = ItemColorDefault.ToPaletteEntry();
+    settings->SearchHighlight = ItemColorSearch.ToPaletteEntry();
+
+    settings->Classifier.FVServer = FVServer;
+    settings->Classifier.FVNormalNoTrade = FVNormalNoTrade;
+    settings->UseGlowTexture = UseGlowTexture;
+    settings->Rules = ColorRules;
+
+    uint32_t onMask = 0;
+    for (ItemColor& itemColor : AvailableItemColors)
+    {
+        settings->Palette[static_cast<size_t>(itemColor.ItemAttribute) + 1] = itemColor.ToPaletteEntry();
+
+        if (itemColor.isOn())
+        {
+            onMask |= GetItemColorAttributeBit(itemColor.ItemAttribute);
+        }
+    }
+    settings->Classifier.EnabledAttributeMask = GetItemColorEnabledMask(onMask);
+
+    for (size_t rule = 0; rule < ColorRules->Rules.size(); ++rule)
     {
-        return ItemColorDefault;
+        settings->Palette[ItemColorRulePaletteBase + rule] = { ColorRules->Rules[rule].NormalARGB, ColorRules->Rules[rule].RolloverARGB, true };
     }
 
-    return AvailableItemColors[static_cast<size_t>(itemColorAttr)];
+    // Start from the newest table, editing one color only builds the entries that use it
+    const ItemColorSettingsSnapshot* pBase = PendingSettings ? PendingSettings.get() : ActiveSettings.get();
+    static const std::vector<ItemColorPaletteEntry> NoPalette;
+    settings->BlendMode = BlendMode;
+    settings->BlendTable = UpdateItemColorBlendTable(pBase ? pBase->BlendTable : nullptr, pBase ? pBase->Palette : NoPalette,
+        settings->Palette, BlendMode, BlendEntriesBuilt);
+
+    PendingSettings = std::move(settings);
 }
 
 
@@ -100,29 +292,106 @@ static void HelpLabel(const char* text)
 
 
 /**
-* @fn WriteGeneralSettingsToINI
+* @fn SaveIni
+*
+* Writes an ini back to INIFileName if anything in it changed, reports a failed write
+*
+* @param ini ItemColorIniFile& - Settings to write
+*/
+static void SaveIni(ItemColorIniFile& ini)
+{
+    if (!ini.Save(INIFileName))
+    {
+        WriteChatf("\ayMQItemColor\ax Could not write settings to %s", INIFileName);
+    }
+}
+
+
+/**
+* @fn WriteGeneralSettings
 *
-* Writes any general settings to the INI
+* Sets any general settings in an ini, nothing is written to disk
+*
+* @param ini ItemColorIniFile& - Settings to update
 */
-static void WriteGeneralSettingsToINI()
+static void WriteGeneralSettings(ItemColorIniFile& ini)
 {
     // Write out FVNormalNoTrade flag
-    WritePrivateProfileBool(GeneralSection, "FVNormalNoTrade", FVNormalNoTrade, INIFileName);
+    ini.SetBool(GeneralSection, "FVNormalNoTrade", FVNormalNoTrade);
     // Write out UseGlowTexture flag
-    WritePrivateProfileBool(GeneralSection, "UseGlowTexture", UseGlowTexture, INIFileName);
+    ini.SetBool(GeneralSection, "UseGlowTexture", UseGlowTexture);
+    // Write out BlendMode
+    ini.SetString(GeneralSection, "BlendMode", GetItemColorBlendModeName(BlendMode));
+    // Write out EventDriven flag
+    ini.SetBool(GeneralSection, "EventDriven", EventDriven);
+    // Write out FullScanInterval
+    ini.SetInt(GeneralSection, "FullScanInterval", FullScanInterval);
+    // Write out scan intervals
+    ini.SetInt(GeneralSection, "ScanIntervalMin", ScanIntervalMin);
+    ini.SetInt(GeneralSection, "ScanIntervalMax", ScanIntervalMax);
+    // Write out ClassificationCacheSize
+    ini.SetInt(GeneralSection, "ClassificationCacheSize", ClassificationCacheSize);
+    // Write out persistent cache settings
+    ini.SetBool(GeneralSection, "PersistentCache", UsePersistentCache);
+    ini.SetInt(GeneralSection, "PersistentCacheSize", PersistentCacheSize);
+    // Write out scan budgets
+    ini.SetInt(GeneralSection, "ScanSlotBudget", ScanSlotBudget);
+    ini.SetInt(GeneralSection, "ScanTimeBudget", ScanTimeBudget);
+    // Write out ClassifyThreads
+    ini.SetInt(GeneralSection, "ClassifyThreads", ClassifyThreads);
+    // Write out DetailedTiming flag
+    ini.SetBool(GeneralSection, "DetailedTiming", Stats.DetailedTiming);
+    // Write out HotReload flag
+    ini.SetBool(GeneralSection, "HotReload", HotReload);
 }
 
 
 /**
-* @fn WriteColorSettingsToINI
+* @fn SnapshotSettings
+*
+* Sets every general and ItemColor setting in an ini that is not backed by a file, for SettingsWriter to merge
 *
-* Writes any ItemColor settings to the INI
+* @return ItemColorIniFile - Settings to write
 */
-static void WriteColorSettingsToINI()
+static ItemColorIniFile SnapshotSettings()
 {
+    ItemColorIniFile ini;
+    WriteGeneralSettings(ini);
+
     for (ItemColor& itemColor : AvailableItemColors)
     {
-        itemColor.WriteColorINI(INIFileName);
+        itemColor.WriteColorINI(ini);
+    }
+    ItemColorSearch.WriteColorINI(ini);
+
+    return ini;
+}
+
+
+/**
+* @fn MarkSettingsDirty
+*
+* Notes a setting was edited, it is written once edits have been quiet for SettingsQuietPeriod
+*/
+static void MarkSettingsDirty()
+{
+    SettingsDirty = true;
+    LastSettingsEdit = std::chrono::steady_clock::now();
+}
+
+
+/**
+* @fn WriteSettingsIfQuiet
+*
+* Hands the settings to SettingsWriter once there have been no edits for SettingsQuietPeriod,
+* so dragging a color picker is one write instead of one per frame
+*/
+static void WriteSettingsIfQuiet()
+{
+    if (SettingsDirty && std::chrono::steady_clock::now() - LastSettingsEdit >= SettingsQuietPeriod)
+    {
+        SettingsWriter.Submit(INIFileName, SnapshotSettings());
+        SettingsDirty = false;
     }
 }
 
@@ -143,7 +412,8 @@ static void ItemColorSettings_General()
     // FV Normal No Trade Checkbox Section
     if (ImGui::Checkbox("Color Items Normally Marked \"No Trade\"", &FVNormalNoTrade))
     {
-        WriteGeneralSettingsToINI();
+        RebuildSettings();
+        MarkSettingsDirty();
     }
     ImGui::SameLine();
     ImGui::TextColored(ImVec4(1.0f, 1.0f, 1.0f, 0.5f), "- Firiona Vie Server Only");
@@ -151,439 +421,2680 @@ static void ItemColorSettings_General()
     // Use Glow Texture Checkbox Section
     if (ImGui::Checkbox("Use \"Glow\" Texture", &UseGlowTexture))
     {
-        WriteGeneralSettingsToINI();
+        RebuildSettings();
+        MarkSettingsDirty();
     }
     ImGui::SameLine();
     ImGui::TextColored(ImVec4(1.0f, 1.0f, 1.0f, 0.5f), "- Can cause crash if used while creating item hot button (New UI Engine Issue)");
-    ImGui::NewLine();
-}
-
-
-/**
-* @fn ItemColorSettings_Colors
-*
-* Sets up the Colors settings area. Contains toggles and color choosers for each ItemColor
-*/
-static void ItemColorSettings_Colors()
-{
-    // Section Title
-    ImGui::PushFont(imgui::LargeTextFont);
-    ImGui::TextColored(MQColor(255, 255, 0).ToImColor(), "Item Colors");
-    ImGui::Separator();
-    ImGui::PopFont();
 
-    for (ItemColor& itemColor : AvailableItemColors)
+    // Blend Mode Section
+    std::string_view blendModeName = GetItemColorBlendModeName(BlendMode);
+    if (ImGui::BeginCombo("Blend Mode", std::string(blendModeName).c_str()))
     {
-        // Enable Checkbox Section
-        if (ImGui::Checkbox((itemColor.Name).c_str(), &itemColor.On))
+        for (ItemColorBlendMode mode : { ItemColorBlendMode::Priority, ItemColorBlendMode::Mix, ItemColorBlendMode::Dual })
         {
-            itemColor.WriteColorINI(INIFileName);
+            if (ImGui::Selectable(std::string(GetItemColorBlendModeName(mode)).c_str(), mode == BlendMode) && (mode != BlendMode))
+            {
+                BlendMode = mode;
+                RebuildSettings();
+                MarkSettingsDirty();
+            }
         }
-        std::string itemColorHelp = "Color items marked \"" + itemColor.Name + "\"";
-        HelpLabel(itemColorHelp.c_str());
-
-        // Normal Color Chooser Section
-        ImGui::PushID(itemColor.NormalProfile.c_str());
+        ImGui::EndCombo();
+    }
+    HelpLabel("How items with more than one type turned on are colored. Priority uses the first type in priority order, "
+        "Mix averages the colors of every type, Dual shows the first type and the second one on mouseover");
 
-        ImColor normalColor = itemColor.NormalColor.ToImColor();
+    // Event Driven Checkbox Section
+    if (ImGui::Checkbox("Event Driven Recoloring", &EventDriven))
+    {
+        FullScanRequested = true;
+        MarkSettingsDirty();
+    }
+    HelpLabel("Recolor slots as soon as items move or windows open instead of scanning every slot over and over");
 
-        if (ImGui::ColorEdit3("Normal", &normalColor.Value.x))
+    // Full Scan Interval Section
+    if (EventDriven)
+    {
+        if (ImGui::SliderInt("Full Scan Interval (ms)", &FullScanInterval, 250, 10000))
         {
-            itemColor.NormalColor.Blue = static_cast<uint8_t>(normalColor.Value.z * 255);
-            itemColor.NormalColor.Green = static_cast<uint8_t>(normalColor.Value.y * 255);
-            itemColor.NormalColor.Red = static_cast<uint8_t>(normalColor.Value.x * 255);
-            itemColor.NormalColor.Alpha = 255U;
-            itemColor.WriteColorINI(INIFileName);
+            MarkSettingsDirty();
         }
-
-        if (itemColor.NormalColor != itemColor.NormalColorDefault)
+        HelpLabel("How often every slot is checked anyway, on top of the checks of open windows every pulse");
+    }
+    else
+    {
+        if (ImGui::SliderInt("Min Scan Interval (ms)", &ScanIntervalMin, 50, 10000))
         {
-            ImGui::SameLine();
-            if (ImGui::Button("Reset"))
-            {
-                itemColor.SetNormalColorToDefault();
-                itemColor.WriteColorINI(INIFileName);
-            }
+            ScanIntervalMax = std::max(ScanIntervalMax, ScanIntervalMin);
+            MarkSettingsDirty();
         }
+        HelpLabel("Time between full scans right after something changed");
+    }
 
-        ImGui::PopID();
-
-
-        // Rollover Color Chooser Section
-        ImGui::PushID(itemColor.RolloverProfile.c_str());
+    if (ImGui::SliderInt("Max Scan Interval (ms)", &ScanIntervalMax, 250, 60000))
+    {
+        ScanIntervalMin = std::min(ScanIntervalMin, ScanIntervalMax);
+        MarkSettingsDirty();
+    }
+    HelpLabel("Full scans that find nothing changed double the time to the next one, up to this. "
+        "Moving an item or opening an inventory, bank or merchant window goes straight back to the fastest");
 
-        ImColor rolloverColor = itemColor.RolloverColor.ToImColor();
+    // Scan Budget Section
+    if (ImGui::SliderInt("Slots Per Pulse", &ScanSlotBudget, 0, 2000))
+    {
+        MarkSettingsDirty();
+    }
+    HelpLabel("Most slots a full scan checks in one pulse before continuing next pulse, 0 for no limit");
 
-        if (ImGui::ColorEdit3("Rollover", &rolloverColor.Value.x))
-        {
-            itemColor.RolloverColor.Blue = static_cast<uint8_t>(rolloverColor.Value.z * 255);
-            itemColor.RolloverColor.Green = static_cast<uint8_t>(rolloverColor.Value.y * 255);
-            itemColor.RolloverColor.Red = static_cast<uint8_t>(rolloverColor.Value.x * 255);
-            itemColor.RolloverColor.Alpha = 255U;
-            itemColor.WriteColorINI(INIFileName);
-        }
+    if (ImGui::SliderInt("Time Per Pulse (us)", &ScanTimeBudget, 0, 5000))
+    {
+        MarkSettingsDirty();
+    }
+    HelpLabel("Most time in microseconds a full scan spends in one pulse before continuing next pulse, 0 for no limit");
 
-        if (itemColor.RolloverColor != itemColor.RolloverColorDefault)
-        {
-            ImGui::SameLine();
-            if (ImGui::Button("Reset"))
-            {
-                itemColor.SetRolloverColorToDefault();
-                itemColor.WriteColorINI(INIFileName);
-            }
-        }
+    // Classify Threads Section
+    if (ImGui::SliderInt("Classify Threads", &ClassifyThreads, 0, MaxClassifyThreads))
+    {
+        MarkSettingsDirty();
+    }
+    HelpLabel("Worker threads classifying new items found by full scans, 0 to classify everything in the game thread");
 
-        ImGui::PopID();
+    // Persistent Cache Checkbox Section
+    if (ImGui::Checkbox("Keep Classification Between Sessions", &UsePersistentCache))
+    {
+        PersistentCacheSyncNeeded = true;
+        MarkSettingsDirty();
+    }
+    HelpLabel("Remember how each item was classified in a file per server, so bags and the bank color straight away after logging in. "
+        "Only the first client on a server uses the file");
 
-        ImGui::NewLine();
+    // Hot Reload Checkbox Section
+    if (ImGui::Checkbox("Reload INI When Changed", &HotReload))
+    {
+        MarkSettingsDirty();
     }
+    HelpLabel("Pick up changes made to the ini outside the game without reloading the plugin");
+    ImGui::NewLine();
 }
 
 
 /**
-* @fn ItemColorSettingsPanel
+* @fn ItemColorSettings_Color
 *
-* Sets up the settings ui for the MQ settings window
+* Sets up the toggle and color choosers of one ItemColor
+*
+* @param itemColor ItemColor& - Color to edit
+* @param help const std::string& - Shown next to the toggle
 */
-void ItemColorSettingsPanel()
+static void ItemColorSettings_Color(ItemColor& itemColor, const std::string& help)
 {
-    ItemColorSettings_General();
-    ItemColorSettings_Colors();
-}
+    // Enable Checkbox Section
+    if (ImGui::Checkbox(itemColor.Name.data(), &itemColor.On))
+    {
+        RebuildSettings();
+        MarkSettingsDirty();
+    }
+    HelpLabel(help.c_str());
 
+    // Normal Color Chooser Section
+    ImGui::PushID(itemColor.NormalProfile.data());
 
-/**
-* @fn SetBGTexture
-*
-* This function will change the given CInvSlotWnd pointer's CTextureAnimation
-* to/from the default or a more visible background for inventory slots.
-*
-* @param pInvSlotWnd CInvSlotWnd* - Pointer to the CInvSlotWnd we want to change the texture of
-* @param setDefault bool - True to set the original texture, false (default) to set more visible background texture
-*/
-void SetBGTexture(CInvSlotWnd* pInvSlotWnd, bool setDefault)
-{
-    if ((pInvSlotWnd != nullptr) && (pInvSlotWnd->pBackground != nullptr))
+    ImColor normalColor = itemColor.NormalColor.ToImColor();
+
+    if (ImGui::ColorEdit3("Normal", &normalColor.Value.x))
     {
-        CTextureAnimation* newTex = nullptr;
+        itemColor.NormalColor.Blue = static_cast<uint8_t>(normalColor.Value.z * 255);
+        itemColor.NormalColor.Green = static_cast<uint8_t>(normalColor.Value.y * 255);
+        itemColor.NormalColor.Red = static_cast<uint8_t>(normalColor.Value.x * 255);
+        itemColor.NormalColor.Alpha = 255U;
+        RebuildSettings();
+        MarkSettingsDirty();
+    }
 
-        // Return texture to normal
-        // Currently using the custom glow texture can cause a crash when creating a hot button from an item
-        // Use default if the user has selected not to use the custom glow texture
-        if (setDefault || !UseGlowTexture)
-        {
-            newTex = pSidlMgr->FindAnimation("A_RecessedBox");
-        }
-        // Set texture to more visible background
-        else
+    if (itemColor.NormalColor != itemColor.NormalColorDefault)
+    {
+        ImGui::SameLine();
+        if (ImGui::Button("Reset"))
         {
-            newTex = pSidlMgr->FindAnimation("A_ItemColorRecessedBox");
+            itemColor.SetNormalColorToDefault();
+            RebuildSettings();
+            MarkSettingsDirty();
         }
+    }
+
+    ImGui::PopID();
+
+
+    // Rollover Color Chooser Section
+    ImGui::PushID(itemColor.RolloverProfile.data());
+
+    ImColor rolloverColor = itemColor.RolloverColor.ToImColor();
+
+    if (ImGui::ColorEdit3("Rollover", &rolloverColor.Value.x))
+    {
+        itemColor.RolloverColor.Blue = static_cast<uint8_t>(rolloverColor.Value.z * 255);
+        itemColor.RolloverColor.Green = static_cast<uint8_t>(rolloverColor.Value.y * 255);
+        itemColor.RolloverColor.Red = static_cast<uint8_t>(rolloverColor.Value.x * 255);
+        itemColor.RolloverColor.Alpha = 255U;
+        RebuildSettings();
+        MarkSettingsDirty();
+    }
 
-        if (newTex != nullptr)
+    if (itemColor.RolloverColor != itemColor.RolloverColorDefault)
+    {
+        ImGui::SameLine();
+        if (ImGui::Button("Reset"))
         {
-            pInvSlotWnd->pBackground = newTex;
+            itemColor.SetRolloverColorToDefault();
+            RebuildSettings();
+            MarkSettingsDirty();
         }
     }
+
+    ImGui::PopID();
+
+    ImGui::NewLine();
 }
 
 
 /**
-* @fn SetBGColors
-*
-* This function will change the given CInvSlotWnd pointer's background colors depending on the ItemColorAttribute given.
+* @fn ItemColorSettings_Colors
 *
-* @param pInvSlotWnd CInvSlotWnd* - Pointer to the CInvSlotWnd we want to change the texture of
-* @param itemColorAttr ItemColorAttribute - Item attribute type used to grab what color we need
+* Sets up the Colors settings area. Contains toggles and color choosers for each ItemColor
 */
-void SetBGColors(CInvSlotWnd* pInvSlotWnd, ItemColorAttribute itemColorAttr)
+static void ItemColorSettings_Colors()
 {
-    if (pInvSlotWnd != nullptr)
+    // Section Title
+    ImGui::PushFont(imgui::LargeTextFont);
+    ImGui::TextColored(MQColor(255, 255, 0).ToImColor(), "Item Colors");
+    ImGui::Separator();
+    ImGui::PopFont();
+
+    for (ItemColor& itemColor : AvailableItemColors)
     {
-        ItemColor itemColor = GetItemColor(itemColorAttr);
-        pInvSlotWnd->BGTintNormal = (itemColor.NormalColor).ToARGB();
-        pInvSlotWnd->BGTintRollover = (itemColor.RolloverColor).ToARGB();
+        ItemColorSettings_Color(itemColor, "Color items marked \"" + std::string(itemColor.Name) + "\"");
     }
 }
 
-bool HasType8AugSlot(ItemPtr pItem) {
-	if (ItemDefinition* pItemDef = pItem->GetItemDefinition()) {
-		if (pItemDef->AugData.Sockets) {
-			for (auto& socket : pItemDef->AugData.Sockets) {
-				if (socket.Type == 8) {
-					return true;
-				}
-			}
-		}
-	}
-	return false;
-}
 
-bool IsOrnamentation(ItemPtr pItem) {
-    return (pItem->GetItemDefinition()->AugType & 0x180000) != 0;
+/**
+* @fn GetPersistentCachePath
+*
+* @return std::string - Persistent cache file for the server we are on, next to the ini
+*/
+static std::string GetPersistentCachePath()
+{
+    std::filesystem::path path = std::filesystem::path(INIFileName).parent_path() /
+        ("MQItemColor_" + std::string(GetServerShortName()) + ".iccache");
+    return path.string();
 }
 
+
 /**
-* @fn SetItemBG
-*
-* This function will change the given CInvSlotWnd pointer's CTextureAnimation
-* to/from the default or a more visible background for inventory slots.
-* Will also change the tint of the background normal and rollover colors
+* @fn SyncPersistentCache
 *
-* @param pInvSlotWnd CInvSlotWnd* - Pointer to the CInvSlotWnd we want to change the background color of
-* @param pItem ItemPtr - Smart Pointer to the Item we are dealing with
-* @param setDefault bool - True to set the original colors, false (default) to set based on item attributes
+* Opens, closes or empties the persistent cache to match the settings, the server and the classification settings.
+* Opening maps the file as it is, nothing in it is read until a definition is looked up.
+* A file that could not be opened is not tried again until something changes.
 */
-void SetItemBG(CInvSlotWnd* pInvSlotWnd, ItemPtr pItem, bool setDefault)
+static void SyncPersistentCache()
 {
-    // pInvSlotWnd must be valid for background to be changed
-    // If pItem (and thus pItemDef) is invalid, we return the slot to default
-    // If pItem is valid, and we have a valid pItemDef, we set the background appropriately
-    // If pItem is valid, but pItemDef is not, we return the slot to default
+    PersistentCacheSyncNeeded = false;
 
-    // If we have a valid item pointer, try to grab its ItemDefinition
-    ItemDefinition* pItemDef = nullptr;
-    if (pItem != nullptr)
+    if (!UsePersistentCache || gGameState != GAMESTATE_INGAME || !ActiveSettings)
     {
-        pItemDef = pItem->GetItemDefinition();
+        PersistentCache.Close();
+        PersistentCacheError.clear();
+        return;
     }
 
-    // Valid SlotWnd and ItemDef means we have an item in the slot to color
-    if ((pInvSlotWnd != nullptr) && (pItemDef != nullptr))
+    std::string path = GetPersistentCachePath();
+    if (PersistentCache.IsOpen() && PersistentCache.GetPath() == path &&
+        PersistentCache.GetCapacity() == std::bit_ceil(static_cast<size_t>(PersistentCacheSize)))
     {
-        // Based on Item Definition Flags in priority order, color background
-        // Default (Return to "Normal")
-        if (setDefault)
-        {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::Default);
-            SetBGTexture(pInvSlotWnd, true);
-        }
-		// has "8" aug slot (raid item)
-		else if (HasType8AugSlot(pItem) && GetItemColor(ItemColorAttribute::HasAugSlot8_Item).isOn())
-		{
-			SetBGColors(pInvSlotWnd, ItemColorAttribute::HasAugSlot8_Item);
-			SetBGTexture(pInvSlotWnd, false);
-		}
-		// if the itemdef has maxpower, it is a powersource
-		else if (pItemDef->MaxPower) {
-			SetBGColors(pInvSlotWnd, ItemColorAttribute::PowerSource_Item);
-			SetBGTexture(pInvSlotWnd, false);
-		}
-        // Quest
-        else if (pItemDef->QuestItem && GetItemColor(ItemColorAttribute::Quest_Item).isOn())
-        {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::Quest_Item);
-            SetBGTexture(pInvSlotWnd, false);
-        }
-        // TradeSkill
-        else if (pItemDef->TradeSkills && GetItemColor(ItemColorAttribute::TradeSkills_Item).isOn())
+        // Only classification settings bump SettingsVersion, colors and enabled attributes keep the file
+        if (PersistentCacheVersion != SettingsVersion)
         {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::TradeSkills_Item);
-            SetBGTexture(pInvSlotWnd, false);
-        }
-        // Collectible
-        else if (pItemDef->Collectible && GetItemColor(ItemColorAttribute::Collectible_Item).isOn())
-        {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::Collectible_Item);
-            SetBGTexture(pInvSlotWnd, false);
-        }
-        // Heirloom
-        else if (pItemDef->Heirloom && GetItemColor(ItemColorAttribute::Heirloom_Item).isOn())
-        {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::Heirloom_Item);
-            SetBGTexture(pInvSlotWnd, false);
-        }
-        // No Trade
-        // On FV server, color Normal No Trade only if FVNormalNoTrade setting is enabled
-        else if (((!pItemDef->IsDroppable || pItem->NoDropFlag) && GetItemColor(ItemColorAttribute::NoTrade_Item).isOn()) &&
-            ((FVServer && FVNormalNoTrade) || (!FVServer)))
-        {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::NoTrade_Item);
-            SetBGTexture(pInvSlotWnd, false);
-        }
-        // FV No Trade
-        // On FV server, color those that are FV No Trade using Normal No Trade settings
-        // Avoids coloring items that are normally No Trade but not on FV
-        else if (FVServer && (pItemDef->bIsFVNoDrop) && GetItemColor(ItemColorAttribute::NoTrade_Item).isOn())
-        {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::NoTrade_Item);
-            SetBGTexture(pInvSlotWnd, false);
-        }
-        // Attuneable
-        else if (pItemDef->Attuneable && GetItemColor(ItemColorAttribute::Attuneable_Item).isOn())
-        {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::Attuneable_Item);
-            SetBGTexture(pInvSlotWnd, false);
-        }
-		// Placeable
-		else if (pItemDef->Placeable && GetItemColor(ItemColorAttribute::Placeable_Item).isOn())
-		{
-			SetBGColors(pInvSlotWnd, ItemColorAttribute::Placeable_Item);
-			SetBGTexture(pInvSlotWnd, false);
-		}
-		// Has Type 20 or 21 aug slot (Ornamentations)
-		else if (IsOrnamentation(pItem) && GetItemColor(ItemColorAttribute::Ornamentation_Item).isOn())
-		{
-			SetBGColors(pInvSlotWnd, ItemColorAttribute::Ornamentation_Item);
-			SetBGTexture(pInvSlotWnd, false);
-		}
-        // Undefined (Return to "Normal")
-        else
-        {
-            SetBGColors(pInvSlotWnd, ItemColorAttribute::Default);
-            SetBGTexture(pInvSlotWnd, true);
+            uint64_t settingsHash = GetItemColorClassificationHash(*ActiveSettings);
+            if (settingsHash != PersistentCache.GetSettingsHash())
+            {
+                PersistentCache.Reset(settingsHash);
+            }
+            PersistentCacheVersion = SettingsVersion;
         }
+        return;
     }
-    // Only pInvSlotWnd valid, empty slot, return to normal
-    else if (pInvSlotWnd != nullptr)
+
+    PersistentCacheError.clear();
+    if (!PersistentCache.Open(path, PersistentCacheSize, GetItemColorClassificationHash(*ActiveSettings), PersistentCacheError))
     {
-        SetBGColors(pInvSlotWnd, ItemColorAttribute::Default);
-        SetBGTexture(pInvSlotWnd, true);
+        WriteChatf("\ayMQItemColor\ax Not keeping classification between sessions: %s", PersistentCacheError.c_str());
+        return;
     }
+
+    PersistentCacheVersion = SettingsVersion;
 }
 
 
 /**
-* @fn SearchInventory
+* @fn GetPersistentCacheStatus
 *
-* Searches through inventory slots to color only those slots we care about
-* Only colors those slots that are part of the player main inventory or bags,
-* avoids coloring worn items or any item buttons that may be created.
-*
-* @param setDefault bool - True to set the original colors, false (default) to set based on item attributes
+* @return std::string - Fill and counters of the persistent cache, or why it is not in use
 */
-void SearchInventory(bool setDefault)
+static std::string GetPersistentCacheStatus()
 {
-    if (!pInvSlotMgr)
+    if (!PersistentCache.IsOpen())
     {
-        return;
+        return !UsePersistentCache ? "off" : PersistentCacheError.empty() ? "not open" : PersistentCacheError;
     }
 
-    // Loop through each inventory slot
-    for (int index = 0; index < pInvSlotMgr->TotalSlots; index++)
-    {
-        // Grab slot at index
-        CInvSlot* pInvSlot = pInvSlotMgr->SlotArray[index];
-        if (!pInvSlot || !pInvSlot->bEnabled)
-        {
-            continue;
-        }
-
-        // Grab global index and pointer to item if one exists at slot
-        ItemGlobalIndex globalIndex = pInvSlot->pInvSlotWnd ? pInvSlot->pInvSlotWnd->ItemLocation : ItemGlobalIndex();
-        ItemContainerInstance location = globalIndex.GetLocation();
-
-        // Check if Index is Valid and the locations we want (Inventory, Bank, or Shared Bank)
-        if (globalIndex.IsValidLocation() &&
-            ((location == eItemContainerPossessions) || (location == eItemContainerBank) || (location == eItemContainerSharedBank)))
-        {
-            // Skip if Index is an Equipped Location
-            if (globalIndex.IsEquippedLocation())
-            {
-                continue;
-            }
-
-            // Grab the pointer for its CInvSlotWnd
-            CInvSlotWnd* pInvSlotWnd = pInvSlot->pInvSlotWnd;
-
-            // Skip if no valid CInvSlotWnd or Hot Button
-            if (!pInvSlotWnd || pInvSlotWnd->bHotButton)
-            {
-                continue;
-            }
-
-            // The remaining CInvSlotWnd at this point should be those in
-            // Inventory, Bank, or Shared Bank that either contain an item or not.
-            ItemPtr pItem = pLocalPC->GetItemByGlobalIndex(globalIndex);
-
-            // Contains Item
-            if (pItem)
-            {
-                // Set background color and texture for InvSlotWnd based on ItemDefinition
-                SetItemBG(pInvSlotWnd, pItem, setDefault);
-            }
-            // Does NOT Contain Item
-            else
-            {
-                // No Item but Valid InvSlotWnd, color default (empty slot)
-                SetItemBG(pInvSlotWnd, nullptr, true);
-            }
-        }
-    }
+    char status[MAX_STRING] = { 0 };
+    snprintf(status, sizeof(status), "%zu / %zu definitions%s  Hits: %llu  Misses: %llu  Full: %llu",
+        PersistentCache.GetSize(), PersistentCache.GetCapacity(), PersistentCache.WasReset() ? " (started empty)" : "",
+        static_cast<unsigned long long>(PersistentCache.Hits), static_cast<unsigned long long>(PersistentCache.Misses),
+        static_cast<unsigned long long>(PersistentCache.Rejected));
+    return status;
 }
 
 
 /**
-* @fn LoadSettingsFromINI
+* @fn CountPendingSlots
 *
-* Load settings from the INI for each of our colors and any general settings
+* @return int - Slots skipped because their window was closed, not yet colored
 */
-void LoadSettingsFromINI()
+static int CountPendingSlots()
 {
-    // Grab FVNormalNoTrade flag from INI
-    FVNormalNoTrade = GetPrivateProfileBool(GeneralSection, "FVNormalNoTrade", false, INIFileName);
-    // Grab UseGlowTexture flag from INI
-    UseGlowTexture = GetPrivateProfileBool(GeneralSection, "UseGlowTexture", false, INIFileName);
+    return static_cast<int>(std::count_if(SlotMemos.begin(), SlotMemos.end(),
+        [](const ItemColorSlotMemo& memo) { return memo.Pending; }));
+}
 
-    // Write out FVNormalNoTrade flag just in case it wasn't there
-    WritePrivateProfileBool(GeneralSection, "FVNormalNoTrade", FVNormalNoTrade, INIFileName);
-    // Write out UseGlowTexture flag just in case it wasn't there
-    WritePrivateProfileBool(GeneralSection, "UseGlowTexture", UseGlowTexture, INIFileName);
 
-    for (ItemColor& itemColor : AvailableItemColors)
-    {
-        itemColor.LoadFromIni(INIFileName);
-    }
+/**
+* @fn ResetStatistics
+*
+* Clears the phase timings, slot counters and classification cache counters
+*/
+static void ResetStatistics()
+{
+    Stats.Reset();
+    ClassificationCache.ResetCounters();
+    PersistentCache.ResetCounters();
+    ColorableSlots.ResetCounters();
 }
 
 
 /**
-* @fn SaveSettingsToINI
+* @fn WriteStatisticsToChat
 *
-* Save settings to the INI for each of our colors and any general settings
+* Writes the phase timings and slot counters to chat for /itemcolor stats
 */
-void SaveSettingsToINI()
+static void WriteStatisticsToChat()
 {
-    // Write General settings to INI
-    WriteGeneralSettingsToINI();
+    WriteChatf("\ayMQItemColor\ax Statistics over \ag%llu\ax pulses", Stats.Pulses);
+    WriteChatf("  Slots Visited: %llu  Not Colorable: %llu  Unchanged: %llu  Reclassified: %llu",
+        Stats.Total.SlotsVisited, Stats.Total.SlotsNotColorable, Stats.Total.SlotsUnchanged, Stats.Total.SlotsReclassified);
+    WriteChatf("  Writes Applied: %llu  Skipped: %llu", Stats.Total.WritesApplied, Stats.Total.WritesSkipped);
+    WriteChatf("  Last Pulse: Visited %llu  Reclassified %llu  Writes %llu",
+        Stats.Last.SlotsVisited, Stats.Last.SlotsReclassified, Stats.Last.WritesApplied);
+    WriteChatf("  Classification Cache: %zu / %zu  Hits: %llu  Misses: %llu  Evictions: %llu",
+        ClassificationCache.GetSize(), ClassificationCache.GetCapacity(),
+        ClassificationCache.Hits, ClassificationCache.Misses, ClassificationCache.Evictions);
+    WriteChatf("  Persistent Cache: %s", GetPersistentCacheStatus().c_str());
+    WriteChatf("  Search Index: %zu slots, %zu words", SearchIndex.GetSlotCount(), SearchIndex.GetWordCount());
+    WriteChatf("  Colorable Slots: %d  Filtered Out: %d  Index Rebuilds: %llu",
+        ColorableSlots.GetSize(), ColorableSlots.GetFilteredSlots(), ColorableSlots.GetRebuilds());
+    WriteChatf("  Skipped In Closed Windows: %llu  Pending Now: %d", Stats.Total.SlotsHidden, CountPendingSlots());
+    WriteChatf("  Classified By Workers: %llu  Threads: %d", Stats.Total.SlotsDeferred, ClassifyPool.GetThreadCount());
+    WriteChatf("  Blend Mode: %s  Table Entries Built On Last Change: %zu",
+        std::string(GetItemColorBlendModeName(BlendMode)).c_str(), BlendEntriesBuilt);
+    WriteChatf("  Last Full Sweep: %.2f ms over %d pulses", Sweep.GetLastDuration().count() / 1000.0, Sweep.GetLastPulses());
+    WriteChatf("  Scan Interval: %lld ms (%lld to %lld)  Rate: %.2f sweeps/s%s",
+        static_cast<long long>(Scheduler.GetInterval().count()), static_cast<long long>(Scheduler.GetMinInterval().count()),
+        static_cast<long long>(Scheduler.GetMaxInterval().count()), Scheduler.GetSweepsPerSecond(), Scheduler.IsPaused() ? " (paused)" : "");
+    WriteChatf("  Settings Load: %.2f ms%s", SettingsLoadTime.count() / 1000.0, SettingsLoadWroteINI ? " (wrote ini)" : "");
+
+    for (int phase = 0; phase < static_cast<int>(ItemColorPhase::Count); ++phase)
+    {
+        const ItemColorLatencyHistogram& histogram = Stats.GetHistogram(static_cast<ItemColorPhase>(phase));
+        if (histogram.GetCount() == 0)
+        {
+            continue;
+        }
+
+        std::string_view phaseName = GetItemColorPhaseName(static_cast<ItemColorPhase>(phase));
+        WriteChatf("  %-8.*s n=%llu  p50 %.2fus  p99 %.2fus  max %.2fus",
+            static_cast<int>(phaseName.size()), phaseName.data(), histogram.GetCount(),
+            histogram.GetPercentile(50).count() / 1000.0, histogram.GetPercentile(99).count() / 1000.0,
+            histogram.GetMax().count() / 1000.0);
+    }
 
-    // Write ItemColor settings to INI
-    WriteColorSettingsToINI();
+    if (!Stats.DetailedTiming)
+    {
+        WriteChatf("  Slot phases are not timed, use \ay/itemcolor stats detailed on\ax to time them");
+    }
 }
 
 
 /**
-* @fn InitializePlugin
+* @fn ItemColorSettings_Search
 *
-* This is called once on plugin initialization and can be considered the startup
-* routine for the plugin.
+* Sets up the Search area. Highlights slots matching the search box, the search runs on the next pulse
 */
-PLUGIN_API void InitializePlugin()
+static void ItemColorSettings_Search()
 {
-    // Load settings from INI
-    LoadSettingsFromINI();
+    // Section Title
+    ImGui::PushFont(imgui::LargeTextFont);
+    ImGui::TextColored(MQColor(255, 255, 0).ToImColor(), "Search");
+    ImGui::Separator();
+    ImGui::PopFont();
 
-    // Add XML for background texture
-    AddXMLFile("MQUI_ItemColorAnimation.xml");
+    if (ImGui::InputText("Find", SearchBuffer, sizeof(SearchBuffer)))
+    {
+        SearchBoxChanged = true;
+    }
+    HelpLabel("Attribute names, words starting item names, * patterns or \"quoted text\", every term has to match");
 
-    // Add Benchmark
-    bmMQItemColor = AddMQ2Benchmark("MQItemColor");
+    if (!SearchText.empty())
+    {
+        ImGui::Text("%zu slots match (%.3f ms)", SearchSlots.size(), SearchTime.count() / 1000000.0);
+        ImGui::SameLine();
+        if (ImGui::Button("Clear"))
+        {
+            SearchBuffer[0] = '\0';
+            SearchBoxChanged = true;
+        }
+    }
 
-    // Add Settings UI
-    AddSettingsPanel("plugins/ItemColor", ItemColorSettingsPanel);
+    ItemColorSettings_Color(ItemColorSearch, "Highlight slots matching the search");
 }
 
 
 /**
-* @fn ShutdownPlugin
+* @fn ItemColorSettings_Statistics
 *
-* This is called once when the plugin has been asked to shutdown. The plugin has
-* not actually shut down until this completes.
+* Sets up the Statistics area. Shows how much work the inventory scan is doing
 */
-PLUGIN_API void ShutdownPlugin()
+static void ItemColorSettings_Statistics()
 {
-    // Set inventory back to default backgrounds
-    SearchInventory(true);
+    // Section Title
+    ImGui::PushFont(imgui::LargeTextFont);
+    ImGui::TextColored(MQColor(255, 255, 0).ToImColor(), "Statistics");
+    ImGui::Separator();
+    ImGui::PopFont();
+
+    ImGui::Text("Pulses: %llu", Stats.Pulses);
+    ImGui::Text("Slots Visited: %llu  Not Colorable: %llu", Stats.Total.SlotsVisited, Stats.Total.SlotsNotColorable);
+    ImGui::Text("Slots Unchanged (Skipped): %llu", Stats.Total.SlotsUnchanged);
+    ImGui::Text("Slots Reclassified: %llu", Stats.Total.SlotsReclassified);
+    ImGui::Text("Colorable Slots: %d  Filtered Out: %d  Index Rebuilds: %llu",
+        ColorableSlots.GetSize(), ColorableSlots.GetFilteredSlots(), ColorableSlots.GetRebuilds());
+    ImGui::Text("Skipped In Closed Windows: %llu  Pending Now: %d", Stats.Total.SlotsHidden, CountPendingSlots());
+    ImGui::Text("Classified By Workers: %llu  Threads: %d", Stats.Total.SlotsDeferred, ClassifyPool.GetThreadCount());
+    ImGui::Text("Blend Table Entries Built On Last Change: %zu", BlendEntriesBuilt);
+    ImGui::Text("Last Full Sweep: %.2f ms over %d pulses", Sweep.GetLastDuration().count() / 1000.0, Sweep.GetLastPulses());
+    ImGui::Text("Scan Interval: %lld ms (%lld to %lld)  Rate: %.2f sweeps/s%s",
+        static_cast<long long>(Scheduler.GetInterval().count()), static_cast<long long>(Scheduler.GetMinInterval().count()),
+        static_cast<long long>(Scheduler.GetMaxInterval().count()), Scheduler.GetSweepsPerSecond(), Scheduler.IsPaused() ? " (paused)" : "");
+    ImGui::Text("Slot Window Writes: %llu  Skipped: %llu", Stats.Total.WritesApplied, Stats.Total.WritesSkipped);
+    ImGui::Text("Classification Cache: %zu / %zu definitions", ClassificationCache.GetSize(), ClassificationCache.GetCapacity());
+    ImGui::Text("Classification Cache Hits: %llu  Misses: %llu  Evictions: %llu",
+        ClassificationCache.Hits, ClassificationCache.Misses, ClassificationCache.Evictions);
+    ImGui::Text("Persistent Cache: %s", GetPersistentCacheStatus().c_str());
+    ImGui::Text("Search Index: %zu slots, %zu words", SearchIndex.GetSlotCount(), SearchIndex.GetWordCount());
+
+    // Phase timings
+    if (ImGui::Checkbox("Time Each Slot Phase", &Stats.DetailedTiming))
+    {
+        MarkSettingsDirty();
+    }
+    HelpLabel("Also time Filter, Lookup, Classify and Write for every slot, adds a little cost to each slot");
+
+    if (ImGui::BeginTable("##ItemColorPhases", 5))
+    {
+        ImGui::TableSetupColumn("Phase");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("p50 (us)");
+        ImGui::TableSetupColumn("p99 (us)");
+        ImGui::TableSetupColumn("Max (us)");
+        ImGui::TableHeadersRow();
+
+        for (int phase = 0; phase < static_cast<int>(ItemColorPhase::Count); ++phase)
+        {
+            const ItemColorLatencyHistogram& histogram = Stats.GetHistogram(static_cast<ItemColorPhase>(phase));
+            std::string_view phaseName = GetItemColorPhaseName(static_cast<ItemColorPhase>(phase));
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%.*s", static_cast<int>(phaseName.size()), phaseName.data());
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", histogram.GetCount());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", histogram.GetPercentile(50).count() / 1000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", histogram.GetPercentile(99).count() / 1000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", histogram.GetMax().count() / 1000.0);
+        }
+
+        ImGui::EndTable();
+    }
+
+    if (ImGui::Button("Reset Statistics"))
+    {
+        ResetStatistics();
+    }
+    ImGui::NewLine();
+}
+
+
+/**
+* @fn ItemColorSettingsPanel
+*
+* Sets up the settings ui for the MQ settings window
+*/
+void ItemColorSettingsPanel()
+{
+    // Save status
+    if (SettingsDirty)
+    {
+        ImGui::TextColored(MQColor(255, 255, 0).ToImColor(), "Unsaved changes");
+    }
+    else
+    {
+        switch (SettingsWriter.GetStatus())
+        {
+        case ItemColorIniWriter::Status::Saving:
+            ImGui::TextColored(MQColor(255, 255, 0).ToImColor(), "Saving...");
+            break;
+
+        case ItemColorIniWriter::Status::Saved:
+            ImGui::TextColored(MQColor(0, 255, 0).ToImColor(), "Saved");
+            break;
+
+        case ItemColorIniWriter::Status::Failed:
+            ImGui::TextColored(MQColor(255, 0, 0).ToImColor(), "Could not save settings to %s", INIFileName);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    ItemColorSettings_Search();
+    ItemColorSettings_General();
+    ItemColorSettings_Colors();
+    ItemColorSettings_Statistics();
+}
+
+
+/**
+* @fn ResolveBGTextures
+*
+* Looks up the default and glow background animations by name once, again after a UI reload
+*/
+static void ResolveBGTextures()
+{
+    if (!BGTexturesResolved && pSidlMgr)
+    {
+        pDefaultBGTexture = pSidlMgr->FindAnimation("A_RecessedBox");
+        pGlowBGTexture = pSidlMgr->FindAnimation("A_ItemColorRecessedBox");
+        BGTexturesResolved = true;
+    }
+}
+
+
+/**
+* @fn ToDefinitionInfo
+*
+* Copies the ItemDefinition fields the classifier reads
+*
+* @param pItemDef const ItemDefinition* - Definition of the item
+* @return ItemColorDefinitionInfo - Fields for GetItemDefinitionMask
+*/
+static ItemColorDefinitionInfo ToDefinitionInfo(const ItemDefinition* pItemDef)
+{
+    ItemColorDefinitionInfo itemInfo;
+    itemInfo.ItemID = pItemDef->ItemNumber;
+    itemInfo.QuestItem = pItemDef->QuestItem;
+    itemInfo.TradeSkills = pItemDef->TradeSkills;
+    itemInfo.Collectible = pItemDef->Collectible;
+    itemInfo.Heirloom = pItemDef->Heirloom;
+    itemInfo.IsDroppable = pItemDef->IsDroppable;
+    itemInfo.FVNoDrop = pItemDef->bIsFVNoDrop;
+    itemInfo.Attuneable = pItemDef->Attuneable;
+    itemInfo.Placeable = pItemDef->Placeable;
+    itemInfo.PowerSource = pItemDef->MaxPower != 0;
+    itemInfo.AugType = pItemDef->AugType;
+    itemInfo.RequiredLevel = pItemDef->RequiredLevel;
+    itemInfo.RecommendedLevel = pItemDef->RecommendedLevel;
+    itemInfo.ItemType = pItemDef->ItemType;
+    itemInfo.ItemClass = pItemDef->ItemClass;
+    itemInfo.Size = pItemDef->Size;
+    itemInfo.Weight = pItemDef->Weight;
+    itemInfo.Cost = pItemDef->Cost;
+    itemInfo.StackSize = pItemDef->StackSize;
+    itemInfo.Lore = pItemDef->Lore != 0;
+    itemInfo.Magic = pItemDef->Magic;
+
+    // Reduced to a bitset once here, so socket checks are a single and instead of a loop over the sockets
+    for (const auto& socket : pItemDef->AugData.Sockets)
+    {
+        itemInfo.SocketTypes |= GetItemColorSocketBit(socket.Type);
+    }
+
+    return itemInfo;
+}
+
+
+/**
+* @fn ToLocationKey
+*
+* Packs an ItemGlobalIndex into a single value for slot memos
+*
+* @param globalIndex const ItemGlobalIndex& - Location of the slot
+* @return uint64_t - Container in the top 16 bits followed by up to three slot indexes
+*/
+static uint64_t ToLocationKey(const ItemGlobalIndex& globalIndex)
+{
+    const ItemIndex& itemIndex = globalIndex.GetIndex();
+
+    return (static_cast<uint64_t>(static_cast<uint16_t>(globalIndex.GetLocation())) << 48) |
+        (static_cast<uint64_t>(static_cast<uint16_t>(itemIndex.GetSlot(0))) << 32) |
+        (static_cast<uint64_t>(static_cast<uint16_t>(itemIndex.GetSlot(1))) << 16) |
+        static_cast<uint64_t>(static_cast<uint16_t>(itemIndex.GetSlot(2)));
+}
+
+
+/**
+* @fn MakeSlotIdentity
+*
+* @param globalIndex const ItemGlobalIndex& - Location of the slot
+* @param pInvSlotWnd CInvSlotWnd* - Window of the slot
+* @param pItem const ItemClient* - Item in the slot, may be null for an empty slot
+* @return ItemColorSlotIdentity - What is in the slot now, compared against slot memos
+*/
+static ItemColorSlotIdentity MakeSlotIdentity(const ItemGlobalIndex& globalIndex, CInvSlotWnd* pInvSlotWnd, const ItemClient* pItem)
+{
+    ItemColorSlotIdentity identity;
+    identity.LocationKey = ToLocationKey(globalIndex);
+    identity.pWindow = pInvSlotWnd;
+    identity.pItem = pItem;
+    identity.ItemID = pItem ? pItem->GetID() : 0;
+    identity.NoDropFlag = pItem ? pItem->NoDropFlag : false;
+    return identity;
+}
+
+
+/**
+* @fn GetSlotInfo
+*
+* Reads the slot fields IsColorableSlot decides on
+*
+* @param pInvSlot CInvSlot* - Slot from pInvSlotMgr->SlotArray, not null
+* @return ItemColorSlotInfo - Fields of the slot
+*/
+static ItemColorSlotInfo GetSlotInfo(CInvSlot* pInvSlot)
+{
+    CInvSlotWnd* pInvSlotWnd = pInvSlot->pInvSlotWnd;
+
+    ItemColorSlotInfo slotInfo;
+    slotInfo.Enabled = pInvSlot->bEnabled;
+    slotInfo.HasWindow = pInvSlotWnd != nullptr;
+
+    if (pInvSlotWnd)
+    {
+        ItemGlobalIndex globalIndex = pInvSlotWnd->ItemLocation;
+
+        slotInfo.HotButton = pInvSlotWnd->bHotButton;
+        slotInfo.ValidLocation = globalIndex.IsValidLocation();
+        slotInfo.Equipped = slotInfo.ValidLocation && globalIndex.IsEquippedLocation();
+
+        switch (globalIndex.GetLocation())
+        {
+        case eItemContainerPossessions:
+            slotInfo.Container = ItemColorContainer::Possessions;
+            break;
+
+        case eItemContainerBank:
+            slotInfo.Container = ItemColorContainer::Bank;
+            break;
+
+        case eItemContainerSharedBank:
+            slotInfo.Container = ItemColorContainer::SharedBank;
+            break;
+
+        default:
+            slotInfo.Container = ItemColorContainer::Other;
+            break;
+        }
+    }
+
+    return slotInfo;
+}
+
+
+/**
+* @fn GetColorableSlotWnd
+*
+* Returns the window of a slot if it is one we care about, see IsColorableSlot.
+*
+* @param pInvSlot CInvSlot* - Slot from pInvSlotMgr->SlotArray
+* @return CInvSlotWnd* - Window to color, nullptr if the slot should not be colored
+*/
+static CInvSlotWnd* GetColorableSlotWnd(CInvSlot* pInvSlot)
+{
+    if (!pInvSlot)
+    {
+        return nullptr;
+    }
+
+    return IsColorableSlot(GetSlotInfo(pInvSlot)) ? pInvSlot->pInvSlotWnd : nullptr;
+}
+
+
+/**
+* @fn DeferSlotClassify
+*
+* Hands a changed slot to the classify workers if its item is not in the classification cache or the persistent cache.
+* The memo is left alone so the slot is still seen as changed until the result is applied,
+* a slot already queued or in the running batch is not queued again.
+*
+* @param index int - Index of the slot in pInvSlotMgr->SlotArray
+* @param identity const ItemColorSlotIdentity& - What is in the slot now, see MakeSlotIdentity
+* @param pItem const ItemClient* - Item in the slot, may be null for an empty slot
+* @return bool - True if the slot was queued for the workers, false to classify it now
+*/
+static bool DeferSlotClassify(int index, const ItemColorSlotIdentity& identity, const ItemClient* pItem)
+{
+    if (!pItem || SlotMemos[index].IsCurrent(identity, SettingsVersion))
+    {
+        return false;
+    }
+
+    const ItemDefinition* pItemDef = pItem->GetItemDefinition();
+    if (!pItemDef || ClassificationCache.Contains(pItemDef->ItemNumber) || PersistentCache.Contains(pItemDef->ItemNumber))
+    {
+        return false;
+    }
+
+    // Its record checks the slot still holds the same item when the result is applied
+    if (SlotMemos[index].Queued)
+    {
+        return true;
+    }
+    SlotMemos[index].Queued = true;
+
+    ItemColorClassifyRecord& record = PendingRecords.emplace_back();
+    record.SlotIndex = index;
+    record.Identity = identity;
+    record.NoDropFlag = pItem->NoDropFlag;
+    record.Info = ToDefinitionInfo(pItemDef);
+
+    ++Stats.Current.SlotsDeferred;
+    return true;
+}
+
+
+/**
+* @fn IsSearchSlot
+*
+* @param index int - Index of the slot in pInvSlotMgr->SlotArray
+* @return bool - True if the slot matches the search
+*/
+static bool IsSearchSlot(int index)
+{
+    return (index >= 0) && (static_cast<size_t>(index) < SearchSlotFlags.size()) && SearchSlotFlags[index];
+}
+
+
+/**
+* @fn GetSlotPaletteIndex
+*
+* @param settings const ItemColorSettingsSnapshot& - Settings the slot is colored with
+* @param index int - Index of the slot in SlotMemos
+* @return uint32_t - Palette index to color the slot with, the search highlight while the slot matches the search
+*/
+static uint32_t GetSlotPaletteIndex(const ItemColorSettingsSnapshot& settings, int index)
+{
+    if (settings.SearchHighlight.On && IsSearchSlot(index))
+    {
+        return ItemColorSearchPaletteIndex;
+    }
+
+    return settings.GetSlotPaletteIndex(SlotMemos[index]);
+}
+
+
+/**
+* @fn IndexSearchSlot
+*
+* Updates SearchIndex with what was just classified into a slot, nothing changes if it holds the same item as before
+*
+* @param index int - Index of the slot in pInvSlotMgr->SlotArray
+* @param pItem const ItemClient* - Item in the slot, may be null for an empty slot
+* @param memo const ItemColorSlotMemo& - Classification of the slot
+*/
+static void IndexSearchSlot(int index, const ItemClient* pItem, const ItemColorSlotMemo& memo)
+{
+    const ItemDefinition* pItemDef = (pItem != nullptr) ? pItem->GetItemDefinition() : nullptr;
+    if (pItemDef)
+    {
+        SearchIndex.SetSlot(index, pItemDef->ItemNumber, memo.AttributeMask, pItemDef->Name);
+    }
+    else
+    {
+        SearchIndex.ClearSlot(index);
+    }
+}
+
+
+// Item in a slot of pInvSlotMgr->SlotArray as ItemColorScanner reads it
+struct GameSlotItem
+{
+    // Keeps a slot's item alive while it is classified, empty for an item found by QueryItem
+    ItemPtr Holder;
+    const ItemClient* pItem = nullptr;
+    const ItemDefinition* pItemDef = nullptr;
+
+    int GetDefinitionID() const { return pItemDef ? pItemDef->ItemNumber : 0; }
+    bool GetNoDropFlag() const { return pItem->NoDropFlag; }
+    ItemColorDefinitionInfo GetDefinitionInfo() const { return ToDefinitionInfo(pItemDef); }
+};
+
+
+// Slots of pInvSlotMgr->SlotArray for ItemColorScanner, see ItemColorSlotSource
+class GameSlotSource : public ItemColorSlotSource
+{
+public:
+    using Window = CInvSlotWnd;
+    using Item = GameSlotItem;
+
+    // Leave items missing from the classification cache to ClassifyPool
+    bool Defer = false;
+
+    CInvSlotWnd* GetColorableWindow(int index)
+    {
+        return GetColorableSlotWnd(pInvSlotMgr->SlotArray[index]);
+    }
+
+    // The remaining CInvSlotWnd at this point should be those in
+    // Inventory, Bank, or Shared Bank that either contain an item or not.
+    GameSlotItem GetItem(int /*index*/, CInvSlotWnd* pInvSlotWnd)
+    {
+        GameSlotItem item;
+        item.Holder = pLocalPC->GetItemByGlobalIndex(pInvSlotWnd->ItemLocation);
+        item.pItem = item.Holder.get();
+        item.pItemDef = item.pItem ? item.pItem->GetItemDefinition() : nullptr;
+        return item;
+    }
+
+    ItemColorSlotIdentity GetIdentity(int /*index*/, CInvSlotWnd* pInvSlotWnd, const GameSlotItem& item)
+    {
+        return MakeSlotIdentity(pInvSlotWnd->ItemLocation, pInvSlotWnd, item.pItem);
+    }
+
+    bool DeferClassify(int index, const ItemColorSlotIdentity& identity, const GameSlotItem& item)
+    {
+        return Defer && DeferSlotClassify(index, identity, item.pItem);
+    }
+
+    void SlotClassified(int index, const GameSlotItem& item, const ItemColorSlotMemo& memo)
+    {
+        IndexSearchSlot(index, item.pItem, memo);
+    }
+
+    void SlotForgotten(int index)
+    {
+        SearchIndex.ClearSlot(index);
+    }
+
+    // Slots matching the search are colored with the search highlight
+    uint32_t GetPaletteIndex(int index, uint32_t paletteIndex)
+    {
+        return (ActiveSettings->SearchHighlight.On && IsSearchSlot(index)) ? ItemColorSearchPaletteIndex : paletteIndex;
+    }
+
+    void ReadWindow(const CInvSlotWnd* pInvSlotWnd, ItemColorSlotWndShadow& shadow)
+    {
+        shadow.BGTintNormal = pInvSlotWnd->BGTintNormal;
+        shadow.BGTintRollover = pInvSlotWnd->BGTintRollover;
+        shadow.pBackground = pInvSlotWnd->pBackground;
+    }
+
+    void WriteTint(CInvSlotWnd* pInvSlotWnd, uint32_t normalARGB, uint32_t rolloverARGB)
+    {
+        pInvSlotWnd->BGTintNormal = normalARGB;
+        pInvSlotWnd->BGTintRollover = rolloverARGB;
+    }
+
+    // Currently using the custom glow texture can cause a crash when creating a hot button from an item,
+    // glow is false for default slots and when the user has selected not to use the custom glow texture
+    const void* GetBackground(const CInvSlotWnd* pInvSlotWnd, bool glow)
+    {
+        if (pInvSlotWnd->pBackground == nullptr)
+        {
+            return nullptr;
+        }
+
+        ResolveBGTextures();
+        return glow ? pGlowBGTexture : pDefaultBGTexture;
+    }
+
+    void WriteBackground(CInvSlotWnd* pInvSlotWnd, const void* pTexture)
+    {
+        pInvSlotWnd->pBackground = static_cast<CTextureAnimation*>(const_cast<void*>(pTexture));
+    }
+};
+
+
+/**
+* @fn SetItemBG
+*
+* This function will change the given CInvSlotWnd pointer's CTextureAnimation
+* to/from the default or a more visible background for inventory slots.
+* Will also change the tint of the background normal and rollover colors.
+* Nothing is written if the window already shows what the plugin last applied.
+*
+* @param pInvSlotWnd CInvSlotWnd* - Pointer to the CInvSlotWnd we want to change the background color of
+* @param paletteIndex uint32_t - Palette index of the attribute or rule to color with, 0 to set the original colors
+*/
+void SetItemBG(CInvSlotWnd* pInvSlotWnd, uint32_t paletteIndex)
+{
+    GameSlotSource slots;
+    Scanner.SetItemBG(slots, pInvSlotWnd, *ActiveSettings, paletteIndex, Stats);
+}
+
+
+/**
+* @fn ColorSlot
+*
+* Colors a single inventory slot if it is one we care about, see GetColorableSlotWnd.
+* Slots whose contents have not changed since they were last colored are skipped.
+*
+* @param index int - Index of the slot in pInvSlotMgr->SlotArray
+* @param setDefault bool - True to set the original colors, false (default) to set based on item attributes
+* @param deferClassify bool - True to leave items missing from the classification cache to ClassifyPool
+*/
+static void ColorSlot(int index, bool setDefault, bool deferClassify = false)
+{
+    if (!pInvSlotMgr || index < 0 || index >= pInvSlotMgr->TotalSlots)
+    {
+        return;
+    }
+
+    GameSlotSource slots;
+    slots.Defer = deferClassify;
+    Scanner.ColorSlot(slots, index, *ActiveSettings, SettingsVersion, Stats, setDefault);
+}
+
+
+/**
+* @fn ApplyPendingSettings
+*
+* Swaps PendingSettings in and repaints only the slots whose color changed.
+* When only colors or enabled attributes changed the attribute masks kept in the slot memos are enough
+* and no items are looked up again. When items may classify differently every slot is checked again.
+*
+* @return ItemColorSettingsChange - What changed, nothing if there were no pending settings
+*/
+static ItemColorSettingsChange ApplyPendingSettings()
+{
+    ItemColorSettingsChange change;
+    if (!PendingSettings)
+    {
+        return change;
+    }
+
+    std::shared_ptr<const ItemColorSettingsSnapshot> previous = std::move(ActiveSettings);
+    ActiveSettings = std::move(PendingSettings);
+    PendingSettings.reset();
+
+    if (!previous)
+    {
+        return change;
+    }
+
+    change = CompareItemColorSettings(*previous, *ActiveSettings);
+    if (change.Reclassify)
+    {
+        ++SettingsVersion;
+        ClassificationCache.Clear();
+        PersistentCacheSyncNeeded = true;
+        FullScanRequested = true;
+        return change;
+    }
+
+    // Cache entries hold the attribute resolved with the old enabled attributes
+    if (change.EnabledAttributes != 0)
+    {
+        ClassificationCache.Clear();
+    }
+
+    if ((change.EnabledAttributes == 0) && !change.Repaint)
+    {
+        return change;
+    }
+
+    for (int index = 0; index < static_cast<int>(SlotMemos.size()); ++index)
+    {
+        ItemColorSlotMemo& memo = SlotMemos[index];
+        if (!memo.IsSet())
+        {
+            continue;
+        }
+
+        uint32_t previousIndex = GetSlotPaletteIndex(*previous, index);
+        if (memo.AttributeMask & change.EnabledAttributes)
+        {
+            memo.Attribute = ResolveItemColorAttribute(memo.AttributeMask, ActiveSettings->Classifier.EnabledAttributeMask);
+        }
+
+        // Default slots keep the default texture whatever UseGlowTexture is
+        uint32_t paletteIndex = GetSlotPaletteIndex(*ActiveSettings, index);
+        bool textureChanged = (paletteIndex != 0) && (previous->UseGlowTexture != ActiveSettings->UseGlowTexture);
+        if ((paletteIndex == previousIndex) && !textureChanged &&
+            (previous->GetPaletteEntry(previousIndex) == ActiveSettings->GetPaletteEntry(paletteIndex)))
+        {
+            continue;
+        }
+
+        SetItemBG(static_cast<CInvSlotWnd*>(const_cast<void*>(memo.Identity.pWindow)), paletteIndex);
+    }
+
+    return change;
+}
+
+
+/**
+* @fn ForgetSearchSlots
+*
+* Drops the index and the slots colored for the search, for when the slot memos are thrown away.
+* The search itself is kept and finds its slots again as they are classified.
+*/
+static void ForgetSearchSlots()
+{
+    SearchIndex.Clear();
+    SearchSlots.clear();
+    SearchSlotFlags.clear();
+    SearchGeneration = SearchIndex.GetGeneration();
+}
+
+
+/**
+* @fn RestoreChangedSlots
+*
+* Returns the slots the plugin colored back to the default colors and texture.
+* Only windows still owned by the slot manager are touched.
+*/
+static void RestoreChangedSlots()
+{
+    if (pInvSlotMgr)
+    {
+        for (int index = 0; index < pInvSlotMgr->TotalSlots; index++)
+        {
+            CInvSlot* pInvSlot = pInvSlotMgr->SlotArray[index];
+            if (pInvSlot && pInvSlot->pInvSlotWnd)
+            {
+                const ItemColorSlotWndShadow* pShadow = Scanner.FindShadow(pInvSlot->pInvSlotWnd);
+                if (pShadow && (pShadow->PaletteIndex != 0))
+                {
+                    SetItemBG(pInvSlot->pInvSlotWnd, 0);
+                }
+            }
+        }
+    }
+
+    Scanner.ForgetWindows();
+    SlotMemos.clear();
+    ForgetSearchSlots();
+}
+
+
+/**
+* @fn RefreshSearch
+*
+* Finds the slots matching the search in SearchIndex and repaints only those that started or stopped matching,
+* so clearing the search puts back the colors of the slots it changed and nothing else
+*/
+static void RefreshSearch()
+{
+    std::vector<int> matches;
+    std::chrono::steady_clock::time_point searchStart = std::chrono::steady_clock::now();
+    SearchIndex.Search(SearchQuery, matches);
+    SearchTime = std::chrono::steady_clock::now() - searchStart;
+    SearchGeneration = SearchIndex.GetGeneration();
+
+    std::vector<int> changed;
+    std::set_symmetric_difference(SearchSlots.begin(), SearchSlots.end(), matches.begin(), matches.end(), std::back_inserter(changed));
+    SearchSlots = std::move(matches);
+
+    SearchSlotFlags.assign(SlotMemos.size(), false);
+    for (int index : SearchSlots)
+    {
+        if (static_cast<size_t>(index) < SearchSlotFlags.size())
+        {
+            SearchSlotFlags[index] = true;
+        }
+    }
+
+    for (int index : changed)
+    {
+        if (static_cast<size_t>(index) < SlotMemos.size() && SlotMemos[index].IsSet())
+        {
+            SetItemBG(static_cast<CInvSlotWnd*>(const_cast<void*>(SlotMemos[index].Identity.pWindow)),
+                GetSlotPaletteIndex(*ActiveSettings, index));
+        }
+    }
+}
+
+
+/**
+* @fn SetSearch
+*
+* @param text std::string_view - Search to color slots for, see ItemColorSearchQuery, empty to clear it
+*/
+static void SetSearch(std::string_view text)
+{
+    SearchText = text;
+    SearchQuery = ParseItemColorSearch(text);
+    RefreshSearch();
+}
+
+
+/**
+* @fn GetOwnerWindow
+*
+* Walks up the parents of a window to the top level window that owns it (inventory, bag, bank)
+*
+* @param pWnd CXWnd* - Window to start from
+* @return CXWnd* - Top level window
+*/
+static CXWnd* GetOwnerWindow(CXWnd* pWnd)
+{
+    while (pWnd && pWnd->GetParentWindow())
+    {
+        pWnd = pWnd->GetParentWindow();
+    }
+
+    return pWnd;
+}
+
+
+/**
+* @fn RebuildWatchedWindows
+*
+* Rebuilds the watched windows from the owners of every slot.
+* Every slot with a window is watched, a closed bag may not be enabled or have a valid location yet.
+*/
+static void RebuildWatchedWindows()
+{
+    WatchedWindows.clear();
+    SlotOwners.assign(pInvSlotMgr->TotalSlots, -1);
+    std::unordered_map<CXWnd*, size_t> watchedLookup;
+
+    for (int index = 0; index < pInvSlotMgr->TotalSlots; index++)
+    {
+        CInvSlot* pInvSlot = pInvSlotMgr->SlotArray[index];
+        if (pInvSlot && pInvSlot->pInvSlotWnd)
+        {
+            if (CXWnd* pOwner = GetOwnerWindow(pInvSlot->pInvSlotWnd))
+            {
+                auto [it, inserted] = watchedLookup.try_emplace(pOwner, WatchedWindows.size());
+                if (inserted)
+                {
+                    WatchedWindows.push_back({ pOwner, pOwner->IsVisible() });
+                }
+
+                WatchedWindows[it->second].SlotIndexes.push_back(index);
+                SlotOwners[index] = static_cast<int>(it->second);
+            }
+        }
+    }
+
+    WatchedWindowsStale = false;
+}
+
+
+/**
+* @fn IsSlotHidden
+*
+* @param index int - Index of the slot in pInvSlotMgr->SlotArray
+* @return bool - True if the window owning the slot was closed when PollWindowVisibility last looked
+*/
+static bool IsSlotHidden(int index)
+{
+    if ((index < 0) || (index >= static_cast<int>(SlotOwners.size())) || (index >= static_cast<int>(SlotMemos.size())))
+    {
+        return false;
+    }
+
+    int owner = SlotOwners[index];
+    return (owner >= 0) && !WatchedWindows[owner].WasVisible;
+}
+
+
+/**
+* @fn PrepareSlotState
+*
+* Makes sure there is a memo for every slot and the watched windows are current before scanning
+*
+* @param setDefault bool - True if slots are being returned to default, which invalidates the memos
+* @return bool - False if there is no slot manager to scan
+*/
+static bool PrepareSlotState(bool setDefault)
+{
+    if (!pInvSlotMgr)
+    {
+        return false;
+    }
+
+    // Keep a memo entry for every slot, memos are invalid after returning slots to default
+    if (setDefault || SlotMemos.size() != static_cast<size_t>(pInvSlotMgr->TotalSlots))
+    {
+        if (SlotMemos.size() != static_cast<size_t>(pInvSlotMgr->TotalSlots))
+        {
+            WatchedWindowsStale = true;
+        }
+
+        SlotMemos.assign(pInvSlotMgr->TotalSlots, ItemColorSlotMemo());
+        ForgetSearchSlots();
+    }
+
+    // Only rebuilt when slots are created or destroyed so a scan does not allocate
+    if (WatchedWindowsStale)
+    {
+        RebuildWatchedWindows();
+    }
+
+    return true;
+}
+
+
+/**
+* @fn GetSlotArrayFingerprint
+*
+* Fingerprint of what ColorableSlots depends on, every slot and window pointer and the slots' enabled flags.
+* Only reads pointers and a flag per slot, none of the location checks GetColorableSlotWnd does.
+*
+* @return uint64_t - Changes when slots or their windows are created, destroyed or enabled
+*/
+static uint64_t GetSlotArrayFingerprint()
+{
+    uint64_t fingerprint = static_cast<uint64_t>(pInvSlotMgr->TotalSlots);
+
+    for (int index = 0; index < pInvSlotMgr->TotalSlots; index++)
+    {
+        CInvSlot* pInvSlot = pInvSlotMgr->SlotArray[index];
+        fingerprint = MixItemColorFingerprint(fingerprint, reinterpret_cast<uintptr_t>(pInvSlot));
+
+        if (pInvSlot)
+        {
+            fingerprint = MixItemColorFingerprint(fingerprint, reinterpret_cast<uintptr_t>(pInvSlot->pInvSlotWnd));
+            fingerprint = MixItemColorFingerprint(fingerprint, pInvSlot->bEnabled ? 1 : 0);
+        }
+    }
+
+    return fingerprint;
+}
+
+
+/**
+* @fn CheckCursorItem
+*
+* Checks if the item on the cursor changed, which means an item was picked up or put down.
+* A bag may have been put in or taken out of a slot so ColorableSlots is rebuilt on the next sweep.
+*
+* @return bool - True if the cursor item changed since the last check
+*/
+static bool CheckCursorItem()
+{
+    const ItemClient* pCursorItem = nullptr;
+    if (PcProfile* pProfile = GetPcProfile())
+    {
+        pCursorItem = pProfile->GetInventorySlot(InvSlot_Cursor).get();
+    }
+
+    if (pCursorItem == LastCursorItem)
+    {
+        return false;
+    }
+
+    LastCursorItem = pCursorItem;
+    ColorableSlots.Invalidate();
+    return true;
+}
+
+
+/**
+* @fn UpdateColorableSlots
+*
+* Rebuilds ColorableSlots if the slot array changed since it was built, along with the watched windows
+*/
+static void UpdateColorableSlots()
+{
+    bool rebuilt = ColorableSlots.Update(pInvSlotMgr->TotalSlots, GetSlotArrayFingerprint(),
+        [](int index) { return GetColorableSlotWnd(pInvSlotMgr->SlotArray[index]) != nullptr; });
+
+    // Windows may have been created or destroyed as well
+    if (rebuilt)
+    {
+        RebuildWatchedWindows();
+    }
+}
+
+
+/**
+* @fn SearchInventory
+*
+* Searches through every colorable slot at once and colors it, see ColorSlot.
+* Pulses use the budgeted BeginSweep/ContinueSweep instead.
+*
+* @param setDefault bool - True to set the original colors, false (default) to set based on item attributes
+*/
+void SearchInventory(bool setDefault)
+{
+    if (!PrepareSlotState(setDefault))
+    {
+        return;
+    }
+
+    UpdateColorableSlots();
+
+    // Loop through each colorable slot
+    for (int index : ColorableSlots.GetSlots())
+    {
+        ColorSlot(index, setDefault);
+    }
+}
+
+
+/**
+* @fn GetReclassifiedSlots
+*
+* @return uint64_t - Slots classified again so far, including this pulse
+*/
+static uint64_t GetReclassifiedSlots()
+{
+    return Stats.Total.SlotsReclassified + Stats.Current.SlotsReclassified;
+}
+
+
+/**
+* @fn BeginSweep
+*
+* Starts a full sweep over every colorable slot, continued each pulse by ContinueSweep.
+* If a sweep is already running it carries on from its cursor and covers every slot again.
+*/
+static void BeginSweep()
+{
+    if (PrepareSlotState(false))
+    {
+        // Event driven pulses already watch the cursor in PollInventorySignals
+        if (!EventDriven)
+        {
+            CheckCursorItem();
+        }
+
+        UpdateColorableSlots();
+        Sweep.Begin(ColorableSlots.GetSize());
+
+        Scheduler.SweepStarted(std::chrono::steady_clock::now());
+        SweepStartReclassified = GetReclassifiedSlots();
+    }
+}
+
+
+/**
+* @fn SweepSlot
+*
+* Colors a slot for a full sweep or from DirtySlots, unless the window owning it is closed.
+* Those are marked pending and colored when PollWindowVisibility sees the window open.
+*
+* @param index int - Index of the slot in pInvSlotMgr->SlotArray
+* @param deferClassify bool - True to leave items missing from the classification cache to ClassifyPool
+*/
+static void SweepSlot(int index, bool deferClassify)
+{
+    if (IsSlotHidden(index))
+    {
+        ++Stats.Current.SlotsHidden;
+        SlotMemos[index].Pending = true;
+        return;
+    }
+
+    ColorSlot(index, false, deferClassify);
+}
+
+
+/**
+* @fn ApplyClassifyResults
+*
+* Colors the slots of a batch ClassifyPool finished and adds their items to the classification cache.
+* Slots that changed since their record was taken, or a batch taken with older settings, are queued again.
+* Turning attributes on or off keeps SettingsVersion, so the attributes are resolved again with the active ones.
+*/
+static void ApplyClassifyResults()
+{
+    ItemColorClassifyBatch batch;
+    if (!ClassifyPool.TakeResults(batch))
+    {
+        return;
+    }
+
+    bool current = batch.SettingsVersion == SettingsVersion && pInvSlotMgr && pLocalPC;
+    for (size_t n = 0; n < batch.Records.size(); ++n)
+    {
+        const ItemColorClassifyRecord& record = batch.Records[n];
+        int index = record.SlotIndex;
+        if (index < static_cast<int>(SlotMemos.size()))
+        {
+            SlotMemos[index].Queued = false;
+        }
+
+        if (!current || index >= pInvSlotMgr->TotalSlots || index >= static_cast<int>(SlotMemos.size()))
+        {
+            if (pInvSlotMgr && index < pInvSlotMgr->TotalSlots)
+            {
+                DirtySlots.push_back(index);
+            }
+            continue;
+        }
+
+        CInvSlot* pInvSlot = pInvSlotMgr->SlotArray[index];
+        CInvSlotWnd* pInvSlotWnd = pInvSlot ? pInvSlot->pInvSlotWnd : nullptr;
+        if (!pInvSlotWnd || pInvSlotWnd != record.Identity.pWindow)
+        {
+            DirtySlots.push_back(index);
+            continue;
+        }
+
+        ItemGlobalIndex globalIndex = pInvSlotWnd->ItemLocation;
+        ItemPtr pItem = pLocalPC->GetItemByGlobalIndex(globalIndex);
+        if (MakeSlotIdentity(globalIndex, pInvSlotWnd, pItem.get()) != record.Identity)
+        {
+            DirtySlots.push_back(index);
+            continue;
+        }
+
+        const ItemColorClassifyResult& result = batch.Results[n];
+        uint32_t enabledAttributeMask = ActiveSettings->Classifier.EnabledAttributeMask;
+        if (!ClassificationCache.Contains(record.Info.ItemID))
+        {
+            ClassificationCache.Insert(record.Info.ItemID, result.DefinitionMask,
+                ResolveItemColorAttribute(result.DefinitionMask, enabledAttributeMask), result.DefinitionRule);
+        }
+        PersistentCache.Insert(record.Info.ItemID, result.DefinitionMask, record.Info.SocketTypes, result.DefinitionRule);
+
+        ItemColorSlotMemo& memo = SlotMemos[index];
+        memo.CheckCurrent(record.Identity, SettingsVersion);
+        memo.AttributeMask = result.AttributeMask;
+        memo.Attribute = ResolveItemColorAttribute(result.AttributeMask, enabledAttributeMask);
+        memo.Rule = result.Rule;
+
+        ++Stats.Current.SlotsReclassified;
+        IndexSearchSlot(index, pItem.get(), memo);
+        SetItemBG(pInvSlotWnd, GetSlotPaletteIndex(*ActiveSettings, index));
+    }
+}
+
+
+/**
+* @fn ContinueSweep
+*
+* Recolors queued slots first, then continues the running full sweep until it is done
+* or the per pulse slot or time budget is used up. Queued slots count against the slot budget,
+* and those whose window is closed are left pending like the sweep leaves them.
+*
+* @return bool - True if a full sweep finished this pulse
+*/
+static bool ContinueSweep()
+{
+    ItemColorTimingScope timeSweep(Stats.Time(ItemColorPhase::Sweep));
+
+    int slotsLeft = (ScanSlotBudget > 0) ? ScanSlotBudget : std::numeric_limits<int>::max();
+
+    // Items the workers classified since the last pulse, anything stale is queued below
+    ApplyClassifyResults();
+
+    // Slots that just changed jump the queue, what the slot budget leaves waits for the next pulse
+    // Results the workers could not apply come back here, so these are classified on the game thread
+    size_t dirtyCount = std::min(DirtySlots.size(), static_cast<size_t>(slotsLeft));
+    for (size_t n = 0; n < dirtyCount; ++n)
+    {
+        SweepSlot(DirtySlots[n], false);
+    }
+    DirtySlots.erase(DirtySlots.begin(), DirtySlots.begin() + dirtyCount);
+    slotsLeft -= static_cast<int>(dirtyCount);
+
+    if (!Sweep.IsInProgress() || !PrepareSlotState(false))
+    {
+        return false;
+    }
+
+    const std::vector<int>& slots = ColorableSlots.GetSlots();
+    bool deferClassify = ClassifyPool.GetThreadCount() > 0;
+    return Sweep.Continue(ColorableSlots.GetSize(), slotsLeft, std::chrono::microseconds(ScanTimeBudget),
+        [&slots, deferClassify](int position) { SweepSlot(slots[position], deferClassify); });
+}
+
+
+/**
+* @fn SubmitClassifyRecords
+*
+* Hands the records the sweep took to ClassifyPool. They wait while the workers are busy with an earlier batch,
+* and go back on the queue to be colored here if the workers were stopped.
+*/
+static void SubmitClassifyRecords()
+{
+    if (PendingRecords.empty() || ClassifyPool.IsBusy())
+    {
+        return;
+    }
+
+    if (ClassifyPool.GetThreadCount() == 0)
+    {
+        for (const ItemColorClassifyRecord& record : PendingRecords)
+        {
+            if (record.SlotIndex < static_cast<int>(SlotMemos.size()))
+            {
+                SlotMemos[record.SlotIndex].Queued = false;
+            }
+            DirtySlots.push_back(record.SlotIndex);
+        }
+        PendingRecords.clear();
+        return;
+    }
+
+    ItemColorClassifyBatch batch;
+    batch.Records = std::move(PendingRecords);
+    batch.Settings = ActiveSettings;
+    batch.SettingsVersion = SettingsVersion;
+    PendingRecords.clear();
+    ClassifyPool.Submit(std::move(batch));
+}
+
+
+/**
+* @fn PollInventorySignals
+*
+* Compares what each colorable slot of an open window holds against its memo and queues only the slots that changed,
+* so items that never pass the cursor (autoloot, trades, quest rewards, merchant buys) are colored on the next pulse.
+* Each slot costs one item lookup and an identity compare, nothing is classified or written here.
+* Slots never colored yet, pending or with the workers are left to the sweeps and ApplyClassifyResults.
+*/
+static void PollInventorySignals()
+{
+    if (!pInvSlotMgr || !pLocalPC)
+    {
+        return;
+    }
+
+    ItemColorTimingScope timeSignals(Stats.Time(ItemColorPhase::Signals));
+
+    // Slots were created or destroyed
+    if (SlotMemos.size() != static_cast<size_t>(pInvSlotMgr->TotalSlots))
+    {
+        FullScanRequested = true;
+        return;
+    }
+
+    // A bag put in or taken out through the cursor changes which slots are colorable
+    CheckCursorItem();
+    UpdateColorableSlots();
+
+    for (int index : ColorableSlots.GetSlots())
+    {
+        ItemColorSlotMemo& memo = SlotMemos[index];
+        if (!memo.IsSet() || memo.Pending || memo.Queued || IsSlotHidden(index))
+        {
+            continue;
+        }
+
+        CInvSlotWnd* pInvSlotWnd = pInvSlotMgr->SlotArray[index]->pInvSlotWnd;
+        ItemGlobalIndex globalIndex = pInvSlotWnd->ItemLocation;
+        ItemPtr pItem = pLocalPC->GetItemByGlobalIndex(globalIndex);
+
+        // Settings changes are caught by their own full sweep, only what the slot holds is compared
+        if (MakeSlotIdentity(globalIndex, pInvSlotWnd, pItem.get()) != memo.Identity)
+        {
+            // Pending until ColorSlot gets to it, so it is queued once
+            memo.Pending = true;
+            DirtySlots.push_back(index);
+        }
+    }
+}
+
+
+/**
+* @fn PollWindowVisibility
+*
+* Notes which bag, inventory and bank windows are open, sweeps skip the slots of closed ones.
+* Opening a window queues all of its slots so they are colored before they are seen,
+* including the ones left pending while it was closed and any that changed since.
+*/
+static void PollWindowVisibility()
+{
+    ItemColorTimingScope timeSignals(Stats.Time(ItemColorPhase::Signals));
+
+    for (WatchedWindow& watched : WatchedWindows)
+    {
+        bool visible = watched.pWnd->IsVisible();
+        if (visible != watched.WasVisible)
+        {
+            // Slots of a bag can be enabled or disabled with its window
+            ColorableSlots.Invalidate();
+            watched.WasVisible = visible;
+            if (visible)
+            {
+                DirtySlots.insert(DirtySlots.end(), watched.SlotIndexes.begin(), watched.SlotIndexes.end());
+            }
+        }
+    }
+}
+
+
+/**
+* @fn PollMerchantWindow
+*
+* Opening a merchant usually means items are about to be bought or sold, so sweeps go back to the fastest interval
+*/
+static void PollMerchantWindow()
+{
+    bool open = pMerchantWnd && pMerchantWnd->IsVisible();
+    if (open && !MerchantWasOpen)
+    {
+        Scheduler.Wake(std::chrono::steady_clock::now());
+    }
+
+    MerchantWasOpen = open;
+}
+
+
+/**
+* @fn CompileRules
+*
+* Compiles the rules and socket colors in an ini, safe to run on the ini watcher's thread
+*
+* @param loaded ItemColorLoadedIni& - Ini that was read, receives the rules and any problems
+*/
+static void CompileRules(ItemColorLoadedIni& loaded)
+{
+    LoadItemColorRules(loaded.Ini, RulesSection, MaxColorRules, ItemColorDefault.NormalColorDefault.ToARGB(),
+        ItemColorDefault.RolloverColorDefault.ToARGB(), *loaded.Rules, loaded.Errors);
+    LoadItemColorSocketColors(loaded.Ini, SocketColorsSection, MaxSocketColors, ItemColorDefault.NormalColorDefault.ToARGB(),
+        ItemColorDefault.RolloverColorDefault.ToARGB(), *loaded.Rules, loaded.Errors);
+}
+
+
+/**
+* @fn ApplyLoadedINI
+*
+* Takes the settings from an ini read from disk and builds PendingSettings from them.
+* The compiled rules only replace ColorRules when they differ, so an unchanged ini leaves the classification alone.
+*
+* @param loaded ItemColorLoadedIni& - Ini and rules read by LoadSettingsFromINI or IniWatcher
+* @param reportRules bool - Report problems with the rules even if they did not change
+*/
+static void ApplyLoadedINI(ItemColorLoadedIni& loaded, bool reportRules)
+{
+    ItemColorIniFile& ini = loaded.Ini;
+
+    // Grab FVNormalNoTrade flag from INI
+    FVNormalNoTrade = ini.GetBool(GeneralSection, "FVNormalNoTrade", false);
+    // Grab UseGlowTexture flag from INI
+    UseGlowTexture = ini.GetBool(GeneralSection, "UseGlowTexture", false);
+    // Grab BlendMode from INI, Priority if missing or unknown
+    BlendMode = ItemColorBlendMode::Priority;
+    ParseItemColorBlendMode(ini.GetString(GeneralSection, "BlendMode", "Priority"), BlendMode);
+    // Grab EventDriven flag from INI
+    EventDriven = ini.GetBool(GeneralSection, "EventDriven", true);
+    // Grab FullScanInterval from INI, keep it sane
+    FullScanInterval = std::clamp(ini.GetInt(GeneralSection, "FullScanInterval", 1000), 250, 10000);
+    // Grab scan intervals from INI, the max is never below the min
+    ScanIntervalMin = std::clamp(ini.GetInt(GeneralSection, "ScanIntervalMin", 100), 50, 10000);
+    ScanIntervalMax = std::clamp(ini.GetInt(GeneralSection, "ScanIntervalMax", 10000), ScanIntervalMin, 60000);
+    // Grab ClassificationCacheSize from INI, 0 turns the cache off
+    int cacheSize = std::max(ini.GetInt(GeneralSection, "ClassificationCacheSize", 1024), 0);
+    // Grab persistent cache settings from INI, the size is in definitions
+    UsePersistentCache = ini.GetBool(GeneralSection, "PersistentCache", false);
+    PersistentCacheSize = std::clamp(ini.GetInt(GeneralSection, "PersistentCacheSize", 32768), 1024, 1 << 22);
+    PersistentCacheSyncNeeded = true;
+    // Grab scan budgets from INI, 0 means no limit
+    ScanSlotBudget = std::max(ini.GetInt(GeneralSection, "ScanSlotBudget", 200), 0);
+    ScanTimeBudget = std::max(ini.GetInt(GeneralSection, "ScanTimeBudget", 500), 0);
+    // Grab ClassifyThreads from INI, 0 classifies on the game thread
+    ClassifyThreads = std::clamp(ini.GetInt(GeneralSection, "ClassifyThreads", 0), 0, MaxClassifyThreads);
+    // Grab DetailedTiming flag from INI
+    Stats.DetailedTiming = ini.GetBool(GeneralSection, "DetailedTiming", false);
+    // Grab HotReload flag from INI
+    HotReload = ini.GetBool(GeneralSection, "HotReload", true);
+
+    // Resizing empties the cache, only do it when the size changed
+    ClassificationCacheSize = cacheSize;
+    if (ClassificationCache.GetCapacity() != static_cast<size_t>(ClassificationCacheSize))
+    {
+        ClassificationCache.SetCapacity(ClassificationCacheSize);
+    }
+
+    for (ItemColor& itemColor : AvailableItemColors)
+    {
+        itemColor.LoadFromIni(ini);
+    }
+    ItemColorSearch.LoadFromIni(ini);
+
+    bool rulesChanged = loaded.Rules->Rules != ColorRules->Rules;
+    if (rulesChanged)
+    {
+        ColorRules = loaded.Rules;
+    }
+
+    if (rulesChanged || reportRules)
+    {
+        for (const std::string& error : loaded.Errors)
+        {
+            WriteChatf("%s", error.c_str());
+        }
+    }
+
+    RebuildSettings();
+}
+
+
+/**
+* @fn LoadSettingsFromINI
+*
+* Load settings from the INI for each of our colors and any general settings.
+* The file is read once, and written back once only if a setting was missing or out of range.
+*/
+void LoadSettingsFromINI()
+{
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+
+    ItemColorLoadedIni loaded;
+    bool iniRead = loaded.Ini.Load(INIFileName);
+    if (!iniRead)
+    {
+        WriteChatf("\ayMQItemColor\ax Could not read %s, using default settings", INIFileName);
+    }
+
+    CompileRules(loaded);
+    ApplyLoadedINI(loaded, true);
+
+    // Write out general settings just in case they weren't there
+    WriteGeneralSettings(loaded.Ini);
+
+    // Only touches the file if something was missing, never overwrite a file we could not read
+    SettingsLoadWroteINI = iniRead && loaded.Ini.IsDirty();
+    if (iniRead)
+    {
+        SaveIni(loaded.Ini);
+    }
+
+    // Do not reload what was just read or written
+    IniWatcher.MarkSeen(INIFileName);
+
+    SettingsLoadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - loadStart);
+
+    ApplyPendingSettings();
+}
+
+
+/**
+* @fn CheckForINIChanges
+*
+* Checks the INI's modification time now and then. When it changed, it is read and its rules compiled
+* on a background thread, and the settings are applied on a later pulse once that is done.
+* Nothing is reloaded while settings edited in the panel are waiting to be written, it would undo them.
+*/
+static void CheckForINIChanges()
+{
+    if (!HotReload)
+    {
+        return;
+    }
+
+    if (SettingsDirty || (SettingsWriter.GetStatus() == ItemColorIniWriter::Status::Saving))
+    {
+        IniWatcher.Ignore();
+        return;
+    }
+
+    if (std::unique_ptr<ItemColorLoadedIni> loaded = IniWatcher.TakeLoaded())
+    {
+        ApplyLoadedINI(*loaded, false);
+
+        // Our own writes read back the same, only mention changes made outside the plugin
+        if (ApplyPendingSettings().Any())
+        {
+            WriteChatf("\ayMQItemColor\ax Reloaded settings from %s", INIFileName);
+        }
+    }
+
+    IniWatcher.Poll(INIFileName, CompileRules);
+}
+
+
+/**
+* @fn SaveSettingsToINI
+*
+* Save settings to the INI for each of our colors and any general settings.
+* Waits for the write and stops SettingsWriter, so it is only used on shutdown.
+*/
+void SaveSettingsToINI()
+{
+    SettingsWriter.Submit(INIFileName, SnapshotSettings());
+    SettingsDirty = false;
+    SettingsWriter.Stop();
+
+    if (SettingsWriter.GetStatus() == ItemColorIniWriter::Status::Failed)
+    {
+        WriteChatf("\ayMQItemColor\ax Could not write settings to %s", INIFileName);
+    }
+}
+
+
+/**
+* @fn BenchmarkSettingsLoad
+*
+* Times reading and writing back every key of a copy of the INI with a profile call per key,
+* the way settings used to be loaded, against one read and one write of the whole file.
+*/
+static void BenchmarkSettingsLoad()
+{
+    std::string copyPath = std::string(INIFileName) + ".bench";
+    std::error_code ec;
+    std::filesystem::copy_file(INIFileName, copyPath, std::filesystem::copy_options::overwrite_existing, ec);
+    if (ec)
+    {
+        WriteChatf("\ayMQItemColor\ax Could not copy %s to benchmark", INIFileName);
+        return;
+    }
+
+    ItemColorIniFile keys;
+    keys.Load(copyPath);
+
+    // A profile read and write per key
+    int keyCount = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    keys.ForEachEntry([&](const std::string& section, const std::string& key, const std::string&)
+        {
+            std::string value = GetPrivateProfileString(section, key, "", copyPath);
+            WritePrivateProfileString(section, key, value, copyPath);
+            ++keyCount;
+        });
+    std::chrono::duration<double, std::milli> perKey = std::chrono::steady_clock::now() - start;
+
+    // One read, every key set in memory, and one write (skipped when nothing changed, as at startup)
+    start = std::chrono::steady_clock::now();
+    ItemColorIniFile ini;
+    ini.Load(copyPath);
+    keys.ForEachEntry([&](const std::string& section, const std::string& key, const std::string& value)
+        {
+            ini.SetString(section, key, ini.GetString(section, key, value));
+        });
+    ini.Save(copyPath);
+    std::chrono::duration<double, std::milli> singlePass = std::chrono::steady_clock::now() - start;
+
+    std::filesystem::remove(copyPath, ec);
+
+    WriteChatf("\ayMQItemColor\ax %d keys  Per key: %.2f ms  Single pass: %.2f ms  Startup load: %.2f ms%s",
+        keyCount, perKey.count(), singlePass.count(), SettingsLoadTime.count() / 1000.0,
+        SettingsLoadWroteINI ? " (wrote ini)" : "");
+}
+
+
+/**
+* @fn BenchmarkRules
+*
+* Times classifying every item in the inventory with the built in attributes alone and with the rules,
+* either the loaded rules or a number of generated rules shaped like real ones.
+*
+* @param generatedRules int - Number of rules to generate, 0 to use the loaded rules
+*/
+static void BenchmarkRules(int generatedRules)
+{
+    std::vector<ItemColorDefinitionInfo> items;
+    if (pInvSlotMgr && pLocalPC)
+    {
+        for (int index = 0; index < pInvSlotMgr->TotalSlots; index++)
+        {
+            if (CInvSlotWnd* pInvSlotWnd = GetColorableSlotWnd(pInvSlotMgr->SlotArray[index]))
+            {
+                ItemPtr pItem = pLocalPC->GetItemByGlobalIndex(pInvSlotWnd->ItemLocation);
+                if (ItemDefinition* pItemDef = pItem ? pItem->GetItemDefinition() : nullptr)
+                {
+                    items.push_back(ToDefinitionInfo(pItemDef));
+                }
+            }
+        }
+    }
+
+    if (items.empty())
+    {
+        WriteChatf("\ayMQItemColor\ax No items to benchmark, open your bags");
+        return;
+    }
+
+    ItemColorRuleProgram generatedProgram;
+    const ItemColorRuleProgram* pProgram = &ActiveSettings->Rules->Program;
+    if (generatedRules > 0)
+    {
+        std::string error;
+        for (int rule = 0; rule < generatedRules; ++rule)
+        {
+            generatedProgram.AddRule(rule, MakeItemColorBenchmarkRule(rule), rule, error);
+        }
+        generatedProgram.BuildIndex();
+        pProgram = &generatedProgram;
+    }
+
+    ItemColorRuleBenchmarkResult result = BenchmarkItemColorRules(items, *pProgram, ActiveSettings->Classifier, 20);
+    WriteChatf("\ayMQItemColor\ax %zu items, %zu rules (%zu tests)", items.size(), pProgram->GetRuleCount(), pProgram->GetTestCount());
+    WriteChatf("  Attributes only: %.1f ns/item  With rules: %.1f ns/item (%.1fx)  Matched: %d",
+        result.ChainNanoseconds, result.RulesNanoseconds,
+        result.ChainNanoseconds > 0 ? result.RulesNanoseconds / result.ChainNanoseconds : 0.0, result.Matches);
+}
+
+
+/**
+* @fn MakeBenchmarkSettings
+*
+* @param generatedRules int - Number of rules to generate, 0 to use the loaded rules
+* @return std::shared_ptr<const ItemColorSettingsSnapshot> - The loaded settings, or a copy of them with only the generated rules
+*/
+static std::shared_ptr<const ItemColorSettingsSnapshot> MakeBenchmarkSettings(int generatedRules)
+{
+    if (generatedRules <= 0)
+    {
+        return ActiveSettings;
+    }
+
+    auto ruleSet = std::make_shared<ItemColorRuleSet>();
+    std::string error;
+    for (int rule = 0; rule < generatedRules; ++rule)
+    {
+        ruleSet->Program.AddRule(rule, MakeItemColorBenchmarkRule(rule), rule, error);
+    }
+    ruleSet->Program.BuildIndex();
+
+    auto generated = std::make_shared<ItemColorSettingsSnapshot>(*ActiveSettings);
+    generated->Rules = std::move(ruleSet);
+    return generated;
+}
+
+
+/**
+* @fn BenchmarkClassifyThreads
+*
+* Times classifying synthetic slots on the game thread against 1 and more worker threads,
+* with the loaded settings or a copy of them with a number of generated rules.
+*
+* @param generatedRules int - Number of rules to generate, 0 to use the loaded rules
+*/
+static void BenchmarkClassifyThreads(int generatedRules)
+{
+    std::shared_ptr<const ItemColorSettingsSnapshot> settings = MakeBenchmarkSettings(generatedRules);
+
+    constexpr int RecordCount = 10000;
+    int maxThreads = std::clamp(std::max(ClassifyThreads, static_cast<int>(std::thread::hardware_concurrency())), 1, MaxClassifyThreads);
+    std::vector<ItemColorThreadBenchmarkResult> results =
+        BenchmarkItemColorClassifyPool(MakeItemColorBenchmarkRecords(RecordCount), settings, maxThreads, 5);
+
+    WriteChatf("\ayMQItemColor\ax %d slots, %zu rules", RecordCount, settings->Rules->Program.GetRuleCount());
+    double serial = results.empty() ? 0.0 : results.front().Milliseconds;
+    for (const ItemColorThreadBenchmarkResult& result : results)
+    {
+        WriteChatf("  %s%d: %.2f ms (%.2fx)", result.Threads == 0 ? "Game thread " : "Threads ", result.Threads,
+            result.Milliseconds, result.Milliseconds > 0 ? serial / result.Milliseconds : 0.0);
+    }
+}
+
+
+/**
+* @fn BenchmarkClassifyBlocks
+*
+* Times working out the attributes of synthetic slots a block at a time with each instruction set this CPU has,
+* and checks every one of them against classifying the slots one at a time.
+*/
+static void BenchmarkClassifyBlocks()
+{
+    constexpr int SlotCount = 10000;
+    std::vector<ItemColorDefinitionInfo> items;
+    std::vector<bool> noDropFlags;
+    for (const ItemColorClassifyRecord& record : MakeItemColorBenchmarkRecords(SlotCount))
+    {
+        items.push_back(record.Info);
+        noDropFlags.push_back(record.NoDropFlag);
+    }
+
+    std::vector<ItemColorBlockBenchmarkResult> results = BenchmarkItemColorBlocks(items, noDropFlags, ActiveSettings->Classifier, 20);
+
+    std::string_view best = GetItemColorSimdLevelName(GetItemColorSimdLevel());
+    WriteChatf("\ayMQItemColor\ax %d slots in blocks of %zu, using \ag%.*s\ax",
+        SlotCount, ItemColorFlagBlock::Size, static_cast<int>(best.size()), best.data());
+
+    double scalar = results.empty() ? 0.0 : results.front().Nanoseconds;
+    for (const ItemColorBlockBenchmarkResult& result : results)
+    {
+        std::string_view name = GetItemColorSimdLevelName(result.Level);
+        WriteChatf("  %-6.*s %.2f ns/slot (%.2fx)  %s%d mismatches\ax", static_cast<int>(name.size()), name.data(),
+            result.Nanoseconds, result.Nanoseconds > 0 ? scalar / result.Nanoseconds : 0.0,
+            result.Mismatches ? "\ar" : "\ag", result.Mismatches);
+    }
+}
+
+
+/**
+* @fn BenchmarkColdStart
+*
+* Times the first sweep of a session over synthetic slots, classifying every definition from scratch
+* against looking each one up in a persistent cache written by an earlier session.
+* Uses a scratch file next to the ini, never the server's own file.
+*
+* @param generatedRules int - Number of rules to generate, 0 to use the loaded rules
+*/
+static void BenchmarkColdStart(int generatedRules)
+{
+    std::shared_ptr<const ItemColorSettingsSnapshot> settings = MakeBenchmarkSettings(generatedRules);
+
+    constexpr int RecordCount = 10000;
+    std::string path = std::string(INIFileName) + ".iccache.bench";
+    ItemColorColdStartBenchmarkResult result;
+    std::string error;
+    if (!BenchmarkItemColorColdStart(MakeItemColorBenchmarkRecords(RecordCount), *settings, path, 5, result, error))
+    {
+        WriteChatf("\ayMQItemColor\ax Could not time a cold start: %s", error.c_str());
+        return;
+    }
+
+    double warm = result.OpenMilliseconds + result.WarmMilliseconds;
+    WriteChatf("\ayMQItemColor\ax First sweep of %d slots, %zu rules", RecordCount, settings->Rules->Program.GetRuleCount());
+    WriteChatf("  Without persistent cache: %.2f ms", result.ColdMilliseconds);
+    WriteChatf("  With persistent cache: %.2f ms (open %.3f ms, %llu hits, %llu misses) (%.2fx)", warm, result.OpenMilliseconds,
+        result.Hits, result.Misses, warm > 0 ? result.ColdMilliseconds / warm : 0.0);
+}
+
+
+/**
+* @fn CaptureFrame
+*
+* Adds every slot of the slot array to the capture as a frame, with what a scan reads from each one
+*/
+static void CaptureFrame()
+{
+    Capture.BeginFrame();
+
+    for (int index = 0; pInvSlotMgr && index < pInvSlotMgr->TotalSlots; ++index)
+    {
+        CInvSlot* pInvSlot = pInvSlotMgr->SlotArray[index];
+        if (!pInvSlot)
+        {
+            continue;
+        }
+
+        ItemColorSlotInfo slotInfo = GetSlotInfo(pInvSlot);
+        uint64_t locationKey = 0;
+        ItemPtr pItem;
+
+        if (CInvSlotWnd* pInvSlotWnd = pInvSlot->pInvSlotWnd)
+        {
+            locationKey = ToLocationKey(pInvSlotWnd->ItemLocation);
+            if (slotInfo.ValidLocation)
+            {
+                pItem = pLocalPC->GetItemByGlobalIndex(pInvSlotWnd->ItemLocation);
+            }
+        }
+
+        const ItemDefinition* pItemDef = pItem ? pItem->GetItemDefinition() : nullptr;
+        if (pItemDef)
+        {
+            ItemColorDefinitionInfo itemInfo = ToDefinitionInfo(pItemDef);
+            Capture.AddSlot(ItemColorCaptureSlot::Make(index, slotInfo, locationKey, pItem.get(), pItem->NoDropFlag, &itemInfo));
+        }
+        else
+        {
+            Capture.AddSlot(ItemColorCaptureSlot::Make(index, slotInfo, locationKey, nullptr, false, nullptr));
+        }
+    }
+
+    Capture.EndFrame();
+}
+
+
+/**
+* @fn FinishCapture
+*
+* Writes the capture next to the ini and stops capturing
+*/
+static void FinishCapture()
+{
+    Capturing = false;
+    CaptureFramesLeft = 0;
+
+    std::filesystem::path path = std::filesystem::path(INIFileName).parent_path() /
+        fmt::format("MQItemColor_{}.iccap", std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+
+    std::string error;
+    if (!Capture.Save(path.string(), error))
+    {
+        WriteChatf("\ayMQItemColor\ax \arCapture not written:\ax %s", error.c_str());
+        return;
+    }
+
+    WriteChatf("\ayMQItemColor\ax Wrote \ag%u\ax frames (%zu KB) to %s",
+        Capture.GetFrameCount(), (Capture.GetSize() + 1023) / 1024, path.string().c_str());
+
+    // Frames of a big bank add up, do not keep them around
+    Capture = ItemColorCaptureWriter();
+}
+
+
+/**
+* @fn ContinueCapture
+*
+* Takes the next capture frame when it is due, and writes the capture after the last one
+*/
+static void ContinueCapture()
+{
+    if (!Capturing || std::chrono::steady_clock::now() < NextCaptureFrame)
+    {
+        return;
+    }
+
+    CaptureFrame();
+    NextCaptureFrame = std::chrono::steady_clock::now() + CaptureInterval;
+
+    if (--CaptureFramesLeft <= 0)
+    {
+        FinishCapture();
+    }
+}
+
+
+/**
+* @fn QuerySlot
+*
+* Answers for a slot from its memo, so scripts see exactly what the slot was colored with.
+* Only slots holding an item and classified with the current settings have an answer.
+*
+* @param index int - Index of the slot in pInvSlotMgr->SlotArray
+* @param query ItemColorQuery& - Receives the classification of the slot
+* @return bool - True if the slot has an answer
+*/
+static bool QuerySlot(int index, ItemColorQuery& query)
+{
+    if (index < 0 || index >= static_cast<int>(SlotMemos.size()))
+    {
+        return false;
+    }
+
+    const ItemColorSlotMemo& memo = SlotMemos[index];
+    if (!memo.IsSet() || memo.Pending || memo.SettingsVersion != SettingsVersion || memo.Identity.ItemID == 0)
+    {
+        return false;
+    }
+
+    query.ItemID = memo.Identity.ItemID;
+    query.AttributeMask = memo.AttributeMask;
+    query.Attribute = memo.Attribute;
+    query.Rule = memo.Rule;
+    return true;
+}
+
+
+/**
+* @fn QueryItem
+*
+* Answers for an item found by ID or name, classified the same way as a slot holding it, through the classification cache
+*
+* @param szIndex const char* - Item ID, or name (an exact match when it starts with =)
+* @param query ItemColorQuery& - Receives the classification of the item
+* @return bool - True if the item was found
+*/
+static bool QueryItem(const char* szIndex, ItemColorQuery& query)
+{
+    if (!ActiveSettings || !szIndex || !szIndex[0])
+    {
+        return false;
+    }
+
+    ItemClient* pItem = IsNumber(szIndex) ? FindItemByID(GetIntFromString(szIndex, 0)) :
+        (szIndex[0] == '=') ? FindItemByName(szIndex + 1, true) : FindItemByName(szIndex, false);
+    if (!pItem)
+    {
+        return false;
+    }
+
+    const ItemDefinition* pItemDef = pItem->GetItemDefinition();
+    if (!pItemDef)
+    {
+        return false;
+    }
+
+    GameSlotItem item;
+    item.pItem = pItem;
+    item.pItemDef = pItemDef;
+
+    ItemColorSlotMemo memo;
+    Scanner.ClassifyItem(item, *ActiveSettings, memo);
+
+    query.ItemID = pItemDef->ItemNumber;
+    query.AttributeMask = memo.AttributeMask;
+    query.Attribute = memo.Attribute;
+    query.Rule = memo.Rule;
+    return true;
+}
+
+
+/**
+* @fn AppendBatchEntries
+*
+* Appends index:itemID:attribute:color for each slot with an answer from QuerySlot, starting at a slot index,
+* for as many slots as fit in a macro string
+*
+* @param start int - First slot index to look at
+* @param out std::string& - Receives the entries separated by commas
+*/
+static void AppendBatchEntries(int start, std::string& out)
+{
+    char entry[MAX_STRING] = { 0 };
+    char color[16] = { 0 };
+
+    for (int index = std::max(start, 0); index < static_cast<int>(SlotMemos.size()); ++index)
+    {
+        ItemColorQuery query;
+        if (!QuerySlot(index, query))
+        {
+            continue;
+        }
+
+        std::string_view attributeName = GetItemColorAttributeName(query.Attribute);
+        FormatItemColorValue(ActiveSettings->GetPaletteEntry(ActiveSettings->GetSlotPaletteIndex(query.ToMemo())).NormalARGB, color, sizeof(color));
+        int length = snprintf(entry, sizeof(entry), "%s%d:%d:%.*s:%s", out.empty() ? "" : ",",
+            index, query.ItemID, static_cast<int>(attributeName.size()), attributeName.data(), color);
+
+        // Leave the rest for the next page
+        if (length < 0 || out.size() + length >= MAX_STRING)
+        {
+            return;
+        }
+
+        out.append(entry, length);
+    }
+}
+
+
+// ${ItemColor.Item[...]} and ${ItemColor.Slot[...]}, what the plugin colors one item or slot with
+// The classification is packed into the variable itself, see ItemColorQuery::Pack
+class MQ2ItemColorQueryType : public MQ2Type
+{
+public:
+    enum Members
+    {
+        Attribute = 1,
+        Attributes,
+        Rule,
+        Color,
+        Rollover,
+        ItemID,
+    };
+
+    MQ2ItemColorQueryType() : MQ2Type("itemcolorquery")
+    {
+        TypeMember(Attribute);
+        TypeMember(Attributes);
+        TypeMember(Rule);
+        TypeMember(Color);
+        TypeMember(Rollover);
+        TypeMember(ItemID);
+    }
+
+    bool GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest) override
+    {
+        UNUSED(Index);
+
+        MQTypeMember* pMember = FindMember(Member);
+        if (!pMember || !ActiveSettings)
+        {
+            return false;
+        }
+
+        ItemColorQuery query = ItemColorQuery::Unpack(static_cast<uint64_t>(VarPtr.Int64));
+        const ItemColorPaletteEntry& entry = ActiveSettings->GetPaletteEntry(ActiveSettings->GetSlotPaletteIndex(query.ToMemo()));
+
+        switch (static_cast<Members>(pMember->ID))
+        {
+        // Attribute the item resolves to, Default if none of its attributes are turned on
+        case Attribute:
+        {
+            std::string_view name = GetItemColorAttributeName(query.Attribute);
+            strncpy_s(DataTypeTemp, name.data(), name.size());
+            Dest.Ptr = &DataTypeTemp[0];
+            Dest.Type = mq::datatypes::pStringType;
+            return true;
+        }
+
+        // Every attribute the item has, turned on or not, separated by |
+        case Attributes:
+        {
+            std::string names;
+            AppendItemColorAttributeNames(query.AttributeMask, '|', names);
+            strcpy_s(DataTypeTemp, names.c_str());
+            Dest.Ptr = &DataTypeTemp[0];
+            Dest.Type = mq::datatypes::pStringType;
+            return true;
+        }
+
+        // Expression of the rule that colors the item, empty if none matched
+        case Rule:
+        {
+            const std::vector<ItemColorRule>& rules = ActiveSettings->Rules->Rules;
+            bool matched = query.Rule >= 0 && query.Rule < static_cast<int>(rules.size());
+            strcpy_s(DataTypeTemp, matched ? rules[query.Rule].Expression.c_str() : "");
+            Dest.Ptr = &DataTypeTemp[0];
+            Dest.Type = mq::datatypes::pStringType;
+            return true;
+        }
+
+        case Color:
+            FormatItemColorValue(entry.NormalARGB, DataTypeTemp, MAX_STRING);
+            Dest.Ptr = &DataTypeTemp[0];
+            Dest.Type = mq::datatypes::pStringType;
+            return true;
+
+        case Rollover:
+            FormatItemColorValue(entry.RolloverARGB, DataTypeTemp, MAX_STRING);
+            Dest.Ptr = &DataTypeTemp[0];
+            Dest.Type = mq::datatypes::pStringType;
+            return true;
+
+        case ItemID:
+            Dest.Int = query.ItemID;
+            Dest.Type = mq::datatypes::pIntType;
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    bool ToString(MQVarPtr VarPtr, char* Destination) override
+    {
+        std::string_view name = GetItemColorAttributeName(ItemColorQuery::Unpack(static_cast<uint64_t>(VarPtr.Int64)).Attribute);
+        strncpy_s(Destination, MAX_STRING, name.data(), name.size());
+        return true;
+    }
+};
+MQ2ItemColorQueryType* pItemColorQueryType = nullptr;
+
+
+// ${ItemColor}, lets macros and Lua (mq.TLO.ItemColor) ask what the plugin colors an item or slot with
+class MQ2ItemColorType : public MQ2Type
+{
+public:
+    enum Members
+    {
+        Item = 1,
+        Slot,
+        Slots,
+        Batch,
+        BlendMode,
+    };
+
+    MQ2ItemColorType() : MQ2Type("itemcolor")
+    {
+        TypeMember(Item);
+        TypeMember(Slot);
+        TypeMember(Slots);
+        TypeMember(Batch);
+        TypeMember(BlendMode);
+    }
+
+    bool GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest) override
+    {
+        UNUSED(VarPtr);
+
+        MQTypeMember* pMember = FindMember(Member);
+        if (!pMember || !ActiveSettings)
+        {
+            return false;
+        }
+
+        ItemColorQuery query;
+        switch (static_cast<Members>(pMember->ID))
+        {
+        // Item[id], Item[name] or Item[=exact name]
+        case Item:
+            if (!QueryItem(Index, query))
+            {
+                return false;
+            }
+            Dest.Int64 = static_cast<int64_t>(query.Pack());
+            Dest.Type = pItemColorQueryType;
+            return true;
+
+        // Slot[index], index as given by Batch
+        case Slot:
+            if (!Index[0] || !QuerySlot(GetIntFromString(Index, -1), query))
+            {
+                return false;
+            }
+            Dest.Int64 = static_cast<int64_t>(query.Pack());
+            Dest.Type = pItemColorQueryType;
+            return true;
+
+        // Number of slots Batch can return
+        case Slots:
+            Dest.Int = 0;
+            for (int index = 0; index < static_cast<int>(SlotMemos.size()); ++index)
+            {
+                Dest.Int += QuerySlot(index, query) ? 1 : 0;
+            }
+            Dest.Type = mq::datatypes::pIntType;
+            return true;
+
+        // Batch[start], every classified slot from start on as index:itemID:attribute:color separated by commas,
+        // as many as fit in one string. Ask again from the last index + 1 until it comes back empty.
+        case Batch:
+        {
+            std::string entries;
+            AppendBatchEntries(GetIntFromString(Index, 0), entries);
+            strcpy_s(DataTypeTemp, entries.c_str());
+            Dest.Ptr = &DataTypeTemp[0];
+            Dest.Type = mq::datatypes::pStringType;
+            return true;
+        }
+
+        case BlendMode:
+        {
+            std::string_view name = GetItemColorBlendModeName(ActiveSettings->BlendMode);
+            strncpy_s(DataTypeTemp, name.data(), name.size());
+            Dest.Ptr = &DataTypeTemp[0];
+            Dest.Type = mq::datatypes::pStringType;
+            return true;
+        }
+
+        default:
+            return false;
+        }
+    }
+
+    bool ToString(MQVarPtr VarPtr, char* Destination) override
+    {
+        UNUSED(VarPtr);
+
+        strcpy_s(Destination, MAX_STRING, "MQItemColor");
+        return true;
+    }
+};
+MQ2ItemColorType* pItemColorType = nullptr;
+
+
+/**
+* @fn dataItemColor
+*
+* ${ItemColor} top level object
+*
+* @param szIndex const char* - Unused
+* @param Ret MQTypeVar& - Receives the ItemColor type
+* @return bool - Always true
+*/
+static bool dataItemColor(const char* szIndex, MQTypeVar& Ret)
+{
+    UNUSED(szIndex);
+
+    Ret.DWord = 0;
+    Ret.Type = pItemColorType;
+    return true;
+}
+
+
+/**
+* @fn ItemColorCommand
+*
+* Handles /itemcolor
+*   /itemcolor stats                   - Show phase timings and slot counters
+*   /itemcolor stats reset             - Clear them
+*   /itemcolor stats detailed [on|off] - Toggle timing of the per slot phases
+*   /itemcolor bench [rules]           - Time the rules against the built in attributes, optionally with generated rules
+*   /itemcolor bench ini               - Time loading the INI with a profile call per key against a single pass
+*   /itemcolor bench threads [rules]   - Time classifying slots on the game thread against worker threads
+*   /itemcolor bench simd              - Time block classification with each instruction set and check they agree
+*   /itemcolor bench coldstart [rules] - Time the first sweep of a session with and without the persistent cache
+*   /itemcolor cache clear             - Empty the persistent cache of this server
+*   /itemcolor capture [frames] [ms]   - Capture the slot array frames times, ms apart, for replaying offline
+*   /itemcolor capture stop            - Write the frames captured so far
+*   /itemcolor find [text]             - Highlight slots matching text, see ItemColorSearchQuery, clear it without text
+*
+* @param pChar PlayerClient* - Unused
+* @param szLine const char* - Arguments to the command
+*/
+void ItemColorCommand(PlayerClient* pChar, const char* szLine)
+{
+    UNUSED(pChar);
+
+    char szArg1[MAX_STRING] = { 0 };
+    char szArg2[MAX_STRING] = { 0 };
+    char szArg3[MAX_STRING] = { 0 };
+    GetArg(szArg1, szLine, 1);
+    GetArg(szArg2, szLine, 2);
+    GetArg(szArg3, szLine, 3);
+
+    if (ci_equals(szArg1, "stats"))
+    {
+        if (ci_equals(szArg2, "reset"))
+        {
+            ResetStatistics();
+            WriteChatf("\ayMQItemColor\ax Statistics reset");
+        }
+        else if (ci_equals(szArg2, "detailed"))
+        {
+            Stats.DetailedTiming = szArg3[0] ? GetBoolFromString(szArg3, true) : !Stats.DetailedTiming;
+            MarkSettingsDirty();
+            WriteChatf("\ayMQItemColor\ax Slot phase timing is \ag%s\ax", Stats.DetailedTiming ? "on" : "off");
+        }
+        else
+        {
+            WriteStatisticsToChat();
+        }
+        return;
+    }
+
+    if (ci_equals(szArg1, "bench") && ci_equals(szArg2, "ini"))
+    {
+        BenchmarkSettingsLoad();
+        return;
+    }
+
+    if (ci_equals(szArg1, "bench") && ci_equals(szArg2, "simd"))
+    {
+        BenchmarkClassifyBlocks();
+        return;
+    }
+
+    if (ci_equals(szArg1, "bench") && ci_equals(szArg2, "threads"))
+    {
+        BenchmarkClassifyThreads(std::clamp(GetIntFromString(szArg3, 0), 0, static_cast<int>(ItemColorRuleProgram::MaxIndexedRules)));
+        return;
+    }
+
+    if (ci_equals(szArg1, "bench") && ci_equals(szArg2, "coldstart"))
+    {
+        BenchmarkColdStart(std::clamp(GetIntFromString(szArg3, 0), 0, static_cast<int>(ItemColorRuleProgram::MaxIndexedRules)));
+        return;
+    }
+
+    if (ci_equals(szArg1, "cache") && ci_equals(szArg2, "clear"))
+    {
+        if (!PersistentCache.IsOpen())
+        {
+            WriteChatf("\ayMQItemColor\ax The persistent cache is %s", GetPersistentCacheStatus().c_str());
+            return;
+        }
+
+        // Item data can change with a patch, this drops anything classified before it
+        PersistentCache.Reset(PersistentCache.GetSettingsHash());
+        ClassificationCache.Clear();
+        ++SettingsVersion;
+        PersistentCacheVersion = SettingsVersion;
+        FullScanRequested = true;
+        WriteChatf("\ayMQItemColor\ax Emptied %s", PersistentCache.GetPath().c_str());
+        return;
+    }
+
+    if (ci_equals(szArg1, "capture"))
+    {
+        if (ci_equals(szArg2, "stop"))
+        {
+            if (Capturing)
+            {
+                FinishCapture();
+            }
+            return;
+        }
+
+        if (Capturing)
+        {
+            WriteChatf("\ayMQItemColor\ax A capture is already running, \ag/itemcolor capture stop\ax to write it");
+            return;
+        }
+
+        Capture.Start(ActiveSettings->Classifier);
+        Capturing = true;
+        CaptureFramesLeft = std::clamp(GetIntFromString(szArg2, 1), 1, MaxCaptureFrames);
+        CaptureInterval = std::chrono::milliseconds(std::clamp(GetIntFromString(szArg3, 1000), 0, 60000));
+        NextCaptureFrame = std::chrono::steady_clock::now();
+        WriteChatf("\ayMQItemColor\ax Capturing \ag%d\ax frames, %lld ms apart", CaptureFramesLeft,
+            static_cast<long long>(CaptureInterval.count()));
+        return;
+    }
+
+    if (ci_equals(szArg1, "find"))
+    {
+        // Everything after find is the search, quotes and all
+        std::string_view text = szLine;
+        size_t start = text.find_first_not_of(" \t");
+        start = (start == std::string_view::npos) ? text.size() : start + strlen(szArg1);
+        text.remove_prefix(std::min(start, text.size()));
+        size_t first = text.find_first_not_of(" \t");
+        text = (first == std::string_view::npos) ? std::string_view() : text.substr(first, text.find_last_not_of(" \t") - first + 1);
+
+        SetSearch(text);
+        strncpy_s(SearchBuffer, SearchText.c_str(), std::min(SearchText.size(), sizeof(SearchBuffer) - 1));
+        if (SearchQuery.IsEmpty())
+        {
+            WriteChatf("\ayMQItemColor\ax Search cleared");
+            return;
+        }
+
+        WriteChatf("\ayMQItemColor\ax \ag%zu\ax slots match \ag%s\ax (%.3f ms)", SearchSlots.size(), SearchText.c_str(),
+            SearchTime.count() / 1000000.0);
+        if (int pending = CountPendingSlots(); pending > 0)
+        {
+            WriteChatf("\ayMQItemColor\ax %d slots in closed windows are searched once they open", pending);
+        }
+        return;
+    }
+
+    if (ci_equals(szArg1, "bench"))
+    {
+        BenchmarkRules(std::clamp(GetIntFromString(szArg2, 0), 0, static_cast<int>(ItemColorRuleProgram::MaxIndexedRules)));
+        return;
+    }
+
+    WriteChatf("\ayMQItemColor\ax Usage:");
+    WriteChatf("  /itemcolor stats [reset | detailed [on|off]]");
+    WriteChatf("  /itemcolor bench [rules | ini | threads [rules] | simd | coldstart [rules]]");
+    WriteChatf("  /itemcolor cache clear");
+    WriteChatf("  /itemcolor capture [frames] [ms] | stop");
+    WriteChatf("  /itemcolor find [text]");
+}
+
+
+/**
+* @fn UpdateServerFlags
+*
+* Sets the flags for the server we are on, only meaningful in game
+*/
+static void UpdateServerFlags()
+{
+    // Check if we are on FV, set flag to true if we are
+    // This flag will be used for any special logic we need if on FV
+    if (strcmp(GetServerShortName(), "firiona") == 0)
+    {
+        FVServer = true;
+    }
+    else
+    {
+        FVServer = false;
+    }
+}
+
+
+/**
+* @fn InitializePlugin
+*
+* This is called once on plugin initialization and can be considered the startup
+* routine for the plugin.
+*/
+PLUGIN_API void InitializePlugin()
+{
+    // Loaded in game, the server flags are part of the settings the persistent cache is checked against
+    if (gGameState == GAMESTATE_INGAME)
+    {
+        UpdateServerFlags();
+    }
+
+    // Load settings from INI
+    LoadSettingsFromINI();
+
+    // Map the persistent cache for this server, nothing in it is read until a definition is looked up
+    Scanner.SetPersistentCache(&PersistentCache);
+    SyncPersistentCache();
+
+    // Add XML for background texture
+    AddXMLFile("MQUI_ItemColorAnimation.xml");
+
+    // Add Benchmark
+    bmMQItemColor = AddMQ2Benchmark("MQItemColor");
+
+    // Add Command
+    AddCommand("/itemcolor", ItemColorCommand);
+
+    // Add Settings UI
+    AddSettingsPanel("plugins/ItemColor", ItemColorSettingsPanel);
+
+    // Add ${ItemColor}
+    pItemColorQueryType = new MQ2ItemColorQueryType;
+    pItemColorType = new MQ2ItemColorType;
+    AddTopLevelObject("ItemColor", dataItemColor);
+}
+
+
+/**
+* @fn ShutdownPlugin
+*
+* This is called once when the plugin has been asked to shutdown. The plugin has
+* not actually shut down until this completes.
+*/
+PLUGIN_API void ShutdownPlugin()
+{
+    // Stop the classify workers before the slots they could still be working on are restored
+    ClassifyPool.SetThreadCount(0);
+
+    // Keep what was captured so far
+    if (Capturing)
+    {
+        FinishCapture();
+    }
+
+    // Write the persistent cache back and unmap it
+    PersistentCache.Close();
+
+    // Set the slots we colored back to default backgrounds
+    RestoreChangedSlots();
 
     // Save settings to INI
     SaveSettingsToINI();
@@ -594,8 +3105,16 @@ PLUGIN_API void ShutdownPlugin()
     // Remove Benchmark
     RemoveMQ2Benchmark(bmMQItemColor);
 
+    // Remove Command
+    RemoveCommand("/itemcolor");
+
     // Remove Settings UI
     RemoveSettingsPanel("plugins/ItemColor");
+
+    // Remove ${ItemColor}
+    RemoveTopLevelObject("ItemColor");
+    delete pItemColorType;
+    delete pItemColorQueryType;
 }
 
 
@@ -619,17 +3138,74 @@ PLUGIN_API void SetGameState(int GameState)
 {
     if (GameState == GAMESTATE_INGAME)
     {
-        // Check if we are on FV, set flag to true if we are
-        // This flag will be used for any special logic we need if on FV
-        if (strcmp(GetServerShortName(), "firiona") == 0)
-        {
-            FVServer = true;
-        }
-        else
-        {
-            FVServer = false;
-        }
+        UpdateServerFlags();
+        RebuildSettings();
+
+        // Sweeps start again from the fastest interval
+        Scheduler.Resume(std::chrono::steady_clock::now());
+
+        // The server may have changed, the next pulse opens its file once the settings above are swapped in
+        PersistentCacheSyncNeeded = true;
     }
+    else
+    {
+        // Nothing is swept while zoning, at character select or in loading screens
+        Scheduler.Pause();
+
+        // A good time to have what was learned this zone written out
+        PersistentCache.Flush();
+    }
+
+    // Recheck everything after a zone or returning to the game
+    FullScanRequested = true;
+}
+
+
+/**
+* @fn OnCleanUI
+*
+* This is called once just before the shutdown of the UI system and each time the
+* game requests that the UI be cleaned.  Most commonly this happens when a
+* /loadskin command is issued, but it also occurs when reaching the character
+* select screen and when first entering the game.
+*
+* Slot windows are destroyed here so forget every pointer we hold to them.
+*/
+PLUGIN_API void OnCleanUI()
+{
+    WatchedWindows.clear();
+    WatchedWindowsStale = true;
+    SlotOwners.clear();
+    ColorableSlots.Clear();
+    DirtySlots.clear();
+    SlotMemos.clear();
+    Scanner.ForgetWindows();
+    ForgetSearchSlots();
+
+    // Results the workers are still producing point at the old windows, drop them
+    ItemColorClassifyBatch staleBatch;
+    ClassifyPool.Wait();
+    ClassifyPool.TakeResults(staleBatch);
+    PendingRecords.clear();
+
+    BGTexturesResolved = false;
+    FullScanRequested = true;
+}
+
+
+/**
+* @fn OnReloadUI
+*
+* This is called once just after the UI system is loaded. Most commonly this
+* happens when a /loadskin command is issued, but it also occurs when first
+* entering the game.
+*
+* Animations may have moved, so look them up again.
+*/
+PLUGIN_API void OnReloadUI()
+{
+    BGTexturesResolved = false;
+    FullScanRequested = true;
 }
 
 
@@ -638,23 +3214,103 @@ PLUGIN_API void SetGameState(int GameState)
 *
 * This is called each time MQ2 goes through its heartbeat (pulse) function.
 *
-* Every time our pulse counter is hit, we take a look at
-* what is in our inventory and color it accordingly.
+* When event driven, slots queued by inventory signals are recolored every pulse
+* and a full sweep runs as a safety net every FullScanInterval ms.
+* Otherwise a full sweep of what is in our inventory starts every ScanIntervalMin ms,
+* sweeps that find nothing changed double the time to the next one up to ScanIntervalMax,
+* and any change goes straight back to the fastest. Nothing runs while Scheduler is paused outside the game.
+* Full sweeps are spread over pulses by the ScanSlotBudget and ScanTimeBudget settings.
 */
 PLUGIN_API void OnPulse()
 {
     // Benchmark on pulse
     MQScopedBenchmark bm(bmMQItemColor);
 
-    static std::chrono::steady_clock::time_point PulseTimer = std::chrono::steady_clock::now();
+    // Write any settings edited in the panel
+    WriteSettingsIfQuiet();
+
+    if (gGameState != GAMESTATE_INGAME || Scheduler.IsPaused())
+    {
+        return;
+    }
+
+    ItemColorTimingScope timePulse(Stats.Time(ItemColorPhase::Pulse));
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (EventDriven)
+    {
+        Scheduler.SetIntervals(std::chrono::milliseconds(FullScanInterval), std::chrono::milliseconds(FullScanInterval));
+    }
+    else
+    {
+        Scheduler.SetIntervals(std::chrono::milliseconds(ScanIntervalMin), std::chrono::milliseconds(ScanIntervalMax));
+    }
+
+    // Pick up changes made to the ini outside the game
+    CheckForINIChanges();
+
+    // Swap in changed settings and repaint the slots they affect, before any slot is looked at this pulse
+    ApplyPendingSettings();
+
+    // Open the persistent cache for this server, or empty it if the classification settings changed
+    if (PersistentCacheSyncNeeded)
+    {
+        SyncPersistentCache();
+    }
+
+    // Search for what was typed in the settings panel
+    if (SearchBoxChanged)
+    {
+        SearchBoxChanged = false;
+        SetSearch(SearchBuffer);
+    }
+
+    if (EventDriven)
+    {
+        PollInventorySignals();
+    }
+
+    // Closed windows are skipped by sweeps and caught up when they open, in either mode
+    PollWindowVisibility();
+    PollMerchantWindow();
+
+    // Anything seen above brings the next sweep forward, event driven pulses recolor queued slots without one
+    if (FullScanRequested || (!EventDriven && !DirtySlots.empty()))
+    {
+        Scheduler.Wake(now);
+    }
+
+    // Start a full sweep when asked to or when the scheduler says one is due
+    if (FullScanRequested || (!Sweep.IsInProgress() && Scheduler.IsSweepDue(now)))
+    {
+        BeginSweep();
+        FullScanRequested = false;
+    }
+
+    // Wait longer before the next sweep if this one changed nothing
+    if (ContinueSweep())
+    {
+        Scheduler.SweepDone(GetReclassifiedSlots() != SweepStartReclassified, std::chrono::steady_clock::now());
+    }
 
-    // Run only after timer is up
-    if ((std::chrono::steady_clock::now() > PulseTimer) && (gGameState == GAMESTATE_INGAME))
+    // Workers are only started or stopped between batches so the game thread never waits on them
+    if (ClassifyPool.GetThreadCount() != ClassifyThreads && !ClassifyPool.IsBusy())
     {
-        // Search through inventory and color slots
-        SearchInventory(false);
+        ClassifyPool.SetThreadCount(ClassifyThreads);
+    }
 
-        // Wait 100ms before running again
-        PulseTimer = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    // Hand the workers the slots this pulse's sweep left for them
+    SubmitClassifyRecords();
+
+    // Color slots that started or stopped matching the search since they changed
+    if (!SearchQuery.IsEmpty() && SearchIndex.GetGeneration() != SearchGeneration)
+    {
+        RefreshSearch();
     }
+
+    // Take the next capture frame if one is due
+    ContinueCapture();
+
+    // Fold this pulse's slot counters into the stats
+    Stats.EndPulse();
 }
@@ -2,26 +2,13 @@
 
 #include <mq/Plugin.h>
 
-// Enumerations of item attributes for each ItemColor
-// Matches index in AvailableItemColors[] except Default which is standalone
-enum class ItemColorAttribute
-{
-    Default = -1,
-    Quest_Item = 0,
-    TradeSkills_Item = 1,
-    Collectible_Item = 2,
-    Heirloom_Item = 3,
-    NoTrade_Item = 4,
-    Attuneable_Item = 5,
-    HasAugSlot8_Item = 6,
-    PowerSource_Item = 7,
-    Placeable_Item = 8,
-    Ornamentation_Item = 9,
-    Last
-};
+#include "ItemColorCore.h"
+#include "ItemColorIni.h"
 
 // ItemColor class holds information for each attribute we want to have a special color for
 // Holds the Name, Normal Color, and Rollover Color.  Knows how to read/write itself to ini.
+// This is the settings side, coloring slots only uses the ItemColorPaletteEntry built from it.
+// Names, ini keys and defaults come from the attribute's entry in ItemColorAttributes, nothing is built at startup.
 class ItemColor
 {
 public:
@@ -29,7 +16,7 @@ public:
     ItemColorAttribute ItemAttribute;
 
     // Name of ItemColor
-    std::string Name;
+    std::string_view Name;
 
     // On Flag
     bool On;
@@ -44,151 +31,82 @@ public:
     MQColor RolloverColorDefault;
 
     // INI Section/Profile Names
-    std::string ItemColorSection;
-    std::string OnProfile;
-    std::string NormalProfile;
-    std::string RolloverProfile;
-
-    // itemAttribute - Attribute type this color is for
-    // On            - Default Enable state
-    // NormalColor   - Color to use for Normal state (used as default too)
-    // RolloverColor - Color to use for Rollover state (used as default too)
-    ItemColor(ItemColorAttribute itemAttribute, bool On, MQColor NormalColor, MQColor RolloverColor) :
-        ItemAttribute(itemAttribute),
-        On(On), OnDefault(On),
-        NormalColor(NormalColor), NormalColorDefault(NormalColor),
-        RolloverColor(RolloverColor), RolloverColorDefault(RolloverColor)
+    std::string_view ItemColorSection;
+    std::string_view OnProfile;
+    std::string_view NormalProfile;
+    std::string_view RolloverProfile;
+
+    // info - Attribute this color is for, with its name, ini keys, default Enable state and default colors
+    ItemColor(const ItemColorAttributeInfo& info) :
+        ItemAttribute(info.Attribute),
+        Name(info.Name),
+        On(info.DefaultOn), OnDefault(info.DefaultOn),
+        NormalColor(info.DefaultNormalARGB), NormalColorDefault(info.DefaultNormalARGB),
+        RolloverColor(info.DefaultRolloverARGB), RolloverColorDefault(info.DefaultRolloverARGB),
+        ItemColorSection(info.Name),
+        OnProfile(info.OnKey),
+        NormalProfile(info.NormalKey),
+        RolloverProfile(info.RolloverKey)
     {
-        switch (itemAttribute)
-        {
-        case ItemColorAttribute::Quest_Item:
-            Name = "Quest";
-            break;
-
-        case ItemColorAttribute::TradeSkills_Item:
-            Name = "TradeSkills";
-            break;
-
-        case ItemColorAttribute::Collectible_Item:
-            Name = "Collectible";
-            break;
-
-        case ItemColorAttribute::Heirloom_Item:
-            Name = "Heirloom";
-            break;
-
-        case ItemColorAttribute::NoTrade_Item:
-            Name = "NoTrade";
-            break;
-
-        case ItemColorAttribute::Attuneable_Item:
-            Name = "Attuneable";
-            break;
-
-        case ItemColorAttribute::HasAugSlot8_Item:
-            Name = "HasAugSlot8";
-            break;
-
-        case ItemColorAttribute::PowerSource_Item:
-            Name = "PowerSource";
-            break;
-
-        case ItemColorAttribute::Placeable_Item:
-            Name = "Placeable";
-            break;
-
-        case ItemColorAttribute::Ornamentation_Item:
-            Name = "Ornamentation";
-            break;
-
-        default:
-            Name = "Unnamed";
-            break;
-        }
-
-        ItemColorSection = Name;
-        OnProfile = Name + "On";
-        NormalProfile = Name + "Normal";
-        RolloverProfile = Name + "Rollover";
     }
 
     // Returns On state of Color
     bool isOn() { return On; }
 
+    // Returns the plain data used while coloring slots
+    ItemColorPaletteEntry ToPaletteEntry() const { return { NormalColor.ToARGB(), RolloverColor.ToARGB(), On }; }
+
     // Resets for Colors back to the Defaults
     void SetNormalColorToDefault() { NormalColor = NormalColorDefault; }
     void SetRolloverColorToDefault() { RolloverColor = RolloverColorDefault; }
 
-    void WriteColorINI(std::string iniFileName)
+    void WriteColorINI(ItemColorIniFile& ini)
     {
-        // Grab On flag from INI, write out default if not there
-        WritePrivateProfileBool(ItemColorSection, OnProfile, On, iniFileName);
+        // Write out On flag
+        ini.SetBool(ItemColorSection, OnProfile, On);
 
         // Write out Normal Color converted to hex string
-        std::string NormalColorStr = fmt::format("0x{:X}", NormalColor.ToARGB());
-        WritePrivateProfileString(ItemColorSection, NormalProfile, NormalColorStr, iniFileName);
+        ini.SetString(ItemColorSection, NormalProfile, fmt::format("0x{:X}", NormalColor.ToARGB()));
 
         // Write out Rollover Color converted to hex string
-        std::string RolloverColorStr = fmt::format("0x{:X}", RolloverColor.ToARGB());
-        WritePrivateProfileString(ItemColorSection, RolloverProfile, RolloverColorStr, iniFileName);
+        ini.SetString(ItemColorSection, RolloverProfile, fmt::format("0x{:X}", RolloverColor.ToARGB()));
     }
 
-    void LoadFromIni(std::string iniFileName)
+    void LoadFromIni(ItemColorIniFile& ini)
     {
         // Grab On flag from INI
-        On = GetPrivateProfileBool(ItemColorSection, OnProfile, OnDefault, iniFileName);
+        On = ini.GetBool(ItemColorSection, OnProfile, OnDefault);
         // Write out On flag just in case it wasn't there
-        WritePrivateProfileBool(ItemColorSection, OnProfile, On, iniFileName);
+        ini.SetBool(ItemColorSection, OnProfile, On);
 
-        // Grab Normal Color from INI
-        std::string NormalColorStr = GetPrivateProfileString(ItemColorSection, NormalProfile, "", iniFileName);
-
-        // No Normal Color found in INI, Write out Default
-        if (NormalColorStr.empty())
-        {
-            NormalColorStr = fmt::format("0x{:X}", NormalColorDefault.ToARGB());
-            WritePrivateProfileString(ItemColorSection, NormalProfile, NormalColorStr, iniFileName);
-            NormalColor = NormalColorDefault;
-        }
-        // Normal Color found in INI, attempt to convert to unsigned int
-        else
-        {
-            try
-            {
-                NormalColor = std::stoul(NormalColorStr, nullptr, 16);
-            }
-            catch (const std::exception& e)
-            {
-                UNUSED(e);
-                WriteChatf("Invalid Normal Color in INI for %s", Name.c_str());
-                NormalColor = NormalColorDefault;
-            }
-        }
+        // Grab Normal Color from INI, attempt to convert to unsigned int
+        NormalColor = LoadColorFromIni(ini, NormalProfile, NormalColorDefault, "Normal");
 
+        // Grab Rollover Color from INI, attempt to convert to unsigned int
+        RolloverColor = LoadColorFromIni(ini, RolloverProfile, RolloverColorDefault, "Rollover");
+    }
 
-        // Grab Rollover Color from INI
-        std::string RolloverColorStr = GetPrivateProfileString(ItemColorSection, RolloverProfile, "", iniFileName);
+private:
+    MQColor LoadColorFromIni(ItemColorIniFile& ini, std::string_view profile, MQColor colorDefault, const char* colorName)
+    {
+        std::string colorStr = ini.GetString(ItemColorSection, profile, "");
 
-        // No Rollover Color found in INI, Write out Default
-        if (RolloverColorStr.empty())
-        {
-            RolloverColorStr = fmt::format("0x{:X}", RolloverColorDefault.ToARGB());
-            WritePrivateProfileString(ItemColorSection, RolloverProfile, RolloverColorStr, iniFileName);
-            RolloverColor = RolloverColorDefault;
-        }
-        // Rollover Color found in INI, attempt to convert to unsigned int
-        else
+        uint32_t argb = 0;
+        switch (ParseItemColorValue(colorStr, colorDefault.ToARGB(), argb))
         {
-            try
-            {
-                RolloverColor = std::stoul(RolloverColorStr, nullptr, 16);
-            }
-            catch (const std::exception& e)
-            {
-                UNUSED(e);
-                WriteChatf("Invalid Rollover Color in INI for %s", Name.c_str());
-                RolloverColor = RolloverColorDefault;
-            }
+        // No Color found in INI, Write out Default
+        case ItemColorValueResult::Missing:
+            ini.SetString(ItemColorSection, profile, fmt::format("0x{:X}", argb));
+            break;
+
+        case ItemColorValueResult::Invalid:
+            WriteChatf("Invalid %s Color in INI for %s", colorName, Name.data());
+            break;
+
+        default:
+            break;
         }
+
+        return argb;
     }
 };
\ No newline at end of file
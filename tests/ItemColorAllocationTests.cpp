@@ -0,0 +1,229 @@
+/**
+* ItemColorAllocationTests.cpp
+*
+* Replaces the global operator new with one that counts, and checks that ItemColorScanner, the same scanner the plugin
+* colors the game's slots with, makes no heap allocations sweeping a mock inventory once the memos, window shadows
+* and classification cache are filled.
+*
+*/
+
+#include "ItemColorMockInventory.h"
+#include "ItemColorTest.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    // Allocations are only counted while this is set, so the test framework's own strings are left out
+    bool CountingAllocations = false;
+    size_t AllocationCount = 0;
+
+    void* CountedAllocate(size_t size)
+    {
+        if (CountingAllocations)
+        {
+            ++AllocationCount;
+        }
+
+        if (void* pMemory = std::malloc(size ? size : 1))
+        {
+            return pMemory;
+        }
+        throw std::bad_alloc();
+    }
+
+    // Allocations made by the calls in between, counting starts when it is made and stops when it goes out of scope
+    class AllocationCounter
+    {
+    public:
+        AllocationCounter()
+        {
+            AllocationCount = 0;
+            CountingAllocations = true;
+        }
+
+        ~AllocationCounter()
+        {
+            CountingAllocations = false;
+        }
+
+        size_t Stop()
+        {
+            CountingAllocations = false;
+            return AllocationCount;
+        }
+    };
+
+    // Mock slot array colored straight through ItemColorScanner, the way the plugin's ColorSlot and SetItemBG do
+    struct MockInventory
+    {
+        ItemColorMockItemSource Source{ 400 };
+        ItemColorMockSlotManager Slots;
+        ItemColorMockSlotSource SlotSource{ Slots, Source };
+        ItemColorScanner Scanner;
+        ItemColorStats Stats;
+        std::shared_ptr<ItemColorSettingsSnapshot> Settings;
+
+        explicit MockInventory(int slotCount)
+        {
+            ItemColorClassifierSettings classifier;
+            classifier.EnabledAttributeMask = GetItemColorDefaultEnabledMask();
+            Settings = MakeItemColorMockSettings(classifier);
+            Slots.Generate(slotCount, Source);
+            Scanner.GetCache().SetCapacity(1024);
+            Scanner.GetMemos().resize(slotCount);
+        }
+
+        ItemColorPulseCounters Sweep(uint32_t settingsVersion)
+        {
+            Stats.Current = ItemColorPulseCounters();
+            for (int index = 0; index < Slots.GetTotalSlots(); ++index)
+            {
+                Scanner.ColorSlot(SlotSource, index, *Settings, settingsVersion, Stats);
+            }
+            return Stats.Current;
+        }
+    };
+}
+
+
+void* operator new(size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* pMemory) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete(void* pMemory, size_t) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t) noexcept
+{
+    std::free(pMemory);
+}
+
+
+// The counter has to see the allocations the scan would make, or a pass means nothing
+ITEMCOLOR_TEST(CounterSeesAllocations)
+{
+    AllocationCounter counter;
+    auto pSettings = std::make_shared<ItemColorSettingsSnapshot>();
+    ITEMCOLOR_CHECK(counter.Stop() > 0);
+}
+
+
+// Nothing in the inventory changes, every slot is skipped by its memo
+ITEMCOLOR_TEST(UnchangedSweepsDoNotAllocate)
+{
+    MockInventory inventory(4000);
+    inventory.Sweep(1);
+
+    AllocationCounter counter;
+    ItemColorPulseCounters counters;
+    for (int sweep = 0; sweep < 50; ++sweep)
+    {
+        counters = inventory.Sweep(1);
+    }
+    size_t allocations = counter.Stop();
+
+    ITEMCOLOR_CHECK_EQUAL(allocations, 0u);
+    ITEMCOLOR_CHECK_EQUAL(counters.SlotsReclassified, 0u);
+}
+
+
+// Every slot classifies again and looks its color up in the palette, with every definition already cached
+ITEMCOLOR_TEST(ReclassifyingSweepsDoNotAllocate)
+{
+    MockInventory inventory(4000);
+    inventory.Sweep(1);
+
+    AllocationCounter counter;
+    ItemColorPulseCounters counters;
+    for (uint32_t settingsVersion = 2; settingsVersion < 50; ++settingsVersion)
+    {
+        counters = inventory.Sweep(settingsVersion);
+    }
+    size_t allocations = counter.Stop();
+
+    ITEMCOLOR_CHECK_EQUAL(allocations, 0u);
+    ITEMCOLOR_CHECK(counters.SlotsReclassified > 0);
+}
+
+
+// Items move between slots and new copies of items already seen are looted, between every sweep
+ITEMCOLOR_TEST(SweepsAfterItemsMoveDoNotAllocate)
+{
+    MockInventory inventory(4000);
+    inventory.Sweep(1);
+
+    // Items are only ever taken from slots, so every definition they use is already cached
+    int slotCount = inventory.Slots.GetTotalSlots();
+    uint64_t reclassified = 0;
+
+    AllocationCounter counter;
+    for (int sweep = 0; sweep < 50; ++sweep)
+    {
+        for (int move = 0; move < 40; ++move)
+        {
+            int first = static_cast<int>(inventory.Source.Next(slotCount));
+            int second = static_cast<int>(inventory.Source.Next(slotCount));
+            inventory.Slots.SwapItems(first, second);
+
+            const ItemColorMockSlot& slot = inventory.Slots.GetSlot(second);
+            inventory.Slots.SetItem(first, slot.ItemID, !slot.NoDropFlag);
+        }
+
+        reclassified += inventory.Sweep(1).SlotsReclassified;
+    }
+    size_t allocations = counter.Stop();
+
+    ITEMCOLOR_CHECK_EQUAL(allocations, 0u);
+    ITEMCOLOR_CHECK(reclassified > 0);
+}
+
+
+// Colors change and every colored window is repainted from its memo, as ApplyPendingSettings and RefreshSearch do
+ITEMCOLOR_TEST(RepaintsDoNotAllocate)
+{
+    MockInventory inventory(4000);
+    inventory.Sweep(1);
+
+    const std::vector<ItemColorSlotMemo>& memos = inventory.Scanner.GetMemos();
+    uint64_t applied = 0;
+
+    AllocationCounter counter;
+    for (int repaint = 0; repaint < 50; ++repaint)
+    {
+        inventory.Stats.Current = ItemColorPulseCounters();
+        for (const ItemColorSlotMemo& memo : memos)
+        {
+            if (memo.IsSet())
+            {
+                ItemColorMockSlotWnd* pWindow = static_cast<ItemColorMockSlotWnd*>(const_cast<void*>(memo.Identity.pWindow));
+                uint32_t paletteIndex = (repaint % 2) ? 0 : inventory.Settings->GetSlotPaletteIndex(memo);
+                inventory.Scanner.SetItemBG(inventory.SlotSource, pWindow, *inventory.Settings, paletteIndex, inventory.Stats);
+            }
+        }
+        applied += inventory.Stats.Current.WritesApplied;
+    }
+    size_t allocations = counter.Stop();
+
+    ITEMCOLOR_CHECK_EQUAL(allocations, 0u);
+    ITEMCOLOR_CHECK(applied > 0);
+}
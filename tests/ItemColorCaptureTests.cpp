@@ -0,0 +1,276 @@
+/**
+* ItemColorCaptureTests.cpp
+*
+* Writes captures of the mock slot array to the temp directory and maps them back in, checking every slot and definition
+* comes back as it was recorded, that damaged files are turned away and that a replay visits every captured slot.
+*
+*/
+
+#include "ItemColorCapture.h"
+#include "ItemColorMockInventory.h"
+#include "ItemColorTest.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr int SlotCount = 300;
+    constexpr int FrameCount = 4;
+
+    // What went into a capture, to compare the mapped file against
+    struct RecordedFrame
+    {
+        std::vector<ItemColorMockSlot> Slots;
+    };
+
+    ItemColorClassifierSettings MakeClassifier()
+    {
+        ItemColorClassifierSettings classifier;
+        classifier.FVServer = true;
+        classifier.EnabledAttributeMask = GetItemColorDefaultEnabledMask();
+        return classifier;
+    }
+
+    // Records FrameCount frames of a slot array, with items looted, moved and destroyed between them
+    std::vector<RecordedFrame> WriteCapture(const std::string& path, ItemColorMockItemSource& source)
+    {
+        ItemColorMockSlotManager slots;
+        slots.Generate(SlotCount, source);
+
+        ItemColorCaptureWriter writer;
+        writer.Start(MakeClassifier());
+
+        std::vector<RecordedFrame> frames;
+        for (int frame = 0; frame < FrameCount; ++frame)
+        {
+            AddItemColorMockFrame(writer, slots, source);
+            frames.push_back({ std::vector<ItemColorMockSlot>(SlotCount) });
+            for (int index = 0; index < SlotCount; ++index)
+            {
+                frames.back().Slots[index] = slots.GetSlot(index);
+            }
+
+            for (int change = 0; change < 10; ++change)
+            {
+                slots.SetItem(static_cast<int>(source.Next(SlotCount)), source.NextItemID(), source.Next(2) != 0);
+                slots.SwapItems(static_cast<int>(source.Next(SlotCount)), static_cast<int>(source.Next(SlotCount)));
+            }
+            slots.SetItem(static_cast<int>(source.Next(SlotCount)), 0, false);
+        }
+
+        ITEMCOLOR_CHECK_EQUAL(writer.GetFrameCount(), static_cast<uint32_t>(FrameCount));
+
+        std::string error;
+        ITEMCOLOR_CHECK(writer.Save(path, error));
+        ITEMCOLOR_CHECK_EQUAL(std::filesystem::file_size(path), sizeof(ItemColorCaptureHeader) + writer.GetSize());
+        return frames;
+    }
+
+    bool SameDefinition(const ItemColorDefinitionInfo& actual, const ItemColorDefinitionInfo& expected)
+    {
+        return actual.ItemID == expected.ItemID &&
+            actual.QuestItem == expected.QuestItem &&
+            actual.TradeSkills == expected.TradeSkills &&
+            actual.Collectible == expected.Collectible &&
+            actual.Heirloom == expected.Heirloom &&
+            actual.IsDroppable == expected.IsDroppable &&
+            actual.FVNoDrop == expected.FVNoDrop &&
+            actual.Attuneable == expected.Attuneable &&
+            actual.Placeable == expected.Placeable &&
+            actual.PowerSource == expected.PowerSource &&
+            actual.AugType == expected.AugType &&
+            actual.SocketTypes == expected.SocketTypes &&
+            actual.RequiredLevel == expected.RequiredLevel &&
+            actual.RecommendedLevel == expected.RecommendedLevel &&
+            actual.ItemType == expected.ItemType &&
+            actual.ItemClass == expected.ItemClass &&
+            actual.Size == expected.Size &&
+            actual.Weight == expected.Weight &&
+            actual.Cost == expected.Cost &&
+            actual.StackSize == expected.StackSize &&
+            actual.Lore == expected.Lore &&
+            actual.Magic == expected.Magic;
+    }
+
+    bool SameSlotInfo(const ItemColorSlotInfo& actual, const ItemColorSlotInfo& expected)
+    {
+        return actual.Enabled == expected.Enabled &&
+            actual.HasWindow == expected.HasWindow &&
+            actual.HotButton == expected.HotButton &&
+            actual.ValidLocation == expected.ValidLocation &&
+            actual.Equipped == expected.Equipped &&
+            actual.Container == expected.Container;
+    }
+
+    // Open is expected to turn the file away with an error naming the problem
+    void CheckRejected(const std::string& path, const std::string& reason)
+    {
+        ItemColorCaptureFile capture;
+        std::string error;
+        ITEMCOLOR_CHECK(!capture.Open(path, error));
+        ITEMCOLOR_CHECK(error.find(reason) != std::string::npos);
+        ITEMCOLOR_CHECK_EQUAL(capture.GetFrameCount(), 0u);
+    }
+}
+
+
+// Every slot and definition read back from the file is the one recorded
+ITEMCOLOR_TEST(SlotsAndDefinitionsRoundTrip)
+{
+    ItemColorTempFile file("ItemColorCaptureTests_RoundTrip.iccap");
+    ItemColorMockItemSource source;
+    std::vector<RecordedFrame> frames = WriteCapture(file.GetPath(), source);
+
+    ItemColorCaptureFile capture;
+    std::string error;
+    ITEMCOLOR_CHECK(capture.Open(file.GetPath(), error));
+    ITEMCOLOR_CHECK_EQUAL(capture.GetFrameCount(), static_cast<size_t>(FrameCount));
+    ITEMCOLOR_CHECK_EQUAL(capture.GetHeader().FrameCount, static_cast<uint32_t>(FrameCount));
+
+    ItemColorClassifierSettings classifier = capture.GetHeader().GetClassifierSettings();
+    ITEMCOLOR_CHECK(classifier.FVServer);
+    ITEMCOLOR_CHECK(!classifier.FVNormalNoTrade);
+    ITEMCOLOR_CHECK_EQUAL(classifier.EnabledAttributeMask, GetItemColorDefaultEnabledMask());
+
+    int slotsWithItems = 0;
+    for (size_t frame = 0; frame < capture.GetFrameCount(); ++frame)
+    {
+        ITEMCOLOR_CHECK_EQUAL(capture.GetFrame(frame).SlotCount, static_cast<uint32_t>(SlotCount));
+        if (frame > 0)
+        {
+            ITEMCOLOR_CHECK(capture.GetFrame(frame).Microseconds >= capture.GetFrame(frame - 1).Microseconds);
+        }
+
+        const ItemColorCaptureSlot* pSlots = capture.GetSlots(frame);
+        for (int index = 0; index < SlotCount; ++index)
+        {
+            const ItemColorCaptureSlot& slot = pSlots[index];
+            const ItemColorMockSlot& recorded = frames[frame].Slots[index];
+
+            ITEMCOLOR_CHECK_EQUAL(slot.SlotIndex, static_cast<uint32_t>(index));
+            ITEMCOLOR_CHECK_EQUAL(slot.LocationKey, recorded.LocationKey);
+            ITEMCOLOR_CHECK_EQUAL(slot.ItemToken, recorded.ItemToken);
+            ITEMCOLOR_CHECK(SameSlotInfo(slot.GetSlotInfo(), recorded.SlotInfo));
+
+            if (!recorded.ItemToken)
+            {
+                ITEMCOLOR_CHECK_EQUAL(slot.GetDefinitionID(), 0);
+                ITEMCOLOR_CHECK(!slot.GetNoDropFlag());
+                continue;
+            }
+
+            ++slotsWithItems;
+            ITEMCOLOR_CHECK_EQUAL(slot.GetDefinitionID(), recorded.ItemID);
+            ITEMCOLOR_CHECK_EQUAL(slot.GetNoDropFlag(), recorded.NoDropFlag);
+            ITEMCOLOR_CHECK(SameDefinition(slot.GetDefinitionInfo(), *source.GetDefinition(recorded.ItemID)));
+        }
+    }
+
+    ITEMCOLOR_CHECK(slotsWithItems > SlotCount);
+
+    // Closing and opening again maps the same file
+    capture.Close();
+    ITEMCOLOR_CHECK_EQUAL(capture.GetFrameCount(), 0u);
+    ITEMCOLOR_CHECK(capture.Open(file.GetPath(), error));
+    ITEMCOLOR_CHECK_EQUAL(capture.GetFrameCount(), static_cast<size_t>(FrameCount));
+}
+
+
+// A capture stopped before its first frame is still a capture
+ITEMCOLOR_TEST(CaptureWithoutFrames)
+{
+    ItemColorTempFile file("ItemColorCaptureTests_Empty.iccap");
+    ItemColorCaptureWriter writer;
+    writer.Start(MakeClassifier());
+
+    std::string error;
+    ITEMCOLOR_CHECK(writer.Save(file.GetPath(), error));
+
+    ItemColorCaptureFile capture;
+    ITEMCOLOR_CHECK(capture.Open(file.GetPath(), error));
+    ITEMCOLOR_CHECK_EQUAL(capture.GetFrameCount(), 0u);
+}
+
+
+// Files cut short, from another version or not captures at all are turned away
+ITEMCOLOR_TEST(DamagedFilesRejected)
+{
+    ItemColorTempFile file("ItemColorCaptureTests_Damaged.iccap");
+    ItemColorMockItemSource source;
+    WriteCapture(file.GetPath(), source);
+
+    size_t frameSize = sizeof(ItemColorCaptureFrame) + SlotCount * sizeof(ItemColorCaptureSlot);
+    size_t fullSize = sizeof(ItemColorCaptureHeader) + FrameCount * frameSize;
+    ITEMCOLOR_CHECK_EQUAL(std::filesystem::file_size(file.GetPath()), fullSize);
+
+    CheckRejected(file.GetPath() + ".missing", "Could not open");
+
+    // Ends inside the slots of the last frame
+    std::filesystem::resize_file(file.GetPath(), fullSize - sizeof(ItemColorCaptureSlot) / 2);
+    CheckRejected(file.GetPath(), "ends in frame 3");
+
+    // Ends inside the frame header of the third frame
+    std::filesystem::resize_file(file.GetPath(), sizeof(ItemColorCaptureHeader) + 2 * frameSize + sizeof(ItemColorCaptureFrame) / 2);
+    CheckRejected(file.GetPath(), "ends in frame 2");
+
+    // Ends right after the header
+    std::filesystem::resize_file(file.GetPath(), sizeof(ItemColorCaptureHeader));
+    CheckRejected(file.GetPath(), "ends in frame 0");
+
+    std::filesystem::resize_file(file.GetPath(), sizeof(ItemColorCaptureHeader) / 2);
+    CheckRejected(file.GetPath(), "is not a capture");
+
+    std::filesystem::resize_file(file.GetPath(), 0);
+    CheckRejected(file.GetPath(), "is not a capture");
+
+    ItemColorCaptureHeader header;
+    header.Version = ItemColorCaptureHeader::CurrentVersion + 1;
+    {
+        std::ofstream out(file.GetPath(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    CheckRejected(file.GetPath(), "another version");
+
+    header = ItemColorCaptureHeader();
+    header.Magic[0] = 'X';
+    {
+        std::ofstream out(file.GetPath(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    CheckRejected(file.GetPath(), "is not a capture");
+}
+
+
+// A replay colors every captured slot of every frame, and the cache does not change what it paints
+ITEMCOLOR_TEST(ReplayVisitsEveryFrame)
+{
+    ItemColorTempFile file("ItemColorCaptureTests_Replay.iccap");
+    ItemColorMockItemSource source;
+    WriteCapture(file.GetPath(), source);
+
+    ItemColorCaptureFile capture;
+    std::string error;
+    ITEMCOLOR_CHECK(capture.Open(file.GetPath(), error));
+
+    std::shared_ptr<ItemColorSettingsSnapshot> settings = MakeItemColorMockSettings(capture.GetHeader().GetClassifierSettings());
+    size_t entriesBuilt = 0;
+    settings->BlendTable = UpdateItemColorBlendTable(nullptr, {}, settings->Palette, settings->BlendMode, entriesBuilt);
+
+    constexpr int Passes = 2;
+    ItemColorReplayResult cached = ReplayItemColorCapture(capture, *settings, 1024, Passes);
+    ItemColorReplayResult uncached = ReplayItemColorCapture(capture, *settings, 0, Passes);
+
+    ITEMCOLOR_CHECK_EQUAL(cached.PulseTime.GetCount(), static_cast<uint64_t>(FrameCount * Passes));
+    ITEMCOLOR_CHECK_EQUAL(cached.SlotsVisited, static_cast<uint64_t>(SlotCount * FrameCount * Passes));
+    ITEMCOLOR_CHECK_EQUAL(cached.SlotsVisited, cached.SlotsNotColorable + cached.SlotsUnchanged + cached.SlotsReclassified);
+    ITEMCOLOR_CHECK(cached.SlotsRepainted > 0);
+    ITEMCOLOR_CHECK(cached.CacheHits > 0);
+
+    ITEMCOLOR_CHECK_EQUAL(uncached.SlotsVisited, cached.SlotsVisited);
+    ITEMCOLOR_CHECK_EQUAL(uncached.SlotsReclassified, cached.SlotsReclassified);
+    ITEMCOLOR_CHECK_EQUAL(uncached.SlotsRepainted, cached.SlotsRepainted);
+    ITEMCOLOR_CHECK_EQUAL(uncached.CacheHits, 0u);
+}
@@ -0,0 +1,345 @@
+/**
+* ItemColorClassifierEquivalenceTests.cpp
+*
+* Checks the attribute mask classifier against the else-if chain SetItemBG used before it,
+* for every combination of item flags, FV flags and attributes turned on.
+*
+*/
+
+#include "ItemColorPipeline.h"
+#include "ItemColorMockInventory.h"
+#include "ItemColorTest.h"
+
+#include <array>
+#include <iterator>
+
+namespace
+{
+    constexpr size_t AttributeCount = std::size(ItemColorAttributes);
+
+    // The ItemDefinition and ItemClient fields the old chain read, as the game has them
+    struct BaselineItem
+    {
+        bool QuestItem = false;
+        bool TradeSkills = false;
+        bool Collectible = false;
+        bool Heirloom = false;
+        bool IsDroppable = true;
+        bool bIsFVNoDrop = false;
+        bool Attuneable = false;
+        bool Placeable = false;
+        int MaxPower = 0;
+        uint32_t AugType = 0;
+        std::array<int, 6> SocketTypes{};
+        bool NoDropFlag = false;
+    };
+
+    // What the old chain read from the plugin's settings, On is indexed by ItemColorAttribute
+    struct BaselineSettings
+    {
+        bool FVServer = false;
+        bool FVNormalNoTrade = false;
+        std::array<bool, AttributeCount> On{};
+
+        bool IsOn(ItemColorAttribute itemAttribute) const { return On[static_cast<size_t>(itemAttribute)]; }
+    };
+
+    bool BaselineHasType8AugSlot(const BaselineItem& item)
+    {
+        for (int socketType : item.SocketTypes)
+        {
+            if (socketType == 8)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool BaselineIsOrnamentation(const BaselineItem& item)
+    {
+        return (item.AugType & 0x180000) != 0;
+    }
+
+    // The else-if chain of SetItemBG before the attribute mask, branch for branch, returning the attribute it colored with
+    ItemColorAttribute BaselineSetItemBG(const BaselineItem& item, const BaselineSettings& settings)
+    {
+        // has "8" aug slot (raid item)
+        if (BaselineHasType8AugSlot(item) && settings.IsOn(ItemColorAttribute::HasAugSlot8_Item))
+        {
+            return ItemColorAttribute::HasAugSlot8_Item;
+        }
+        // if the itemdef has maxpower, it is a powersource
+        else if (item.MaxPower)
+        {
+            return ItemColorAttribute::PowerSource_Item;
+        }
+        // Quest
+        else if (item.QuestItem && settings.IsOn(ItemColorAttribute::Quest_Item))
+        {
+            return ItemColorAttribute::Quest_Item;
+        }
+        // TradeSkill
+        else if (item.TradeSkills && settings.IsOn(ItemColorAttribute::TradeSkills_Item))
+        {
+            return ItemColorAttribute::TradeSkills_Item;
+        }
+        // Collectible
+        else if (item.Collectible && settings.IsOn(ItemColorAttribute::Collectible_Item))
+        {
+            return ItemColorAttribute::Collectible_Item;
+        }
+        // Heirloom
+        else if (item.Heirloom && settings.IsOn(ItemColorAttribute::Heirloom_Item))
+        {
+            return ItemColorAttribute::Heirloom_Item;
+        }
+        // No Trade
+        // On FV server, color Normal No Trade only if FVNormalNoTrade setting is enabled
+        else if (((!item.IsDroppable || item.NoDropFlag) && settings.IsOn(ItemColorAttribute::NoTrade_Item)) &&
+            ((settings.FVServer && settings.FVNormalNoTrade) || (!settings.FVServer)))
+        {
+            return ItemColorAttribute::NoTrade_Item;
+        }
+        // FV No Trade
+        // On FV server, color those that are FV No Trade using Normal No Trade settings
+        else if (settings.FVServer && item.bIsFVNoDrop && settings.IsOn(ItemColorAttribute::NoTrade_Item))
+        {
+            return ItemColorAttribute::NoTrade_Item;
+        }
+        // Attuneable
+        else if (item.Attuneable && settings.IsOn(ItemColorAttribute::Attuneable_Item))
+        {
+            return ItemColorAttribute::Attuneable_Item;
+        }
+        // Placeable
+        else if (item.Placeable && settings.IsOn(ItemColorAttribute::Placeable_Item))
+        {
+            return ItemColorAttribute::Placeable_Item;
+        }
+        // Has Type 20 or 21 aug slot (Ornamentations)
+        else if (BaselineIsOrnamentation(item) && settings.IsOn(ItemColorAttribute::Ornamentation_Item))
+        {
+            return ItemColorAttribute::Ornamentation_Item;
+        }
+
+        // Undefined (Return to "Normal")
+        return ItemColorAttribute::Default;
+    }
+
+    // Same as the plugin's ToDefinitionInfo
+    ItemColorDefinitionInfo ToDefinitionInfo(const BaselineItem& item)
+    {
+        ItemColorDefinitionInfo itemInfo;
+        itemInfo.ItemID = 1;
+        itemInfo.QuestItem = item.QuestItem;
+        itemInfo.TradeSkills = item.TradeSkills;
+        itemInfo.Collectible = item.Collectible;
+        itemInfo.Heirloom = item.Heirloom;
+        itemInfo.IsDroppable = item.IsDroppable;
+        itemInfo.FVNoDrop = item.bIsFVNoDrop;
+        itemInfo.Attuneable = item.Attuneable;
+        itemInfo.Placeable = item.Placeable;
+        itemInfo.PowerSource = item.MaxPower != 0;
+        itemInfo.AugType = item.AugType;
+
+        for (int socketType : item.SocketTypes)
+        {
+            itemInfo.SocketTypes |= GetItemColorSocketBit(socketType);
+        }
+
+        return itemInfo;
+    }
+
+    // One flag per bit of combination, the socket and aug type values vary so more than one layout of each is seen
+    constexpr int FlagCount = 12;
+
+    BaselineItem MakeItem(int combination)
+    {
+        auto flag = [combination](int bit) { return (combination & (1 << bit)) != 0; };
+
+        BaselineItem item;
+        item.QuestItem = flag(0);
+        item.TradeSkills = flag(1);
+        item.Collectible = flag(2);
+        item.Heirloom = flag(3);
+        item.IsDroppable = !flag(4);
+        item.bIsFVNoDrop = flag(5);
+        item.Attuneable = flag(6);
+        item.Placeable = flag(7);
+        item.MaxPower = flag(8) ? 3000 : 0;
+        item.NoDropFlag = flag(11);
+
+        // Other sockets and aug types around the ones that count, which slot holds the type 8 moves around
+        item.SocketTypes = { 3, 0, 7, 0, 0, 21 };
+        if (flag(9))
+        {
+            item.SocketTypes[combination % item.SocketTypes.size()] = 8;
+        }
+        item.AugType = flag(10) ? ((combination & 0x800) ? 0x80000 : 0x100000) : 0x40000 | 0x200000 | 0x80;
+        return item;
+    }
+}
+
+
+// Every flag combination against every FV setting and every set of attributes turned on
+ITEMCOLOR_TEST(MaskClassifierMatchesTheOldChain)
+{
+    int mismatches = 0;
+
+    for (int fv = 0; fv < 4; ++fv)
+    {
+        for (uint32_t onMask = 0; onMask < (1U << AttributeCount); ++onMask)
+        {
+            BaselineSettings baselineSettings;
+            baselineSettings.FVServer = (fv & 1) != 0;
+            baselineSettings.FVNormalNoTrade = (fv & 2) != 0;
+
+            uint32_t onBits = 0;
+            for (size_t attribute = 0; attribute < AttributeCount; ++attribute)
+            {
+                baselineSettings.On[attribute] = (onMask & (1U << attribute)) != 0;
+                if (baselineSettings.On[attribute])
+                {
+                    onBits |= GetItemColorAttributeBit(static_cast<ItemColorAttribute>(attribute));
+                }
+            }
+
+            ItemColorClassifierSettings classifier;
+            classifier.FVServer = baselineSettings.FVServer;
+            classifier.FVNormalNoTrade = baselineSettings.FVNormalNoTrade;
+            classifier.EnabledAttributeMask = GetItemColorEnabledMask(onBits);
+
+            for (int combination = 0; combination < (1 << FlagCount); ++combination)
+            {
+                BaselineItem item = MakeItem(combination);
+                ItemColorAttribute expected = BaselineSetItemBG(item, baselineSettings);
+
+                uint32_t mask = GetItemDefinitionMask(ToDefinitionInfo(item), classifier) | GetItemInstanceMask(item.NoDropFlag, classifier);
+                ItemColorAttribute actual = ResolveItemColorAttribute(mask, classifier.EnabledAttributeMask);
+
+                if (actual != expected && ++mismatches <= 10)
+                {
+                    ITEMCOLOR_CHECK_EQUAL(actual, expected);
+                    fprintf(stderr, "  flags 0x%03X, FV %d, on 0x%03X\n", combination, fv, onMask);
+                }
+            }
+        }
+    }
+
+    ITEMCOLOR_CHECK_EQUAL(mismatches, 0);
+}
+
+
+// The paths the plugin colors through, a cached definition plus the item's own state and the worker records,
+// give the same as the old chain too, with each attribute turned off on its own
+ITEMCOLOR_TEST(CachedAndRecordPathsMatchTheOldChain)
+{
+    int mismatches = 0;
+
+    for (int fv = 0; fv < 4; ++fv)
+    {
+        for (size_t off = 0; off <= AttributeCount; ++off)
+        {
+            BaselineSettings baselineSettings;
+            baselineSettings.FVServer = (fv & 1) != 0;
+            baselineSettings.FVNormalNoTrade = (fv & 2) != 0;
+            baselineSettings.On.fill(true);
+
+            uint32_t onBits = (1U << AttributeCount) - 1;
+            if (off < AttributeCount)
+            {
+                baselineSettings.On[off] = false;
+                onBits &= ~GetItemColorAttributeBit(static_cast<ItemColorAttribute>(off));
+            }
+
+            ItemColorClassifierSettings classifier;
+            classifier.FVServer = baselineSettings.FVServer;
+            classifier.FVNormalNoTrade = baselineSettings.FVNormalNoTrade;
+            classifier.EnabledAttributeMask = GetItemColorEnabledMask(onBits);
+            auto settings = MakeItemColorMockSettings(classifier);
+
+            for (int combination = 0; combination < (1 << FlagCount); ++combination)
+            {
+                BaselineItem item = MakeItem(combination);
+                ItemColorAttribute expected = BaselineSetItemBG(item, baselineSettings);
+
+                ItemColorClassifyRecord record;
+                record.Info = ToDefinitionInfo(item);
+                record.NoDropFlag = item.NoDropFlag;
+                ItemColorClassifyResult result = ClassifyItemColorRecord(record, *settings);
+
+                // What the classification cache holds for the definition, with the item's NoDropFlag added afterwards
+                uint32_t instanceMask = GetItemInstanceMask(item.NoDropFlag, classifier);
+                ItemColorAttribute cached = instanceMask ?
+                    ResolveItemColorAttribute(result.DefinitionMask | instanceMask, classifier.EnabledAttributeMask) : result.DefinitionAttribute;
+
+                if ((result.Attribute != expected || cached != expected) && ++mismatches <= 10)
+                {
+                    ITEMCOLOR_CHECK_EQUAL(result.Attribute, expected);
+                    ITEMCOLOR_CHECK_EQUAL(cached, expected);
+                    fprintf(stderr, "  flags 0x%03X, FV %d, off %zu\n", combination, fv, off);
+                }
+            }
+        }
+    }
+
+    ITEMCOLOR_CHECK_EQUAL(mismatches, 0);
+}
+
+
+// Power sources were colored whether or not PowerSourceOn was set, and still are
+ITEMCOLOR_TEST(PowerSourceIgnoresItsOnFlag)
+{
+    BaselineItem item;
+    item.MaxPower = 100;
+    item.QuestItem = true;
+
+    BaselineSettings baselineSettings;
+    baselineSettings.On.fill(true);
+    baselineSettings.On[static_cast<size_t>(ItemColorAttribute::PowerSource_Item)] = false;
+    ITEMCOLOR_CHECK_EQUAL(BaselineSetItemBG(item, baselineSettings), ItemColorAttribute::PowerSource_Item);
+
+    ItemColorClassifierSettings classifier;
+    classifier.EnabledAttributeMask = GetItemColorEnabledMask(0);
+    uint32_t mask = GetItemDefinitionMask(ToDefinitionInfo(item), classifier);
+    ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(mask, classifier.EnabledAttributeMask), ItemColorAttribute::PowerSource_Item);
+}
+
+
+// Normal No Trade and FV No Trade share NoTradeOn, and both come after Heirloom and before Attuneable
+ITEMCOLOR_TEST(NoTradeOrderingOnFV)
+{
+    BaselineItem item;
+    item.IsDroppable = false;
+    item.bIsFVNoDrop = true;
+    item.Heirloom = true;
+    item.Attuneable = true;
+
+    for (int fv = 0; fv < 4; ++fv)
+    {
+        for (int heirloomOn = 0; heirloomOn < 2; ++heirloomOn)
+        {
+            BaselineSettings baselineSettings;
+            baselineSettings.FVServer = (fv & 1) != 0;
+            baselineSettings.FVNormalNoTrade = (fv & 2) != 0;
+            baselineSettings.On.fill(true);
+            baselineSettings.On[static_cast<size_t>(ItemColorAttribute::Heirloom_Item)] = heirloomOn != 0;
+
+            ItemColorClassifierSettings classifier;
+            classifier.FVServer = baselineSettings.FVServer;
+            classifier.FVNormalNoTrade = baselineSettings.FVNormalNoTrade;
+            classifier.EnabledAttributeMask = GetItemColorEnabledMask((1U << AttributeCount) - 1);
+            if (!heirloomOn)
+            {
+                classifier.EnabledAttributeMask &= ~GetItemColorAttributeBit(ItemColorAttribute::Heirloom_Item);
+            }
+
+            ItemColorAttribute expected = heirloomOn ? ItemColorAttribute::Heirloom_Item : ItemColorAttribute::NoTrade_Item;
+            uint32_t mask = GetItemDefinitionMask(ToDefinitionInfo(item), classifier);
+
+            ITEMCOLOR_CHECK_EQUAL(BaselineSetItemBG(item, baselineSettings), expected);
+            ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(mask, classifier.EnabledAttributeMask), expected);
+        }
+    }
+}
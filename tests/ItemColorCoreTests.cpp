@@ -0,0 +1,440 @@
+/**
+* ItemColorCoreTests.cpp
+*
+* Pins down the coloring priority order and the attribute masks the classifier builds, runs the scan over
+* mock inventories, and checks the ${ItemColor} query packing and when the pulse scheduler starts sweeps.
+*
+*/
+
+#include "ItemColorMockInventory.h"
+#include "ItemColorTest.h"
+
+#include <chrono>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+    ItemColorClassifierSettings MakeClassifier(bool fvServer, bool fvNormalNoTrade, uint32_t enabledAttributeMask)
+    {
+        ItemColorClassifierSettings settings;
+        settings.FVServer = fvServer;
+        settings.FVNormalNoTrade = fvNormalNoTrade;
+        settings.EnabledAttributeMask = enabledAttributeMask;
+        return settings;
+    }
+
+    uint32_t Bit(ItemColorAttribute itemAttribute)
+    {
+        return GetItemColorAttributeBit(itemAttribute);
+    }
+
+    constexpr uint32_t AllAttributes = (1U << std::size(ItemColorAttributes)) - 1;
+}
+
+
+// The order items have always been colored in, an item with more than one attribute takes the first one here
+ITEMCOLOR_TEST(PriorityOrderIsPinned)
+{
+    const ItemColorAttribute expected[] =
+    {
+        ItemColorAttribute::HasAugSlot8_Item,
+        ItemColorAttribute::PowerSource_Item,
+        ItemColorAttribute::Quest_Item,
+        ItemColorAttribute::TradeSkills_Item,
+        ItemColorAttribute::Collectible_Item,
+        ItemColorAttribute::Heirloom_Item,
+        ItemColorAttribute::NoTrade_Item,
+        ItemColorAttribute::Attuneable_Item,
+        ItemColorAttribute::Placeable_Item,
+        ItemColorAttribute::Ornamentation_Item,
+    };
+
+    ITEMCOLOR_CHECK_EQUAL(std::size(ItemColorPriority), std::size(expected));
+    for (size_t priority = 0; priority < std::size(expected); ++priority)
+    {
+        ITEMCOLOR_CHECK_EQUAL(ItemColorPriority[priority], expected[priority]);
+        ITEMCOLOR_CHECK_EQUAL(Bit(ItemColorPriority[priority]), 1U << priority);
+    }
+
+    ITEMCOLOR_CHECK_EQUAL(Bit(ItemColorAttribute::Default), 0U);
+}
+
+
+ITEMCOLOR_TEST(DefinitionMaskHasOneBitPerFlag)
+{
+    ItemColorClassifierSettings settings = MakeClassifier(false, false, AllAttributes);
+
+    ItemColorDefinitionInfo plain;
+    ITEMCOLOR_CHECK_EQUAL(GetItemDefinitionMask(plain, settings), 0U);
+
+    auto check = [&settings](ItemColorDefinitionInfo itemInfo, uint32_t expected)
+        {
+            ITEMCOLOR_CHECK_EQUAL(GetItemDefinitionMask(itemInfo, settings), expected);
+        };
+
+    ItemColorDefinitionInfo itemInfo;
+    itemInfo.QuestItem = true;
+    check(itemInfo, Bit(ItemColorAttribute::Quest_Item));
+
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.TradeSkills = true;
+    check(itemInfo, Bit(ItemColorAttribute::TradeSkills_Item));
+
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.Collectible = true;
+    check(itemInfo, Bit(ItemColorAttribute::Collectible_Item));
+
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.Heirloom = true;
+    check(itemInfo, Bit(ItemColorAttribute::Heirloom_Item));
+
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.IsDroppable = false;
+    check(itemInfo, Bit(ItemColorAttribute::NoTrade_Item));
+
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.Attuneable = true;
+    check(itemInfo, Bit(ItemColorAttribute::Attuneable_Item));
+
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.Placeable = true;
+    check(itemInfo, Bit(ItemColorAttribute::Placeable_Item));
+
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.PowerSource = true;
+    check(itemInfo, Bit(ItemColorAttribute::PowerSource_Item));
+
+    // Type 8 aug socket (raid items), other sockets do not count
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.SocketTypes = GetItemColorSocketBit(8);
+    check(itemInfo, Bit(ItemColorAttribute::HasAugSlot8_Item));
+    itemInfo.SocketTypes = GetItemColorSocketBit(7) | GetItemColorSocketBit(9);
+    check(itemInfo, 0);
+
+    // Fits a type 20 or 21 aug slot (Ornamentations)
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.AugType = GetItemColorAugTypeBit(20);
+    check(itemInfo, Bit(ItemColorAttribute::Ornamentation_Item));
+    itemInfo.AugType = GetItemColorAugTypeBit(21);
+    check(itemInfo, Bit(ItemColorAttribute::Ornamentation_Item));
+    itemInfo.AugType = GetItemColorAugTypeBit(19) | GetItemColorAugTypeBit(22);
+    check(itemInfo, 0);
+
+    // Turning attributes off never changes the mask
+    itemInfo = ItemColorDefinitionInfo();
+    itemInfo.QuestItem = true;
+    itemInfo.Placeable = true;
+    settings.EnabledAttributeMask = 0;
+    check(itemInfo, Bit(ItemColorAttribute::Quest_Item) | Bit(ItemColorAttribute::Placeable_Item));
+}
+
+
+// Normal No Trade only counts on FV with FVNormalNoTrade, FV No Trade only counts on FV
+ITEMCOLOR_TEST(NoTradeFollowsTheFVFlags)
+{
+    for (int combination = 0; combination < 16; ++combination)
+    {
+        bool fvServer = (combination & 1) != 0;
+        bool fvNormalNoTrade = (combination & 2) != 0;
+        bool droppable = (combination & 4) != 0;
+        bool fvNoDrop = (combination & 8) != 0;
+
+        ItemColorDefinitionInfo itemInfo;
+        itemInfo.IsDroppable = droppable;
+        itemInfo.FVNoDrop = fvNoDrop;
+
+        bool expected = (!droppable && (!fvServer || fvNormalNoTrade)) || (fvServer && fvNoDrop);
+        ItemColorClassifierSettings settings = MakeClassifier(fvServer, fvNormalNoTrade, AllAttributes);
+
+        ITEMCOLOR_CHECK_EQUAL(IsNoTrade(itemInfo, settings), expected);
+        ITEMCOLOR_CHECK_EQUAL(GetItemDefinitionMask(itemInfo, settings), expected ? Bit(ItemColorAttribute::NoTrade_Item) : 0U);
+    }
+}
+
+
+ITEMCOLOR_TEST(InstanceMaskIsNoTradeFromNoDropFlag)
+{
+    for (int combination = 0; combination < 8; ++combination)
+    {
+        bool fvServer = (combination & 1) != 0;
+        bool fvNormalNoTrade = (combination & 2) != 0;
+        bool noDropFlag = (combination & 4) != 0;
+
+        bool expected = noDropFlag && (!fvServer || fvNormalNoTrade);
+        ItemColorClassifierSettings settings = MakeClassifier(fvServer, fvNormalNoTrade, AllAttributes);
+
+        ITEMCOLOR_CHECK_EQUAL(GetItemInstanceMask(noDropFlag, settings), expected ? Bit(ItemColorAttribute::NoTrade_Item) : 0U);
+    }
+}
+
+
+ITEMCOLOR_TEST(ResolvePicksTheFirstEnabledAttributeInPriorityOrder)
+{
+    ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(0, AllAttributes), ItemColorAttribute::Default);
+    ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(AllAttributes, 0), ItemColorAttribute::Default);
+
+    // An item with every attribute walks down the priority order as each winner is turned off
+    uint32_t enabledMask = AllAttributes;
+    for (ItemColorAttribute itemAttribute : ItemColorPriority)
+    {
+        ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(AllAttributes, enabledMask), itemAttribute);
+        enabledMask &= ~Bit(itemAttribute);
+    }
+    ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(AllAttributes, enabledMask), ItemColorAttribute::Default);
+
+    // Only attributes the item has count
+    uint32_t mask = Bit(ItemColorAttribute::Placeable_Item) | Bit(ItemColorAttribute::TradeSkills_Item);
+    ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(mask, AllAttributes), ItemColorAttribute::TradeSkills_Item);
+    ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(mask, Bit(ItemColorAttribute::Placeable_Item)), ItemColorAttribute::Placeable_Item);
+    ITEMCOLOR_CHECK_EQUAL(ResolveItemColorAttribute(mask, Bit(ItemColorAttribute::Quest_Item)), ItemColorAttribute::Default);
+}
+
+
+// What ${ItemColor} hands from one member to the next has to come back exactly as it went in
+ITEMCOLOR_TEST(QueryPacksIntoOneValue)
+{
+    auto roundTrip = [](int itemID, uint32_t attributeMask, ItemColorAttribute itemAttribute, int rule)
+    {
+        ItemColorQuery query;
+        query.ItemID = itemID;
+        query.AttributeMask = attributeMask;
+        query.Attribute = itemAttribute;
+        query.Rule = rule;
+        return ItemColorQuery::Unpack(query.Pack());
+    };
+
+    const int itemIDs[] = { 0, 1, 12345, 0x7FFFFFFF, static_cast<int>(0x80000001U), -1 };
+    const int rules[] = { -1, 0, 1, 1000, ItemColorQuery::MaxRule };
+    for (int itemID : itemIDs)
+    {
+        for (int rule : rules)
+        {
+            for (int attribute = static_cast<int>(ItemColorAttribute::Default); attribute < static_cast<int>(ItemColorAttribute::Last); ++attribute)
+            {
+                ItemColorAttribute itemAttribute = static_cast<ItemColorAttribute>(attribute);
+                ItemColorQuery query = roundTrip(itemID, AllAttributes, itemAttribute, rule);
+                ITEMCOLOR_CHECK_EQUAL(query.ItemID, itemID);
+                ITEMCOLOR_CHECK_EQUAL(query.AttributeMask, AllAttributes);
+                ITEMCOLOR_CHECK_EQUAL(query.Attribute, itemAttribute);
+                ITEMCOLOR_CHECK_EQUAL(query.Rule, rule);
+            }
+        }
+    }
+
+    // Nothing set packs to 0 and back to Default with no rule
+    ITEMCOLOR_CHECK_EQUAL(ItemColorQuery().Pack(), 0u);
+    ItemColorQuery empty = ItemColorQuery::Unpack(0);
+    ITEMCOLOR_CHECK_EQUAL(empty.ItemID, 0);
+    ITEMCOLOR_CHECK_EQUAL(empty.AttributeMask, 0u);
+    ITEMCOLOR_CHECK_EQUAL(empty.Attribute, ItemColorAttribute::Default);
+    ITEMCOLOR_CHECK_EQUAL(empty.Rule, -1);
+
+    // Fields do not run into each other
+    ItemColorQuery single = roundTrip(-1, Bit(ItemColorAttribute::Ornamentation_Item), ItemColorAttribute::Default, -1);
+    ITEMCOLOR_CHECK_EQUAL(single.AttributeMask, Bit(ItemColorAttribute::Ornamentation_Item));
+    ITEMCOLOR_CHECK_EQUAL(single.Attribute, ItemColorAttribute::Default);
+    ITEMCOLOR_CHECK_EQUAL(single.Rule, -1);
+
+    // Rules past MaxRule are answered as no rule
+    ITEMCOLOR_CHECK_EQUAL(roundTrip(5, 0, ItemColorAttribute::Quest_Item, ItemColorQuery::MaxRule + 1).Rule, -1);
+    ITEMCOLOR_CHECK_EQUAL(roundTrip(5, 0, ItemColorAttribute::Quest_Item, 100000).Rule, -1);
+    ITEMCOLOR_CHECK_EQUAL(roundTrip(5, 0, ItemColorAttribute::Quest_Item, -7).Rule, -1);
+
+    // The memo colors the slot the same way the query was classified
+    ItemColorQuery query;
+    query.AttributeMask = Bit(ItemColorAttribute::Quest_Item) | Bit(ItemColorAttribute::NoTrade_Item);
+    query.Attribute = ItemColorAttribute::Quest_Item;
+    query.Rule = 3;
+    ItemColorSlotMemo memo = query.ToMemo();
+    ITEMCOLOR_CHECK_EQUAL(memo.AttributeMask, query.AttributeMask);
+    ITEMCOLOR_CHECK_EQUAL(memo.Attribute, ItemColorAttribute::Quest_Item);
+    ITEMCOLOR_CHECK_EQUAL(memo.Rule, 3);
+}
+
+
+ITEMCOLOR_TEST(MockInventoryOfAnySize)
+{
+    ItemColorMockItemSource source;
+    ItemColorMockSlotManager slots;
+
+    for (int slotCount : { 0, 1, 37, 2000, 20000 })
+    {
+        slots.Generate(slotCount, source);
+        ITEMCOLOR_CHECK_EQUAL(slots.GetTotalSlots(), slotCount);
+
+        auto settings = MakeItemColorMockSettings(MakeClassifier(false, false, GetItemColorDefaultEnabledMask()));
+        ItemColorMockScanner scanner;
+        ItemColorPulseCounters counters = scanner.Sweep(slots, source, *settings, 1);
+
+        ITEMCOLOR_CHECK_EQUAL(counters.SlotsVisited, static_cast<uint64_t>(slotCount));
+        ITEMCOLOR_CHECK_EQUAL(counters.SlotsNotColorable + counters.SlotsReclassified, static_cast<uint64_t>(slotCount));
+        ITEMCOLOR_CHECK_EQUAL(counters.SlotsUnchanged, 0U);
+    }
+}
+
+
+// Every slot is colored with what the classifier gives for its item, and sweeps after the first only look at what changed
+ITEMCOLOR_TEST(MockInventorySweepColorsAndSkipsUnchangedSlots)
+{
+    ItemColorMockItemSource source;
+    ItemColorMockSlotManager slots;
+    slots.Generate(3000, source);
+
+    ItemColorClassifierSettings classifier = MakeClassifier(false, false, GetItemColorDefaultEnabledMask());
+    auto settings = MakeItemColorMockSettings(classifier);
+    ItemColorMockScanner scanner;
+
+    ItemColorPulseCounters first = scanner.Sweep(slots, source, *settings, 1);
+    ITEMCOLOR_CHECK(first.SlotsReclassified > 0);
+    ITEMCOLOR_CHECK(first.SlotsNotColorable > 0);
+
+    for (int index = 0; index < slots.GetTotalSlots(); ++index)
+    {
+        const ItemColorMockSlot& slot = slots.GetSlot(index);
+        if (!IsColorableSlot(slot.SlotInfo))
+        {
+            continue;
+        }
+
+        ItemColorAttribute expected = ItemColorAttribute::Default;
+        if (const ItemColorDefinitionInfo* pItemInfo = slot.ItemToken ? source.GetDefinition(slot.ItemID) : nullptr)
+        {
+            uint32_t mask = GetItemDefinitionMask(*pItemInfo, classifier) | GetItemInstanceMask(slot.NoDropFlag, classifier);
+            expected = ResolveItemColorAttribute(mask, classifier.EnabledAttributeMask);
+        }
+
+        ITEMCOLOR_CHECK_EQUAL(scanner.GetMemo(index).Attribute, expected);
+        const ItemColorPaletteEntry& entry = settings->GetPaletteEntry(GetItemColorPaletteIndex(expected));
+        ITEMCOLOR_CHECK_EQUAL(slot.Window.BGTintNormal, entry.NormalARGB);
+        ITEMCOLOR_CHECK_EQUAL(slot.Window.BGTintRollover, entry.RolloverARGB);
+    }
+
+    ItemColorPulseCounters second = scanner.Sweep(slots, source, *settings, 1);
+    ITEMCOLOR_CHECK_EQUAL(second.SlotsReclassified, 0U);
+    ITEMCOLOR_CHECK_EQUAL(second.SlotsUnchanged, first.SlotsReclassified);
+    ITEMCOLOR_CHECK_EQUAL(second.WritesApplied, 0U);
+
+    // Moving an item and looting another only classifies those slots again
+    std::vector<int> colorable;
+    for (int index = 0; index < slots.GetTotalSlots() && colorable.size() < 3; ++index)
+    {
+        if (IsColorableSlot(slots.GetSlot(index).SlotInfo))
+        {
+            colorable.push_back(index);
+        }
+    }
+    ITEMCOLOR_CHECK_EQUAL(colorable.size(), 3U);
+
+    slots.SwapItems(colorable[0], colorable[1]);
+    slots.SetItem(colorable[2], source.NextItemID(), false);
+    ItemColorPulseCounters third = scanner.Sweep(slots, source, *settings, 1);
+    ITEMCOLOR_CHECK_EQUAL(third.SlotsReclassified, 3U);
+
+    // A new settings version classifies every slot again
+    ItemColorPulseCounters fourth = scanner.Sweep(slots, source, *settings, 2);
+    ITEMCOLOR_CHECK_EQUAL(fourth.SlotsReclassified, first.SlotsReclassified);
+    ITEMCOLOR_CHECK_EQUAL(fourth.WritesApplied, 0U);
+}
+
+
+// Sweeps back off while nothing changes and come straight back when something does
+ITEMCOLOR_TEST(PulseSchedulerBacksOffAndSnapsBack)
+{
+    using namespace std::chrono_literals;
+    using Clock = ItemColorPulseScheduler::Clock;
+
+    ItemColorPulseScheduler scheduler;
+    scheduler.SetIntervals(100ms, 1000ms);
+    Clock::time_point now = Clock::now();
+    ITEMCOLOR_CHECK(scheduler.IsSweepDue(now));
+
+    // Each quiet sweep doubles the interval until the max
+    const std::chrono::milliseconds expected[] = { 200ms, 400ms, 800ms, 1000ms, 1000ms };
+    for (std::chrono::milliseconds interval : expected)
+    {
+        scheduler.SweepStarted(now);
+        scheduler.SweepDone(false, now);
+        ITEMCOLOR_CHECK_EQUAL(scheduler.GetInterval().count(), interval.count());
+        ITEMCOLOR_CHECK(!scheduler.IsSweepDue(now + interval - 1ms));
+        ITEMCOLOR_CHECK(scheduler.IsSweepDue(now + interval));
+        now += interval;
+    }
+
+    // A sweep that changed something goes back to the min
+    scheduler.SweepDone(true, now);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetInterval().count(), 100);
+    ITEMCOLOR_CHECK(!scheduler.IsSweepDue(now + 99ms));
+    ITEMCOLOR_CHECK(scheduler.IsSweepDue(now + 100ms));
+
+    // So does a change seen between sweeps, pulling the next sweep in
+    for (int sweep = 0; sweep < 4; ++sweep)
+    {
+        scheduler.SweepDone(false, now);
+    }
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetInterval().count(), 1000);
+    scheduler.Wake(now + 300ms);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetInterval().count(), 100);
+    ITEMCOLOR_CHECK(!scheduler.IsSweepDue(now + 399ms));
+    ITEMCOLOR_CHECK(scheduler.IsSweepDue(now + 400ms));
+
+    // But never pushes one that is already closer further out
+    scheduler.SweepDone(true, now);
+    scheduler.Wake(now + 50ms);
+    ITEMCOLOR_CHECK(scheduler.IsSweepDue(now + 100ms));
+
+    // The interval stays inside a new range
+    for (int sweep = 0; sweep < 4; ++sweep)
+    {
+        scheduler.SweepDone(false, now);
+    }
+    scheduler.SetIntervals(100ms, 500ms);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetInterval().count(), 500);
+    scheduler.SetIntervals(2000ms, 100ms);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetMinInterval().count(), 2000);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetMaxInterval().count(), 2000);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetInterval().count(), 2000);
+    scheduler.SetIntervals(0ms, 0ms);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetMinInterval().count(), 1);
+}
+
+
+// Nothing sweeps while paused, and the first sweep after Resume starts at once from the min interval
+ITEMCOLOR_TEST(PulseSchedulerPauseAndResume)
+{
+    using namespace std::chrono_literals;
+    using Clock = ItemColorPulseScheduler::Clock;
+
+    ItemColorPulseScheduler scheduler;
+    scheduler.SetIntervals(100ms, 1000ms);
+    Clock::time_point now = Clock::now();
+
+    scheduler.SweepStarted(now);
+    scheduler.SweepStarted(now + 100ms);
+    ITEMCOLOR_CHECK(scheduler.GetSweepsPerSecond() > 9.9 && scheduler.GetSweepsPerSecond() < 10.1);
+
+    for (int sweep = 0; sweep < 3; ++sweep)
+    {
+        scheduler.SweepDone(false, now);
+    }
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetInterval().count(), 800);
+
+    scheduler.Pause();
+    ITEMCOLOR_CHECK(scheduler.IsPaused());
+    ITEMCOLOR_CHECK(!scheduler.IsSweepDue(now + 1h));
+    scheduler.Wake(now);
+    ITEMCOLOR_CHECK(!scheduler.IsSweepDue(now + 1h));
+
+    now += 1h;
+    scheduler.Resume(now);
+    ITEMCOLOR_CHECK(!scheduler.IsPaused());
+    ITEMCOLOR_CHECK(scheduler.IsSweepDue(now));
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetInterval().count(), 100);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetSweepsPerSecond(), 0.0);
+
+    // The rate starts over, the gap across the pause is not counted
+    scheduler.SweepStarted(now);
+    ITEMCOLOR_CHECK_EQUAL(scheduler.GetSweepsPerSecond(), 0.0);
+    scheduler.SweepStarted(now + 200ms);
+    ITEMCOLOR_CHECK(scheduler.GetSweepsPerSecond() > 4.9 && scheduler.GetSweepsPerSecond() < 5.1);
+}
@@ -0,0 +1,271 @@
+/**
+* ItemColorIniTests.cpp
+*
+* Loads, edits and saves ini files in the temp directory, checking lookups ignore case, new keys and sections
+* go where a person would put them, and everything else in the file is written back as it was read.
+*
+*/
+
+#include "ItemColorIni.h"
+#include "ItemColorTest.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+    void WriteText(const std::string& path, const std::string& text)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+    }
+
+    std::string ReadText(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::ostringstream text;
+        text << file.rdbuf();
+        return text.str();
+    }
+
+    const std::string SampleText =
+        "; MQItemColor settings\r\n"
+        "\r\n"
+        "[General]\r\n"
+        "BlendMode=Mix\r\n"
+        "UseGlowTexture=true\r\n"
+        "ScanIntervalMin = +250 \r\n"
+        "; colors below\r\n"
+        "\r\n"
+        "[Quest]\r\n"
+        "QuestOn=1\r\n"
+        "QuestNormal=0xFFF01DFF\r\n"
+        "\r\n"
+        "\r\n"
+        "# kept\r\n"
+        "[Rules]\r\n"
+        "Rule1=Magic and Weight >= 20\r\n";
+
+    // Loads text from a fresh file, so each check starts from the same place
+    void LoadText(ItemColorIniFile& ini, const ItemColorTempFile& file, const std::string& text)
+    {
+        WriteText(file.GetPath(), text);
+        ITEMCOLOR_CHECK(ini.Load(file.GetPath()));
+        ITEMCOLOR_CHECK(!ini.IsDirty());
+    }
+
+    // Sets the bool key of a one line file and returns the line written back
+    std::string SetBoolLine(const ItemColorTempFile& file, const std::string& line, bool value)
+    {
+        ItemColorIniFile ini;
+        LoadText(ini, file, "[General]\r\n" + line + "\r\n");
+        ini.SetBool("General", "Flag", value);
+        ITEMCOLOR_CHECK(ini.Save(file.GetPath()));
+
+        std::string text = ReadText(file.GetPath());
+        size_t start = text.find("\r\n") + 2;
+        return text.substr(start, text.find("\r\n", start) - start);
+    }
+}
+
+
+ITEMCOLOR_TEST(LookupsIgnoreCase)
+{
+    ItemColorTempFile file("ItemColorIniTests_Lookup.ini");
+    ItemColorIniFile ini;
+    LoadText(ini, file, SampleText);
+
+    ITEMCOLOR_CHECK(ini.GetString("general", "BLENDMODE", "") == "Mix");
+    ITEMCOLOR_CHECK(ini.GetString("RULES", "rule1", "") == "Magic and Weight >= 20");
+    ITEMCOLOR_CHECK_EQUAL(ini.GetInt("General", "scanintervalmin", 0), 250);
+    ITEMCOLOR_CHECK(ini.GetBool("GENERAL", "useglowtexture", false));
+    ITEMCOLOR_CHECK(ini.GetBool("quest", "queston", false));
+
+    ITEMCOLOR_CHECK(ini.Find("General", "Missing") == nullptr);
+    ITEMCOLOR_CHECK(ini.Find("Missing", "BlendMode") == nullptr);
+    ITEMCOLOR_CHECK_EQUAL(ini.GetInt("General", "BlendMode", 7), 7);
+    ITEMCOLOR_CHECK(!ini.GetBool("General", "BlendMode", false));
+
+    // Comments are not keys even with an = in them
+    LoadText(ini, file, "[General]\r\n;Commented=1\r\n#Hashed=1\r\nPlain=1\n");
+    ITEMCOLOR_CHECK(ini.Find("General", ";Commented") == nullptr);
+    ITEMCOLOR_CHECK(ini.Find("General", "Commented") == nullptr);
+    ITEMCOLOR_CHECK(ini.Find("General", "#Hashed") == nullptr);
+    ITEMCOLOR_CHECK(ini.GetBool("General", "Plain", false));
+
+    // A missing file loads empty
+    ITEMCOLOR_CHECK(ini.Load(file.GetPath() + ".missing"));
+    ITEMCOLOR_CHECK(ini.Find("General", "Plain") == nullptr);
+}
+
+
+// Changing one value rewrites that value and nothing else, comments and blank lines included
+ITEMCOLOR_TEST(SaveKeepsEverythingElse)
+{
+    ItemColorTempFile file("ItemColorIniTests_Keep.ini");
+    ItemColorIniFile ini;
+    LoadText(ini, file, SampleText);
+
+    ini.SetString("quest", "questnormal", "0xFF000000");
+    ITEMCOLOR_CHECK(ini.IsDirty());
+    ITEMCOLOR_CHECK(ini.Save(file.GetPath()));
+    ITEMCOLOR_CHECK(!ini.IsDirty());
+
+    std::string expected = SampleText;
+    expected.replace(expected.find("0xFFF01DFF"), 10, "0xFF000000");
+    // Keys are written back trimmed
+    expected.replace(expected.find("ScanIntervalMin = +250 "), 23, "ScanIntervalMin=+250");
+    ITEMCOLOR_CHECK(ReadText(file.GetPath()) == expected);
+
+    // Saved again unchanged, and loaded back, it reads the same
+    ITEMCOLOR_CHECK(ini.Load(file.GetPath()));
+    ini.SetString("Quest", "QuestNormal", "0xFF000000");
+    ITEMCOLOR_CHECK(!ini.IsDirty());
+    ITEMCOLOR_CHECK(ini.Save(file.GetPath()));
+    ITEMCOLOR_CHECK(ReadText(file.GetPath()) == expected);
+}
+
+
+// A new key goes after the last key of its section, ahead of the comments and blank lines that end it
+ITEMCOLOR_TEST(NewKeysFollowTheLastKey)
+{
+    ItemColorTempFile file("ItemColorIniTests_NewKeys.ini");
+    ItemColorIniFile ini;
+    LoadText(ini, file, SampleText);
+
+    ini.SetString("GENERAL", "HotReload", "1");
+    ini.SetString("Quest", "QuestRollover", "0xFFF9AFFF");
+    ini.SetString("Search", "SearchOn", "1");
+    ITEMCOLOR_CHECK(ini.Save(file.GetPath()));
+
+    std::string expected =
+        "; MQItemColor settings\r\n"
+        "\r\n"
+        "[General]\r\n"
+        "BlendMode=Mix\r\n"
+        "UseGlowTexture=true\r\n"
+        "ScanIntervalMin=+250\r\n"
+        "HotReload=1\r\n"
+        "; colors below\r\n"
+        "\r\n"
+        "[Quest]\r\n"
+        "QuestOn=1\r\n"
+        "QuestNormal=0xFFF01DFF\r\n"
+        "QuestRollover=0xFFF9AFFF\r\n"
+        "\r\n"
+        "\r\n"
+        "# kept\r\n"
+        "[Rules]\r\n"
+        "Rule1=Magic and Weight >= 20\r\n"
+        "\r\n"
+        "[Search]\r\n"
+        "SearchOn=1\r\n";
+    ITEMCOLOR_CHECK(ReadText(file.GetPath()) == expected);
+
+    // Sections added to a file that does not exist yet start at the top, one blank line apart
+    ItemColorTempFile newFile("ItemColorIniTests_NewFile.ini");
+    ItemColorIniFile created;
+    ITEMCOLOR_CHECK(created.Load(newFile.GetPath()));
+    created.SetString("General", "BlendMode", "Dual");
+    created.SetInt("General", "ScanIntervalMin", 100);
+    created.SetBool("Quest", "QuestOn", true);
+    ITEMCOLOR_CHECK(created.Save(newFile.GetPath()));
+    ITEMCOLOR_CHECK(ReadText(newFile.GetPath()) == "[General]\r\nBlendMode=Dual\r\nScanIntervalMin=100\r\n\r\n[Quest]\r\nQuestOn=1\r\n");
+}
+
+
+// SetBool and SetInt leave a value that reads back the same alone, and a changed bool keeps the style it was written in
+ITEMCOLOR_TEST(ValuesKeepTheirStyle)
+{
+    ItemColorTempFile file("ItemColorIniTests_Style.ini");
+    ItemColorIniFile ini;
+    LoadText(ini, file, "[General]\r\nOn=true\r\nNumber=+5\r\nYes=Yes\r\n");
+
+    ini.SetBool("General", "On", true);
+    ini.SetBool("General", "Yes", true);
+    ini.SetInt("General", "Number", 5);
+    ITEMCOLOR_CHECK(!ini.IsDirty());
+
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=true", false) == "Flag=false");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=False", true) == "Flag=True");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=TRUE", false) == "Flag=FALSE");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=on", false) == "Flag=off");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=No", true) == "Flag=Yes");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=1", false) == "Flag=0");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=0", true) == "Flag=1");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=5", false) == "Flag=0");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Flag=maybe", true) == "Flag=1");
+    ITEMCOLOR_CHECK(SetBoolLine(file, "Other=1", true) == "Other=1");
+}
+
+
+// Save writes a temporary file and renames it over the ini, a failed write leaves the ini as it was
+ITEMCOLOR_TEST(SaveReplacesThroughATempFile)
+{
+    ItemColorTempFile file("ItemColorIniTests_Temp.ini");
+    std::string tempPath = file.GetPath() + ".tmp";
+    ItemColorIniFile ini;
+    LoadText(ini, file, SampleText);
+
+    // Nothing changed, nothing written
+    std::filesystem::remove(file.GetPath());
+    ITEMCOLOR_CHECK(ini.Save(file.GetPath()));
+    ITEMCOLOR_CHECK(!std::filesystem::exists(file.GetPath()));
+
+    WriteText(file.GetPath(), SampleText);
+    ini.SetString("General", "BlendMode", "Dual");
+
+    // The temporary file can not be made
+    std::filesystem::create_directory(tempPath);
+    ITEMCOLOR_CHECK(!ini.Save(file.GetPath()));
+    ITEMCOLOR_CHECK(ini.IsDirty());
+    ITEMCOLOR_CHECK(ReadText(file.GetPath()) == SampleText);
+    std::filesystem::remove(tempPath);
+
+    ITEMCOLOR_CHECK(ini.Save(file.GetPath()));
+    ITEMCOLOR_CHECK(!std::filesystem::exists(tempPath));
+    ITEMCOLOR_CHECK(ReadText(file.GetPath()).find("BlendMode=Dual\r\n") != std::string::npos);
+}
+
+
+// The writer merges what was submitted into the file on disk, keys edited elsewhere since are kept
+ITEMCOLOR_TEST(WriterMergesIntoTheFile)
+{
+    ItemColorTempFile file("ItemColorIniTests_Writer.ini");
+    WriteText(file.GetPath(), SampleText);
+
+    ItemColorIniWriter writer;
+    ITEMCOLOR_CHECK(writer.GetStatus() == ItemColorIniWriter::Status::Idle);
+
+    for (int interval = 100; interval <= 300; interval += 100)
+    {
+        ItemColorIniFile snapshot;
+        snapshot.SetInt("General", "ScanIntervalMin", interval);
+        snapshot.SetBool("General", "UseGlowTexture", false);
+        writer.Submit(file.GetPath(), std::move(snapshot));
+    }
+    writer.Flush();
+    ITEMCOLOR_CHECK(writer.GetStatus() == ItemColorIniWriter::Status::Saved);
+
+    ItemColorIniFile ini;
+    ITEMCOLOR_CHECK(ini.Load(file.GetPath()));
+    ITEMCOLOR_CHECK_EQUAL(ini.GetInt("General", "ScanIntervalMin", 0), 300);
+    ITEMCOLOR_CHECK(!ini.GetBool("General", "UseGlowTexture", true));
+    ITEMCOLOR_CHECK(ini.GetString("Rules", "Rule1", "") == "Magic and Weight >= 20");
+    std::string text = ReadText(file.GetPath());
+    ITEMCOLOR_CHECK(text.find("UseGlowTexture=false\r\n") != std::string::npos);
+    ITEMCOLOR_CHECK(text.find("ScanIntervalMin=300\r\n") != std::string::npos);
+    ITEMCOLOR_CHECK(text.find("; colors below\r\n\r\n[Quest]") != std::string::npos);
+
+    // Values that read back the same are not written at all
+    ItemColorIniFile same;
+    same.SetBool("General", "UseGlowTexture", false);
+    same.SetInt("Quest", "QuestOn", 1);
+    same.SetString("general", "blendmode", "Mix");
+    ITEMCOLOR_CHECK(ini.Load(file.GetPath()));
+    ini.Merge(same);
+    ITEMCOLOR_CHECK(!ini.IsDirty());
+    writer.Stop();
+}
@@ -0,0 +1,61 @@
+/**
+* ItemColorMakeCapture.cpp
+*
+* Writes a small capture of the mock slot array for the ItemColorReplay test, the way /itemcolor capture records sweeps.
+*
+* Usage:
+*   ItemColorMakeCapture capture.iccap
+*
+*/
+
+#include "ItemColorCapture.h"
+#include "ItemColorMockInventory.h"
+
+#include <cstdio>
+#include <string>
+
+namespace
+{
+    constexpr int SlotCount = 500;
+    constexpr int FrameCount = 20;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s capture.iccap\n", argv[0]);
+        return 2;
+    }
+
+    ItemColorMockItemSource source;
+    ItemColorMockSlotManager slots;
+    slots.Generate(SlotCount, source);
+
+    ItemColorClassifierSettings classifier;
+    classifier.EnabledAttributeMask = GetItemColorDefaultEnabledMask();
+
+    ItemColorCaptureWriter writer;
+    writer.Start(classifier);
+
+    // A few items looted and moved between sweeps
+    for (int frame = 0; frame < FrameCount; ++frame)
+    {
+        AddItemColorMockFrame(writer, slots, source);
+        for (int change = 0; change < 5; ++change)
+        {
+            slots.SetItem(static_cast<int>(source.Next(SlotCount)), source.NextItemID(), source.Next(4) == 0);
+            slots.SwapItems(static_cast<int>(source.Next(SlotCount)), static_cast<int>(source.Next(SlotCount)));
+        }
+    }
+
+    std::string error;
+    if (!writer.Save(argv[1], error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    return 0;
+}
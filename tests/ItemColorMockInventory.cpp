@@ -0,0 +1,319 @@
+/**
+* ItemColorMockInventory.cpp
+*
+* Made up items and slots for the unit tests, and a scan over them that follows the plugin's.
+*
+*/
+
+#include "ItemColorMockInventory.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    // Two textures the window background can show, only their addresses matter
+    const char DefaultTexture = 0;
+    const char GlowTexture = 0;
+}
+
+
+/**
+* @fn ItemColorMockItemSource::ItemColorMockItemSource
+*
+* @param definitionCount int - Number of distinct definitions
+* @param seed uint32_t - Same seed, same definitions
+*/
+ItemColorMockItemSource::ItemColorMockItemSource(int definitionCount, uint32_t seed) :
+    Seed(seed)
+{
+    Definitions.resize(std::max(definitionCount, 1));
+
+    for (size_t index = 0; index < Definitions.size(); ++index)
+    {
+        ItemColorDefinitionInfo& info = Definitions[index];
+
+        info.ItemID = FirstItemID + static_cast<int>(index);
+        info.QuestItem = Next(12) == 0;
+        info.TradeSkills = Next(5) == 0;
+        info.Collectible = Next(30) == 0;
+        info.Heirloom = Next(40) == 0;
+        info.IsDroppable = Next(4) != 0;
+        info.FVNoDrop = Next(10) == 0;
+        info.Attuneable = Next(15) == 0;
+        info.Placeable = Next(25) == 0;
+        info.PowerSource = Next(60) == 0;
+        info.AugType = (Next(10) == 0) ? GetItemColorAugTypeBit(static_cast<int>(Next(22)) + 1) : 0;
+        info.SocketTypes = GetItemColorSocketBit(Next(8) == 0 ? 8 : static_cast<int>(Next(20)));
+        info.RequiredLevel = static_cast<int>(Next(126));
+        info.RecommendedLevel = info.RequiredLevel;
+        info.ItemType = static_cast<int>(Next(60));
+        info.ItemClass = static_cast<int>(Next(3));
+        info.Size = static_cast<int>(Next(5));
+        info.Weight = static_cast<int>(Next(200));
+        info.Cost = static_cast<int>(Next(100000));
+        info.StackSize = Next(3) == 0 ? 1000 : 1;
+        info.Lore = Next(3) == 0;
+        info.Magic = Next(2) == 0;
+    }
+}
+
+
+const ItemColorDefinitionInfo* ItemColorMockItemSource::GetDefinition(int itemID) const
+{
+    int index = itemID - FirstItemID;
+    if (index < 0 || index >= GetDefinitionCount())
+    {
+        return nullptr;
+    }
+
+    return &Definitions[index];
+}
+
+
+int ItemColorMockItemSource::NextItemID()
+{
+    return FirstItemID + static_cast<int>(Next(static_cast<uint32_t>(Definitions.size())));
+}
+
+
+uint32_t ItemColorMockItemSource::Next(uint32_t range)
+{
+    Seed = Seed * 1664525u + 1013904223u;
+    return (Seed >> 8) % std::max(range, 1u);
+}
+
+
+/**
+* @fn ItemColorMockSlotManager::Generate
+*
+* One slot in twenty of each kind is worn, a hot button or disabled, the rest are split between
+* the inventory and bags (half), the bank and the shared bank
+*
+* @param slotCount int - Number of slots in the slot array
+* @param source ItemColorMockItemSource& - Where the items come from
+*/
+void ItemColorMockSlotManager::Generate(int slotCount, ItemColorMockItemSource& source)
+{
+    Slots.assign(std::max(slotCount, 0), ItemColorMockSlot());
+
+    for (size_t index = 0; index < Slots.size(); ++index)
+    {
+        ItemColorMockSlot& slot = Slots[index];
+        ItemColorSlotInfo& slotInfo = slot.SlotInfo;
+
+        slotInfo.Enabled = (index % 20) != 2;
+        slotInfo.HasWindow = true;
+        slotInfo.HotButton = (index % 20) == 1;
+        slotInfo.ValidLocation = true;
+        slotInfo.Equipped = (index % 20) == 0;
+
+        if (index < Slots.size() / 2)
+        {
+            slotInfo.Container = ItemColorContainer::Possessions;
+        }
+        else if (index < Slots.size() * 17 / 20)
+        {
+            slotInfo.Container = ItemColorContainer::Bank;
+        }
+        else
+        {
+            slotInfo.Container = ItemColorContainer::SharedBank;
+        }
+
+        slot.LocationKey = (static_cast<uint64_t>(slotInfo.Container) << 48) | index;
+        slot.Window.pBackground = ItemColorMockScanner::GetDefaultTexture();
+
+        if (source.Next(3) != 0)
+        {
+            SetItem(static_cast<int>(index), source.NextItemID(), source.Next(20) == 0);
+        }
+    }
+}
+
+
+void ItemColorMockSlotManager::SetItem(int index, int itemID, bool noDropFlag)
+{
+    ItemColorMockSlot& slot = Slots[index];
+    slot.ItemID = itemID;
+    slot.ItemToken = itemID ? NextToken++ : 0;
+    slot.NoDropFlag = itemID ? noDropFlag : false;
+}
+
+
+void ItemColorMockSlotManager::SwapItems(int first, int second)
+{
+    ItemColorMockSlot& a = Slots[first];
+    ItemColorMockSlot& b = Slots[second];
+    std::swap(a.ItemID, b.ItemID);
+    std::swap(a.ItemToken, b.ItemToken);
+    std::swap(a.NoDropFlag, b.NoDropFlag);
+}
+
+
+ItemColorMockSlotSource::Window* ItemColorMockSlotSource::GetColorableWindow(int index)
+{
+    ItemColorMockSlot& slot = Slots.GetSlot(index);
+    return IsColorableSlot(slot.SlotInfo) ? &slot.Window : nullptr;
+}
+
+
+ItemColorMockSlotSource::Item ItemColorMockSlotSource::GetItem(int index, Window* /*pWindow*/)
+{
+    const ItemColorMockSlot& slot = Slots.GetSlot(index);
+
+    Item item;
+    item.pInfo = slot.ItemToken ? Source.GetDefinition(slot.ItemID) : nullptr;
+    item.NoDropFlag = slot.NoDropFlag;
+    return item;
+}
+
+
+ItemColorSlotIdentity ItemColorMockSlotSource::GetIdentity(int index, Window* pWindow, const Item& /*item*/)
+{
+    const ItemColorMockSlot& slot = Slots.GetSlot(index);
+
+    ItemColorSlotIdentity identity;
+    identity.LocationKey = slot.LocationKey;
+    identity.pWindow = pWindow;
+    identity.pItem = reinterpret_cast<const void*>(static_cast<uintptr_t>(slot.ItemToken));
+    identity.ItemID = slot.ItemID;
+    identity.NoDropFlag = slot.NoDropFlag;
+    return identity;
+}
+
+
+void ItemColorMockSlotSource::ReadWindow(const Window* pWindow, ItemColorSlotWndShadow& shadow)
+{
+    shadow.BGTintNormal = pWindow->BGTintNormal;
+    shadow.BGTintRollover = pWindow->BGTintRollover;
+    shadow.pBackground = pWindow->pBackground;
+}
+
+
+void ItemColorMockSlotSource::WriteTint(Window* pWindow, uint32_t normalARGB, uint32_t rolloverARGB)
+{
+    pWindow->BGTintNormal = normalARGB;
+    pWindow->BGTintRollover = rolloverARGB;
+}
+
+
+const void* ItemColorMockSlotSource::GetBackground(const Window* /*pWindow*/, bool glow)
+{
+    return glow ? ItemColorMockScanner::GetGlowTexture() : ItemColorMockScanner::GetDefaultTexture();
+}
+
+
+void ItemColorMockSlotSource::WriteBackground(Window* pWindow, const void* pTexture)
+{
+    pWindow->pBackground = pTexture;
+}
+
+
+ItemColorMockScanner::ItemColorMockScanner(size_t cacheSize)
+{
+    Scanner.GetCache().SetCapacity(cacheSize);
+}
+
+
+const void* ItemColorMockScanner::GetDefaultTexture()
+{
+    return &DefaultTexture;
+}
+
+
+const void* ItemColorMockScanner::GetGlowTexture()
+{
+    return &GlowTexture;
+}
+
+
+/**
+* @fn ItemColorMockScanner::Sweep
+*
+* @param slots ItemColorMockSlotManager& - Slot array to color
+* @param source const ItemColorMockItemSource& - Definitions of the items in the slots
+* @param settings const ItemColorSettingsSnapshot& - Settings to classify and color with
+* @param settingsVersion uint32_t - Changing it makes every slot classify again, as the plugin's SettingsVersion does
+* @return ItemColorPulseCounters - Slots visited, skipped and classified and window writes
+*/
+ItemColorPulseCounters ItemColorMockScanner::Sweep(ItemColorMockSlotManager& slots, const ItemColorMockItemSource& source,
+    const ItemColorSettingsSnapshot& settings, uint32_t settingsVersion)
+{
+    // The plugin sizes its memos when the slot array changes size, not on every pulse
+    std::vector<ItemColorSlotMemo>& memos = Scanner.GetMemos();
+    if (memos.size() != static_cast<size_t>(slots.GetTotalSlots()))
+    {
+        memos.assign(slots.GetTotalSlots(), ItemColorSlotMemo());
+    }
+
+    ItemColorMockSlotSource slotSource(slots, source);
+    Stats.Current = ItemColorPulseCounters();
+    for (int index = 0; index < slots.GetTotalSlots(); ++index)
+    {
+        Scanner.ColorSlot(slotSource, index, settings, settingsVersion, Stats);
+    }
+
+    return Stats.Current;
+}
+
+
+/**
+* @fn AddItemColorMockFrame
+*
+* @param writer ItemColorCaptureWriter& - Capture to add the frame to
+* @param slots const ItemColorMockSlotManager& - Slot array to record
+* @param source const ItemColorMockItemSource& - Definitions of the items in the slots
+*/
+void AddItemColorMockFrame(ItemColorCaptureWriter& writer, const ItemColorMockSlotManager& slots, const ItemColorMockItemSource& source)
+{
+    writer.BeginFrame();
+    for (int index = 0; index < slots.GetTotalSlots(); ++index)
+    {
+        const ItemColorMockSlot& slot = slots.GetSlot(index);
+        const void* pItem = reinterpret_cast<const void*>(static_cast<uintptr_t>(slot.ItemToken));
+        writer.AddSlot(ItemColorCaptureSlot::Make(index, slot.SlotInfo, slot.LocationKey, pItem, slot.NoDropFlag,
+            slot.ItemToken ? source.GetDefinition(slot.ItemID) : nullptr));
+    }
+    writer.EndFrame();
+}
+
+
+/**
+* @fn MakeItemColorMockSettings
+*
+* @param classifier const ItemColorClassifierSettings& - FV flags and enabled attributes
+* @return std::shared_ptr<ItemColorSettingsSnapshot> - Settings built like the plugin's RebuildSettings with default colors
+*/
+std::shared_ptr<ItemColorSettingsSnapshot> MakeItemColorMockSettings(const ItemColorClassifierSettings& classifier)
+{
+    auto settings = std::make_shared<ItemColorSettingsSnapshot>();
+    settings->Classifier = classifier;
+    settings->UseGlowTexture = true;
+    settings->Rules = std::make_shared<ItemColorRuleSet>();
+
+    settings->Palette.resize(ItemColorRulePaletteBase);
+    settings->Palette[0] = { ItemColorDefaultAttribute.DefaultNormalARGB, ItemColorDefaultAttribute.DefaultRolloverARGB, true };
+    for (const ItemColorAttributeInfo& info : ItemColorAttributes)
+    {
+        settings->Palette[GetItemColorPaletteIndex(info.Attribute)] = { info.DefaultNormalARGB, info.DefaultRolloverARGB,
+            (classifier.EnabledAttributeMask & GetItemColorAttributeBit(info.Attribute)) != 0 };
+    }
+
+    return settings;
+}
+
+
+uint32_t GetItemColorDefaultEnabledMask()
+{
+    uint32_t onMask = 0;
+    for (const ItemColorAttributeInfo& info : ItemColorAttributes)
+    {
+        if (info.DefaultOn)
+        {
+            onMask |= GetItemColorAttributeBit(info.Attribute);
+        }
+    }
+
+    return GetItemColorEnabledMask(onMask);
+}
@@ -0,0 +1,146 @@
+/**
+* ItemColorMockInventory.h
+*
+* Stand ins for the game objects the plugin reads, so the scan can be run by the unit tests.
+* ItemColorMockItemSource makes up item definitions, ItemColorMockSlotManager lays them out in a slot array
+* shaped like pInvSlotMgr->SlotArray, and ItemColorMockScanner colors it with the same ItemColorScanner the plugin uses.
+*
+*/
+
+#pragma once
+
+#include "ItemColorCapture.h"
+#include "ItemColorCore.h"
+#include "ItemColorScanner.h"
+#include "ItemColorSettings.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Item definitions made up from a seed, the same seed always gives the same definitions
+class ItemColorMockItemSource
+{
+public:
+    // Item IDs handed out start here
+    static constexpr int FirstItemID = 1000;
+
+    explicit ItemColorMockItemSource(int definitionCount = 2000, uint32_t seed = 12345);
+
+    int GetDefinitionCount() const { return static_cast<int>(Definitions.size()); }
+
+    // Definition of an item ID from this source, nullptr for any other ID
+    const ItemColorDefinitionInfo* GetDefinition(int itemID) const;
+
+    // A random item ID from the source
+    int NextItemID();
+
+    // Random number from 0 to range - 1
+    uint32_t Next(uint32_t range);
+
+private:
+    std::vector<ItemColorDefinitionInfo> Definitions;
+    uint32_t Seed = 0;
+};
+
+// What the plugin reads and writes on a CInvSlotWnd
+struct ItemColorMockSlotWnd
+{
+    uint32_t BGTintNormal = 0;
+    uint32_t BGTintRollover = 0;
+    const void* pBackground = nullptr;
+};
+
+// One entry of the mock slot array
+struct ItemColorMockSlot
+{
+    ItemColorSlotInfo SlotInfo;
+    uint64_t LocationKey = 0;
+    // Stands in for the item's address, changes whenever the item in the slot is replaced, 0 for an empty slot
+    uint64_t ItemToken = 0;
+    int ItemID = 0;
+    bool NoDropFlag = false;
+    ItemColorMockSlotWnd Window;
+};
+
+// Slot array laid out like the game's: inventory and bag slots, bank and shared bank slots,
+// with worn slots, hot buttons and disabled slots mixed in for the filter to drop
+class ItemColorMockSlotManager
+{
+public:
+    // Replaces the slot array with slotCount slots, about two thirds of the colorable ones holding an item from source
+    void Generate(int slotCount, ItemColorMockItemSource& source);
+
+    int GetTotalSlots() const { return static_cast<int>(Slots.size()); }
+    ItemColorMockSlot& GetSlot(int index) { return Slots[index]; }
+    const ItemColorMockSlot& GetSlot(int index) const { return Slots[index]; }
+
+    // Puts a new item in a slot, as looting or buying does, 0 empties it
+    void SetItem(int index, int itemID, bool noDropFlag);
+
+    // Swaps what two slots hold, as moving an item does, the slot windows stay where they are
+    void SwapItems(int first, int second);
+
+private:
+    std::vector<ItemColorMockSlot> Slots;
+    uint64_t NextToken = 1;
+};
+
+// The mock slot array as ItemColorScanner reads and writes it
+class ItemColorMockSlotSource : public ItemColorSlotSource
+{
+public:
+    using Window = ItemColorMockSlotWnd;
+    using Item = ItemColorDefinitionItem;
+
+    ItemColorMockSlotSource(ItemColorMockSlotManager& slots, const ItemColorMockItemSource& source) :
+        Slots(slots),
+        Source(source)
+    {
+    }
+
+    Window* GetColorableWindow(int index);
+    Item GetItem(int index, Window* pWindow);
+    ItemColorSlotIdentity GetIdentity(int index, Window* pWindow, const Item& item);
+
+    void ReadWindow(const Window* pWindow, ItemColorSlotWndShadow& shadow);
+    void WriteTint(Window* pWindow, uint32_t normalARGB, uint32_t rolloverARGB);
+    const void* GetBackground(const Window* pWindow, bool glow);
+    void WriteBackground(Window* pWindow, const void* pTexture);
+
+private:
+    ItemColorMockSlotManager& Slots;
+    const ItemColorMockItemSource& Source;
+};
+
+// Colors a mock slot array with ItemColorScanner, the way the plugin's full sweeps do on the game thread
+class ItemColorMockScanner
+{
+public:
+    explicit ItemColorMockScanner(size_t cacheSize = 1024);
+
+    // Colors every slot, returns what the sweep did
+    ItemColorPulseCounters Sweep(ItemColorMockSlotManager& slots, const ItemColorMockItemSource& source,
+        const ItemColorSettingsSnapshot& settings, uint32_t settingsVersion);
+
+    const ItemColorSlotMemo& GetMemo(int index) const { return Scanner.GetMemos()[index]; }
+    ItemClassificationCache& GetCache() { return Scanner.GetCache(); }
+    ItemColorScanner& GetScanner() { return Scanner; }
+
+    // Textures the window background is set to
+    static const void* GetDefaultTexture();
+    static const void* GetGlowTexture();
+
+private:
+    ItemColorScanner Scanner;
+    ItemColorStats Stats;
+};
+
+// Adds a frame holding every slot of the array to a capture, the way /itemcolor capture records a sweep
+void AddItemColorMockFrame(ItemColorCaptureWriter& writer, const ItemColorMockSlotManager& slots, const ItemColorMockItemSource& source);
+
+// Settings with the default colors of every attribute and no rules, classified with classifier
+std::shared_ptr<ItemColorSettingsSnapshot> MakeItemColorMockSettings(const ItemColorClassifierSettings& classifier);
+
+// Enabled mask with every attribute turned on that is on by default, see ItemColorAttributeInfo::DefaultOn
+uint32_t GetItemColorDefaultEnabledMask();
@@ -0,0 +1,269 @@
+/**
+* ItemColorPersistentCacheTests.cpp
+*
+* Opens persistent cache files in the temp directory and checks what survives a Close and Open, what empties the file,
+* the load limit, probing past the end of the table and the lock that keeps a second client out.
+*
+*/
+
+#include "ItemColorPersistentCache.h"
+#include "ItemColorTest.h"
+
+#include <bit>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr size_t Capacity = 64;
+    constexpr uint64_t SettingsHash = 0x1234567890ABCDEFULL;
+
+    // Cache file in the temp directory
+    class TempFile : public ItemColorTempFile
+    {
+    public:
+        explicit TempFile(const char* name) :
+            ItemColorTempFile(std::string("ItemColorPersistentCacheTests_") + name + ".cache")
+        {
+        }
+
+        // Overwrites bytes of the file, as another version or a damaged file would have them
+        template <typename T>
+        void Write(size_t offset, const T& value) const
+        {
+            std::fstream file(GetPath(), std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(static_cast<std::streamoff>(offset));
+            file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+    };
+
+    bool Open(ItemColorPersistentCache& cache, const TempFile& file, size_t capacity = Capacity, uint64_t settingsHash = SettingsHash)
+    {
+        std::string error;
+        bool opened = cache.Open(file.GetPath(), capacity, settingsHash, error);
+        if (!opened)
+        {
+            fprintf(stderr, "  %s\n", error.c_str());
+        }
+        return opened;
+    }
+
+    // Writes a file holding item IDs 1 to count and closes it
+    void WriteEntries(const TempFile& file, int count)
+    {
+        ItemColorPersistentCache cache;
+        ITEMCOLOR_CHECK(Open(cache, file));
+        for (int itemID = 1; itemID <= count; ++itemID)
+        {
+            ITEMCOLOR_CHECK(cache.Insert(itemID, static_cast<uint32_t>(itemID) * 3, static_cast<uint32_t>(itemID), itemID % 5 - 1));
+        }
+    }
+
+    // Item IDs whose probe starts at the last entry of a table of Capacity entries, the same hash GetSlot uses
+    std::vector<int> GetLastSlotItemIDs(size_t count)
+    {
+        std::vector<int> itemIDs;
+        for (int itemID = 1; itemIDs.size() < count; ++itemID)
+        {
+            uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(itemID)) * 0x9E3779B97F4A7C15ULL;
+            if ((hash >> (64 - std::countr_zero(Capacity))) == Capacity - 1)
+            {
+                itemIDs.push_back(itemID);
+            }
+        }
+        return itemIDs;
+    }
+}
+
+
+// Entries written in one session are found in the next
+ITEMCOLOR_TEST(EntriesSurviveCloseAndOpen)
+{
+    TempFile file("Survive");
+    WriteEntries(file, 20);
+
+    ItemColorPersistentCache cache;
+    ITEMCOLOR_CHECK(Open(cache, file));
+    ITEMCOLOR_CHECK(!cache.WasReset());
+    ITEMCOLOR_CHECK_EQUAL(cache.GetSize(), 20u);
+    ITEMCOLOR_CHECK_EQUAL(cache.GetCapacity(), Capacity);
+    ITEMCOLOR_CHECK_EQUAL(cache.GetSettingsHash(), SettingsHash);
+
+    for (int itemID = 1; itemID <= 20; ++itemID)
+    {
+        const ItemColorPersistentCacheEntry* pEntry = cache.Find(itemID);
+        ITEMCOLOR_CHECK(pEntry != nullptr);
+        if (pEntry)
+        {
+            ITEMCOLOR_CHECK_EQUAL(pEntry->ItemID, itemID);
+            ITEMCOLOR_CHECK_EQUAL(pEntry->DefinitionMask, static_cast<uint32_t>(itemID) * 3);
+            ITEMCOLOR_CHECK_EQUAL(pEntry->SocketTypes, static_cast<uint32_t>(itemID));
+            ITEMCOLOR_CHECK_EQUAL(pEntry->Rule, itemID % 5 - 1);
+        }
+    }
+
+    ITEMCOLOR_CHECK(cache.Find(21) == nullptr);
+    ITEMCOLOR_CHECK(cache.Find(0) == nullptr);
+    ITEMCOLOR_CHECK_EQUAL(cache.Hits, 20u);
+    ITEMCOLOR_CHECK_EQUAL(cache.Misses, 2u);
+
+    // Adding a definition already there keeps the first entry
+    ITEMCOLOR_CHECK(cache.Insert(5, 0, 0, 7));
+    ITEMCOLOR_CHECK_EQUAL(cache.Find(5)->Rule, 5 % 5 - 1);
+    ITEMCOLOR_CHECK_EQUAL(cache.GetSize(), 20u);
+}
+
+
+// A file that does not match exactly is opened empty rather than trusted
+ITEMCOLOR_TEST(MismatchedFilesStartEmpty)
+{
+    auto reopened = [](const TempFile& file, size_t capacity, uint64_t settingsHash)
+    {
+        ItemColorPersistentCache cache;
+        ITEMCOLOR_CHECK(Open(cache, file, capacity, settingsHash));
+        ITEMCOLOR_CHECK(cache.WasReset());
+        ITEMCOLOR_CHECK_EQUAL(cache.GetSize(), 0u);
+        ITEMCOLOR_CHECK(cache.Find(1) == nullptr);
+        ITEMCOLOR_CHECK_EQUAL(cache.GetSettingsHash(), settingsHash);
+    };
+
+    TempFile file("Mismatch");
+
+    // Missing
+    reopened(file, Capacity, SettingsHash);
+
+    WriteEntries(file, 10);
+    file.Write(offsetof(ItemColorPersistentCacheHeader, Magic), 'X');
+    reopened(file, Capacity, SettingsHash);
+
+    WriteEntries(file, 10);
+    file.Write(offsetof(ItemColorPersistentCacheHeader, Version), ItemColorPersistentCacheHeader::CurrentVersion + 1);
+    reopened(file, Capacity, SettingsHash);
+
+    // Capacity in the header that does not match the file's size
+    WriteEntries(file, 10);
+    file.Write(offsetof(ItemColorPersistentCacheHeader, Capacity), static_cast<uint32_t>(Capacity * 2));
+    reopened(file, Capacity, SettingsHash);
+
+    // Count past the load limit
+    WriteEntries(file, 10);
+    file.Write(offsetof(ItemColorPersistentCacheHeader, Count), static_cast<uint32_t>(Capacity));
+    reopened(file, Capacity, SettingsHash);
+
+    // Opened for a table of another size
+    WriteEntries(file, 10);
+    reopened(file, Capacity * 4, SettingsHash);
+    ITEMCOLOR_CHECK_EQUAL(std::filesystem::file_size(file.GetPath()),
+        sizeof(ItemColorPersistentCacheHeader) + Capacity * 4 * sizeof(ItemColorPersistentCacheEntry));
+
+    // Classified with other settings
+    WriteEntries(file, 10);
+    reopened(file, Capacity, SettingsHash + 1);
+
+    // And a file that does match is kept
+    WriteEntries(file, 10);
+    ItemColorPersistentCache cache;
+    ITEMCOLOR_CHECK(Open(cache, file));
+    ITEMCOLOR_CHECK(!cache.WasReset());
+    ITEMCOLOR_CHECK_EQUAL(cache.GetSize(), 10u);
+}
+
+
+// The table stops taking definitions at MaxLoadPercent full
+ITEMCOLOR_TEST(LoadLimit)
+{
+    TempFile file("LoadLimit");
+    ItemColorPersistentCache cache;
+    ITEMCOLOR_CHECK(Open(cache, file));
+
+    size_t limit = Capacity * ItemColorPersistentCache::MaxLoadPercent / 100;
+    for (size_t itemID = 1; itemID <= limit; ++itemID)
+    {
+        ITEMCOLOR_CHECK(cache.Insert(static_cast<int>(itemID), 0, 0, -1));
+    }
+    ITEMCOLOR_CHECK_EQUAL(cache.GetSize(), limit);
+    ITEMCOLOR_CHECK_EQUAL(cache.Rejected, 0u);
+
+    ITEMCOLOR_CHECK(!cache.Insert(static_cast<int>(limit + 1), 0, 0, -1));
+    ITEMCOLOR_CHECK(!cache.Contains(static_cast<int>(limit + 1)));
+    ITEMCOLOR_CHECK_EQUAL(cache.Rejected, 1u);
+    ITEMCOLOR_CHECK_EQUAL(cache.GetSize(), limit);
+
+    // What is already there is still found, and can be added again
+    ITEMCOLOR_CHECK(cache.Contains(1));
+    ITEMCOLOR_CHECK(cache.Insert(1, 0, 0, -1));
+    ITEMCOLOR_CHECK_EQUAL(cache.Rejected, 1u);
+
+    // Reset empties the table in place
+    cache.Reset(SettingsHash + 1);
+    ITEMCOLOR_CHECK_EQUAL(cache.GetSize(), 0u);
+    ITEMCOLOR_CHECK(!cache.Contains(1));
+    ITEMCOLOR_CHECK_EQUAL(cache.GetSettingsHash(), SettingsHash + 1);
+    ITEMCOLOR_CHECK(cache.Insert(static_cast<int>(limit + 1), 0, 0, -1));
+}
+
+
+// Definitions that hash to the last entry continue probing from the first
+ITEMCOLOR_TEST(ProbesWrapAround)
+{
+    std::vector<int> itemIDs = GetLastSlotItemIDs(4);
+
+    TempFile file("Wrap");
+    {
+        ItemColorPersistentCache cache;
+        ITEMCOLOR_CHECK(Open(cache, file));
+        for (size_t n = 0; n < itemIDs.size(); ++n)
+        {
+            ITEMCOLOR_CHECK(cache.Insert(itemIDs[n], 0, 0, static_cast<int>(n)));
+        }
+    }
+
+    // The first takes the last entry and the rest the first entries of the table
+    std::ifstream raw(file.GetPath(), std::ios::binary);
+    std::vector<ItemColorPersistentCacheEntry> entries(Capacity);
+    raw.seekg(sizeof(ItemColorPersistentCacheHeader));
+    raw.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(Capacity * sizeof(ItemColorPersistentCacheEntry)));
+    ITEMCOLOR_CHECK_EQUAL(entries[Capacity - 1].ItemID, itemIDs[0]);
+    for (size_t n = 1; n < itemIDs.size(); ++n)
+    {
+        ITEMCOLOR_CHECK_EQUAL(entries[n - 1].ItemID, itemIDs[n]);
+    }
+
+    ItemColorPersistentCache cache;
+    ITEMCOLOR_CHECK(Open(cache, file));
+    for (size_t n = 0; n < itemIDs.size(); ++n)
+    {
+        const ItemColorPersistentCacheEntry* pEntry = cache.Find(itemIDs[n]);
+        ITEMCOLOR_CHECK(pEntry != nullptr);
+        ITEMCOLOR_CHECK_EQUAL(pEntry ? pEntry->Rule : -2, static_cast<int>(n));
+    }
+
+    // A definition that would probe past them stops at the first unused entry
+    ITEMCOLOR_CHECK(cache.Find(GetLastSlotItemIDs(5).back()) == nullptr);
+}
+
+
+// Only one client writes a file, a second one runs without it until the first closes it
+ITEMCOLOR_TEST(SecondOpenFailsWhileLocked)
+{
+    TempFile file("Lock");
+    ItemColorPersistentCache first;
+    ITEMCOLOR_CHECK(Open(first, file));
+    ITEMCOLOR_CHECK(first.Insert(1, 0, 0, -1));
+
+    ItemColorPersistentCache second;
+    std::string error;
+    ITEMCOLOR_CHECK(!second.Open(file.GetPath(), Capacity, SettingsHash, error));
+    ITEMCOLOR_CHECK(error.find("in use") != std::string::npos);
+    ITEMCOLOR_CHECK(!second.IsOpen());
+    ITEMCOLOR_CHECK(!second.Insert(2, 0, 0, -1));
+    ITEMCOLOR_CHECK(second.Find(1) == nullptr);
+
+    first.Close();
+    ITEMCOLOR_CHECK(!first.IsOpen());
+    ITEMCOLOR_CHECK(Open(second, file));
+    ITEMCOLOR_CHECK(second.Contains(1));
+}
@@ -0,0 +1,90 @@
+/**
+* ItemColorRulesBenchmark.cpp
+*
+* Times the rule program the way /itemcolor bench does, at 100 and 500 rules, and checks the index keeps
+* the cost per item from growing with the number of rules. The bounds are loose so a busy machine does not fail them,
+* they catch the index being lost, not small slowdowns.
+*
+*/
+
+#include "ItemColorMockInventory.h"
+#include "ItemColorRules.h"
+#include "ItemColorTest.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    constexpr int Passes = 40;
+
+    std::vector<ItemColorDefinitionInfo> MakeItems()
+    {
+        ItemColorMockItemSource source;
+        std::vector<ItemColorDefinitionInfo> items;
+        for (int definition = 0; definition < source.GetDefinitionCount(); ++definition)
+        {
+            items.push_back(*source.GetDefinition(ItemColorMockItemSource::FirstItemID + definition));
+        }
+        return items;
+    }
+
+    ItemColorRuleProgram MakeProgram(int ruleCount, bool indexed)
+    {
+        ItemColorRuleProgram program;
+        std::string error;
+        for (int rule = 0; rule < ruleCount; ++rule)
+        {
+            ITEMCOLOR_CHECK(program.AddRule(rule, MakeItemColorBenchmarkRule(rule), rule, error));
+        }
+
+        if (indexed)
+        {
+            program.BuildIndex();
+        }
+        return program;
+    }
+
+    // Best of a few runs, the least disturbed one is closest to what the code costs
+    ItemColorRuleBenchmarkResult Benchmark(const std::vector<ItemColorDefinitionInfo>& items, const ItemColorRuleProgram& program)
+    {
+        ItemColorClassifierSettings settings;
+        settings.EnabledAttributeMask = GetItemColorDefaultEnabledMask();
+
+        ItemColorRuleBenchmarkResult best;
+        for (int run = 0; run < 5; ++run)
+        {
+            ItemColorRuleBenchmarkResult result = BenchmarkItemColorRules(items, program, settings, Passes);
+            if (run == 0 || result.RulesNanoseconds < best.RulesNanoseconds)
+            {
+                best = result;
+            }
+        }
+        return best;
+    }
+}
+
+
+ITEMCOLOR_TEST(IndexKeepsRuleCostFlat)
+{
+    std::vector<ItemColorDefinitionInfo> items = MakeItems();
+    ITEMCOLOR_CHECK(!items.empty());
+
+    ItemColorRuleBenchmarkResult indexed100 = Benchmark(items, MakeProgram(100, true));
+    ItemColorRuleBenchmarkResult indexed500 = Benchmark(items, MakeProgram(500, true));
+    ItemColorRuleBenchmarkResult plain500 = Benchmark(items, MakeProgram(500, false));
+
+    printf("%zu items, chain %.1f ns per item\n", items.size(), indexed100.ChainNanoseconds);
+    printf("100 rules indexed: %.1f ns per item\n", indexed100.RulesNanoseconds);
+    printf("500 rules indexed: %.1f ns per item\n", indexed500.RulesNanoseconds);
+    printf("500 rules, every rule tried: %.1f ns per item\n", plain500.RulesNanoseconds);
+
+    // The benchmark rules never match
+    ITEMCOLOR_CHECK_EQUAL(indexed100.Matches, 0);
+    ITEMCOLOR_CHECK_EQUAL(indexed500.Matches, 0);
+    ITEMCOLOR_CHECK_EQUAL(plain500.Matches, 0);
+
+    // Five times the rules walked one by one costs about five times as much, the index has to stay well under that
+    ITEMCOLOR_CHECK(indexed500.RulesNanoseconds < indexed100.RulesNanoseconds * 3.0);
+    ITEMCOLOR_CHECK(indexed500.RulesNanoseconds < plain500.RulesNanoseconds);
+}
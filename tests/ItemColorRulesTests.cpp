@@ -0,0 +1,586 @@
+/**
+* ItemColorRulesTests.cpp
+*
+* Checks the rule parser and compiler: precedence, not, Socket(...), error messages, the jumps the tests are joined by
+* and the range index. Generated rule sets are run through the compiled program, with and without the index,
+* and every answer is checked against a plain tree walk of the same rules.
+*
+*/
+
+#include "ItemColorRules.h"
+#include "ItemColorTest.h"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct FieldName
+    {
+        const char* Name;
+        ItemColorRuleField Field;
+        bool Flag;
+    };
+
+    // Every name a rule can use, NoTrade is another name for NoDrop
+    constexpr FieldName FieldNames[] =
+    {
+        { "ID", ItemColorRuleField::ID, false },
+        { "ReqLevel", ItemColorRuleField::ReqLevel, false },
+        { "RecLevel", ItemColorRuleField::RecLevel, false },
+        { "ItemType", ItemColorRuleField::ItemType, false },
+        { "ItemClass", ItemColorRuleField::ItemClass, false },
+        { "Size", ItemColorRuleField::Size, false },
+        { "Weight", ItemColorRuleField::Weight, false },
+        { "Cost", ItemColorRuleField::Cost, false },
+        { "StackSize", ItemColorRuleField::StackSize, false },
+        { "Lore", ItemColorRuleField::Lore, true },
+        { "Magic", ItemColorRuleField::Magic, true },
+        { "Quest", ItemColorRuleField::Quest, true },
+        { "TradeSkills", ItemColorRuleField::TradeSkills, true },
+        { "Collectible", ItemColorRuleField::Collectible, true },
+        { "Heirloom", ItemColorRuleField::Heirloom, true },
+        { "NoDrop", ItemColorRuleField::NoDrop, true },
+        { "NoTrade", ItemColorRuleField::NoDrop, true },
+        { "Attuneable", ItemColorRuleField::Attuneable, true },
+        { "AugSlot8", ItemColorRuleField::AugSlot8, true },
+        { "PowerSource", ItemColorRuleField::PowerSource, true },
+        { "Placeable", ItemColorRuleField::Placeable, true },
+        { "Ornamentation", ItemColorRuleField::Ornamentation, true },
+    };
+
+    // Numeric fields and the constants rules compare them with are drawn from this range, so both sides of a test come up
+    constexpr int ValueRange = 12;
+
+    // Socket types generated rules and items use, few enough that Socket(...) matches often
+    constexpr int SocketTypes[] = { 3, 7, 8, 20, 21 };
+
+    // Rule as a tree, evaluated by walking it
+    struct Expr
+    {
+        enum class Kind { Test, Socket, Not, And, Or };
+
+        Kind NodeKind = Kind::Test;
+        ItemColorRuleField Field = ItemColorRuleField::ID;
+        ItemColorRuleOp Op = ItemColorRuleOp::NotEqual;
+        int32_t Value = 0;
+        int Left = -1;
+        int Right = -1;
+    };
+
+    struct ReferenceRule
+    {
+        std::vector<Expr> Nodes;
+        int Root = -1;
+        int Priority = 0;
+        std::string Text;
+    };
+
+    bool Compare(int32_t value, ItemColorRuleOp op, int32_t constant)
+    {
+        switch (op)
+        {
+        case ItemColorRuleOp::Equal: return value == constant;
+        case ItemColorRuleOp::NotEqual: return value != constant;
+        case ItemColorRuleOp::Less: return value < constant;
+        case ItemColorRuleOp::LessEqual: return value <= constant;
+        case ItemColorRuleOp::Greater: return value > constant;
+        case ItemColorRuleOp::GreaterEqual: return value >= constant;
+        case ItemColorRuleOp::AnyOf: return (value & constant) != 0;
+        case ItemColorRuleOp::NoneOf: return (value & constant) == 0;
+        }
+        return false;
+    }
+
+    bool Walk(const ReferenceRule& rule, int node, const ItemColorRuleFields& fields)
+    {
+        const Expr& expr = rule.Nodes[node];
+        switch (expr.NodeKind)
+        {
+        case Expr::Kind::Not: return !Walk(rule, expr.Left, fields);
+        case Expr::Kind::And: return Walk(rule, expr.Left, fields) && Walk(rule, expr.Right, fields);
+        case Expr::Kind::Or: return Walk(rule, expr.Left, fields) || Walk(rule, expr.Right, fields);
+        default: return Compare(fields[static_cast<size_t>(expr.Field)], expr.Op, expr.Value);
+        }
+    }
+
+    // First rule by priority, then by the order added, that matches, -1 if none
+    int EvaluateReference(const std::vector<ReferenceRule>& rules, const ItemColorRuleFields& fields)
+    {
+        int best = -1;
+        for (int rule = 0; rule < static_cast<int>(rules.size()); ++rule)
+        {
+            if ((best < 0 || rules[rule].Priority < rules[best].Priority) && Walk(rules[rule], rules[rule].Root, fields))
+            {
+                best = rule;
+            }
+        }
+        return best;
+    }
+
+    // Makes up rules and items, and writes the rules out the many ways a user could
+    class RuleGenerator
+    {
+    public:
+        explicit RuleGenerator(uint32_t seed) : Random(seed) {}
+
+        int Next(int range) { return static_cast<int>(Random() % static_cast<uint32_t>(range)); }
+        bool Chance(int percent) { return Next(100) < percent; }
+
+        ReferenceRule MakeRule(int priority)
+        {
+            ReferenceRule rule;
+            rule.Priority = priority;
+            rule.Root = MakeNode(rule, 0);
+            rule.Text = Write(rule, rule.Root);
+            return rule;
+        }
+
+        ItemColorRuleFields MakeFields()
+        {
+            ItemColorRuleFields fields{};
+            for (const FieldName& fieldName : FieldNames)
+            {
+                fields[static_cast<size_t>(fieldName.Field)] = fieldName.Flag ? Next(2) : Next(ValueRange) - 1;
+            }
+
+            uint32_t sockets = 0;
+            for (int socketType : SocketTypes)
+            {
+                sockets |= Chance(30) ? GetItemColorSocketBit(socketType) : 0;
+            }
+            fields[static_cast<size_t>(ItemColorRuleField::Sockets)] = static_cast<int32_t>(sockets);
+            return fields;
+        }
+
+    private:
+        std::mt19937 Random;
+
+        int Add(ReferenceRule& rule, const Expr& expr)
+        {
+            rule.Nodes.push_back(expr);
+            return static_cast<int>(rule.Nodes.size()) - 1;
+        }
+
+        // Tops of rules are mostly and-ed tests, the shape the index narrows rules down with
+        int MakeNode(ReferenceRule& rule, int depth)
+        {
+            int pick = Next(100);
+            if (depth < 3 && pick < ((depth == 0) ? 75 : 30))
+            {
+                Expr expr;
+                expr.NodeKind = (depth == 0 || Chance(50)) ? Expr::Kind::And : Expr::Kind::Or;
+                expr.Left = MakeNode(rule, depth + 1);
+                expr.Right = MakeNode(rule, depth + 1);
+                return Add(rule, expr);
+            }
+
+            if (depth < 3 && pick < 45)
+            {
+                Expr expr;
+                expr.NodeKind = Expr::Kind::Not;
+                expr.Left = MakeNode(rule, depth + 1);
+                return Add(rule, expr);
+            }
+
+            if (pick < 52)
+            {
+                Expr expr;
+                expr.NodeKind = Expr::Kind::Socket;
+                expr.Field = ItemColorRuleField::Sockets;
+                expr.Op = ItemColorRuleOp::AnyOf;
+                for (int socket = 0, count = 1 + Next(2); socket < count; ++socket)
+                {
+                    expr.Value |= static_cast<int32_t>(GetItemColorSocketBit(SocketTypes[Next(static_cast<int>(std::size(SocketTypes)))]));
+                }
+                return Add(rule, expr);
+            }
+
+            const FieldName& fieldName = FieldNames[Next(static_cast<int>(std::size(FieldNames)))];
+            Expr expr;
+            expr.Field = fieldName.Field;
+            if (fieldName.Flag && Chance(50))
+            {
+                // Field on its own
+                expr.Op = ItemColorRuleOp::NotEqual;
+                expr.Value = 0;
+            }
+            else
+            {
+                expr.Op = static_cast<ItemColorRuleOp>(Next(static_cast<int>(ItemColorRuleOp::GreaterEqual) + 1));
+                expr.Value = fieldName.Flag ? Next(3) : Next(ValueRange) - 1;
+            }
+            return Add(rule, expr);
+        }
+
+        // Field names and keywords in any case
+        std::string Mangle(std::string text)
+        {
+            int style = Next(3);
+            for (char& c : text)
+            {
+                if (style == 1)
+                {
+                    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                }
+                else if (style == 2)
+                {
+                    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+                }
+            }
+            return text;
+        }
+
+        std::string Write(const ReferenceRule& rule, int node)
+        {
+            const Expr& expr = rule.Nodes[node];
+            switch (expr.NodeKind)
+            {
+            case Expr::Kind::And:
+                return "(" + Write(rule, expr.Left) + (Chance(50) ? Mangle(" and ") : " && ") + Write(rule, expr.Right) + ")";
+
+            case Expr::Kind::Or:
+                return "(" + Write(rule, expr.Left) + (Chance(50) ? Mangle(" or ") : " || ") + Write(rule, expr.Right) + ")";
+
+            case Expr::Kind::Not:
+                return (Chance(50) ? Mangle("not ") : std::string(Chance(50) ? "!" : "! ")) + Write(rule, expr.Left);
+
+            case Expr::Kind::Socket:
+            {
+                std::string text = Mangle("Socket") + "(";
+                bool first = true;
+                for (int socketType : SocketTypes)
+                {
+                    if (expr.Value & static_cast<int32_t>(GetItemColorSocketBit(socketType)))
+                    {
+                        text += (first ? "" : ", ") + std::to_string(socketType);
+                        first = false;
+                    }
+                }
+                return text + ")";
+            }
+
+            default:
+                break;
+            }
+
+            auto name = std::find_if(std::begin(FieldNames), std::end(FieldNames),
+                [&expr](const FieldName& fieldName) { return fieldName.Field == expr.Field; });
+            std::string text = Mangle((expr.Field == ItemColorRuleField::NoDrop && Chance(50)) ? "NoTrade" : name->Name);
+            if (name->Flag && expr.Op == ItemColorRuleOp::NotEqual && expr.Value == 0 && Chance(50))
+            {
+                return text;
+            }
+
+            static const char* const Symbols[] = { "=", "!=", "<", "<=", ">", ">=" };
+            const char* symbol = (expr.Op == ItemColorRuleOp::Equal && Chance(50)) ? "==" : Symbols[static_cast<int>(expr.Op)];
+            return text + (Chance(50) ? " " : "") + symbol + (Chance(50) ? " " : "") + std::to_string(expr.Value);
+        }
+    };
+
+    ItemColorRuleProgram Compile(const std::vector<std::string>& rules)
+    {
+        ItemColorRuleProgram program;
+        for (int rule = 0; rule < static_cast<int>(rules.size()); ++rule)
+        {
+            std::string error;
+            ITEMCOLOR_CHECK(program.AddRule(rule, rules[rule], rule, error));
+            ITEMCOLOR_CHECK(error.empty());
+        }
+        return program;
+    }
+
+    ItemColorRuleFields MakeFields(std::initializer_list<std::pair<ItemColorRuleField, int32_t>> values)
+    {
+        ItemColorRuleFields fields{};
+        for (const auto& [field, value] : values)
+        {
+            fields[static_cast<size_t>(field)] = value;
+        }
+        return fields;
+    }
+
+    // Message AddRule gives for a rule, empty if it compiles
+    std::string GetRuleError(std::string_view expression)
+    {
+        ItemColorRuleProgram program;
+        std::string error;
+        bool added = program.AddRule(0, expression, 0, error);
+        ITEMCOLOR_CHECK_EQUAL(added, error.empty());
+        ITEMCOLOR_CHECK_EQUAL(program.GetRuleCount(), added ? 1u : 0u);
+        return error;
+    }
+}
+
+
+// Generated rule sets give the same answer compiled, compiled and indexed, and walked as a tree
+ITEMCOLOR_TEST(CompiledRulesMatchTheTreeWalk)
+{
+    RuleGenerator generator(20240611);
+    int mismatches = 0;
+    int matched = 0;
+    int evaluated = 0;
+
+    for (int set = 0; set < 300; ++set)
+    {
+        std::vector<ReferenceRule> rules;
+        ItemColorRuleProgram program;
+        // Every tenth set has more rules than one word of the index holds
+        int count = (set % 10 == 9) ? 150 : 1 + generator.Next(8);
+        for (int rule = 0; rule < count; ++rule)
+        {
+            rules.push_back(generator.MakeRule(generator.Next(8)));
+
+            std::string error;
+            if (!program.AddRule(rule, rules.back().Text, rules.back().Priority, error))
+            {
+                ITEMCOLOR_CHECK(false);
+                fprintf(stderr, "  %s: %s\n", rules.back().Text.c_str(), error.c_str());
+            }
+        }
+
+        ItemColorRuleProgram indexed = program;
+        indexed.BuildIndex();
+
+        for (int item = 0; item < 200; ++item)
+        {
+            ItemColorRuleFields fields = generator.MakeFields();
+            int expected = EvaluateReference(rules, fields);
+            int plain = program.Evaluate(fields);
+            int fast = indexed.Evaluate(fields);
+
+            ++evaluated;
+            matched += (expected >= 0) ? 1 : 0;
+            if ((plain != expected || fast != expected) && ++mismatches <= 5)
+            {
+                ITEMCOLOR_CHECK_EQUAL(plain, expected);
+                ITEMCOLOR_CHECK_EQUAL(fast, expected);
+                fprintf(stderr, "  set %d item %d, expected rule %s\n", set, item,
+                    (expected >= 0) ? rules[expected].Text.c_str() : "none");
+            }
+        }
+    }
+
+    ITEMCOLOR_CHECK_EQUAL(mismatches, 0);
+    printf("%d of %d items matched a rule\n", matched, evaluated);
+
+    // Both outcomes have to come up often for the comparison to mean anything
+    ITEMCOLOR_CHECK(matched > evaluated / 10);
+    ITEMCOLOR_CHECK(matched < evaluated - evaluated / 10);
+}
+
+
+// And binds tighter than or, not binds tighter than both, and keywords and symbols mean the same
+ITEMCOLOR_TEST(PrecedenceAndNot)
+{
+    const std::pair<const char*, const char*> same[] =
+    {
+        { "Quest or Lore and Magic", "Quest or (Lore and Magic)" },
+        { "Quest and Lore or Magic", "(Quest and Lore) or Magic" },
+        { "not Quest and Lore", "(not Quest) and Lore" },
+        { "!Quest || Lore && !Magic", "(not Quest) or (Lore and (not Magic))" },
+        { "not not Quest", "Quest" },
+        { "!(Quest or Lore)", "not Quest and not Lore" },
+        { "ReqLevel != 3", "!(ReqLevel = 3)" },
+        { "ReqLevel==3", "reqlevel = 3" },
+        { "QUEST AND NOT lore", "Quest and !Lore" },
+        { "NoTrade", "NoDrop != 0" },
+    };
+
+    for (const auto& [text, expected] : same)
+    {
+        ItemColorRuleProgram program = Compile({ text });
+        ItemColorRuleProgram reference = Compile({ expected });
+
+        for (int combination = 0; combination < 8 * 6; ++combination)
+        {
+            ItemColorRuleFields fields = MakeFields({
+                { ItemColorRuleField::Quest, combination & 1 },
+                { ItemColorRuleField::Lore, (combination >> 1) & 1 },
+                { ItemColorRuleField::Magic, (combination >> 2) & 1 },
+                { ItemColorRuleField::NoDrop, combination & 1 },
+                { ItemColorRuleField::ReqLevel, combination / 8 } });
+
+            if (program.Evaluate(fields) != reference.Evaluate(fields))
+            {
+                ITEMCOLOR_CHECK_EQUAL(program.Evaluate(fields), reference.Evaluate(fields));
+                fprintf(stderr, "  \"%s\" and \"%s\" differ for combination %d\n", text, expected, combination);
+            }
+        }
+    }
+
+    // Spot checks so the pairs above can not all be wrong the same way
+    ItemColorRuleProgram program = Compile({ "Quest or Lore and Magic" });
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Quest, 1 } })), 0);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Lore, 1 } })), -1);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Lore, 1 }, { ItemColorRuleField::Magic, 1 } })), 0);
+}
+
+
+// Socket(...) is true when the item has a socket of any listed type
+ITEMCOLOR_TEST(SocketTypesAnyOf)
+{
+    ItemColorRuleProgram program = Compile({ "Socket(8, 20)", "not Socket(3)" });
+
+    auto sockets = [](std::initializer_list<int> socketTypes)
+    {
+        uint32_t mask = 0;
+        for (int socketType : socketTypes)
+        {
+            mask |= GetItemColorSocketBit(socketType);
+        }
+        return MakeFields({ { ItemColorRuleField::Sockets, static_cast<int32_t>(mask) } });
+    };
+
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(sockets({ 8 })), 0);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(sockets({ 3, 20 })), 0);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(sockets({ 21 })), 1);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(sockets({})), 1);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(sockets({ 3, 21 })), -1);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(sockets({ 31 })), 1);
+}
+
+
+// A rule that does not parse says why and where, and is not added
+ITEMCOLOR_TEST(ErrorsNameTheColumn)
+{
+    ITEMCOLOR_CHECK(GetRuleError("ReqLevel > 100 and NoDrop").empty());
+    ITEMCOLOR_CHECK(GetRuleError("") == "expected a field name at column 1");
+    ITEMCOLOR_CHECK(GetRuleError("Foo > 1") == "unknown field at column 1");
+    ITEMCOLOR_CHECK(GetRuleError("ReqLevel >") == "expected a number at column 11");
+    ITEMCOLOR_CHECK(GetRuleError("ReqLevel > x") == "expected a number at column 12");
+    ITEMCOLOR_CHECK(GetRuleError("(Quest") == "expected ) at column 7");
+    ITEMCOLOR_CHECK(GetRuleError("Quest Lore") == "unexpected text at column 7");
+    ITEMCOLOR_CHECK(GetRuleError("Quest and") == "expected a field name at column 10");
+    ITEMCOLOR_CHECK(GetRuleError("Socket 8") == "expected ( at column 8");
+    ITEMCOLOR_CHECK(GetRuleError("Socket(0)") == "socket type must be 1 to 31 at column 8");
+    ITEMCOLOR_CHECK(GetRuleError("Socket(8, 32)") == "socket type must be 1 to 31 at column 11");
+    ITEMCOLOR_CHECK(GetRuleError("Socket(8") == "expected ) at column 9");
+
+    // Rules after a bad one still get the ID they were added with
+    ItemColorRuleProgram program;
+    std::string error;
+    ITEMCOLOR_CHECK(!program.AddRule(0, "Quest >", 0, error));
+    ITEMCOLOR_CHECK(program.AddRule(1, "Quest", 1, error));
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Quest, 1 } })), 1);
+}
+
+
+// And, or and not compile to jumps between tests, one test per comparison and nothing for the operators
+ITEMCOLOR_TEST(OperatorsBecomeJumps)
+{
+    ItemColorRuleProgram program = Compile({ "Quest and Lore or Magic" });
+    ITEMCOLOR_CHECK_EQUAL(program.GetTestCount(), 3u);
+
+    program = Compile({ "not (Quest or not Lore)", "((Magic))", "!!!Heirloom" });
+    ITEMCOLOR_CHECK_EQUAL(program.GetTestCount(), 4u);
+
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Lore, 1 } })), 0);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Lore, 1 }, { ItemColorRuleField::Quest, 1 } })), 2);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Magic, 1 }, { ItemColorRuleField::Heirloom, 1 } })), 1);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Heirloom, 1 } })), -1);
+
+    // Only NoDrop can change with the item rather than its definition
+    ITEMCOLOR_CHECK(!program.UsesInstanceFields());
+    ITEMCOLOR_CHECK(Compile({ "Quest", "not NoTrade" }).UsesInstanceFields());
+}
+
+
+// Lower priorities are tried first, equal ones in the order they were added
+ITEMCOLOR_TEST(PriorityOrder)
+{
+    ItemColorRuleProgram program;
+    std::string error;
+    program.AddRule(10, "Quest", 5, error);
+    program.AddRule(11, "Lore", 1, error);
+    program.AddRule(12, "Quest", 1, error);
+    program.AddRule(13, "Magic", 1, error);
+
+    ItemColorRuleFields fields = MakeFields({ { ItemColorRuleField::Quest, 1 }, { ItemColorRuleField::Magic, 1 } });
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(fields), 12);
+    program.BuildIndex();
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(fields), 12);
+}
+
+
+// The index only rules out rules that can not match, at every edge of the ranges it splits values into
+ITEMCOLOR_TEST(RangeIndexEdges)
+{
+    ItemColorRuleProgram program = Compile({
+        "ReqLevel >= 10 and ReqLevel < 20",
+        "ReqLevel >= 15 and ItemType = 3",
+        "not (ReqLevel < 5) and not Quest",
+        "ReqLevel > 100 or ItemType = 7",
+        "Lore != 0 and Magic != 1" });
+    ItemColorRuleProgram indexed = program;
+    indexed.BuildIndex();
+
+    for (int level = -2; level <= 110; ++level)
+    {
+        for (int combination = 0; combination < 32; ++combination)
+        {
+            ItemColorRuleFields fields = MakeFields({
+                { ItemColorRuleField::ReqLevel, level },
+                { ItemColorRuleField::ItemType, (combination & 1) ? 3 : ((combination & 2) ? 7 : 0) },
+                { ItemColorRuleField::Quest, (combination >> 2) & 1 },
+                { ItemColorRuleField::Lore, (combination >> 3) & 1 },
+                { ItemColorRuleField::Magic, (combination >> 4) & 1 } });
+
+            if (program.Evaluate(fields) != indexed.Evaluate(fields))
+            {
+                ITEMCOLOR_CHECK_EQUAL(indexed.Evaluate(fields), program.Evaluate(fields));
+                fprintf(stderr, "  level %d, combination %d\n", level, combination);
+            }
+        }
+    }
+
+    ITEMCOLOR_CHECK_EQUAL(indexed.Evaluate(MakeFields({ { ItemColorRuleField::ReqLevel, 9 }, { ItemColorRuleField::Quest, 1 } })), -1);
+    ITEMCOLOR_CHECK_EQUAL(indexed.Evaluate(MakeFields({ { ItemColorRuleField::ReqLevel, 10 } })), 0);
+    ITEMCOLOR_CHECK_EQUAL(indexed.Evaluate(MakeFields({ { ItemColorRuleField::ReqLevel, 19 }, { ItemColorRuleField::ItemType, 3 } })), 0);
+    ITEMCOLOR_CHECK_EQUAL(indexed.Evaluate(MakeFields({ { ItemColorRuleField::ReqLevel, 20 }, { ItemColorRuleField::ItemType, 3 } })), 1);
+    ITEMCOLOR_CHECK_EQUAL(indexed.Evaluate(MakeFields({ { ItemColorRuleField::ReqLevel, 5 } })), 2);
+    ITEMCOLOR_CHECK_EQUAL(indexed.Evaluate(MakeFields({ { ItemColorRuleField::ReqLevel, 4 }, { ItemColorRuleField::ItemType, 7 } })), 3);
+    ITEMCOLOR_CHECK_EQUAL(indexed.Evaluate(MakeFields({ { ItemColorRuleField::Lore, 1 }, { ItemColorRuleField::Quest, 1 } })), 4);
+}
+
+
+// Past MaxIndexedRules every rule is tried and the answer is the same
+ITEMCOLOR_TEST(TooManyRulesForTheIndex)
+{
+    ItemColorRuleProgram program;
+    std::string error;
+    int ruleCount = static_cast<int>(ItemColorRuleProgram::MaxIndexedRules) + 1;
+    for (int rule = 0; rule < ruleCount; ++rule)
+    {
+        ITEMCOLOR_CHECK(program.AddRule(rule, MakeItemColorBenchmarkRule(rule), rule, error));
+    }
+    ITEMCOLOR_CHECK(program.AddRule(ruleCount, "Quest", ruleCount, error));
+    program.BuildIndex();
+
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::Quest, 1 } })), ruleCount);
+    ITEMCOLOR_CHECK_EQUAL(program.Evaluate(MakeFields({ { ItemColorRuleField::ReqLevel, 50 } })), -1);
+}
+
+
+// The fields come from the definition and the attribute mask, NoDrop included
+ITEMCOLOR_TEST(EvaluateFromDefinition)
+{
+    ItemColorDefinitionInfo itemInfo;
+    itemInfo.ItemID = 1234;
+    itemInfo.RequiredLevel = 110;
+    itemInfo.SocketTypes = GetItemColorSocketBit(8);
+
+    ItemColorRuleProgram program = Compile({ "NoDrop and Socket(8)", "ReqLevel > 100 and ID = 1234" });
+    program.BuildIndex();
+
+    uint32_t noDrop = GetItemColorAttributeBit(ItemColorAttribute::NoTrade_Item);
+    ITEMCOLOR_CHECK_EQUAL(EvaluateItemColorRules(&program, itemInfo, noDrop), 0);
+    ITEMCOLOR_CHECK_EQUAL(EvaluateItemColorRules(&program, itemInfo, 0), 1);
+    ITEMCOLOR_CHECK_EQUAL(EvaluateItemColorRules(nullptr, itemInfo, noDrop), -1);
+
+    ItemColorRuleProgram empty;
+    ITEMCOLOR_CHECK_EQUAL(EvaluateItemColorRules(&empty, itemInfo, noDrop), -1);
+}
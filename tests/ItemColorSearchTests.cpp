@@ -0,0 +1,321 @@
+/**
+* ItemColorSearchTests.cpp
+*
+* Parsing searches, matching name patterns and searching the slot index, checked against a plain walk
+* of every slot so the narrowing by attribute and word lists can not drop a slot that matches.
+*
+*/
+
+#include "ItemColorSearch.h"
+#include "ItemColorTest.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr uint32_t QuestBit = GetItemColorAttributeBit(ItemColorAttribute::Quest_Item);
+    constexpr uint32_t TradeSkillsBit = GetItemColorAttributeBit(ItemColorAttribute::TradeSkills_Item);
+    constexpr uint32_t NoTradeBit = GetItemColorAttributeBit(ItemColorAttribute::NoTrade_Item);
+
+    std::vector<int> Search(const ItemColorSearchIndex& index, std::string_view text)
+    {
+        std::vector<int> slots;
+        index.Search(ParseItemColorSearch(text), slots);
+        return slots;
+    }
+
+    // Slots of a few made up bags and a bank, indexes past 64 so the candidate bits span words
+    ItemColorSearchIndex MakeIndex()
+    {
+        ItemColorSearchIndex index;
+        index.SetSlot(3, 1001, QuestBit, "Spell: Fire Bolt");
+        index.SetSlot(5, 1002, TradeSkillsBit, "Black Sapphire");
+        index.SetSlot(9, 1003, NoTradeBit, "Black Sapphire Electrum Earring");
+        index.SetSlot(64, 1004, QuestBit | NoTradeBit, "Sword of Flame");
+        index.SetSlot(70, 1005, 0, "Swordsman's Tome");
+        index.SetSlot(130, 1006, QuestBit, "Tome of Spell: Quest Hunting");
+        return index;
+    }
+
+    // Lower case words of a name, the way the index splits them
+    std::vector<std::string> GetWords(std::string_view name)
+    {
+        std::vector<std::string> words;
+        std::string word;
+        for (char c : name)
+        {
+            if (std::isalnum(static_cast<unsigned char>(c)))
+            {
+                word += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            else if (!word.empty())
+            {
+                words.push_back(word);
+                word.clear();
+            }
+        }
+        if (!word.empty())
+        {
+            words.push_back(word);
+        }
+        return words;
+    }
+
+    std::string ToLower(std::string_view text)
+    {
+        std::string lower(text);
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+        return lower;
+    }
+
+    // What a search means, checked slot by slot without the index
+    bool MatchesQuery(const ItemColorSearchQuery& query, uint32_t attributeMask, std::string_view name)
+    {
+        if (query.IsEmpty() || (attributeMask & query.AttributeMask) != query.AttributeMask)
+        {
+            return false;
+        }
+
+        std::vector<std::string> words = GetWords(name);
+        for (const std::string& searchWord : query.Words)
+        {
+            if (std::none_of(words.begin(), words.end(), [&searchWord](const std::string& word) { return word.starts_with(searchWord); }))
+            {
+                return false;
+            }
+        }
+
+        std::string lower = ToLower(name);
+        return std::all_of(query.Patterns.begin(), query.Patterns.end(),
+            [&lower](const std::string& pattern) { return MatchesItemColorPattern(pattern, lower); });
+    }
+}
+
+
+ITEMCOLOR_TEST(ParseTerms)
+{
+    ItemColorSearchQuery query = ParseItemColorSearch("qUeSt  Sword \"Black Sapphire\" *Spell:*   tradeskills");
+    ITEMCOLOR_CHECK_EQUAL(query.AttributeMask, QuestBit | TradeSkillsBit);
+    ITEMCOLOR_CHECK_EQUAL(query.Words.size(), 1u);
+    ITEMCOLOR_CHECK(query.Words == std::vector<std::string>({ "sword" }));
+    ITEMCOLOR_CHECK(query.Patterns == std::vector<std::string>({ "*black sapphire*", "*spell:*" }));
+
+    // A word is split at anything but letters and digits
+    query = ParseItemColorSearch("Swordsman's Spell:");
+    ITEMCOLOR_CHECK(query.Words == std::vector<std::string>({ "swordsman", "s", "spell" }));
+    ITEMCOLOR_CHECK(query.Patterns.empty());
+
+    // Quoted, an attribute name is text in the name, and quotes end a term
+    query = ParseItemColorSearch("\"Quest\"sword\"");
+    ITEMCOLOR_CHECK_EQUAL(query.AttributeMask, 0u);
+    ITEMCOLOR_CHECK(query.Words == std::vector<std::string>({ "sword" }));
+    ITEMCOLOR_CHECK(query.Patterns == std::vector<std::string>({ "*quest*" }));
+
+    // An unclosed quote runs to the end
+    query = ParseItemColorSearch("\"of Flame");
+    ITEMCOLOR_CHECK(query.Patterns == std::vector<std::string>({ "*of flame*" }));
+
+    ITEMCOLOR_CHECK(ParseItemColorSearch("").IsEmpty());
+    ITEMCOLOR_CHECK(ParseItemColorSearch("   ").IsEmpty());
+    ITEMCOLOR_CHECK(ParseItemColorSearch("\"\" : -").IsEmpty());
+}
+
+
+ITEMCOLOR_TEST(Patterns)
+{
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("*spell:*", "spell: fire bolt"));
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("*spell:*", "tome of spell: quest"));
+    ITEMCOLOR_CHECK(!MatchesItemColorPattern("*spell:*", "spell fire bolt"));
+
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("spell:*", "spell: fire bolt"));
+    ITEMCOLOR_CHECK(!MatchesItemColorPattern("spell:*", "tome of spell: quest"));
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("*bolt", "spell: fire bolt"));
+    ITEMCOLOR_CHECK(!MatchesItemColorPattern("*bolt", "bolt of cloth"));
+
+    // Stars that have to give back text they took
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("a*b*c", "axbxbc"));
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("a*c", "abbbc"));
+    ITEMCOLOR_CHECK(!MatchesItemColorPattern("a*c", "abbbcd"));
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("*ab*ab*", "xabyyab"));
+    ITEMCOLOR_CHECK(!MatchesItemColorPattern("*ab*ab*", "xaby"));
+
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("black sapphire", "black sapphire"));
+    ITEMCOLOR_CHECK(!MatchesItemColorPattern("black sapphire", "black sapphire earring"));
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("*", ""));
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("**", "anything"));
+    ITEMCOLOR_CHECK(MatchesItemColorPattern("", ""));
+    ITEMCOLOR_CHECK(!MatchesItemColorPattern("", "x"));
+    ITEMCOLOR_CHECK(!MatchesItemColorPattern("ab*", "a"));
+}
+
+
+ITEMCOLOR_TEST(SearchIndex)
+{
+    ItemColorSearchIndex index = MakeIndex();
+    ITEMCOLOR_CHECK_EQUAL(index.GetSlotCount(), 6u);
+
+    // Attributes and words are and-ed together
+    ITEMCOLOR_CHECK(Search(index, "quest") == std::vector<int>({ 3, 64, 130 }));
+    ITEMCOLOR_CHECK(Search(index, "quest sword") == std::vector<int>({ 64 }));
+    ITEMCOLOR_CHECK(Search(index, "notrade quest") == std::vector<int>({ 64 }));
+    ITEMCOLOR_CHECK(Search(index, "tradeskills sword").empty());
+
+    // Words match the start of any word in the name
+    ITEMCOLOR_CHECK(Search(index, "sword") == std::vector<int>({ 64, 70 }));
+    ITEMCOLOR_CHECK(Search(index, "SWORDS") == std::vector<int>({ 70 }));
+    ITEMCOLOR_CHECK(Search(index, "tome") == std::vector<int>({ 70, 130 }));
+    ITEMCOLOR_CHECK(Search(index, "ord").empty());
+    ITEMCOLOR_CHECK(Search(index, "black sap") == std::vector<int>({ 5, 9 }));
+
+    // Patterns match the whole name
+    ITEMCOLOR_CHECK(Search(index, "*Spell:*") == std::vector<int>({ 3, 130 }));
+    ITEMCOLOR_CHECK(Search(index, "Spell:*") == std::vector<int>({ 3 }));
+    ITEMCOLOR_CHECK(Search(index, "*earring") == std::vector<int>({ 9 }));
+    ITEMCOLOR_CHECK(Search(index, "*Spell:* quest") == std::vector<int>({ 3, 130 }));
+
+    // Quoted text is found anywhere, spaces and all, and a quoted attribute name is a name
+    ITEMCOLOR_CHECK(Search(index, "\"black sapphire\"") == std::vector<int>({ 5, 9 }));
+    ITEMCOLOR_CHECK(Search(index, "\"sapphire electrum\"") == std::vector<int>({ 9 }));
+    ITEMCOLOR_CHECK(Search(index, "\"sapphire black\"").empty());
+    ITEMCOLOR_CHECK(Search(index, "\"quest\"") == std::vector<int>({ 130 }));
+    ITEMCOLOR_CHECK(Search(index, "\"e of\"") == std::vector<int>({ 130 }));
+
+    ITEMCOLOR_CHECK(Search(index, "").empty());
+    ITEMCOLOR_CHECK(Search(index, "dragon").empty());
+}
+
+
+// A new item in a slot drops every word and attribute of the old one
+ITEMCOLOR_TEST(ReplacedAndClearedSlots)
+{
+    ItemColorSearchIndex index = MakeIndex();
+    size_t words = index.GetWordCount();
+    uint64_t generation = index.GetGeneration();
+
+    // The same item again changes nothing
+    index.SetSlot(64, 1004, QuestBit | NoTradeBit, "Sword of Flame");
+    ITEMCOLOR_CHECK_EQUAL(index.GetGeneration(), generation);
+
+    index.SetSlot(64, 1007, TradeSkillsBit, "Dragon Scale");
+    ITEMCOLOR_CHECK(index.GetGeneration() != generation);
+    ITEMCOLOR_CHECK_EQUAL(index.GetSlotCount(), 6u);
+    ITEMCOLOR_CHECK(Search(index, "sword") == std::vector<int>({ 70 }));
+    ITEMCOLOR_CHECK(Search(index, "flame").empty());
+    ITEMCOLOR_CHECK(Search(index, "quest") == std::vector<int>({ 3, 130 }));
+    ITEMCOLOR_CHECK(Search(index, "notrade") == std::vector<int>({ 9 }));
+    ITEMCOLOR_CHECK(Search(index, "tradeskills dragon") == std::vector<int>({ 64 }));
+
+    // "sword" and "flame" went, "dragon" and "scale" came, "of" is still in another name
+    ITEMCOLOR_CHECK_EQUAL(index.GetWordCount(), words);
+
+    // Same item with other attributes, as turning an FV flag on does
+    index.SetSlot(64, 1007, QuestBit, "Dragon Scale");
+    ITEMCOLOR_CHECK(Search(index, "tradeskills") == std::vector<int>({ 5 }));
+    ITEMCOLOR_CHECK(Search(index, "quest dragon") == std::vector<int>({ 64 }));
+
+    index.ClearSlot(64);
+    ITEMCOLOR_CHECK_EQUAL(index.GetSlotCount(), 5u);
+    ITEMCOLOR_CHECK(Search(index, "dragon").empty());
+    ITEMCOLOR_CHECK_EQUAL(index.GetWordCount(), words - 2);
+
+    // Clearing an empty slot or one past the end changes nothing
+    generation = index.GetGeneration();
+    index.ClearSlot(64);
+    index.ClearSlot(1000);
+    index.ClearSlot(-1);
+    ITEMCOLOR_CHECK_EQUAL(index.GetGeneration(), generation);
+    ITEMCOLOR_CHECK_EQUAL(index.GetSlotCount(), 5u);
+
+    // An empty item ID empties the slot
+    index.SetSlot(130, 0, 0, "");
+    ITEMCOLOR_CHECK(Search(index, "*Spell:*") == std::vector<int>({ 3 }));
+    ITEMCOLOR_CHECK_EQUAL(index.GetSlotCount(), 4u);
+
+    index.Clear();
+    ITEMCOLOR_CHECK_EQUAL(index.GetSlotCount(), 0u);
+    ITEMCOLOR_CHECK_EQUAL(index.GetWordCount(), 0u);
+    ITEMCOLOR_CHECK(Search(index, "black").empty());
+}
+
+
+// Many slots filled, replaced and cleared, every search agreeing with a walk of every slot
+ITEMCOLOR_TEST(SearchMatchesSlotWalk)
+{
+    const char* const nameWords[] = { "Spell:", "Black", "Sapphire", "Sword", "Swordsman's", "of", "the", "Tome", "Flame",
+        "Quest", "Dragon", "Scale", "Earring", "Ring", "Bolt", "Fire" };
+    const char* const searches[] = { "sword", "quest", "quest sword", "\"of the\"", "*spell:*", "spell:*", "*ring",
+        "tradeskills ring", "s", "black sapphire", "\"sapphire\" notrade", "*e*e*", "drag sca", "\"quest\" quest" };
+    constexpr uint32_t attributeBits[] = { 0, QuestBit, TradeSkillsBit, NoTradeBit, QuestBit | NoTradeBit };
+    constexpr int SlotCount = 300;
+
+    struct ReferenceSlot
+    {
+        int ItemID = 0;
+        uint32_t AttributeMask = 0;
+        std::string Name;
+    };
+
+    std::vector<ReferenceSlot> reference(SlotCount);
+    ItemColorSearchIndex index;
+    uint32_t seed = 2024;
+    auto next = [&seed](uint32_t range)
+    {
+        seed = seed * 1664525 + 1013904223;
+        return (seed >> 8) % range;
+    };
+
+    for (int round = 0; round < 6; ++round)
+    {
+        for (int change = 0; change < SlotCount; ++change)
+        {
+            int slot = static_cast<int>(next(SlotCount));
+            ReferenceSlot& entry = reference[slot];
+            if (next(5) == 0)
+            {
+                entry = ReferenceSlot();
+                index.ClearSlot(slot);
+                continue;
+            }
+
+            int itemID = 1 + static_cast<int>(next(200));
+            uint32_t seedForName = static_cast<uint32_t>(itemID);
+            std::string name;
+            for (uint32_t word = 0; word < 1 + seedForName % 4; ++word)
+            {
+                name += (word ? " " : "");
+                name += nameWords[(seedForName * 7 + word * 13) % std::size(nameWords)];
+            }
+
+            entry = { itemID, attributeBits[next(static_cast<uint32_t>(std::size(attributeBits)))], name };
+            index.SetSlot(slot, entry.ItemID, entry.AttributeMask, entry.Name);
+        }
+
+        for (const char* text : searches)
+        {
+            ItemColorSearchQuery query = ParseItemColorSearch(text);
+            std::vector<int> expected;
+            for (int slot = 0; slot < SlotCount; ++slot)
+            {
+                if (reference[slot].ItemID && MatchesQuery(query, reference[slot].AttributeMask, reference[slot].Name))
+                {
+                    expected.push_back(slot);
+                }
+            }
+
+            std::vector<int> slots;
+            index.Search(query, slots);
+            if (slots != expected)
+            {
+                fprintf(stderr, "  round %d, \"%s\": %zu slots, expected %zu\n", round, text, slots.size(), expected.size());
+            }
+            ITEMCOLOR_CHECK(slots == expected);
+        }
+
+        size_t filled = static_cast<size_t>(std::count_if(reference.begin(), reference.end(), [](const ReferenceSlot& entry) { return entry.ItemID != 0; }));
+        ITEMCOLOR_CHECK_EQUAL(index.GetSlotCount(), filled);
+    }
+}
@@ -0,0 +1,157 @@
+/**
+* ItemColorSettingsTests.cpp
+*
+* Checks a blend table updated after a color change is the table a full build of the new palette gives,
+* for every blend mode and every one of its entries.
+*
+*/
+
+#include "ItemColorMockInventory.h"
+#include "ItemColorSettings.h"
+#include "ItemColorTest.h"
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    constexpr ItemColorBlendMode BlendedModes[] = { ItemColorBlendMode::Mix, ItemColorBlendMode::Dual };
+
+    std::vector<ItemColorPaletteEntry> MakePalette()
+    {
+        ItemColorClassifierSettings classifier;
+        classifier.EnabledAttributeMask = GetItemColorDefaultEnabledMask();
+        return MakeItemColorMockSettings(classifier)->Palette;
+    }
+
+    std::shared_ptr<const ItemColorBlendTable> BuildFull(const std::vector<ItemColorPaletteEntry>& palette, ItemColorBlendMode mode)
+    {
+        size_t entriesBuilt = 0;
+        std::shared_ptr<const ItemColorBlendTable> table = UpdateItemColorBlendTable(nullptr, {}, palette, mode, entriesBuilt);
+        ITEMCOLOR_CHECK_EQUAL(entriesBuilt, ItemColorBlendTable::Size);
+        return table;
+    }
+
+    // Number of entries of table that differ from a full build of palette
+    size_t CountDifferences(const ItemColorBlendTable& table, const std::vector<ItemColorPaletteEntry>& palette, ItemColorBlendMode mode)
+    {
+        std::shared_ptr<const ItemColorBlendTable> full = BuildFull(palette, mode);
+        size_t differences = 0;
+        for (uint32_t attributeMask = 0; attributeMask < ItemColorBlendTable::Size; ++attributeMask)
+        {
+            if (!(table.Get(attributeMask) == full->Get(attributeMask)))
+            {
+                ++differences;
+            }
+        }
+        return differences;
+    }
+}
+
+
+ITEMCOLOR_TEST(PriorityHasNoBlendTable)
+{
+    size_t entriesBuilt = 1;
+    ITEMCOLOR_CHECK(UpdateItemColorBlendTable(nullptr, {}, MakePalette(), ItemColorBlendMode::Priority, entriesBuilt) == nullptr);
+    ITEMCOLOR_CHECK_EQUAL(entriesBuilt, 0u);
+}
+
+
+// Editing one attribute's colors rebuilds the half of the table that has it, and gives the full build's table
+ITEMCOLOR_TEST(OneColorUpdateMatchesFullBuild)
+{
+    const std::vector<ItemColorPaletteEntry> palette = MakePalette();
+
+    for (ItemColorBlendMode mode : BlendedModes)
+    {
+        std::shared_ptr<const ItemColorBlendTable> previous = BuildFull(palette, mode);
+
+        for (const ItemColorAttributeInfo& info : ItemColorAttributes)
+        {
+            uint32_t paletteIndex = GetItemColorPaletteIndex(info.Attribute);
+            auto edits =
+            {
+                ItemColorPaletteEntry{ 0xFF102030, palette[paletteIndex].RolloverARGB, palette[paletteIndex].On },
+                ItemColorPaletteEntry{ palette[paletteIndex].NormalARGB, 0x80FFEEDD, palette[paletteIndex].On },
+                ItemColorPaletteEntry{ palette[paletteIndex].NormalARGB, palette[paletteIndex].RolloverARGB, !palette[paletteIndex].On },
+            };
+
+            for (const ItemColorPaletteEntry& edit : edits)
+            {
+                std::vector<ItemColorPaletteEntry> edited = palette;
+                edited[paletteIndex] = edit;
+
+                size_t entriesBuilt = 0;
+                std::shared_ptr<const ItemColorBlendTable> updated = UpdateItemColorBlendTable(previous, palette, edited, mode, entriesBuilt);
+                ITEMCOLOR_CHECK(updated != nullptr && updated != previous);
+                ITEMCOLOR_CHECK_EQUAL(entriesBuilt, ItemColorBlendTable::Size / 2);
+                ITEMCOLOR_CHECK_EQUAL(updated->GetMode(), mode);
+                ITEMCOLOR_CHECK_EQUAL(CountDifferences(*updated, edited, mode), 0u);
+
+                // The table it was updated from is shared with the old snapshot and stays as it was
+                ITEMCOLOR_CHECK_EQUAL(CountDifferences(*previous, palette, mode), 0u);
+            }
+        }
+    }
+}
+
+
+// Updates chained one after another, as a user trying colors out does, never drift from a full build
+ITEMCOLOR_TEST(ChainedUpdatesMatchFullBuild)
+{
+    for (ItemColorBlendMode mode : BlendedModes)
+    {
+        std::vector<ItemColorPaletteEntry> palette = MakePalette();
+        std::shared_ptr<const ItemColorBlendTable> table = BuildFull(palette, mode);
+
+        uint32_t color = 0xFF000000;
+        for (int edit = 0; edit < 40; ++edit)
+        {
+            std::vector<ItemColorPaletteEntry> edited = palette;
+            const ItemColorAttributeInfo& first = ItemColorAttributes[edit % std::size(ItemColorAttributes)];
+            const ItemColorAttributeInfo& second = ItemColorAttributes[(edit * 3 + 1) % std::size(ItemColorAttributes)];
+            color += 0x00132537;
+            edited[GetItemColorPaletteIndex(first.Attribute)].NormalARGB = color;
+            edited[GetItemColorPaletteIndex(second.Attribute)].RolloverARGB = ~color | 0xFF000000;
+            if (edit % 7 == 0)
+            {
+                edited[GetItemColorPaletteIndex(second.Attribute)].On = !edited[GetItemColorPaletteIndex(second.Attribute)].On;
+            }
+
+            size_t entriesBuilt = 0;
+            table = UpdateItemColorBlendTable(table, palette, edited, mode, entriesBuilt);
+            ITEMCOLOR_CHECK(entriesBuilt < ItemColorBlendTable::Size);
+            ITEMCOLOR_CHECK_EQUAL(CountDifferences(*table, edited, mode), 0u);
+            palette = edited;
+        }
+    }
+}
+
+
+// What can not be updated in place is built whole, and nothing changed reuses the table
+ITEMCOLOR_TEST(FullBuildsAndReuse)
+{
+    const std::vector<ItemColorPaletteEntry> palette = MakePalette();
+    std::shared_ptr<const ItemColorBlendTable> mix = BuildFull(palette, ItemColorBlendMode::Mix);
+
+    // Only the rule colors changed
+    std::vector<ItemColorPaletteEntry> withRule = palette;
+    withRule.push_back({ 0xFF123456, 0xFF654321, true });
+    size_t entriesBuilt = 1;
+    ITEMCOLOR_CHECK(UpdateItemColorBlendTable(mix, palette, withRule, ItemColorBlendMode::Mix, entriesBuilt) == mix);
+    ITEMCOLOR_CHECK_EQUAL(entriesBuilt, 0u);
+
+    // Another mode
+    std::shared_ptr<const ItemColorBlendTable> dual = UpdateItemColorBlendTable(mix, palette, palette, ItemColorBlendMode::Dual, entriesBuilt);
+    ITEMCOLOR_CHECK_EQUAL(entriesBuilt, ItemColorBlendTable::Size);
+    ITEMCOLOR_CHECK_EQUAL(dual->GetMode(), ItemColorBlendMode::Dual);
+    ITEMCOLOR_CHECK_EQUAL(CountDifferences(*dual, palette, ItemColorBlendMode::Dual), 0u);
+
+    // The Default color, which fills the entry with no attribute
+    std::vector<ItemColorPaletteEntry> newDefault = palette;
+    newDefault[0].NormalARGB = 0xFF010203;
+    std::shared_ptr<const ItemColorBlendTable> rebuilt = UpdateItemColorBlendTable(mix, palette, newDefault, ItemColorBlendMode::Mix, entriesBuilt);
+    ITEMCOLOR_CHECK_EQUAL(entriesBuilt, ItemColorBlendTable::Size);
+    ITEMCOLOR_CHECK_EQUAL(CountDifferences(*rebuilt, newDefault, ItemColorBlendMode::Mix), 0u);
+}
@@ -0,0 +1,186 @@
+/**
+* ItemColorSimdTests.cpp
+*
+* Runs ClassifyItemColorBlock at every level this CPU supports and checks each slot against
+* GetItemDefinitionMask, GetItemInstanceMask and ResolveItemColorAttribute run one slot at a time.
+*
+*/
+
+#include "ItemColorBatch.h"
+#include "ItemColorTest.h"
+
+#include <iterator>
+#include <vector>
+
+namespace
+{
+    constexpr size_t AttributeCount = std::size(ItemColorAttributes);
+    constexpr int FlagCount = static_cast<int>(ItemColorFlagPlane::Count);
+
+    // An item with one flag per bit of combination, in ItemColorFlagPlane order
+    struct FlagItem
+    {
+        ItemColorDefinitionInfo Info;
+        bool NoDropFlag = false;
+    };
+
+    FlagItem MakeItem(int combination)
+    {
+        auto flag = [combination](ItemColorFlagPlane plane) { return (combination & (1 << static_cast<int>(plane))) != 0; };
+
+        FlagItem item;
+        ItemColorDefinitionInfo& info = item.Info;
+        info.ItemID = combination + 1;
+        info.SocketTypes = GetItemColorSocketBit(3) | (flag(ItemColorFlagPlane::AugSlot8) ? GetItemColorSocketBit(8) : 0);
+        info.PowerSource = flag(ItemColorFlagPlane::PowerSource);
+        info.QuestItem = flag(ItemColorFlagPlane::Quest);
+        info.TradeSkills = flag(ItemColorFlagPlane::TradeSkills);
+        info.Collectible = flag(ItemColorFlagPlane::Collectible);
+        info.Heirloom = flag(ItemColorFlagPlane::Heirloom);
+        info.IsDroppable = !flag(ItemColorFlagPlane::NoTrade);
+        info.FVNoDrop = flag(ItemColorFlagPlane::FVNoTrade);
+        info.Attuneable = flag(ItemColorFlagPlane::Attuneable);
+        info.Placeable = flag(ItemColorFlagPlane::Placeable);
+        info.AugType = GetItemColorAugTypeBit(7) |
+            (flag(ItemColorFlagPlane::Ornamentation) ? GetItemColorAugTypeBit((combination & 1) ? 20 : 21) : 0);
+        item.NoDropFlag = flag(ItemColorFlagPlane::NoDropFlag);
+        return item;
+    }
+
+    // Every flag combination, plus a few more so the last block is only partly filled
+    std::vector<FlagItem> MakeItems()
+    {
+        std::vector<FlagItem> items;
+        for (int combination = 0; combination < (1 << FlagCount) + 7; ++combination)
+        {
+            items.push_back(MakeItem(combination % (1 << FlagCount)));
+        }
+        return items;
+    }
+
+    std::vector<ItemColorFlagBlock> MakeBlocks(const std::vector<FlagItem>& items)
+    {
+        std::vector<ItemColorFlagBlock> blocks(1);
+        for (const FlagItem& item : items)
+        {
+            if (!blocks.back().Add(item.Info, item.NoDropFlag))
+            {
+                blocks.emplace_back().Add(item.Info, item.NoDropFlag);
+            }
+        }
+        return blocks;
+    }
+}
+
+
+// Blocks are filled in order, a block holds Size slots and the slots past Count are left zero
+ITEMCOLOR_TEST(BlocksHoldEveryItem)
+{
+    std::vector<FlagItem> items = MakeItems();
+    std::vector<ItemColorFlagBlock> blocks = MakeBlocks(items);
+
+    ITEMCOLOR_CHECK_EQUAL(blocks.size(), (items.size() + ItemColorFlagBlock::Size - 1) / ItemColorFlagBlock::Size);
+    ITEMCOLOR_CHECK_EQUAL(blocks.back().Count, items.size() % ItemColorFlagBlock::Size);
+
+    const ItemColorFlagBlock& last = blocks.back();
+    for (size_t slot = last.Count; slot < ItemColorFlagBlock::Size; ++slot)
+    {
+        for (int plane = 0; plane < FlagCount; ++plane)
+        {
+            ITEMCOLOR_CHECK_EQUAL(last.Planes[plane][slot], 0);
+        }
+    }
+}
+
+
+// Every level, every flag combination, every FV setting and every set of attributes turned on
+ITEMCOLOR_TEST(EveryLevelMatchesTheScalarChain)
+{
+    std::vector<FlagItem> items = MakeItems();
+    std::vector<ItemColorFlagBlock> blocks = MakeBlocks(items);
+    int bestLevel = static_cast<int>(GetItemColorSimdLevel());
+    printf("Best level on this CPU: %s\n", GetItemColorSimdLevelName(GetItemColorSimdLevel()).data());
+
+    std::vector<int> mismatches(bestLevel + 1, 0);
+    ItemColorBlockResult result;
+
+    for (int fv = 0; fv < 4; ++fv)
+    {
+        for (uint32_t enabledAttributeMask = 0; enabledAttributeMask < (1U << AttributeCount); ++enabledAttributeMask)
+        {
+            ItemColorClassifierSettings settings;
+            settings.FVServer = (fv & 1) != 0;
+            settings.FVNormalNoTrade = (fv & 2) != 0;
+            settings.EnabledAttributeMask = enabledAttributeMask;
+
+            for (int level = 0; level <= bestLevel; ++level)
+            {
+                for (size_t block = 0; block < blocks.size(); ++block)
+                {
+                    ClassifyItemColorBlock(blocks[block], settings, result, static_cast<ItemColorSimdLevel>(level));
+
+                    for (size_t slot = 0; slot < ItemColorFlagBlock::Size; ++slot)
+                    {
+                        // Slots past the end of the items are empty and classify as Default
+                        uint32_t definitionMask = 0;
+                        uint32_t attributeMask = 0;
+                        size_t item = block * ItemColorFlagBlock::Size + slot;
+                        if (item < items.size())
+                        {
+                            definitionMask = GetItemDefinitionMask(items[item].Info, settings);
+                            attributeMask = definitionMask | GetItemInstanceMask(items[item].NoDropFlag, settings);
+                        }
+
+                        ItemColorAttribute definitionAttribute = ResolveItemColorAttribute(definitionMask, enabledAttributeMask);
+                        ItemColorAttribute attribute = ResolveItemColorAttribute(attributeMask, enabledAttributeMask);
+
+                        bool match = result.DefinitionMask[slot] == definitionMask && result.AttributeMask[slot] == attributeMask &&
+                            result.DefinitionAttribute[slot] == static_cast<int16_t>(definitionAttribute) &&
+                            result.Attribute[slot] == static_cast<int16_t>(attribute);
+
+                        if (!match && ++mismatches[level] <= 5)
+                        {
+                            ITEMCOLOR_CHECK_EQUAL(result.DefinitionMask[slot], definitionMask);
+                            ITEMCOLOR_CHECK_EQUAL(result.AttributeMask[slot], attributeMask);
+                            ITEMCOLOR_CHECK_EQUAL(result.DefinitionAttribute[slot], static_cast<int16_t>(definitionAttribute));
+                            ITEMCOLOR_CHECK_EQUAL(result.Attribute[slot], static_cast<int16_t>(attribute));
+                            fprintf(stderr, "  %s, item %zu, FV %d, enabled 0x%03X\n",
+                                GetItemColorSimdLevelName(static_cast<ItemColorSimdLevel>(level)).data(), item, fv, enabledAttributeMask);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int level = 0; level <= bestLevel; ++level)
+    {
+        ITEMCOLOR_CHECK_EQUAL(mismatches[level], 0);
+    }
+}
+
+
+// A level the CPU does not have falls back to one it does and still classifies the same
+ITEMCOLOR_TEST(UnsupportedLevelFallsBack)
+{
+    std::vector<FlagItem> items = MakeItems();
+    std::vector<ItemColorFlagBlock> blocks = MakeBlocks(items);
+
+    ItemColorClassifierSettings settings;
+    settings.FVServer = true;
+    settings.EnabledAttributeMask = (1U << AttributeCount) - 1;
+
+    ItemColorBlockResult scalar;
+    ItemColorBlockResult best;
+    for (const ItemColorFlagBlock& block : blocks)
+    {
+        ClassifyItemColorBlock(block, settings, scalar, ItemColorSimdLevel::Scalar);
+        ClassifyItemColorBlock(block, settings, best, ItemColorSimdLevel::AVX2);
+
+        for (size_t slot = 0; slot < ItemColorFlagBlock::Size; ++slot)
+        {
+            ITEMCOLOR_CHECK_EQUAL(best.AttributeMask[slot], scalar.AttributeMask[slot]);
+            ITEMCOLOR_CHECK_EQUAL(best.Attribute[slot], scalar.Attribute[slot]);
+        }
+    }
+}
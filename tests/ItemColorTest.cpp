@@ -0,0 +1,87 @@
+/**
+* ItemColorTest.cpp
+*
+* Registry and main for the core unit tests, see ItemColorTest.h.
+*
+*/
+
+#include "ItemColorTest.h"
+
+#include <filesystem>
+
+namespace
+{
+    ItemColorTestCase* FirstTest = nullptr;
+    ItemColorTestCase* LastTest = nullptr;
+    const ItemColorTestCase* RunningTest = nullptr;
+    int RunningFailures = 0;
+}
+
+
+ItemColorTestCase::ItemColorTestCase(const char* name, TestFn test) :
+    Name(name),
+    Test(test)
+{
+    if (LastTest)
+    {
+        LastTest->pNext = this;
+    }
+    else
+    {
+        FirstTest = this;
+    }
+    LastTest = this;
+}
+
+
+void FailItemColorTest(const char* file, int line, const std::string& message)
+{
+    fprintf(stderr, "%s:%d: %s: check failed: %s\n", file, line, RunningTest ? RunningTest->Name : "", message.c_str());
+    ++RunningFailures;
+}
+
+
+int RunItemColorTests()
+{
+    int tests = 0;
+    int failed = 0;
+
+    for (const ItemColorTestCase* pTest = FirstTest; pTest; pTest = pTest->pNext)
+    {
+        RunningTest = pTest;
+        RunningFailures = 0;
+        pTest->Test();
+
+        ++tests;
+        if (RunningFailures)
+        {
+            ++failed;
+        }
+        printf("[%s] %s\n", RunningFailures ? "FAIL" : " OK ", pTest->Name);
+    }
+
+    RunningTest = nullptr;
+    printf("%d tests, %d failed\n", tests, failed);
+    return failed;
+}
+
+
+ItemColorTempFile::ItemColorTempFile(const std::string& name) :
+    Path((std::filesystem::temp_directory_path() / name).string())
+{
+    std::error_code error;
+    std::filesystem::remove(Path, error);
+}
+
+
+ItemColorTempFile::~ItemColorTempFile()
+{
+    std::error_code error;
+    std::filesystem::remove(Path, error);
+}
+
+
+int main()
+{
+    return RunItemColorTests() ? 1 : 0;
+}
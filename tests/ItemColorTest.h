@@ -0,0 +1,73 @@
+/**
+* ItemColorTest.h
+*
+* Just enough of a test framework for the core unit tests, so they build with nothing but the core.
+* Each test file defines its tests with ITEMCOLOR_TEST and links ItemColorTest.cpp for main.
+*
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+// A test registered by ITEMCOLOR_TEST, run in the order the file defines them
+struct ItemColorTestCase
+{
+    using TestFn = void (*)();
+
+    ItemColorTestCase(const char* name, TestFn test);
+
+    const char* Name;
+    TestFn Test;
+    ItemColorTestCase* pNext = nullptr;
+};
+
+// Records a failed check against the running test, the test carries on so every failure is reported
+void FailItemColorTest(const char* file, int line, const std::string& message);
+
+// Runs every registered test, returns the number that failed
+int RunItemColorTests();
+
+// Path of a file in the temp directory, removed when it is made and again when it goes out of scope
+class ItemColorTempFile
+{
+public:
+    explicit ItemColorTempFile(const std::string& name);
+    ~ItemColorTempFile();
+    ItemColorTempFile(const ItemColorTempFile&) = delete;
+    ItemColorTempFile& operator=(const ItemColorTempFile&) = delete;
+
+    const std::string& GetPath() const { return Path; }
+
+private:
+    std::string Path;
+};
+
+#define ITEMCOLOR_TEST(Name) \
+    static void Name(); \
+    static ItemColorTestCase Name##Case(#Name, Name); \
+    static void Name()
+
+#define ITEMCOLOR_CHECK(Expression) \
+    do \
+    { \
+        if (!(Expression)) \
+        { \
+            FailItemColorTest(__FILE__, __LINE__, #Expression); \
+        } \
+    } while (false)
+
+// Values are printed as integers, enums and bools included
+#define ITEMCOLOR_CHECK_EQUAL(Actual, Expected) \
+    do \
+    { \
+        auto actualValue = (Actual); \
+        auto expectedValue = (Expected); \
+        if (!(actualValue == expectedValue)) \
+        { \
+            FailItemColorTest(__FILE__, __LINE__, std::string(#Actual " == " #Expected " (") + \
+                std::to_string(static_cast<long long>(actualValue)) + " != " + \
+                std::to_string(static_cast<long long>(expectedValue)) + ")"); \
+        } \
+    } while (false)
@@ -0,0 +1,165 @@
+/**
+* ItemColorReplay.cpp
+*
+* Replays a capture taken with /itemcolor capture through the classification and scan logic and reports per pulse timings.
+* Runs anywhere the plugin's core files build, for timing real inventories away from the game, for example in CI.
+*
+* Build from the repository root:
+*   g++ -std=c++20 -O2 -I. tools/ItemColorReplay.cpp ItemColorCore.cpp ItemColorIni.cpp ItemColorRules.cpp \
+*       ItemColorSettings.cpp ItemColorPipeline.cpp ItemColorBatch.cpp ItemColorCapture.cpp ItemColorScanner.cpp \
+*       ItemColorPersistentCache.cpp -o ItemColorReplay -pthread
+* or with the CMake build, which also builds the unit tests, see README.md
+*
+* Usage:
+*   ItemColorReplay capture.iccap [MQItemColor.ini] [passes] [cache size]
+*
+* The ini supplies the colors, blend mode and rules, without it only the built in attributes are used.
+* The FV flags and which attributes are turned on always come from the capture.
+*
+*/
+
+#include "ItemColorCapture.h"
+#include "ItemColorIni.h"
+#include "ItemColorRules.h"
+#include "ItemColorSettings.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Same as the plugin's MaxColorRules and MaxSocketColors
+    constexpr int MaxColorRules = 1024;
+    constexpr int MaxSocketColors = 64;
+
+    // Default Item Color of the plugin, used for slots without an attribute and rules without colors
+    constexpr ItemColorPaletteEntry DefaultColor =
+        { ItemColorDefaultAttribute.DefaultNormalARGB, ItemColorDefaultAttribute.DefaultRolloverARGB, true };
+
+    /**
+    * @fn ReadColor
+    *
+    * @param ini const ItemColorIniFile& - Settings read from the ini
+    * @param section std::string_view - Section of the color
+    * @param key std::string_view - Key of the color
+    * @param defaultARGB uint32_t - Color if the key is missing or invalid
+    * @return uint32_t - The color
+    */
+    uint32_t ReadColor(const ItemColorIniFile& ini, std::string_view section, std::string_view key, uint32_t defaultARGB)
+    {
+        uint32_t argb = defaultARGB;
+        if (ParseItemColorValue(ini.GetString(section, key, ""), defaultARGB, argb) == ItemColorValueResult::Invalid)
+        {
+            argb = defaultARGB;
+        }
+
+        return argb;
+    }
+
+    /**
+    * @fn MakeSettings
+    *
+    * Builds the settings to replay with the same way the plugin's RebuildSettings does
+    *
+    * @param capture const ItemColorCaptureFile& - Capture holding the classifier settings
+    * @param ini const ItemColorIniFile& - Colors, blend mode and rules, may be empty
+    * @return std::shared_ptr<ItemColorSettingsSnapshot> - Settings for ReplayItemColorCapture
+    */
+    std::shared_ptr<ItemColorSettingsSnapshot> MakeSettings(const ItemColorCaptureFile& capture, const ItemColorIniFile& ini)
+    {
+        auto rules = std::make_shared<ItemColorRuleSet>();
+        std::vector<std::string> errors;
+        LoadItemColorRules(ini, "Rules", MaxColorRules, DefaultColor.NormalARGB, DefaultColor.RolloverARGB, *rules, errors);
+        LoadItemColorSocketColors(ini, "SocketColors", MaxSocketColors, DefaultColor.NormalARGB, DefaultColor.RolloverARGB, *rules, errors);
+        for (const std::string& error : errors)
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+        }
+
+        auto settings = std::make_shared<ItemColorSettingsSnapshot>();
+        settings->Classifier = capture.GetHeader().GetClassifierSettings();
+        settings->Rules = rules;
+
+        settings->Palette.resize(ItemColorRulePaletteBase + rules->Rules.size());
+        settings->Palette[0] = DefaultColor;
+        for (const ItemColorAttributeInfo& info : ItemColorAttributes)
+        {
+            settings->Palette[GetItemColorPaletteIndex(info.Attribute)] = {
+                ReadColor(ini, info.Name, info.NormalKey, info.DefaultNormalARGB),
+                ReadColor(ini, info.Name, info.RolloverKey, info.DefaultRolloverARGB),
+                (settings->Classifier.EnabledAttributeMask & GetItemColorAttributeBit(info.Attribute)) != 0 };
+        }
+
+        for (size_t rule = 0; rule < rules->Rules.size(); ++rule)
+        {
+            settings->Palette[ItemColorRulePaletteBase + rule] = { rules->Rules[rule].NormalARGB, rules->Rules[rule].RolloverARGB, true };
+        }
+
+        ParseItemColorBlendMode(ini.GetString("General", "BlendMode", "Priority"), settings->BlendMode);
+        size_t entriesBuilt = 0;
+        settings->BlendTable = UpdateItemColorBlendTable(nullptr, {}, settings->Palette, settings->BlendMode, entriesBuilt);
+
+        return settings;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s capture.iccap [MQItemColor.ini] [passes] [cache size]\n", argv[0]);
+        return 2;
+    }
+
+    ItemColorCaptureFile capture;
+    std::string error;
+    if (!capture.Open(argv[1], error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    ItemColorIniFile ini;
+    if (argc > 2 && !ini.Load(argv[2]))
+    {
+        fprintf(stderr, "Could not read %s\n", argv[2]);
+        return 1;
+    }
+
+    int passes = (argc > 3) ? std::max(atoi(argv[3]), 1) : 10;
+    size_t cacheSize = (argc > 4) ? static_cast<size_t>(std::max(atoi(argv[4]), 0)) : 1024;
+
+    std::shared_ptr<ItemColorSettingsSnapshot> settings = MakeSettings(capture, ini);
+
+    size_t slots = 0;
+    for (size_t frame = 0; frame < capture.GetFrameCount(); ++frame)
+    {
+        slots += capture.GetFrame(frame).SlotCount;
+    }
+
+    printf("%zu frames, %zu slots, %zu rules, blend %.*s, cache %zu, %d passes\n",
+        capture.GetFrameCount(), slots, settings->Rules->Rules.size(),
+        static_cast<int>(GetItemColorBlendModeName(settings->BlendMode).size()), GetItemColorBlendModeName(settings->BlendMode).data(),
+        cacheSize, passes);
+
+    ItemColorReplayResult result = ReplayItemColorCapture(capture, *settings, cacheSize, passes);
+
+    const ItemColorLatencyHistogram& pulses = result.PulseTime;
+    auto micros = [](std::chrono::nanoseconds duration) { return duration.count() / 1000.0; };
+    printf("Pulse     p50 %.1f us  p99 %.1f us  max %.1f us  mean %.1f us\n",
+        micros(pulses.GetPercentile(50)), micros(pulses.GetPercentile(99)), micros(pulses.GetMax()),
+        pulses.GetCount() ? micros(pulses.GetTotal()) / static_cast<double>(pulses.GetCount()) : 0.0);
+    printf("Slots     %llu visited, %llu not colorable, %llu unchanged, %llu reclassified, %llu repainted\n",
+        static_cast<unsigned long long>(result.SlotsVisited), static_cast<unsigned long long>(result.SlotsNotColorable),
+        static_cast<unsigned long long>(result.SlotsUnchanged), static_cast<unsigned long long>(result.SlotsReclassified),
+        static_cast<unsigned long long>(result.SlotsRepainted));
+    printf("Cache     %llu hits, %llu misses\n",
+        static_cast<unsigned long long>(result.CacheHits), static_cast<unsigned long long>(result.CacheMisses));
+
+    return 0;
+}